@@ -12,9 +12,27 @@ SQLITE_EXTENSION_INIT1;
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <zlib.h>
 #include <time.h>
 #include <math.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "logreader.h"
+#include "logcache.h"
+#include "logfollow.h"
+#include "logformat.h"
+#include "logmatch.h"
+#include "logpost.h"
+#include "logrollup.h"
+#include "logsample.h"
+#include "logset.h"
+#include "logstats.h"
+#include "logapprox.h"
+#include "logcorrelate.h"
+#include "logip.h"
+#include "logtime.h"
+#include "logzone.h"
 
 /**
 The expected log format is NCSA combined with the addition of %D.
@@ -35,6 +53,17 @@ The expected log format is NCSA combined with the addition of %D.
 %{User-agent}i: The contents of User-agent: header line(s) in the request
                 sent to the server.
 %D:             The time taken to serve the request, in microseconds.
+
+Other formats are read with a format= table argument, an httpd
+LogFormat string or one of its nicknames, see logformat.h:
+    create virtual table log using access_log('access_log',
+        'format=%h %l %u %t "%r" %>s %b "%{X-Forwarded-For}i" %T');
+    create virtual table log using access_log('access_log', format=common);
+It is compiled once, when the table is created, into the program that
+splits lines. The directives above fill the columns they always have,
+and columns of directives the format does not have are NULL. Each
+other directive adds a column at the end of the table, here
+x_forwarded_for and time_taken.
 **/
 
 const static char *access_log_sql = 
@@ -62,17 +91,143 @@ const static char *access_log_sql =
 "        time_epoch            INTEGER,        "  /* 18 */
 "        method                TEXT,           "  /* 19 */
 "        url                   TEXT,           "  /* 20 */
-"        line                  TEXT HIDDEN     "  /* 21 */
+"        line                  TEXT HIDDEN,    "  /* 21 */
+"        time_epoch_ms         INTEGER HIDDEN, "  /* 22 */
+"        time_utc              TEXT HIDDEN,    "  /* 23 */
+/* The following describe the file the line is from */
+"        source_file           TEXT HIDDEN,    "  /* 24 */
+"        vhost                 TEXT HIDDEN,    "  /* 25 */
+/* The following are for sample=, see logsample.h */
+"        sample_rate           REAL HIDDEN,    "  /* 26 */
+"        sample_scale          REAL HIDDEN,    "  /* 27 */
+/* remote_host as 16 bytes, see logip.h */
+"        remote_host_ip        BLOB HIDDEN     "  /* 28 */
 "     );                                       ";
 
-#define TABLE_COLS_SCAN  10 /* number cols read directly from log entry */
-#define TABLE_COLS       22 /* total columns in table: direct log + computed */
+#define TABLE_COLS       29 /* total columns in table: direct log + computed */
+#define TABLE_COLS_MAX   ( TABLE_COLS + LOG_FORMAT_EXTRA )  /* with format= columns */
+
+#define COL_SOURCE_FILE  24
+#define COL_VHOST        25
+#define COL_SAMPLE_RATE  26
+#define COL_SAMPLE_SCALE 27
+#define COL_TIME_EPOCH   18
+#define COL_TIME_EPOCH_MS 22
+#define COL_TIME_UTC     23
+#define COL_LINE         21
+#define COL_REMOTE_HOST  0
+#define COL_STATUS       5
+#define COL_REMOTE_HOST_INT 10
+#define COL_REMOTE_HOST_IP 28
+#define COL_METHOD       19
+#define COL_URL          20
+#define COL_REQUEST      4
+#define COL_BYTES        6
+#define COL_RESPONSE_TIME 9
+
+/*
+Sets of columns, a bit each as in sqlite3_index_info.colUsed, with bit
+63 for columns 63 on. Lines are split only as far as the columns a
+query uses need, see access_log_scanline().
+ */
+#define COL_BIT( cidx )  ( (uint64_t)1 << ( (cidx) < 63 ? (cidx) : 63 ) )
+#define COLS_ALL         ( ~(uint64_t)0 )
+#define COLS_TIME        ( COL_BIT( 11 ) | COL_BIT( 12 ) | COL_BIT( 13 ) | COL_BIT( 14 ) | COL_BIT( 15 ) | \
+                           COL_BIT( 16 ) | COL_BIT( 17 ) | COL_BIT( COL_TIME_EPOCH ) |                    \
+                           COL_BIT( COL_TIME_EPOCH_MS ) | COL_BIT( COL_TIME_UTC ) )
+#define COLS_ZONE        ( COL_BIT( COL_STATUS ) | COL_BIT( COL_REMOTE_HOST_INT ) | COL_BIT( COL_METHOD ) | \
+                           COL_BIT( COL_TIME_EPOCH ) )
+#define COLS_POST        ( COL_BIT( COL_STATUS ) | COL_BIT( COL_REMOTE_HOST_INT ) | COL_BIT( COL_METHOD ) | \
+                           COL_BIT( COL_URL ) )
+
+/* the directives of the columns above, for log_format_compile() */
+static const log_format_std access_log_directives[] = {
+    { "h",              COL_REMOTE_HOST },
+    { "a",              COL_REMOTE_HOST },
+    { "l",              1 },
+    { "u",              2 },
+    { "t",              3 },
+    { "r",              COL_REQUEST },
+    { "s",              COL_STATUS },
+    { "b",              6 },
+    { "B",              6 },
+    { "{referer}i",     7 },
+    { "{user-agent}i",  8 },
+    { "D",              9 },
+    { NULL,             0 }
+};
+
+/*
+Apache writes %t (the time the request was received) when the request
+completes, so a log is only nearly sorted by time_epoch: a slow request
+is logged after faster ones that started later. time_slack is how far
+out of order, in seconds, a line may be and still be found by a
+time_epoch range scan. It can be set with a table argument, e.g.
+    create virtual table log using access_log('access_log', 'time_slack=600');
+*/
+#define TIME_SLACK_DEFAULT 300
+
+/*
+Inflating a gzip log costs more than parsing it, so by default a scan
+reads ahead in background threads: one for the file being scanned and,
+for a scan without a time_epoch range, one for each of the next few
+files of the table. threads=N sets how many files are read at once;
+threads=0 reads everything on SQLite's thread.
+
+The cursors of a table share a cache of the blocks they decompress, so
+a join of the table with itself inflates each compressed log once, not
+once for each row of the outer loop. block_cache=MB sets its size,
+block_cache=off turns it off; see logblocks.h.
+*/
+#define THREADS_MAX      16
+
+/* idxNum flags set by bestindex, in the order of filter's arguments */
+#define IDX_TIME_LO      0x01                /* time_epoch constraints */
+#define IDX_TIME_HI      0x02
+#define IDX_ROWID_LO     0x04                /* rowid (line number) constraints */
+#define IDX_ROWID_HI     0x08
+#define IDX_TIME_EQ      0x10                /* upper bound is the lower bound */
+#define IDX_ROWID_EQ     0x20
+#define IDX_SOURCE_FILE  0x40                /* source_file = ? */
+#define IDX_VHOST        0x80                /* vhost = ? */
+#define IDX_STATUS_LO    0x100               /* status constraints, for zone maps */
+#define IDX_STATUS_HI    0x200
+#define IDX_STATUS_EQ    0x400
+#define IDX_HOST         0x800               /* remote_host = ? */
+#define IDX_HOST_INT     0x1000              /* remote_host_int = ? */
+#define IDX_METHOD       0x2000              /* method = ? */
+#define IDX_URL          0x4000              /* url = ?, with lookup=on */
+#define IDX_SAMPLE       0x8000              /* sample_rate = ? */
+
+/* constraints checked on each line before it is returned, see access_log_pushdown() */
+#define PRED_MAX         16
+
+/*
+A table can span several files. rowid is the line number in the file
+plus the file's position in the table shifted left ROWID_FILE_SHIFT
+bits, so for a single file table it is just the line number.
+ */
+#define ROWID_FILE_SHIFT 40
+#define ROWID_LINE_MASK  ( ( (sqlite_int64)1 << ROWID_FILE_SHIFT ) - 1 )
 
 
 typedef struct access_log_vtab_s {
     sqlite3_vtab   vtab;
     sqlite3        *db;
-    char           *filename;
+    log_set        *files;                   /* see logset.h */
+    int            time_slack;               /* seconds, see above */
+    int            index_mode;               /* LOG_INDEX_*, see logindex.h */
+    int            threads;                  /* see THREADS_MAX */
+    int            reader_flags;             /* LOG_READER_*, see logreader.h */
+    char           *cache_dir;               /* cache= directory, see logcache.h */
+    log_follow     *follow;                  /* follow= positions, see logfollow.h */
+    int            lookup;                   /* lookup=on, see logpost.h */
+    log_stats_table *stats;                  /* see logstats.h */
+    int            timing;                   /* timing=on */
+    log_format     format;                   /* format=, see logformat.h */
+    int            n_cols;                   /* TABLE_COLS and its extra columns */
+    char           *cache_kind;              /* of cache files, by format */
+    double         sample;                   /* sample=, see logsample.h */
 } access_log_vtab;
 
 
@@ -97,12 +252,12 @@ static char * access_log_trimquote(const char *q_str)
     int start = 0;
     int end = q_str_len -1;
 
-    char *u_str = malloc(q_str_len);
+    char *u_str = malloc(q_str_len + 1);
     
-    if (q_str[0] == '"' || q_str[0] == '\'' )
+    if (q_str_len > 0 && (q_str[0] == '"' || q_str[0] == '\'' ))
         start++;
     
-    if (q_str[q_str_len -1] == '"' || q_str[q_str_len -1] == '\'')
+    if (q_str_len > 1 && (q_str[q_str_len -1] == '"' || q_str[q_str_len -1] == '\''))
         end--;
 
     int i;
@@ -112,106 +267,239 @@ static char * access_log_trimquote(const char *q_str)
     }
 
     // null terminate string
-    if (j > 0) u_str[j]=0;
+    u_str[j]=0;
 
     return u_str;
 }
 
+/*
+Return the value of a "name=value" table argument, or NULL if arg is
+not the named option. Quotes around the argument and around the value
+are stripped, so 'time_slack=600' and time_slack='600' are the same.
+The caller frees the returned string.
+ */
+static char * access_log_option(const char *arg, const char *name)
+{
+    char *u_str = access_log_trimquote(arg);
+    char *value = NULL;
+    int   len = strlen(name);
+
+    if (strncmp(u_str, name, len) == 0 && u_str[len] == '=')
+        value = access_log_trimquote(u_str + len + 1);
+
+    free(u_str);
+    return value;
+}
+
+/*
+The value of a format= table argument, or NULL if arg is not one. Only
+single quotes are stripped, as a format often starts or ends with a
+double quote: 'format=%h "%r"' and format='%h "%r"' are the same. The
+caller frees the returned string.
+ */
+static char * access_log_format_option( const char *arg )
+{
+    int   quoted = ( *arg == '\'' );
+    char  *value;
+    int   len;
+
+    arg += quoted;
+    if ( strncmp( arg, "format=", 7 ) != 0 ) return NULL;
+    arg += 7;
+    if ( *arg == '\'' ) {
+        quoted = 1;
+        arg++;
+    }
+    len = strlen( arg );
+    if ( ( value = malloc( len + 1 ) ) == NULL ) return NULL;
+    memcpy( value, arg, len + 1 );
+    if ( quoted && len > 0 && value[len - 1] == '\'' ) value[len - 1] = '\0';
+    return value;
+}
+
+typedef struct access_log_pred_s {
+    int            col;
+    int            op;                       /* SQLITE_INDEX_CONSTRAINT_* */
+    int            type;                     /* of the value: SQLITE_INTEGER, _FLOAT, _TEXT */
+    sqlite_int64   i;
+    double         d;
+    char           *s;                       /* text, or a pattern's literal part */
+    int            n;
+} access_log_pred;
+
 typedef struct access_log_cursor_s {
     sqlite3_vtab_cursor   cur;               /* this must be first */
 
-    gzFile         *fptr;                    /* used to scan file */
-    sqlite_int64   row;                      /* current row count (ROWID) */
+    log_reader     *reader;                  /* used to scan file */
+    int            file;                     /* index of file in v->files */
+    int            reader_file;              /* file reader is open on */
+    log_reader     *ahead[THREADS_MAX];      /* next files, reading ahead */
+    int            ahead_file[THREADS_MAX];  /* in file order */
+    int            n_ahead;
+    sqlite_int64   row;                      /* line number in file */
     int            eof;                      /* EOF flag */
 
+    /* time_epoch range from bestindex, inclusive */
+    int            has_time_lo;
+    int            has_time_hi;
+    sqlite_int64   time_lo;
+    sqlite_int64   time_hi;
+    int            time_slack;
+
+    /* rowid range from bestindex, inclusive, split into file and line */
+    int            has_row_lo;
+    int            row_lo_file;
+    sqlite_int64   row_lo;
+    int            has_row_hi;
+    int            row_hi_file;
+    sqlite_int64   row_hi;
+
+    /* source_file and vhost equality constraints from bestindex */
+    char           *source_file;
+    char           *vhost;
+
+    log_cache      *cache;                   /* columns of file, see logcache.h */
+    sqlite_int64   line_row;                 /* row line is of, with a cache */
+
+    /* follow= scan, see logfollow.h, one position per file */
+    int            following;                /* scan starts at follow_start */
+    log_follow_pos *follow_start;            /* where the last query got to */
+    log_follow_pos *follow_end;              /* files this cursor read to the end */
+
+    /* zone maps, see logzone.h */
+    int            has_zone_query;           /* constraints a zone map can use */
+    int            zone_keys;                /* any besides time_epoch */
+    log_zone_query zone_query;
+    log_zone       *zone;                    /* of the file, to skip blocks with */
+    int            zone_next;                /* next block to check */
+    log_zone       *zone_build;              /* being built by this scan */
+    sqlite_int64   zone_off;                 /* offset of the next line, building */
+
+    /* lookup=on, see logpost.h */
+    int            use_post;                 /* constraints the index can use */
+    int            n_post_keys;
+    uint64_t       post_keys[TABLE_COLS];    /* the lines must have all of them */
+    int            post_lookup;              /* reading the lines of post_rows */
+    int64_t        *post_rows;               /* line numbers in the file */
+    int64_t        *post_offs;               /* and where the lines start */
+    sqlite_int64   post_n;
+    sqlite_int64   post_i;                   /* next of them */
+    log_post       *post_from;               /* index to add newer lines to */
+    log_post       *post_build;              /* being built by this scan */
+    sqlite_int64   post_off;                 /* offset of the next line, building */
+
+    /* pushed down constraints */
+    int            n_pred;
+    access_log_pred pred[PRED_MAX];          /* ANDed, checked on each line */
+
+    /* sample= or sample_rate = ?, see logsample.h */
+    double         sample_rate;              /* 0 to read every line */
+    log_sample     sample;                   /* blocks of the file to read */
+
+    /* counts for cattoy_stats, see logstats.h */
+    log_stats      stats;
+    int            timing;                   /* timing=on */
+
+    const log_format *format;                /* the table's, see logformat.h */
+    int            n_cols;
+
     /* per-line info */
-    char           line[LINESIZE];           /* line buffer */
+    char           *line;                    /* line, in the reader's buffer */
     int            line_len;                 /* length of data in buffer */
-    int            line_ptrs_valid;          /* flag for scan data */
-    char           *(line_ptrs[TABLE_COLS]); /* array of pointers */
-    int            line_size[TABLE_COLS];    /* length of data for each pointer */
+    int            line_partial;             /* length if it has no new-line */
+    uint64_t       cols;                     /* COL_BIT()s the query uses, or COLS_ALL */
+    int            scan_ops;                 /* of the format, to split lines for cols */
+    uint64_t       line_cols;                /* COL_BIT()s the line is split for, 0 if not yet */
+    int            line_epoch_valid;         /* flag for line_epoch */
+    sqlite_int64   line_epoch;               /* time_epoch of line */
+    int            line_msec;                /* milliseconds of line_epoch */
+    log_time       time_cache;               /* last minute converted, see logtime.h */
+    char           *(line_ptrs[TABLE_COLS_MAX]); /* array of pointers */
+    int            line_size[TABLE_COLS_MAX];    /* length of data for each pointer */
 } access_log_cursor;
 
-static int access_log_get_line( access_log_cursor *c )
+static void access_log_pred_clear( access_log_cursor *c );
+
+/*
+atoi() for a field of the line. Lines are not NUL terminated, they run
+straight on into the next one in the reader's buffer.
+ */
+static int access_log_atoi( const char *p, int len )
 {
-    char   *cptr;
-    int    rc = SQLITE_OK;
+    const char  *end = p + len;
+    unsigned    n = 0;
+    int         neg = 0;
+
+    while ( p < end && ( *p == ' ' || *p == '\t' ) ) p++;
+    if ( p < end && ( *p == '-' || *p == '+' ) ) neg = ( *p++ == '-' );
+    while ( p < end && *p >= '0' && *p <= '9' ) n = n * 10 + ( *p++ - '0' );
+    return (int)( neg ? -n : n );
+}
 
-    c->row++;                          /* advance row (line) counter */
-    c->line_ptrs_valid = 0;            /* reset scan flag */
-    cptr = gzgets( c->fptr, c->line, LINESIZE );
-    if ( cptr == NULL ) {  /* found the end of the file/error */
-        if (gzeof( c->fptr ) ) {
-            c->eof = 1;
-        } else {
-            rc = -1;
-        }
-        return rc;
+static int access_log_read_line( access_log_cursor *c )
+{
+    const char   *line;
+    int          len;
+
+    c->line_cols = 0;                  /* reset scan flags */
+    c->line_epoch_valid = 0;
+
+    /* the line is parsed where the reader has it, see logreader.h */
+    line = log_reader_line( c->reader, &len );
+    if ( line == NULL ) {  /* found the end of the file/error */
+        if ( !log_reader_eof( c->reader ) ) return -1;
+        c->eof = 1;
+        c->line_partial = 0;
+        return SQLITE_OK;
     }
-    /* find end of buffer and make sure it is the end a line... */
-    cptr = c->line + strlen( c->line ) - 1;       /* find end of string */
-    if ( ( *cptr != '\n' )&&( *cptr != '\r' ) ) { /* overflow? */
-        char   buf[1024], *bufptr;
-        /* ... if so, keep reading */
-        while ( 1 ) {
-            bufptr = gzgets( c->fptr, buf, sizeof( buf ) );
-            if ( bufptr == NULL ) {  /* found the end of the file/error */
-                if (gzeof( c->fptr ) ) {
-                    c->eof = 1;
-                } else {
-                    rc = -1;
-                }
-                break;
-            }
-            bufptr = &buf[ strlen( buf ) - 1 ];
-            if ( ( *bufptr == '\n' )||( *bufptr == '\r' ) ) {
-                break;               /* found the end of this line */
-            }
-        }
+    c->line_partial = ( len > 0 && line[len - 1] != '\n' ? len : 0 );
+    while ( len > 0 && ( line[len - 1] == '\n' || line[len - 1] == '\r' ) ) {
+        len--;             /* trim new-line characters off end of line */
     }
+    c->line = (char *)line;
+    c->line_len = len;
+    return SQLITE_OK;
+}
 
-    while ( ( *cptr == '\n' )||( *cptr == '\r' ) ) {
-        *cptr-- = '\0';   /* trim new-line characters off end of line */
-    }
-    c->line_len = ( cptr - c->line ) + 1;
-    return rc;
+/*
+The fields columns cols are worked out from: the time for its parts,
+the request for method and url, remote_host for its other forms.
+ */
+static uint64_t access_log_fields( uint64_t cols )
+{
+    if ( cols & COLS_TIME ) cols |= COL_BIT( 3 );
+    if ( cols & ( COL_BIT( COL_METHOD ) | COL_BIT( COL_URL ) ) ) cols |= COL_BIT( COL_REQUEST );
+    if ( cols & ( COL_BIT( COL_REMOTE_HOST_INT ) | COL_BIT( COL_REMOTE_HOST_IP ) ) ) cols |= COL_BIT( COL_REMOTE_HOST );
+    return cols;
 }
 
-static int access_log_scanline( access_log_cursor *c )
+/*
+Split the current line for columns cols: its fields up to the last one
+they need, the user_agent and referer at the end of the line only if
+they are wanted, and the parts of the time and request only if those
+are.
+ */
+static int access_log_scanline( access_log_cursor *c, uint64_t cols )
 {
-    char   *start = c->line, *end = NULL, next = ' ';
-    int    i;
+    char     *start, *end;
+    char     *eol = c->line + c->line_len;   /* not NUL terminated if mapped */
+    int      i;
+    int64_t  t = ( c->timing ? log_stats_clock() : 0 );
 
-    /* clear pointers */
+    /* clear pointers, the table's own with a constant count */
     for ( i = 0; i < TABLE_COLS; i++ ) {
         c->line_ptrs[i] = NULL;
         c->line_size[i] = -1;
     }
-
-    /* process actual fields */
-    for ( i = 0; i < TABLE_COLS_SCAN; i++ ) {
-        next = ' ';
-        while ( *start == ' ' )  start++;     /* trim whitespace */
-        if (*start == '\0' )  break;          /* found the end */
-        if (*start == '"' ) {
-            next = '"';  /* if we started with a quote, end with one */
-            start++;
-        }
-        else if (*start == '[' ) {
-            next = ']';  /* if we started with a bracket, end with one */
-            start++;
-        }
-        end = strchr( start, next );    /* find end of this field */
-        if ( end == NULL ) {            /* found the end of the line */
-            int     len = strlen ( start );
-            end = start + len;          /* end now points to '\0' */
-        }
-        c->line_ptrs[i] = start;        /* record start */
-        c->line_size[i] = end - start;  /* record length */
-        while ( ( *end != ' ' )&&( *end != '\0' ) )  end++;  /* find end */
-        start = end;
+    for ( ; i < c->n_cols; i++ ) {
+        c->line_ptrs[i] = NULL;
+        c->line_size[i] = -1;
     }
 
+    /* process actual fields, with the program format= compiled to */
+    log_format_scan( c->format, cols == c->cols ? c->scan_ops : c->format->n_ops,
+                     c->line, c->line_len, c->line_ptrs, c->line_size );
+
     /* process special fields */
 
     /* remote_host_int. Copy here, convert in column() */
@@ -220,7 +508,7 @@ static int access_log_scanline( access_log_cursor *c )
 
     /* assumes: "DD/MMM/YYYY:HH:MM:SS zone" */
     /*     idx:  012345678901234567890...   */
-    if (( c->line_ptrs[3] != NULL )&&( c->line_size[3] >= 20 )) {
+    if (( cols & COLS_TIME )&&( c->line_ptrs[3] != NULL )&&( c->line_size[3] >= 20 )) {
     /* timestamp field present, so likely a valid record */
         start = c->line_ptrs[3];
         c->line_ptrs[11] = &start[0];    c->line_size[11] = 2; /* time_day   */
@@ -233,256 +521,2226 @@ static int access_log_scanline( access_log_cursor *c )
     }
 
     /* method, req_url */
-    start = c->line_ptrs[4];
-    end = ( start == NULL ? NULL : strchr( start, ' ' ) );
+    start = ( cols & ( COL_BIT( COL_METHOD ) | COL_BIT( COL_URL ) ) ? c->line_ptrs[4] : NULL );
+    end = ( start == NULL ? NULL : memchr( start, ' ', eol - start ) );
     if ( end != NULL ) {
         c->line_ptrs[19] = start; /* req_op */
         c->line_size[19] = end - start;
         start = end + 1;
     }
-    end = ( start == NULL ? NULL : strchr( start, ' ' ) );
+    end = ( start == NULL ? NULL : memchr( start, ' ', eol - start ) );
     if ( end != NULL ) {
         c->line_ptrs[20] = start;  /* req_url */
         c->line_size[20] = end - start;
     }
 
-    /* time_epoch   */
+    /* time_epoch, time_epoch_ms, time_utc */
     c->line_size[18] = 2;
+    c->line_size[22] = 2;
+    c->line_size[23] = 2;
 
     /* line */
     c->line_ptrs[21] = c->line;
     c->line_size[21] = c->line_len;
 
-    c->line_ptrs_valid = 1;
+    c->line_cols = cols;
+    if ( c->timing ) c->stats.ns_scanline += log_stats_clock() - t;
     return SQLITE_OK;
 }
 
+/* Split the current line, unless it already is for column cidx. */
+static void access_log_scan( access_log_cursor *c, int cidx )
+{
+    if ( !( c->line_cols & COL_BIT( cidx ) ) ) {
+        access_log_scanline( c, c->line_cols == 0 ? c->cols : COLS_ALL );
+    }
+}
 
-static int access_log_connect( sqlite3 *db, void *udp, int argc, 
-        const char *const *argv, sqlite3_vtab **vtab, char **errmsg )
+static sqlite_int64 access_log_epoch( access_log_cursor *c )
 {
-    access_log_vtab  *v = NULL;
-    const char   *filename = access_log_trimquote(argv[3]);
-    gzFile         *ftest;
+    sqlite_int64 epoch;
 
-    if ( argc != 4 ) return SQLITE_ERROR;
+    if ( c->line_epoch_valid ) return c->line_epoch;
 
-    *vtab = NULL;
-    *errmsg = NULL;
+    if ( c->cache != NULL ) {
+        log_value val;
 
-    /* test to see if filename is valid */
-    ftest = gzopen( filename, "rb" );
-    if ( ftest == NULL ) {
-      return SQLITE_ERROR;
+        log_cache_get( c->cache, COL_TIME_EPOCH, c->row - 1, &val );
+        return ( val.type == LOG_VALUE_INT ? val.i : -1 );
     }
-    gzclose( ftest );
 
-    /* alloccate structure and set data */
-    v = sqlite3_malloc( sizeof( access_log_vtab ) );
-    if ( v == NULL ) return SQLITE_NOMEM;
-    ((sqlite3_vtab*)v)->zErrMsg = NULL; /* need to init this */
+    access_log_scan( c, COL_TIME_EPOCH );
 
-    v->filename = sqlite3_mprintf( "%s", filename );
-    if ( v->filename == NULL ) {
-        sqlite3_free( v );
-        return SQLITE_NOMEM;
+    epoch = -1;
+    if (( c->line_ptrs[3] != NULL )&&( c->line_size[3] >= 20 )) {
+        /* "04/Nov/2014:13:15:48 -0500", the offset is applied */
+        epoch = log_time_clf( &c->time_cache, c->line_ptrs[3], c->line_size[3] );
     }
-    v->db = db;
 
-    sqlite3_declare_vtab( db, access_log_sql );
-    *vtab = (sqlite3_vtab*)v;
-    return SQLITE_OK;
+    c->line_epoch = epoch;
+    c->line_epoch_valid = 1;
+    return epoch;
 }
 
-static int access_log_disconnect( sqlite3_vtab *vtab )
+static int access_log_next_file( access_log_cursor *c );
+
+/*
+The zone map classes (see logzone.h) of a status range: the hundreds,
+0 to 29, and LOG_ZONE_CLASS_OTHER for anything else.
+ */
+static uint32_t access_log_status_classes( int has_lo, sqlite_int64 lo, int has_hi, sqlite_int64 hi )
 {
-    sqlite3_free( ((access_log_vtab*)vtab)->filename );
-    sqlite3_free( vtab );
-    return SQLITE_OK;
+    uint32_t  classes = 0;
+    int       k;
+
+    for ( k = 0; k < 30; k++ ) {
+        if ( ( !has_lo || k * 100 + 99 >= lo ) && ( !has_hi || k * 100 <= hi ) ) classes |= 1U << k;
+    }
+    if ( !has_lo || !has_hi || lo < 0 || hi >= 3000 ) classes |= 1U << LOG_ZONE_CLASS_OTHER;
+    return classes;
 }
 
-static int access_log_bestindex( sqlite3_vtab *vtab, sqlite3_index_info *info )
+static void access_log_value( access_log_cursor *c, int cidx, log_value *val );
+
+/*
+Take the zone map of file f to skip blocks of lines with, or, if there
+is none and the scan reads the whole file for constraints a zone map
+could use, build one as it goes.
+ */
+static void access_log_zone_open( access_log_cursor *c, log_file *f )
 {
-    return SQLITE_OK;
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+
+    if ( ( c->zone = log_file_zone( f, v->index_mode ) ) != NULL ) {
+        c->zone_next = log_zone_find( c->zone, c->row );
+    }
+    else if ( c->zone_keys && c->row == 0 && !c->has_time_lo && !c->has_time_hi &&
+              v->index_mode != LOG_INDEX_OFF ) {
+        c->zone_build = log_zone_new();
+        c->zone_off = 0;
+    }
 }
 
-static int access_log_open( sqlite3_vtab *vtab, sqlite3_vtab_cursor **cur )
+/* Add the current line to the zone map being built. */
+static void access_log_zone_add( access_log_cursor *c )
 {
-    access_log_vtab     *v = (access_log_vtab*)vtab;
-    access_log_cursor   *c;
-    gzFile            *fptr;
-    char            *cmd;
+    log_value  val;
+    int        has_key[LOG_ZONE_KEYS] = { 0, 0 }, cls = LOG_ZONE_CLASS_OTHER;
+    uint64_t   key[LOG_ZONE_KEYS];
+
+    access_log_value( c, COL_STATUS, &val );
+    if ( val.type == LOG_VALUE_INT && val.i >= 0 && val.i < 3000 ) cls = val.i / 100;
+    access_log_value( c, COL_REMOTE_HOST_INT, &val );
+    if ( val.type == LOG_VALUE_INT ) {
+        key[0] = val.i;
+        has_key[0] = 1;
+    }
+    access_log_value( c, COL_METHOD, &val );
+    if ( val.type == LOG_VALUE_TEXT ) {
+        key[1] = log_zone_hash( val.s, val.n );
+        has_key[1] = 1;
+    }
+    if ( log_zone_line( c->zone_build, c->zone_off, access_log_epoch( c ), cls, has_key, key ) != 0 ) {
+        log_zone_free( c->zone_build );
+        c->zone_build = NULL;
+    }
+    c->zone_off = log_reader_tell( c->reader );
+}
 
-    *cur = NULL;
+/* Keep the zone map the scan has built, now it has read the file. */
+static void access_log_zone_done( access_log_cursor *c )
+{
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+    log_file         *f = &v->files->files[c->file];
 
-    fptr = gzopen( v->filename, "rb" );
+    if ( log_zone_finish( c->zone_build, f->filename, c->reader ) == 0 ) {
+        log_file_set_zone( f, c->zone_build, v->index_mode );
+    }
+    else {
+        log_zone_free( c->zone_build );
+    }
+    c->zone_build = NULL;
+}
 
-    if ( fptr == NULL ) return SQLITE_ERROR;
+/*
+At the start of a block of the zone map, move on to the first block
+from there that can hold a matching line. On a gzip log a seek stops
+the read ahead thread and inflates from an index point, so nearby
+blocks are skipped by reading past their lines instead. Returns 1 if
+no block in the rest of the file can match.
+ */
+static int access_log_zone_skip( access_log_cursor *c )
+{
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+    log_zone         *z = c->zone;
+    int              j = c->zone_next, len;
+    sqlite_int64     skip;
+
+    while ( j < z->n && !log_zone_may( &z->list[j], &c->zone_query ) ) j++;
+    if ( j == z->n ) return 1;
+    if ( j > c->zone_next ) {
+        if ( !log_reader_compressed( c->reader ) ||
+             ( log_reader_seekable( c->reader ) &&
+               z->list[j].off - log_reader_tell( c->reader ) > LOG_INDEX_SPAN ) ) {
+            if ( log_reader_seek( c->reader, z->list[j].off ) != 0 ) return 1;
+            if ( v->threads > 0 ) log_reader_prefetch( c->reader );
+        }
+        else {
+            for ( skip = z->list[j].rows - ( c->row - 1 ); skip > 0; skip-- ) {
+                if ( log_reader_line( c->reader, &len ) == NULL ) return 1;
+            }
+        }
+        c->stats.lines_jumped += z->list[j].rows - ( c->row - 1 );
+        c->row = z->list[j].rows + 1;
+    }
+    c->zone_next = j + 1;
+    return 0;
+}
 
-    c = sqlite3_malloc( sizeof( access_log_cursor ) );
-    if ( c == NULL ) {
-        gzclose( fptr );
-        return SQLITE_NOMEM;
+/*
+Set up the sample of file f. Its lines are counted by its cache or its
+index, which is built first if need be; without either, for index=off,
+they are not known.
+ */
+static void access_log_sample_open( access_log_cursor *c, log_file *f )
+{
+    sqlite_int64  lines = -1;
+
+    if ( c->sample_rate > 0 && c->sample_rate < 1 ) {
+        if ( c->cache != NULL ) lines = c->cache->rows;
+        else if ( log_reader_index( c->reader ) == 0 && f->index != NULL ) lines = f->index->lines;
     }
-    
-    c->fptr = fptr;
-    *cur = (sqlite3_vtab_cursor*)c;
-    return SQLITE_OK;
+    log_sample_init( &c->sample, c->sample_rate < 1 ? c->sample_rate : 0, f->filename, lines );
 }
 
-static int access_log_close( sqlite3_vtab_cursor *cur )
+/*
+Move on from the current line, not yet read, to line, the first of the
+next block of the sample. As for zone maps, a gzip log seeks only to an
+index point ahead of where it is and reads past nearer lines; a plain
+log seeks from the index point before line. Returns 1 if the file ends
+first.
+ */
+static int access_log_sample_skip( access_log_cursor *c, sqlite_int64 line )
 {
-    if ( ((access_log_cursor*)cur)->fptr != NULL ) {
-        gzclose( ((access_log_cursor*)cur)->fptr );
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+    log_index        *idx = v->files->files[c->file].index;
+    log_index_point  *p = ( idx != NULL ? log_index_find_line( idx, line ) : NULL );
+    int              len;
+
+    c->stats.lines_jumped += line - c->row;
+    if ( c->cache == NULL ) {
+        if ( p != NULL && ( !log_reader_compressed( c->reader ) || p->out > log_reader_tell( c->reader ) ) ) {
+            if ( log_reader_seek_line( c->reader, line ) != 0 ) return 1;
+            if ( v->threads > 0 ) log_reader_prefetch( c->reader );
+        }
+        else {
+            for ( ; c->row < line; c->row++ ) {
+                if ( log_reader_line( c->reader, &len ) == NULL ) return 1;
+            }
+        }
     }
-    sqlite3_free( cur );
-    return SQLITE_OK;
+    c->row = line - 1;
+    if ( c->zone != NULL ) c->zone_next = log_zone_find( c->zone, c->row );
+    return 0;
 }
 
-static int access_log_filter( sqlite3_vtab_cursor *cur,
-        int idxnum, const char *idxstr,
-        int argc, sqlite3_value **value )
+/* The key of a url in the inverted index: its path, without the query. */
+static uint64_t access_log_url_hash( const char *url, int n )
 {
-    access_log_cursor   *c = (access_log_cursor*)cur;
+    const char *q = memchr( url, '?', n );
 
-   gzseek( c->fptr, 0, SEEK_SET );
-    c->row = 0;
-    c->eof = 0;
-    return access_log_get_line( (access_log_cursor*)cur );
+    return log_zone_hash( url, q == NULL ? n : q - url );
 }
 
-static int access_log_next( sqlite3_vtab_cursor *cur )
+/* The keys of the current line in the inverted index. */
+static int access_log_post_keys( access_log_cursor *c, uint64_t *keys )
 {
-    return access_log_get_line( (access_log_cursor*)cur );
+    log_value  val;
+    int        n = 0;
+
+    access_log_value( c, COL_REMOTE_HOST_INT, &val );
+    if ( val.type == LOG_VALUE_INT ) keys[n++] = log_post_key( COL_REMOTE_HOST_INT, val.i );
+    access_log_value( c, COL_STATUS, &val );
+    if ( val.type == LOG_VALUE_INT ) keys[n++] = log_post_key( COL_STATUS, val.i );
+    access_log_value( c, COL_METHOD, &val );
+    if ( val.type == LOG_VALUE_TEXT ) {
+        keys[n++] = log_post_key( COL_METHOD, log_zone_hash( val.s, val.n ) );
+    }
+    access_log_value( c, COL_URL, &val );
+    if ( val.type == LOG_VALUE_TEXT ) keys[n++] = log_post_key( COL_URL, access_log_url_hash( val.s, val.n ) );
+    return n;
 }
 
-static int access_log_eof( sqlite3_vtab_cursor *cur )
+/*
+Look up the lines of file f that have all the constraints' keys in its
+inverted index. If there is none, a scan from the start of the file
+builds one as it goes. Returns 0 if the lookup is set up.
+ */
+static int access_log_post_open( access_log_cursor *c, log_file *f )
 {
-    return ((access_log_cursor*)cur)->eof;
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+    log_post         *p;
+    int              grown = 0;
+
+    if ( ( p = log_file_post( f, v->index_mode, &grown ) ) == NULL ) {
+        if ( v->index_mode != LOG_INDEX_OFF && !c->has_time_lo && !c->has_time_hi ) {
+            c->post_build = log_post_new();
+            c->post_off = 0;
+        }
+        return 1;
+    }
+    c->post_n = log_post_rows( p, c->post_keys, c->n_post_keys, &c->post_rows, &c->post_offs );
+    if ( c->post_n < 0 ) return 1;
+    c->post_i = 0;
+    c->post_from = ( grown ? p : NULL );
+    c->post_lookup = 1;
+    c->row = 0;
+    return log_reader_seek( c->reader, 0 );
 }
 
-static int access_log_rowid( sqlite3_vtab_cursor *cur, sqlite3_int64 *rowid )
+/*
+Move to the next line of the lookup. As for zone maps, lines a little
+way ahead in a gzip log are read past rather than sought to. After the
+last, the lines logged since the index was built are read and added to
+it. Returns 1 if there are no more lines to read in the file.
+ */
+static int access_log_post_next( access_log_cursor *c )
 {
-    *rowid = ((access_log_cursor*)cur)->row;
-    return SQLITE_OK;
+    sqlite_int64  row, off, tell;
+    int           len;
+
+    if ( c->post_i == c->post_n ) {
+        c->post_lookup = 0;
+        if ( c->post_from == NULL ) return 1;
+        if ( log_reader_seek( c->reader, c->post_from->end_off ) != 0 ) return 1;
+        c->row = c->post_from->rows;
+        c->post_off = c->post_from->end_off;
+        c->post_build = log_post_grow( c->post_from );
+        return 0;
+    }
+    row = c->post_rows[c->post_i];
+    off = c->post_offs[c->post_i++];
+    if ( row != c->row + 1 ) {
+        tell = log_reader_tell( c->reader );
+        if ( log_reader_compressed( c->reader ) && off >= tell &&
+             ( !log_reader_seekable( c->reader ) || off - tell <= LOG_INDEX_SPAN ) ) {
+            for ( ; c->row < row - 1; c->row++ ) {
+                if ( log_reader_line( c->reader, &len ) == NULL ) return 1;
+            }
+        }
+        else if ( log_reader_seek( c->reader, off ) != 0 ) {
+            return 1;
+        }
+    }
+    c->row = row - 1;
+    return 0;
 }
 
-static int access_log_column( sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int cidx )
+/* Add the current line to the inverted index being built. */
+static void access_log_post_add( access_log_cursor *c )
 {
-    access_log_cursor    *c = (access_log_cursor*)cur;
+    uint64_t      keys[TABLE_COLS];
+    sqlite_int64  end = log_reader_tell( c->reader );
+    int           n;
+
+    /* a last line still being written is added once it is whole */
+    if ( c->line_partial > 0 && !log_reader_compressed( c->reader ) ) return;
+    n = access_log_post_keys( c, keys );
+    if ( log_post_line( c->post_build, c->row, c->post_off, end, n, keys ) != 0 ) {
+        log_post_free( c->post_build );
+        c->post_build = NULL;
+    }
+    c->post_off = end;
+}
+
+/* Keep the inverted index the scan has built, now it has read the file. */
+static void access_log_post_done( access_log_cursor *c )
+{
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+    log_file         *f = &v->files->files[c->file];
 
-    if ( c->line_ptrs_valid == 0 ) {
-        access_log_scanline( c );         /* scan line, if required */
+    if ( log_post_finish( c->post_build, f->filename, c->reader ) == 0 ) {
+        log_file_set_post( f, c->post_build, v->index_mode );
     }
-    if ( c->line_size[cidx] < 0 ) {   /* field not scanned and set */
-        sqlite3_result_null( ctx );
-        return SQLITE_OK;
+    else {
+        log_post_free( c->post_build );
     }
+    c->post_build = NULL;
+}
 
-    switch( cidx ) {
-    case 10: { /* convert IP address string to signed 64 bit integer */
-        int            i;
-        sqlite_int64   v = 0;
-        char          *start = c->line_ptrs[cidx], *end, *oct[4];
-
-        for ( i = 0; i < 4; i++ ) {
-            oct[i] = start;
-            end = ( start == NULL ? NULL : strchr( start, '.' ) );
-            if ( end != NULL ) {
-                start = end + 1;
-            }
+static void access_log_pred_clear( access_log_cursor *c )
+{
+    int k;
+
+    for ( k = 0; k < c->n_pred; k++ ) sqlite3_free( c->pred[k].s );
+    c->n_pred = 0;
+}
+
+/*
+Keep constraint op on column col with the value from filter, for the
+lines to be checked against. Values that SQLite would not compare the
+way access_log_pred_match() does are left to SQLite alone.
+ */
+static void access_log_pred_add( access_log_cursor *c, int col, int op, sqlite3_value *value )
+{
+    access_log_pred  *p = &c->pred[c->n_pred];
+    const char       *s;
+    int              n, off;
+
+    if ( c->n_pred == PRED_MAX ) return;
+    memset( p, 0, sizeof( access_log_pred ) );
+    p->col = col;
+    p->op = op;
+    if ( op == LOG_IP_IN_CIDR ) {
+        /* the block's lowest and highest addresses, checked against remote_host_ip */
+        s = (const char *)sqlite3_value_text( value );
+        if ( s == NULL || ( p->s = sqlite3_malloc( 32 ) ) == NULL ) return;
+        if ( log_ip_cidr( s, sqlite3_value_bytes( value ), (unsigned char *)p->s,
+                          (unsigned char *)p->s + 16 ) != 0 ) {
+            sqlite3_free( p->s );
+            return;
         }
-        v += ( ( oct[0] == NULL ? 0 : atoi( oct[0] ) ) * pow(256, 3) );
-        v += ( ( oct[1] == NULL ? 0 : atoi( oct[1] ) ) * pow(256, 2) );
-        v += ( ( oct[2] == NULL ? 0 : atoi( oct[2] ) ) *     256     );
-        v +=   ( oct[3] == NULL ? 0 : atoi( oct[3] ) );
-        sqlite3_result_int64( ctx, v );
-        return SQLITE_OK;
+        p->type = SQLITE_BLOB;
+        c->n_pred++;
+        return;
     }
-    case 13: { 
-        int m = 0;
-             if ( strncmp( c->line_ptrs[cidx], "Jan", 3 ) == 0 ) m =  1;
-        else if ( strncmp( c->line_ptrs[cidx], "Feb", 3 ) == 0 ) m =  2;
-        else if ( strncmp( c->line_ptrs[cidx], "Mar", 3 ) == 0 ) m =  3;
-        else if ( strncmp( c->line_ptrs[cidx], "Apr", 3 ) == 0 ) m =  4;
-        else if ( strncmp( c->line_ptrs[cidx], "May", 3 ) == 0 ) m =  5;
-        else if ( strncmp( c->line_ptrs[cidx], "Jun", 3 ) == 0 ) m =  6;
-        else if ( strncmp( c->line_ptrs[cidx], "Jul", 3 ) == 0 ) m =  7;
-        else if ( strncmp( c->line_ptrs[cidx], "Aug", 3 ) == 0 ) m =  8;
-        else if ( strncmp( c->line_ptrs[cidx], "Sep", 3 ) == 0 ) m =  9;
-        else if ( strncmp( c->line_ptrs[cidx], "Oct", 3 ) == 0 ) m = 10;
-        else if ( strncmp( c->line_ptrs[cidx], "Nov", 3 ) == 0 ) m = 11;
-        else if ( strncmp( c->line_ptrs[cidx], "Dec", 3 ) == 0 ) m = 12;
-        else break;    /* give up, return text */
-        sqlite3_result_int( ctx, m );
-        return SQLITE_OK;
+    if ( col == COL_STATUS || col == COL_REMOTE_HOST_INT ) {
+        /* a value that is not a number compares as text, left to SQLite */
+        p->type = sqlite3_value_numeric_type( value );
+        if      ( p->type == SQLITE_INTEGER ) p->i = sqlite3_value_int64( value );
+        else if ( p->type == SQLITE_FLOAT )   p->d = sqlite3_value_double( value );
+        else return;
+        c->n_pred++;
+        return;
     }
-    case 5:    /* result code */
-    case 6:    /* bytes transfered */
-    case 11:   /* day-of-month */
-    case 14:   /* year */
-    case 15:   /* hour */
-    case 16:   /* minute */
-    case 17:   /* second */
-        sqlite3_result_int( ctx, atoi( c->line_ptrs[cidx] ) );
-        return SQLITE_OK;
-    case 18: { /* time_epoch - check results against http://www.epochconverter.com */
+    if ( sqlite3_value_type( value ) == SQLITE_NULL || sqlite3_value_type( value ) == SQLITE_BLOB ) {
+        return;
+    }
+    s = (const char *)sqlite3_value_text( value );
+    n = sqlite3_value_bytes( value );
+    if ( s == NULL ) return;
+    if ( op == SQLITE_INDEX_CONSTRAINT_LIKE || op == SQLITE_INDEX_CONSTRAINT_GLOB ) {
+        off = log_match_literal( s, n, op == SQLITE_INDEX_CONSTRAINT_GLOB, &n );
+        s += off;
+    }
+    if ( ( p->s = sqlite3_malloc( n + 1 ) ) == NULL ) return;
+    memcpy( p->s, s, n );
+    p->n = n;
+    p->type = SQLITE_TEXT;
+    c->n_pred++;
+}
 
-      time_t epoch;
-      struct tm tm;
-      tm.tm_isdst = -1;
+/*
+Whether the current line can match, going by its raw bytes alone: it
+must hold the value of each text equality and the literal part of each
+LIKE and GLOB pattern, see logmatch.h. A line from the cache is only
+checked by access_log_pred_match().
+ */
+static int access_log_pred_raw( access_log_cursor *c )
+{
+    access_log_pred  *p;
+    int              k;
+
+    if ( c->cache != NULL ) return 1;
+    for ( k = 0; k < c->n_pred; k++ ) {
+        p = &c->pred[k];
+        if ( p->type != SQLITE_TEXT || p->n == 0 ) continue;
+        if ( p->op != SQLITE_INDEX_CONSTRAINT_EQ && p->op != SQLITE_INDEX_CONSTRAINT_LIKE &&
+             p->op != SQLITE_INDEX_CONSTRAINT_GLOB ) {
+            continue;
+        }
+        if ( log_match_find( c->line, c->line_len, p->s, p->n,
+                             p->op == SQLITE_INDEX_CONSTRAINT_LIKE ) == NULL ) {
+            return 0;
+        }
+    }
+    return 1;
+}
 
-      char ts[27];
-      memcpy(ts, c->line_ptrs[3], 26); ts[26] = '\0';    
+/*
+Whether the current line passes the pushed down comparisons, as SQLite
+compares: text by its bytes, then length, and a NULL never passes.
+ip_in_cidr() is a range of remote_host_ip, whichever column it is on.
+LIKE and GLOB are left to SQLite once the line has passed
+access_log_pred_raw().
+ */
+static int access_log_pred_match( access_log_cursor *c )
+{
+    access_log_pred  *p;
+    log_value        val;
+    int              k, cmp;
+
+    for ( k = 0; k < c->n_pred; k++ ) {
+        p = &c->pred[k];
+        if ( p->op == SQLITE_INDEX_CONSTRAINT_LIKE || p->op == SQLITE_INDEX_CONSTRAINT_GLOB ) continue;
+        if ( p->op == LOG_IP_IN_CIDR ) {
+            access_log_value( c, COL_REMOTE_HOST_IP, &val );
+            if ( val.type != LOG_VALUE_BLOB ||
+                 !log_ip_in( (const unsigned char *)val.s, (unsigned char *)p->s, (unsigned char *)p->s + 16 ) ) {
+                return 0;
+            }
+            continue;
+        }
+        access_log_value( c, p->col, &val );
+        if ( val.type == LOG_VALUE_NULL ) return 0;
+        if ( p->type == SQLITE_TEXT ) {
+            if ( val.type != LOG_VALUE_TEXT ) continue;
+            cmp = memcmp( val.s, p->s, val.n < p->n ? val.n : p->n );
+            if ( cmp == 0 ) cmp = val.n - p->n;
+        }
+        else if ( val.type != LOG_VALUE_INT ) {
+            continue;
+        }
+        else if ( p->type == SQLITE_INTEGER ) {
+            cmp = ( val.i > p->i ) - ( val.i < p->i );
+        }
+        else {
+            cmp = ( val.i > p->d ) - ( val.i < p->d );
+        }
+        switch ( p->op ) {
+        case SQLITE_INDEX_CONSTRAINT_EQ: if ( cmp != 0 ) return 0; break;
+        case SQLITE_INDEX_CONSTRAINT_GT: if ( cmp <= 0 ) return 0; break;
+        case SQLITE_INDEX_CONSTRAINT_GE: if ( cmp < 0 ) return 0;  break;
+        case SQLITE_INDEX_CONSTRAINT_LT: if ( cmp >= 0 ) return 0; break;
+        case SQLITE_INDEX_CONSTRAINT_LE: if ( cmp > 0 ) return 0;  break;
+        }
+    }
+    return 1;
+}
 
-      //if ( strptime("04/Nov/2014:13:15:48 -0500", "%d/%b/%Y:%H:%M:%S", &tm) != NULL )
-      if ( strptime(ts, "%d/%b/%Y:%H:%M:%S", &tm) != NULL )
-        epoch = mktime(&tm);
-      else
-        epoch = -1;
+/*
+Note that a follow= scan has read the current file to its end, so the
+next query starts after its last whole line. A last line that is still
+being written is left for then too.
+ */
+static void access_log_follow_end( access_log_cursor *c )
+{
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+    sqlite_int64     end = log_reader_tell( c->reader );
 
-      sqlite3_result_int( ctx, epoch );
-      return SQLITE_OK;
-    }
-    default:
-        break;
-    }
-    sqlite3_result_text( ctx, c->line_ptrs[cidx],
-                              c->line_size[cidx], SQLITE_STATIC );
-    return SQLITE_OK;
+    log_follow_mark( &c->follow_end[c->file], &v->files->files[c->file], c->reader,
+                     end, end - c->line_partial, c->row - 1 );
+    c->eof = 1;
 }
 
-static int access_log_rename( sqlite3_vtab *vtab, const char *newname )
+/*
+Advance to the next line inside the cursor's time_epoch range. Lines
+outside the range are skipped here rather than returned for SQLite to
+reject, but they still count toward the rowid. Once a line is later
+than the upper bound by more than time_slack the rest of the file is
+assumed to be later still and the scan moves on to the next file.
+Lines of blocks left out of a sample are passed over the same way.
+ */
+static int access_log_get_line( access_log_cursor *c )
 {
-    return SQLITE_OK;
+    sqlite_int64   epoch, next;
+    int            rc;
+
+    while ( 1 ) {
+        if ( c->post_lookup && access_log_post_next( c ) != 0 ) {
+            if ( access_log_next_file( c ) != 0 ) return SQLITE_OK;
+            continue;
+        }
+        c->row++;                      /* advance row (line) counter */
+        if ( c->zone != NULL && c->zone_next < c->zone->n &&
+             c->zone->list[c->zone_next].rows == c->row - 1 && access_log_zone_skip( c ) != 0 ) {
+            if ( access_log_next_file( c ) != 0 ) return SQLITE_OK;
+            continue;
+        }
+        if ( c->has_row_hi && c->file == c->row_hi_file && c->row > c->row_hi ) {
+            if ( access_log_next_file( c ) != 0 ) return SQLITE_OK;
+            continue;
+        }
+        /* blocks out of the sample are passed over, unless an index is being built */
+        if ( c->sample.rate > 0 && !c->post_lookup && c->zone_build == NULL && c->post_build == NULL &&
+             ( next = log_sample_next( &c->sample, c->row ) ) != c->row ) {
+            if ( next < 0 || access_log_sample_skip( c, next ) != 0 ) {
+                if ( access_log_next_file( c ) != 0 ) return SQLITE_OK;
+            }
+            continue;
+        }
+        if ( c->cache != NULL ) {
+            rc = SQLITE_OK;
+            c->eof = ( c->row > c->cache->rows );
+        }
+        else if ( ( rc = access_log_read_line( c ) ) != SQLITE_OK ) {
+            return rc;
+        }
+        if ( c->following && ( c->eof || c->line_partial > 0 ) ) {
+            access_log_follow_end( c );
+        }
+        if ( c->eof ) {
+            if ( c->zone_build != NULL ) access_log_zone_done( c );
+            if ( c->post_build != NULL ) access_log_post_done( c );
+            if ( access_log_next_file( c ) != 0 ) return SQLITE_OK;
+            continue;
+        }
+        c->stats.lines++;
+        if ( c->zone_build != NULL ) access_log_zone_add( c );
+        if ( c->post_build != NULL ) access_log_post_add( c );
+        if ( c->sample.rate > 0 && log_sample_next( &c->sample, c->row ) != c->row ) continue;
+        if ( c->n_pred > 0 && !access_log_pred_raw( c ) ) continue;
+        if ( c->has_time_lo || c->has_time_hi ) {
+            epoch = access_log_epoch( c );
+            if ( c->has_time_hi && epoch > c->time_hi + c->time_slack ) {
+                if ( access_log_next_file( c ) != 0 ) return SQLITE_OK;
+                continue;
+            }
+            if ( c->has_time_lo && epoch < c->time_lo ) continue;
+            if ( c->has_time_hi && epoch > c->time_hi ) continue;
+        }
+        if ( c->n_pred > 0 && !access_log_pred_match( c ) ) continue;
+        c->stats.rows++;
+        return rc;
+    }
 }
 
 
-static sqlite3_module access_log_mod = {
-    1,                       /* iVersion        */
-    access_log_connect,      /* xCreate()       */
-    access_log_connect,      /* xConnect()      */
-    access_log_bestindex,    /* xBestIndex()    */
-    access_log_disconnect,   /* xDisconnect()   */
-    access_log_disconnect,   /* xDestroy()      */
-    access_log_open,         /* xOpen()         */
-    access_log_close,        /* xClose()        */
-    access_log_filter,       /* xFilter()       */
-    access_log_next,         /* xNext()         */
-    access_log_eof,          /* xEof()          */
-    access_log_column,       /* xColumn()       */
-    access_log_rowid,        /* xRowid()        */
-    NULL,                    /* xUpdate()       */
-    NULL,                    /* xBegin()        */
-    NULL,                    /* xSync()         */
-    NULL,                    /* xCommit()       */
-    NULL,                    /* xRollback()     */
-    NULL,                    /* xFindFunction() */
-    access_log_rename        /* xRename()       */
-};
+static int access_log_disconnect( sqlite3_vtab *vtab );
 
-int sqlite3_extension_init( sqlite3 *db, char **error, const sqlite3_api_routines *api )
+/*
+Make the table from its arguments, in a structure of size bytes that
+starts with an access_log_vtab, without declaring its columns.
+ */
+static int access_log_new( sqlite3 *db, int argc, const char *const *argv,
+        int size, access_log_vtab **vtab, char **errmsg )
 {
-    SQLITE_EXTENSION_INIT2(api);
-    return sqlite3_create_module( db, "access_log", &access_log_mod, NULL );
+    access_log_vtab  *v = NULL;
+    log_set        *files;
+    int            time_slack = TIME_SLACK_DEFAULT;
+    int            index_mode = LOG_INDEX_FILE;
+    int            threads = -1;
+    int            block_cache = LOG_BLOCKS_DEFAULT;
+    int            reader_flags = LOG_READER_MMAP;
+    char           *cache_dir = NULL;
+    log_follow     *follow = NULL;
+    int            lookup = 0;
+    char           *trace = NULL;
+    char           *format = NULL;
+    const char     *text;
+    log_format     compiled;
+    char           *cache_kind = NULL;
+    int            timing = 0;
+    double         sample = 0;
+    log_stats_table *stats = NULL;
+    char           *value = NULL;
+    int            i, n, rc = SQLITE_ERROR;
+
+    if ( argc < 4 ) return SQLITE_ERROR;
+
+    *vtab = NULL;
+    *errmsg = NULL;
+
+    files = log_set_new();
+    if ( files == NULL ) return SQLITE_NOMEM;
+
+    for ( i = 3; i < argc; i++ ) {
+        if ( ( value = access_log_option( argv[i], "time_slack" ) ) != NULL ) {
+            time_slack = atoi( value );
+        }
+        else if ( ( value = access_log_option( argv[i], "mmap" ) ) != NULL ) {
+            if      ( strcmp( value, "off" ) == 0 ) reader_flags &= ~( LOG_READER_MMAP | LOG_FILE_MAP_LIVE );
+            else if ( strcmp( value, "on" ) == 0 )  reader_flags |= LOG_READER_MMAP | LOG_FILE_MAP_LIVE;
+            else {
+                *errmsg = sqlite3_mprintf( "mmap must be on or off: %s", value );
+                goto fail;
+            }
+        }
+        else if ( ( value = access_log_option( argv[i], "threads" ) ) != NULL ) {
+            threads = atoi( value );
+            if ( threads < 0 ) threads = 0;
+        }
+        else if ( ( value = access_log_option( argv[i], "block_cache" ) ) != NULL ) {
+            block_cache = ( strcmp( value, "off" ) == 0 ? 0 : atoi( value ) );
+            if ( block_cache < 0 ) block_cache = 0;
+        }
+        else if ( ( value = access_log_option( argv[i], "cache" ) ) != NULL ) {
+            struct stat st;
+
+            if ( stat( value, &st ) != 0 || !S_ISDIR( st.st_mode ) ) {
+                *errmsg = sqlite3_mprintf( "cache must be a directory: %s", value );
+                goto fail;
+            }
+            free( cache_dir );
+            cache_dir = value;
+            value = NULL;
+        }
+        else if ( ( value = access_log_option( argv[i], "follow" ) ) != NULL ) {
+            log_follow_free( follow );
+            follow = NULL;
+            if ( strcmp( value, "off" ) != 0 &&
+                 ( follow = log_follow_new( strcmp( value, "on" ) == 0 ? NULL : value ) ) == NULL ) {
+                *errmsg = sqlite3_mprintf( "cannot keep follow state in: %s", value );
+                goto fail;
+            }
+        }
+        else if ( ( value = access_log_option( argv[i], "lookup" ) ) != NULL ) {
+            if      ( strcmp( value, "off" ) == 0 ) lookup = 0;
+            else if ( strcmp( value, "on" ) == 0 )  lookup = 1;
+            else {
+                *errmsg = sqlite3_mprintf( "lookup must be on or off: %s", value );
+                goto fail;
+            }
+        }
+        else if ( ( value = access_log_option( argv[i], "sample" ) ) != NULL ) {
+            sample = ( strcmp( value, "off" ) == 0 ? 0 : atof( value ) );
+            if ( sample != 0 && !( sample >= LOG_SAMPLE_MIN && sample <= 1 ) ) {
+                *errmsg = sqlite3_mprintf( "sample must be off or from %.6f to 1: %s", LOG_SAMPLE_MIN, value );
+                goto fail;
+            }
+        }
+        else if ( ( value = access_log_option( argv[i], "timing" ) ) != NULL ) {
+            if      ( strcmp( value, "off" ) == 0 ) timing = 0;
+            else if ( strcmp( value, "on" ) == 0 )  timing = 1;
+            else {
+                *errmsg = sqlite3_mprintf( "timing must be on or off: %s", value );
+                goto fail;
+            }
+        }
+        else if ( ( value = access_log_format_option( argv[i] ) ) != NULL ) {
+            free( format );
+            format = value;
+            value = NULL;
+        }
+        else if ( ( value = access_log_option( argv[i], "trace" ) ) != NULL ) {
+            free( trace );
+            trace = value;
+            value = NULL;
+        }
+        else if ( ( value = access_log_option( argv[i], "index" ) ) != NULL ) {
+            if      ( strcmp( value, "off" ) == 0 )    index_mode = LOG_INDEX_OFF;
+            else if ( strcmp( value, "memory" ) == 0 ) index_mode = LOG_INDEX_MEMORY;
+            else if ( strcmp( value, "on" ) == 0 )     index_mode = LOG_INDEX_FILE;
+            else {
+                *errmsg = sqlite3_mprintf( "index must be on, off or memory: %s", value );
+                goto fail;
+            }
+        }
+        else {
+            /* anything else is a file name, glob or directory */
+            value = access_log_trimquote( argv[i] );
+            if ( ( n = log_set_add( files, value ) ) < 0 ) {
+                rc = SQLITE_NOMEM;
+                goto fail;
+            }
+            if ( n == 0 ) {
+                *errmsg = sqlite3_mprintf( "no log files found: %s", value );
+                goto fail;
+            }
+        }
+        free( value );
+        value = NULL;
+    }
+    log_set_sort( files );
+    log_set_cache( files, (int64_t)block_cache * 1048576 );
+
+    /* leave a core for SQLite */
+    if ( threads < 0 ) {
+        threads = sysconf( _SC_NPROCESSORS_ONLN ) - 1;
+        if ( threads > 4 ) threads = 4;
+        if ( threads < 0 ) threads = 0;
+    }
+
+    /* format=, a nickname or a LogFormat string, see logformat.h */
+    text = ( format == NULL ? LOG_FORMAT_DEFAULT : format );
+    if ( log_format_nickname( text ) != NULL ) text = log_format_nickname( text );
+    if ( log_format_compile( &compiled, text, access_log_directives, TABLE_COLS, access_log_sql ) != 0 ) {
+        *errmsg = sqlite3_mprintf( "%s", compiled.error );
+        goto fail;
+    }
+    /* the default keeps the caches written before there was format= */
+    if ( ( cache_kind = malloc( strlen( text ) + 12 ) ) != NULL ) {
+        if ( strcmp( text, LOG_FORMAT_DEFAULT ) == 0 ) strcpy( cache_kind, "access_log" );
+        else sprintf( cache_kind, "access_log %s", text );
+    }
+    free( format );
+    format = NULL;
+
+    /* for cattoy_stats and trace=, see logstats.h */
+    stats = log_stats_table_new( db, argv[0], argv[2], trace, timing );
+    if ( stats == NULL || cache_kind == NULL ) {
+        if ( stats == NULL && trace != NULL ) *errmsg = sqlite3_mprintf( "cannot trace to: %s", trace );
+        if ( *errmsg == NULL ) rc = SQLITE_NOMEM;
+        goto fail;
+    }
+    free( trace );
+    trace = NULL;
+
+    /* alloccate structure and set data */
+    v = sqlite3_malloc( size );
+    if ( v == NULL ) {
+        rc = SQLITE_NOMEM;
+        goto fail;
+    }
+    memset( v, 0, size );
+
+    v->files = files;
+    v->db = db;
+    v->time_slack = time_slack;
+    v->index_mode = index_mode;
+    v->reader_flags = reader_flags;
+    v->cache_dir = cache_dir;
+    v->follow = follow;
+    v->lookup = lookup;
+    v->stats = stats;
+    v->timing = timing;
+    v->threads = ( threads > THREADS_MAX ? THREADS_MAX : threads );
+    v->format = compiled;
+    v->n_cols = TABLE_COLS + compiled.n_extra;
+    v->cache_kind = cache_kind;
+    v->sample = sample;
+    *vtab = v;
+    return SQLITE_OK;
+
+fail:
+    free( value );
+    free( format );
+    free( trace );
+    free( cache_kind );
+    free( cache_dir );
+    log_stats_table_free( stats );
+    log_follow_free( follow );
+    log_set_free( files );
+    return rc;
+}
+
+static int access_log_connect( sqlite3 *db, void *udp, int argc, 
+        const char *const *argv, sqlite3_vtab **vtab, char **errmsg )
+{
+    access_log_vtab  *v;
+    char             *sql = NULL;
+    int              rc;
+
+    *vtab = NULL;
+    *errmsg = NULL;
+    rc = access_log_new( db, argc, argv, sizeof( access_log_vtab ), &v, errmsg );
+    if ( rc != SQLITE_OK ) return rc;
+
+    if ( v->format.n_extra == 0 ) {
+        sqlite3_declare_vtab( db, access_log_sql );
+    }
+    else if ( ( sql = log_format_schema( &v->format, access_log_sql ) ) == NULL ||
+              sqlite3_declare_vtab( db, sql ) != SQLITE_OK ) {
+        *errmsg = sqlite3_mprintf( "cannot declare the columns of format=" );
+        free( sql );
+        access_log_disconnect( (sqlite3_vtab*)v );
+        return SQLITE_ERROR;
+    }
+    free( sql );
+    *vtab = (sqlite3_vtab*)v;
+    return SQLITE_OK;
+}
+
+static int access_log_disconnect( sqlite3_vtab *vtab )
+{
+    log_set_free( ((access_log_vtab*)vtab)->files );
+    free( ((access_log_vtab*)vtab)->cache_dir );
+    log_follow_free( ((access_log_vtab*)vtab)->follow );
+    log_stats_table_free( ((access_log_vtab*)vtab)->stats );
+    free( ((access_log_vtab*)vtab)->cache_kind );
+    sqlite3_free( vtab );
+    return SQLITE_OK;
+}
+
+/*
+Find a lower and an upper bound constraint on column col, usable ones
+only. An equality constraint is both.
+ */
+static void access_log_range( sqlite3_index_info *info, int col, int *lo, int *hi )
+{
+    int   i;
+
+    *lo = *hi = -1;
+    for ( i = 0; i < info->nConstraint; i++ ) {
+        const struct sqlite3_index_constraint *con = &info->aConstraint[i];
+
+        if ( !con->usable || con->iColumn != col ) continue;
+        switch ( con->op ) {
+        case SQLITE_INDEX_CONSTRAINT_EQ:
+            if ( *lo < 0 ) *lo = i;
+            if ( *hi < 0 ) *hi = i;
+            break;
+        case SQLITE_INDEX_CONSTRAINT_GT:
+        case SQLITE_INDEX_CONSTRAINT_GE:
+            if ( *lo < 0 ) *lo = i;
+            break;
+        case SQLITE_INDEX_CONSTRAINT_LT:
+        case SQLITE_INDEX_CONSTRAINT_LE:
+            if ( *hi < 0 ) *hi = i;
+            break;
+        }
+    }
+}
+
+/*
+Whether constraint i compares as filter does, text by its bytes: under
+a collation other than BINARY, such as NOCASE or RTRIM, other text is
+equal too, and the constraint is left to SQLite. LIKE and GLOB have no
+collation.
+ */
+static int access_log_binary( sqlite3_index_info *info, int i )
+{
+    const char  *coll;
+
+    if ( info->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_LIKE ||
+         info->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_GLOB ) {
+        return 1;
+    }
+    coll = sqlite3_vtab_collation( info, i );
+    return coll == NULL || sqlite3_stricmp( coll, "BINARY" ) == 0;
+}
+
+/*
+Whether a constraint is checked on each line by filter: comparisons,
+LIKE and GLOB on the columns that are text straight from the line,
+comparisons on status and remote_host_int, and ip_in_cidr() on the
+remote host in any of its forms.
+ */
+static int access_log_pushable( int col, int op )
+{
+    if ( op == LOG_IP_IN_CIDR ) {
+        return col == COL_REMOTE_HOST || col == COL_REMOTE_HOST_INT || col == COL_REMOTE_HOST_IP;
+    }
+    switch ( op ) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+    case SQLITE_INDEX_CONSTRAINT_GT:
+    case SQLITE_INDEX_CONSTRAINT_GE:
+    case SQLITE_INDEX_CONSTRAINT_LT:
+    case SQLITE_INDEX_CONSTRAINT_LE:
+    case SQLITE_INDEX_CONSTRAINT_LIKE:
+    case SQLITE_INDEX_CONSTRAINT_GLOB:
+        break;
+    default:
+        return 0;
+    }
+    switch ( col ) {
+    case COL_REMOTE_HOST:
+    case COL_REQUEST:
+    case COL_METHOD:
+    case COL_URL:
+        return 1;
+    case COL_STATUS:
+    case COL_REMOTE_HOST_INT:
+        return op != SQLITE_INDEX_CONSTRAINT_LIKE && op != SQLITE_INDEX_CONSTRAINT_GLOB;
+    }
+    return 0;
+}
+
+/*
+Pass the columns the query uses to filter in idxStr, "cols=HEX", then
+the pushable constraints as "column op argument" triples, but those
+under another collation than BINARY. Those that already have an
+argument, for zone maps or the inverted index, keep it.
+ */
+static void access_log_pushdown( sqlite3_index_info *info, int *argc )
+{
+    char  *str = sqlite3_mprintf( "cols=%llx ", (unsigned long long)info->colUsed );
+    int   i, n = 0;
+
+    if ( str == NULL ) return;
+
+    for ( i = 0; i < info->nConstraint && n < PRED_MAX; i++ ) {
+        const struct sqlite3_index_constraint *con = &info->aConstraint[i];
+
+        if ( !con->usable || !access_log_pushable( con->iColumn, con->op ) ||
+             !access_log_binary( info, i ) ) {
+            continue;
+        }
+        if ( info->aConstraintUsage[i].argvIndex == 0 ) {
+            info->aConstraintUsage[i].argvIndex = ++*argc;
+        }
+        str = sqlite3_mprintf( "%z%d %d %d ", str, con->iColumn, con->op,
+                               info->aConstraintUsage[i].argvIndex );
+        if ( str == NULL ) return;
+        n++;
+    }
+    info->idxStr = str;
+    info->needToFreeIdxStr = 1;
+}
+
+/*
+Accept time_epoch and rowid range constraints. For each, at most one
+lower and one upper bound are passed to filter, lower bound first; an
+equality constraint is passed once and used as both. Equality on
+source_file or vhost is passed next, to skip whole files. Constraints
+on status, remote_host, remote_host_int and method come after those,
+for zone maps to skip blocks of lines with (see logzone.h). With
+lookup=on equality on those, and on url, reads only the lines the
+inverted index lists (see logpost.h) and is costed that way; SQLite
+calls filter once for each value of an IN list. Comparisons, LIKE and
+GLOB on status, remote_host, request, method and url, comparisons on
+remote_host_int and ip_in_cidr() on the remote host are checked on
+each line before it is returned, see access_log_pushdown(). None of
+them is taken under another collation than BINARY, see
+access_log_binary().
+
+Neither is omitted: bounds are treated as inclusive and SQLite still
+checks every row, so filter only has to avoid skipping rows that
+could match.
+ */
+static int access_log_bestindex( sqlite3_vtab *vtab, sqlite3_index_info *info )
+{
+    access_log_vtab  *v = (access_log_vtab*)vtab;
+    int              lo, hi, argc = 0;
+
+    info->idxNum = 0;
+    info->estimatedCost = 1000000;
+
+    access_log_range( info, COL_TIME_EPOCH, &lo, &hi );
+    if ( lo >= 0 ) {
+        info->idxNum |= IDX_TIME_LO;
+        info->aConstraintUsage[lo].argvIndex = ++argc;
+        info->estimatedCost /= 10;
+    }
+    if ( hi >= 0 ) {
+        info->idxNum |= ( hi == lo ? IDX_TIME_HI | IDX_TIME_EQ : IDX_TIME_HI );
+        if ( hi != lo ) info->aConstraintUsage[hi].argvIndex = ++argc;
+        info->estimatedCost /= 10;
+    }
+
+    access_log_range( info, -1, &lo, &hi );
+    if ( lo >= 0 ) {
+        info->idxNum |= IDX_ROWID_LO;
+        info->aConstraintUsage[lo].argvIndex = ++argc;
+        info->estimatedCost /= 10;
+    }
+    if ( hi >= 0 ) {
+        info->idxNum |= ( hi == lo ? IDX_ROWID_HI | IDX_ROWID_EQ : IDX_ROWID_HI );
+        if ( hi != lo ) info->aConstraintUsage[hi].argvIndex = ++argc;
+        info->estimatedCost /= ( hi == lo ? 1000 : 10 );
+    }
+
+    /* whole files can be skipped for source_file and vhost */
+    access_log_range( info, COL_SOURCE_FILE, &lo, &hi );
+    if ( lo >= 0 && lo == hi && access_log_binary( info, lo ) ) {
+        info->idxNum |= IDX_SOURCE_FILE;
+        info->aConstraintUsage[lo].argvIndex = ++argc;
+        info->estimatedCost /= 10;
+    }
+    access_log_range( info, COL_VHOST, &lo, &hi );
+    if ( lo >= 0 && lo == hi && access_log_binary( info, lo ) ) {
+        info->idxNum |= IDX_VHOST;
+        info->aConstraintUsage[lo].argvIndex = ++argc;
+        info->estimatedCost /= 10;
+    }
+
+    /* blocks of lines can be skipped for these, with a zone map */
+    access_log_range( info, COL_STATUS, &lo, &hi );
+    if ( lo >= 0 && !access_log_binary( info, lo ) ) lo = -1;
+    if ( hi >= 0 && !access_log_binary( info, hi ) ) hi = -1;
+    if ( lo >= 0 ) {
+        info->idxNum |= IDX_STATUS_LO;
+        info->aConstraintUsage[lo].argvIndex = ++argc;
+        info->estimatedCost /= 2;
+    }
+    if ( hi >= 0 ) {
+        info->idxNum |= ( hi == lo ? IDX_STATUS_HI | IDX_STATUS_EQ : IDX_STATUS_HI );
+        if ( hi != lo ) info->aConstraintUsage[hi].argvIndex = ++argc;
+        info->estimatedCost /= ( v->lookup && hi == lo ? 100 : 2 );
+    }
+    access_log_range( info, COL_REMOTE_HOST, &lo, &hi );
+    if ( lo >= 0 && lo == hi && access_log_binary( info, lo ) ) {
+        info->idxNum |= IDX_HOST;
+        info->aConstraintUsage[lo].argvIndex = ++argc;
+        info->estimatedCost /= ( v->lookup ? 1000 : 10 );
+    }
+    access_log_range( info, COL_REMOTE_HOST_INT, &lo, &hi );
+    if ( lo >= 0 && lo == hi ) {
+        info->idxNum |= IDX_HOST_INT;
+        info->aConstraintUsage[lo].argvIndex = ++argc;
+        info->estimatedCost /= ( v->lookup ? 1000 : 10 );
+    }
+    access_log_range( info, COL_METHOD, &lo, &hi );
+    if ( lo >= 0 && lo == hi && access_log_binary( info, lo ) ) {
+        info->idxNum |= IDX_METHOD;
+        info->aConstraintUsage[lo].argvIndex = ++argc;
+        info->estimatedCost /= ( v->lookup ? 10 : 2 );
+    }
+    access_log_range( info, COL_URL, &lo, &hi );
+    if ( v->lookup && lo >= 0 && lo == hi && access_log_binary( info, lo ) ) {
+        info->idxNum |= IDX_URL;
+        info->aConstraintUsage[lo].argvIndex = ++argc;
+        info->estimatedCost /= 1000;
+    }
+
+    /* a sample_rate for this query instead of sample= */
+    access_log_range( info, COL_SAMPLE_RATE, &lo, &hi );
+    if ( lo >= 0 && lo == hi ) {
+        info->idxNum |= IDX_SAMPLE;
+        info->aConstraintUsage[lo].argvIndex = ++argc;
+        info->aConstraintUsage[lo].omit = 1;
+    }
+
+    access_log_pushdown( info, &argc );
+    log_stats_bestindex( v->stats, info );
+    return SQLITE_OK;
+}
+
+static int access_log_open( sqlite3_vtab *vtab, sqlite3_vtab_cursor **cur )
+{
+    access_log_vtab     *v = (access_log_vtab*)vtab;
+    access_log_cursor   *c;
+
+    *cur = NULL;
+
+    c = sqlite3_malloc( sizeof( access_log_cursor ) );
+    if ( c == NULL ) return SQLITE_NOMEM;
+    memset( c, 0, sizeof( access_log_cursor ) );
+
+    c->reader_file = -1;
+    c->eof = 1;
+    log_time_init( &c->time_cache );
+    c->timing = v->timing;
+    c->format = &v->format;
+    c->n_cols = v->n_cols;
+    c->cols = COLS_ALL;
+    c->scan_ops = c->format->n_ops;
+    log_stats_open( v->stats, &c->stats );
+    *cur = (sqlite3_vtab_cursor*)c;
+    return SQLITE_OK;
+}
+
+/* Close a reader, adding what it read to the cursor's counts. */
+static void access_log_close_reader( access_log_cursor *c, log_reader *r )
+{
+    log_stats_reader( &c->stats, r );
+    log_reader_close( r );
+}
+
+static int access_log_close( sqlite3_vtab_cursor *cur )
+{
+    access_log_cursor    *c = (access_log_cursor*)cur;
+    int                  i;
+
+    if ( c->reader != NULL ) {
+        access_log_close_reader( c, c->reader );
+    }
+    for ( i = 0; i < c->n_ahead; i++ ) {
+        access_log_close_reader( c, c->ahead[i] );
+    }
+    log_cache_close( c->cache );
+    if ( c->follow_end != NULL ) {
+        log_follow_save( ((access_log_vtab*)cur->pVtab)->follow, c->follow_end,
+                         ((access_log_vtab*)cur->pVtab)->files->n );
+    }
+    sqlite3_free( c->follow_start );
+    sqlite3_free( c->follow_end );
+    log_zone_free( c->zone_build );
+    free( c->post_rows );
+    free( c->post_offs );
+    log_post_free( c->post_build );
+    access_log_pred_clear( c );
+    sqlite3_free( c->source_file );
+    sqlite3_free( c->vhost );
+    log_stats_close( ((access_log_vtab*)cur->pVtab)->stats, &c->stats );
+    sqlite3_free( cur );
+    return SQLITE_OK;
+}
+
+/*
+Convert a time_epoch constraint value to an inclusive integer bound.
+Returns 0 if the value is not numeric, in which case SQLite's own
+comparison decides and no bound is applied.
+ */
+static int access_log_bound( sqlite3_value *value, int upper, sqlite_int64 *bound )
+{
+    double d;
+
+    switch ( sqlite3_value_numeric_type( value ) ) {
+    case SQLITE_INTEGER:
+        *bound = sqlite3_value_int64( value );
+        return 1;
+    case SQLITE_FLOAT:
+        d = sqlite3_value_double( value );
+        *bound = (sqlite_int64)( upper ? ceil( d ) : floor( d ) );
+        return 1;
+    }
+    return 0;
+}
+
+/*
+Read the first line that starts at or after offset off and that has a
+time stamp. Returns 0 and sets *epoch, or 1 if none was found.
+ */
+static int access_log_probe( access_log_cursor *c, sqlite_int64 off, sqlite_int64 *epoch )
+{
+    int   tries;
+
+    /* back up one byte so a line starting exactly at off is not skipped */
+    if ( off > 0 ) {
+        if ( log_reader_seek( c->reader, off - 1 ) != 0 ) return 1;
+        if ( access_log_read_line( c ) != SQLITE_OK || c->eof ) return 1;
+    }
+    else {
+        log_reader_seek( c->reader, 0 );
+    }
+
+    for ( tries = 0; tries < 16; tries++ ) {
+        if ( access_log_read_line( c ) != SQLITE_OK || c->eof ) return 1;
+        *epoch = access_log_epoch( c );
+        if ( *epoch != -1 ) return 0;
+    }
+    return 1;
+}
+
+/*
+Position the file near the first line with a time_epoch of at least
+target - time_slack. Bisect over byte offsets, probing the first whole
+line after each midpoint, until the window is small enough to scan.
+Midpoints are aligned to index points so that on a gzip file each
+probe only inflates a little; a gzip file without an index is read
+once to build one. Sets c->row to the number of lines skipped.
+ */
+static void access_log_seek_time( access_log_cursor *c, sqlite_int64 target )
+{
+    sqlite_int64     lo = 0, hi, mid;
+    sqlite_int64     epoch;
+
+    c->row = 0;
+    if ( !log_reader_seekable( c->reader ) && log_reader_index( c->reader ) != 0 ) {
+        log_reader_seek( c->reader, 0 );
+        return;
+    }
+
+    target -= c->time_slack;
+    hi = log_reader_size( c->reader );
+    while ( hi - lo > LINESIZE ) {
+        mid = log_reader_align( c->reader, lo + ( hi - lo ) / 2 );
+        if ( mid <= lo ) break;
+        if ( access_log_probe( c, mid, &epoch ) == 0 && epoch < target ) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    c->eof = 0;
+
+    /* start at the first whole line at or after lo */
+    if ( lo > 0 ) {
+        log_reader_seek( c->reader, lo - 1 );
+        access_log_read_line( c );
+        lo = log_reader_tell( c->reader );
+    }
+    c->row = log_reader_lines_before( c->reader, lo );
+    c->eof = 0;
+}
+
+/*
+Record the first and last time stamps of the open file, so later
+queries can skip it without reading it. Only done when that is cheap:
+the head of the file and, if the file can seek, its tail.
+ */
+static void access_log_file_span( access_log_cursor *c, log_file *f )
+{
+    struct stat    st;
+    sqlite_int64   epoch, first = -1, last = -1, tail;
+    int            i;
+
+    if ( !log_reader_seekable( c->reader ) || stat( f->filename, &st ) != 0 ) return;
+
+    log_reader_seek( c->reader, 0 );
+    for ( i = 0; i < 16 && first == -1; i++ ) {
+        if ( access_log_read_line( c ) != SQLITE_OK || c->eof ) break;
+        first = access_log_epoch( c );
+    }
+
+    tail = log_reader_size( c->reader ) - 65536;
+    tail = log_reader_align( c->reader, tail < 0 ? 0 : tail );
+    log_reader_seek( c->reader, tail );
+    if ( tail > 0 ) access_log_read_line( c );         /* partial line */
+    while ( access_log_read_line( c ) == SQLITE_OK && !c->eof ) {
+        epoch = access_log_epoch( c );
+        if ( epoch > last ) last = epoch;
+    }
+    c->eof = 0;
+
+    if ( first == -1 || last == -1 ) return;
+    f->first = first;
+    f->last = last;
+    f->span_size = st.st_size;
+    f->has_span = 1;
+}
+
+/*
+Whether file i can hold matching lines, going by the rowid,
+source_file and vhost constraints, the dates in its name and its
+first and last time stamps if they are known.
+ */
+static int access_log_want_file( access_log_cursor *c, int i )
+{
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+    sqlite_int64     lo = ( c->has_time_lo ? c->time_lo : LOG_TIME_MIN );
+    sqlite_int64     hi = ( c->has_time_hi ? c->time_hi : LOG_TIME_MAX );
+    log_file         *f = &v->files->files[i];
+
+    if ( c->has_row_lo && i < c->row_lo_file ) return 0;
+    if ( c->has_row_hi && i > c->row_hi_file ) return 0;
+    if ( c->source_file != NULL && strcmp( c->source_file, f->filename ) != 0 ) return 0;
+    if ( c->vhost != NULL && ( f->vhost == NULL || strcmp( c->vhost, f->vhost ) != 0 ) ) return 0;
+    if ( c->following && c->follow_start[i].unchanged ) return 0;
+    return log_file_may_contain( f, lo, hi, c->time_slack );
+}
+
+/*
+Hand over the read ahead reader for file i, if there is one, and close
+those of files before it, which the scan has skipped.
+ */
+static log_reader * access_log_take_ahead( access_log_cursor *c, int i )
+{
+    log_reader *r = NULL;
+    int        n = 0, k;
+
+    while ( n < c->n_ahead && c->ahead_file[n] <= i ) {
+        if ( c->ahead_file[n] == i ) r = c->ahead[n];
+        else                         access_log_close_reader( c, c->ahead[n] );
+        n++;
+    }
+    for ( k = n; k < c->n_ahead; k++ ) {
+        c->ahead[k - n] = c->ahead[k];
+        c->ahead_file[k - n] = c->ahead_file[k];
+    }
+    c->n_ahead -= n;
+    return r;
+}
+
+/*
+Start reading the next files of a whole file scan in the background,
+so they are inflated while this one is parsed. A time_epoch range scan
+has to position each file first, which is not worth doing early.
+ */
+static void access_log_read_ahead( access_log_cursor *c )
+{
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+    log_reader       *r;
+    int              i;
+
+    if ( c->has_time_lo || c->has_time_hi ) return;
+
+    i = ( c->n_ahead > 0 ? c->ahead_file[c->n_ahead - 1] : c->file ) + 1;
+    for ( ; i < v->files->n && c->n_ahead < v->threads - 1; i++ ) {
+        if ( c->has_row_hi && i > c->row_hi_file ) break;
+        if ( !access_log_want_file( c, i ) ) continue;
+
+        r = log_file_open( &v->files->files[i], v->index_mode,
+                           v->reader_flags );
+        if ( r == NULL ) continue;
+        log_reader_prefetch( r );
+        c->ahead[c->n_ahead] = r;
+        c->ahead_file[c->n_ahead] = i;
+        c->n_ahead++;
+    }
+}
+
+/*
+Columns cached: all but line, which would make the cache as big as the
+log, and those worked out from other columns or from the file.
+ */
+static int access_log_cacheable( int cidx )
+{
+    return cidx != COL_LINE && cidx != COL_TIME_UTC &&
+           cidx != COL_SOURCE_FILE && cidx != COL_VHOST &&
+           cidx != COL_SAMPLE_RATE && cidx != COL_SAMPLE_SCALE && cidx != COL_REMOTE_HOST_IP;
+}
+
+static void access_log_value( access_log_cursor *c, int cidx, log_value *val );
+
+/*
+Open the cache of file f, writing it first if there is none and the
+query reads the whole file anyway. The log is read from the start and
+every cached column of every line is handed to the writer. Returns 0
+if c->cache is open; if not, for instance because the cache directory
+is not writable, the file is read as usual.
+ */
+static int access_log_use_cache( access_log_cursor *c, log_file *f )
+{
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+    log_cache_writer  *w;
+    log_value         val;
+    int               i, rc;
+
+    c->cache = log_cache_open( v->cache_dir, v->cache_kind, f->filename, v->n_cols );
+    if ( c->cache != NULL ) return 0;
+
+    if ( c->has_time_lo || c->has_time_hi ) return -1;
+    if ( c->has_row_lo && c->file == c->row_lo_file ) return -1;
+    if ( c->has_row_hi && c->file == c->row_hi_file ) return -1;
+
+    if ( c->reader == NULL || c->reader_file != c->file ) {
+        if ( c->reader != NULL ) access_log_close_reader( c, c->reader );
+        c->reader = access_log_take_ahead( c, c->file );
+        if ( c->reader == NULL ) c->reader = log_file_open( f, v->index_mode, v->reader_flags );
+        c->reader_file = c->file;
+        if ( c->reader == NULL ) return -1;
+    }
+    w = log_cache_create( v->cache_dir, v->cache_kind, f->filename, v->n_cols );
+    if ( w == NULL ) return -1;
+
+    log_reader_seek( c->reader, 0 );
+    if ( v->threads > 0 ) {
+        log_reader_prefetch( c->reader );
+        access_log_read_ahead( c );
+    }
+    c->row = 0;
+    while ( ( rc = access_log_read_line( c ) ) == SQLITE_OK && !c->eof ) {
+        c->row++;
+        for ( i = 0; i < v->n_cols && rc == SQLITE_OK; i++ ) {
+            if ( !access_log_cacheable( i ) ) continue;
+            access_log_value( c, i, &val );
+            if ( log_cache_put( w, i, &val ) != 0 ) rc = SQLITE_NOMEM;
+        }
+        if ( rc != SQLITE_OK ) break;
+        log_cache_end_row( w );
+    }
+    c->eof = 0;
+    if ( rc != SQLITE_OK ) {
+        log_cache_abort( w );
+        return -1;
+    }
+    if ( log_cache_finish( w ) != 0 ) return -1;
+
+    c->cache = log_cache_open( v->cache_dir, v->cache_kind, f->filename, v->n_cols );
+    return ( c->cache != NULL ? 0 : -1 );
+}
+
+/*
+Read the current line from the log, for the line column of a cached
+file. The reader follows a sequential scan, and seeks for anything else.
+ */
+static int access_log_cache_line( access_log_cursor *c )
+{
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+
+    if ( c->line_row == c->row ) return 0;
+    if ( c->reader == NULL || c->reader_file != c->file ) {
+        if ( c->reader != NULL ) access_log_close_reader( c, c->reader );
+        c->reader = log_file_open( &v->files->files[c->file], v->index_mode, v->reader_flags );
+        c->reader_file = c->file;
+        c->line_row = -1;
+        if ( c->reader == NULL ) return -1;
+    }
+    if ( c->line_row != c->row - 1 || c->line_row == -1 ) {
+        if ( log_reader_seek_line( c->reader, c->row ) != 0 ) return -1;
+    }
+    if ( access_log_read_line( c ) != SQLITE_OK || c->eof ) {
+        c->eof = 0;
+        c->line_row = -1;
+        return -1;
+    }
+    c->line_row = c->row;
+    return 0;
+}
+
+/*
+Open the next file that can hold matching lines and position it at
+the first candidate line. Returns 1, with eof set, when there are no
+more.
+ */
+static int access_log_next_file( access_log_cursor *c )
+{
+    access_log_vtab  *v = (access_log_vtab*)c->cur.pVtab;
+    sqlite_int64     lo = ( c->has_time_lo ? c->time_lo : LOG_TIME_MIN );
+    sqlite_int64     hi = ( c->has_time_hi ? c->time_hi : LOG_TIME_MAX );
+    log_file         *f;
+
+    for ( c->file++; c->file < v->files->n; c->file++ ) {
+        f = &v->files->files[c->file];
+
+        if ( c->has_row_hi && c->file > c->row_hi_file ) break;
+        if ( !access_log_want_file( c, c->file ) ) continue;
+
+        log_cache_close( c->cache );
+        c->cache = NULL;
+        c->zone = NULL;
+        log_zone_free( c->zone_build );
+        c->zone_build = NULL;
+        free( c->post_rows );
+        free( c->post_offs );
+        c->post_rows = c->post_offs = NULL;
+        c->post_lookup = 0;
+        c->post_from = NULL;
+        log_post_free( c->post_build );
+        c->post_build = NULL;
+        if ( v->cache_dir != NULL && !c->following && !c->use_post && access_log_use_cache( c, f ) == 0 ) {
+            c->row = 0;
+            if ( c->has_row_lo && c->file == c->row_lo_file && c->row_lo > 1 ) {
+                c->row = c->row_lo - 1;
+            }
+            c->line_row = -1;
+            c->eof = 0;
+            access_log_sample_open( c, f );
+            return 0;
+        }
+
+        if ( c->reader == NULL || c->reader_file != c->file ) {
+            if ( c->reader != NULL ) access_log_close_reader( c, c->reader );
+            c->reader = access_log_take_ahead( c, c->file );
+            if ( c->reader == NULL ) c->reader = log_file_open( f, v->index_mode, v->reader_flags );
+            c->reader_file = c->file;
+            if ( c->reader == NULL ) continue;   /* rotated away? */
+        }
+        c->eof = 0;
+
+        if ( c->has_time_lo || c->has_time_hi ) {
+            if ( !f->has_span ) access_log_file_span( c, f );
+            if ( !log_file_may_contain( f, lo, hi, c->time_slack ) ) continue;
+        }
+        access_log_sample_open( c, f );
+        if ( c->use_post && access_log_post_open( c, f ) == 0 ) {
+            c->eof = 0;
+            return 0;
+        }
+
+        c->row = 0;
+        if ( c->has_time_lo ) {
+            access_log_seek_time( c, c->time_lo );
+        }
+        else {
+            log_reader_seek( c->reader, 0 );
+        }
+        if ( c->following && c->follow_start[c->file].off > log_reader_tell( c->reader ) ) {
+            if ( log_reader_seek( c->reader, c->follow_start[c->file].off ) == 0 ) {
+                c->row = c->follow_start[c->file].rows;
+            }
+            else {
+                log_reader_seek( c->reader, 0 );   /* read it all again */
+                c->row = 0;
+            }
+        }
+        if ( c->has_row_lo && c->file == c->row_lo_file && c->row_lo - 1 > c->row ) {
+            if ( log_reader_seek_line( c->reader, c->row_lo ) != 0 ) continue;
+            c->row = c->row_lo - 1;
+        }
+        if ( c->has_zone_query && c->post_build == NULL ) access_log_zone_open( c, f );
+        c->eof = 0;
+
+        if ( v->threads > 0 ) {
+            log_reader_prefetch( c->reader );
+            access_log_read_ahead( c );
+        }
+        return 0;
+    }
+    c->eof = 1;
+    return 1;
+}
+
+static int access_log_next( sqlite3_vtab_cursor *cur );
+
+static int access_log_filter( sqlite3_vtab_cursor *cur,
+        int idxnum, const char *idxstr,
+        int argc, sqlite3_value **value )
+{
+    access_log_cursor   *c = (access_log_cursor*)cur;
+    access_log_vtab     *v = (access_log_vtab*)cur->pVtab;
+    sqlite_int64         row_lo = 0, row_hi = 0;
+    const char           *p;
+    int                  i = 0, col, op, arg, len;
+    unsigned long long   used;
+
+    log_stats_filter( v->stats, &c->stats, idxnum, idxstr, argc, value );
+
+    c->time_slack = v->time_slack;
+    c->has_time_lo = 0;
+    c->has_time_hi = 0;
+    c->has_row_lo = 0;
+    c->has_row_hi = 0;
+    sqlite3_free( c->source_file );
+    sqlite3_free( c->vhost );
+    c->source_file = NULL;
+    c->vhost = NULL;
+
+    /* an equality constraint is passed once and used as both bounds */
+    if ( idxnum & IDX_TIME_LO ) {
+        c->has_time_lo = access_log_bound( value[i++], 0, &c->time_lo );
+    }
+    if ( idxnum & IDX_TIME_HI ) {
+        if ( idxnum & IDX_TIME_EQ ) i--;
+        c->has_time_hi = access_log_bound( value[i++], 1, &c->time_hi );
+    }
+    if ( idxnum & IDX_ROWID_LO ) {
+        c->has_row_lo = access_log_bound( value[i++], 0, &row_lo ) && row_lo > 0;
+        c->row_lo_file = row_lo >> ROWID_FILE_SHIFT;
+        c->row_lo = row_lo & ROWID_LINE_MASK;
+    }
+    if ( idxnum & IDX_ROWID_HI ) {
+        if ( idxnum & IDX_ROWID_EQ ) i--;
+        c->has_row_hi = access_log_bound( value[i++], 1, &row_hi );
+        if ( c->has_row_hi && row_hi < 1 ) {
+            c->eof = 1;              /* there is no line 0 */
+            return SQLITE_OK;
+        }
+        c->row_hi_file = row_hi >> ROWID_FILE_SHIFT;
+        c->row_hi = row_hi & ROWID_LINE_MASK;
+    }
+    if ( idxnum & IDX_SOURCE_FILE ) {
+        c->source_file = sqlite3_mprintf( "%s", sqlite3_value_text( value[i++] ) );
+    }
+    if ( idxnum & IDX_VHOST ) {
+        c->vhost = sqlite3_mprintf( "%s", sqlite3_value_text( value[i++] ) );
+    }
+
+    /* what a block of lines must be able to hold, see logzone.h */
+    memset( &c->zone_query, 0, sizeof( c->zone_query ) );
+    c->zone_query.time_lo = ( c->has_time_lo ? c->time_lo : LOG_TIME_MIN );
+    c->zone_query.time_hi = ( c->has_time_hi ? c->time_hi : LOG_TIME_MAX );
+    c->zone_query.classes = ~0U;
+    c->zone_keys = 0;
+    c->n_post_keys = 0;
+    if ( idxnum & ( IDX_STATUS_LO | IDX_STATUS_HI ) ) {
+        sqlite_int64  lo = 0, hi = 0;
+        int           has_lo = 0, has_hi = 0;
+
+        if ( idxnum & IDX_STATUS_LO ) has_lo = access_log_bound( value[i++], 0, &lo );
+        if ( idxnum & IDX_STATUS_HI ) {
+            if ( idxnum & IDX_STATUS_EQ ) i--;
+            has_hi = access_log_bound( value[i++], 1, &hi );
+        }
+        if ( has_lo || has_hi ) {
+            c->zone_query.classes = access_log_status_classes( has_lo, lo, has_hi, hi );
+            c->zone_keys = 1;
+        }
+        if ( ( idxnum & IDX_STATUS_EQ ) && has_lo && has_hi && lo == hi ) {
+            c->post_keys[c->n_post_keys++] = log_post_key( COL_STATUS, lo );
+        }
+    }
+    if ( idxnum & IDX_HOST ) {
+        const char    *host = (const char *)sqlite3_value_text( value[i] );
+        int           n = sqlite3_value_bytes( value[i++] );
+        unsigned char ip[16];
+
+        /* lines are keyed by remote_host_int, which only IPv4 hosts have */
+        if ( host != NULL && log_ip_parse( host, n, 0, ip ) != 0 && log_ip_v4( ip ) >= 0 ) {
+            c->zone_query.key[0] = log_ip_v4( ip );
+            c->zone_query.has_key[0] = c->zone_keys = 1;
+            c->post_keys[c->n_post_keys++] = log_post_key( COL_REMOTE_HOST_INT, c->zone_query.key[0] );
+        }
+    }
+    if ( idxnum & IDX_HOST_INT ) {
+        if ( sqlite3_value_numeric_type( value[i] ) == SQLITE_INTEGER ) {
+            c->zone_query.key[0] = sqlite3_value_int64( value[i] );
+            c->zone_query.has_key[0] = c->zone_keys = 1;
+            c->post_keys[c->n_post_keys++] = log_post_key( COL_REMOTE_HOST_INT, c->zone_query.key[0] );
+        }
+        i++;
+    }
+    if ( idxnum & IDX_METHOD ) {
+        const char *method = (const char *)sqlite3_value_text( value[i] );
+        int         n = sqlite3_value_bytes( value[i++] );
+
+        if ( method != NULL ) {
+            c->zone_query.key[1] = log_zone_hash( method, n );
+            c->zone_query.has_key[1] = c->zone_keys = 1;
+            c->post_keys[c->n_post_keys++] = log_post_key( COL_METHOD, c->zone_query.key[1] );
+        }
+    }
+    if ( idxnum & IDX_URL ) {
+        const char *url = (const char *)sqlite3_value_text( value[i] );
+        int         n = sqlite3_value_bytes( value[i++] );
+
+        if ( url != NULL ) {
+            c->post_keys[c->n_post_keys++] = log_post_key( COL_URL, access_log_url_hash( url, n ) );
+        }
+    }
+    c->sample_rate = v->sample;
+    if ( idxnum & IDX_SAMPLE ) {
+        c->sample_rate = sqlite3_value_double( value[i++] );
+        if ( !( c->sample_rate >= LOG_SAMPLE_MIN && c->sample_rate <= 1 ) ) {
+            cur->pVtab->zErrMsg = sqlite3_mprintf( "sample_rate must be from %.6f to 1", LOG_SAMPLE_MIN );
+            return SQLITE_ERROR;
+        }
+    }
+
+    /* the columns lines are split for, and those zone maps, the inverted index or the cache add */
+    p = idxstr;
+    c->cols = COLS_ALL;
+    if ( p != NULL && sscanf( p, "cols=%llx %n", &used, &len ) == 1 ) {
+        c->cols = used;
+        p += len;
+    }
+    if ( c->zone_keys ) c->cols |= COLS_ZONE;
+    if ( c->n_post_keys > 0 ) c->cols |= COLS_POST;
+    if ( v->cache_dir != NULL ) c->cols = COLS_ALL;
+    c->scan_ops = log_format_ops( c->format, access_log_fields( c->cols ) );
+
+    /* constraints checked on each line, "column op argument" triples */
+    access_log_pred_clear( c );
+    for ( ; p != NULL && sscanf( p, "%d %d %d %n", &col, &op, &arg, &len ) == 3; p += len ) {
+        if ( arg >= 1 && arg <= argc ) access_log_pred_add( c, col, op, value[arg - 1] );
+    }
+
+    /* rowid lookups read the lines asked for, wherever a follow= table got to */
+    c->following = ( v->follow != NULL && !c->has_row_lo && !c->has_row_hi );
+    if ( c->following && c->follow_start == NULL ) {
+        c->follow_start = sqlite3_malloc( v->files->n * sizeof( log_follow_pos ) + 1 );
+        c->follow_end = sqlite3_malloc( v->files->n * sizeof( log_follow_pos ) + 1 );
+        if ( c->follow_start == NULL || c->follow_end == NULL ) return SQLITE_NOMEM;
+        memset( c->follow_end, 0, v->files->n * sizeof( log_follow_pos ) );
+        log_follow_find( v->follow, v->files, v->index_mode, v->reader_flags, c->follow_start );
+    }
+    /* a followed log is read from where the last query got to, not by blocks */
+    c->has_zone_query = !c->following && ( c->zone_keys || c->has_time_lo || c->has_time_hi );
+    /* nor sampled */
+    if ( c->following ) c->sample_rate = 0;
+    /* nor from an inverted index; a rowid lookup is cheaper anyway */
+    c->use_post = v->lookup && c->n_post_keys > 0 && !c->following &&
+                  !c->has_row_lo && !c->has_row_hi;
+
+    c->file = -1;
+    c->eof = 0;
+    if ( access_log_next_file( c ) != 0 ) return SQLITE_OK;
+    return access_log_next( cur );
+}
+
+static int access_log_next( sqlite3_vtab_cursor *cur )
+{
+    access_log_cursor  *c = (access_log_cursor*)cur;
+    int64_t     t = ( c->timing ? log_stats_clock() : 0 );
+    int         rc = access_log_get_line( c );
+
+    if ( c->timing ) c->stats.ns_get_line += log_stats_clock() - t;
+    return rc;
+}
+
+static int access_log_eof( sqlite3_vtab_cursor *cur )
+{
+    return ((access_log_cursor*)cur)->eof;
+}
+
+static int access_log_rowid( sqlite3_vtab_cursor *cur, sqlite3_int64 *rowid )
+{
+    access_log_cursor *c = (access_log_cursor*)cur;
+
+    *rowid = ( (sqlite_int64)c->file << ROWID_FILE_SHIFT ) | c->row;
+    return SQLITE_OK;
+}
+
+/*
+The value of column cidx of the current line. Text points into the
+reader's buffer or the cache, valid until the cursor moves.
+ */
+static void access_log_value( access_log_cursor *c, int cidx, log_value *val )
+{
+    log_file       *f = &((access_log_vtab*)c->cur.pVtab)->files->files[c->file];
+    unsigned char  ip[16];
+
+    val->type = LOG_VALUE_NULL;
+    switch( cidx ) {
+    case COL_SOURCE_FILE:
+    case COL_VHOST:
+        val->s = ( cidx == COL_VHOST ? f->vhost : f->filename );
+        if ( val->s != NULL ) {
+            val->type = LOG_VALUE_TEXT;
+            val->n = strlen( val->s );
+        }
+        return;
+    case COL_TIME_UTC:
+        if ( ( val->i = access_log_epoch( c ) ) != -1 ) {
+            val->type = LOG_VALUE_TEXT;
+            val->n = log_time_utc( val->i, val->buf );
+            val->s = val->buf;
+        }
+        return;
+    case COL_REMOTE_HOST_IP:
+        /* from remote_host, which may be cached */
+        access_log_value( c, COL_REMOTE_HOST, val );
+        if ( val->type == LOG_VALUE_TEXT && log_ip_parse( val->s, val->n, 0, ip ) != 0 ) {
+            memcpy( val->buf, ip, 16 );
+            val->type = LOG_VALUE_BLOB;
+            val->s = val->buf;
+            val->n = 16;
+        }
+        else {
+            val->type = LOG_VALUE_NULL;
+        }
+        return;
+    }
+
+    if ( c->cache != NULL ) {
+        if ( log_cache_has( c->cache, cidx ) ) {
+            log_cache_get( c->cache, cidx, c->row - 1, val );
+            return;
+        }
+        if ( access_log_cache_line( c ) != 0 ) return;
+    }
+
+    access_log_scan( c, cidx );           /* scan line, if required */
+    if ( c->line_size[cidx] < 0 ) {   /* field not scanned and set */
+        return;
+    }
+
+    switch( cidx ) {
+    case 10:   /* remote_host_int */
+        if ( log_ip_parse( c->line_ptrs[cidx], c->line_size[cidx], 0, ip ) != 0 && ( val->i = log_ip_v4( ip ) ) >= 0 ) {
+            val->type = LOG_VALUE_INT;
+        }
+        return;
+    case 13: {
+        int m = log_time_month( c->line_ptrs[cidx] );
+        if ( m == 0 ) break;    /* give up, return text */
+        val->type = LOG_VALUE_INT;
+        val->i = m;
+        return;
+    }
+    case 5:    /* result code */
+    case 6:    /* bytes transfered */
+    case 11:   /* day-of-month */
+    case 14:   /* year */
+    case 15:   /* hour */
+    case 16:   /* minute */
+    case 17:   /* second */
+        val->type = LOG_VALUE_INT;
+        val->i = access_log_atoi( c->line_ptrs[cidx], c->line + c->line_len - c->line_ptrs[cidx] );
+        return;
+    case 18:   /* time_epoch */
+        val->type = LOG_VALUE_INT;
+        val->i = access_log_epoch( c );
+        return;
+    case COL_TIME_EPOCH_MS:
+        if ( ( val->i = access_log_epoch( c ) ) != -1 ) {
+            val->type = LOG_VALUE_INT;
+            val->i = val->i * 1000 + c->line_msec;
+        }
+        return;
+    default:
+        if ( cidx >= TABLE_COLS && c->format->extra[cidx - TABLE_COLS].integer ) {
+            val->type = LOG_VALUE_INT;        /* a format= column, "-" is 0 as for bytes */
+            val->i = access_log_atoi( c->line_ptrs[cidx], c->line_size[cidx] );
+            return;
+        }
+        break;
+    }
+    val->type = LOG_VALUE_TEXT;
+    val->s = c->line_ptrs[cidx];
+    val->n = c->line_size[cidx];
+}
+
+static int access_log_column( sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int cidx )
+{
+    access_log_cursor  *c = (access_log_cursor*)cur;
+    int64_t     t = ( c->timing ? log_stats_clock() : 0 );
+    log_value   val;
+
+    if ( cidx < LOG_STATS_COLS ) c->stats.columns[cidx]++;
+    if ( cidx == COL_SAMPLE_RATE ) {
+        sqlite3_result_double( ctx, c->sample_rate > 0 ? c->sample_rate : 1 );
+        return SQLITE_OK;
+    }
+    if ( cidx == COL_SAMPLE_SCALE ) {
+        sqlite3_result_double( ctx, c->sample.rate > 0 ? c->sample.scale : 1 );
+        return SQLITE_OK;
+    }
+    access_log_value( c, cidx, &val );
+    switch ( val.type ) {
+    case LOG_VALUE_INT:
+        sqlite3_result_int64( ctx, val.i );
+        break;
+    case LOG_VALUE_TEXT:
+        /*
+        Copied: the line lies in the reader's buffer, which is refilled,
+        or in a mapping, which is remapped as the log grows and unmapped
+        at the next file, while SQLite may still hold the value, as
+        max() and min() do.
+        */
+        sqlite3_result_text( ctx, val.s, val.n, SQLITE_TRANSIENT );
+        break;
+    case LOG_VALUE_BLOB:
+        sqlite3_result_blob( ctx, val.s, val.n, SQLITE_TRANSIENT );
+        break;
+    default:
+        sqlite3_result_null( ctx );
+    }
+    if ( c->timing ) c->stats.ns_column += log_stats_clock() - t;
+    return SQLITE_OK;
+}
+
+static int access_log_rename( sqlite3_vtab *vtab, const char *newname )
+{
+    return SQLITE_OK;
+}
+
+/* ip_in_cidr() on a column is a constraint for bestindex, see logip.h */
+static int access_log_findfunction( sqlite3_vtab *vtab, int argc, const char *name,
+                                    void (**func)( sqlite3_context *, int, sqlite3_value ** ), void **arg )
+{
+    return log_ip_find_function( 0, argc, name, func, arg );
+}
+
+
+static sqlite3_module access_log_mod = {
+    1,                       /* iVersion        */
+    access_log_connect,      /* xCreate()       */
+    access_log_connect,      /* xConnect()      */
+    access_log_bestindex,    /* xBestIndex()    */
+    access_log_disconnect,   /* xDisconnect()   */
+    access_log_disconnect,   /* xDestroy()      */
+    access_log_open,         /* xOpen()         */
+    access_log_close,        /* xClose()        */
+    access_log_filter,       /* xFilter()       */
+    access_log_next,         /* xNext()         */
+    access_log_eof,          /* xEof()          */
+    access_log_column,       /* xColumn()       */
+    access_log_rowid,        /* xRowid()        */
+    NULL,                    /* xUpdate()       */
+    NULL,                    /* xBegin()        */
+    NULL,                    /* xSync()         */
+    NULL,                    /* xCommit()       */
+    NULL,                    /* xRollback()     */
+    access_log_findfunction, /* xFindFunction() */
+    access_log_rename        /* xRename()       */
+};
+
+/*
+The access_log_rollup module: rows of a log rolled up by minute, hour
+or day, and by remote_host or url path with by=minute,url and so on.
+It takes the arguments access_log does, see logrollup.h.
+    create virtual table access_log_rollup_minute using access_log_rollup(
+        '/var/log/httpd/access_log', by=minute);
+ */
+static const char *access_log_rollup_sql =
+"    CREATE TABLE access_log_rollup (    "
+"        time_epoch            INTEGER,        "  /*  0 start of the interval */
+"        %s,                                   "  /*  1 by= key, hidden without */
+"        requests              INTEGER,        "  /*  2 */
+"        bytes                 INTEGER,        "  /*  3 */
+"        status_4xx            INTEGER,        "  /*  4 */
+"        status_5xx            INTEGER,        "  /*  5 */
+"        response_time_count   INTEGER,        "  /*  6 requests with one */
+"        response_time_sum     INTEGER,        "  /*  7 */
+"        response_time_max     INTEGER,        "  /*  8 */
+"        response_time_p50     INTEGER,        "  /*  9 approximate, see logrollup.h */
+"        response_time_p90     INTEGER,        "  /* 10 */
+"        response_time_p99     INTEGER,        "  /* 11 */
+"        time_utc              TEXT HIDDEN     "  /* 12 */
+"     );                                       ";
+
+typedef struct access_log_rollup_vtab_s {
+    access_log_vtab  log;                    /* this must be first, the table rolled up */
+    int            seconds;                  /* by= interval */
+    int            key_col;                  /* by= key column, or -1 */
+    char           name[32];                 /* by=, e.g. "minute-url", of the files */
+    uint64_t       kind;                     /* by= and format=, see logrollup.h */
+    log_rollup     **rollups;                /* of each file, unless index=off */
+} access_log_rollup_vtab;
+
+typedef struct access_log_rollup_cursor_s {
+    sqlite3_vtab_cursor   cur;               /* this must be first */
+    access_log_cursor *scan;                 /* reads the lines not rolled up yet */
+    log_rollup     *sum;                     /* of the files, sorted */
+    sqlite_int64   i;                        /* row of sum */
+} access_log_rollup_cursor;
+
+static int access_log_rollup_disconnect( sqlite3_vtab *vtab )
+{
+    access_log_rollup_vtab  *v = (access_log_rollup_vtab*)vtab;
+    int                     i;
+
+    if ( v->rollups != NULL ) {
+        for ( i = 0; i < v->log.files->n; i++ ) log_rollup_free( v->rollups[i] );
+        free( v->rollups );
+    }
+    return access_log_disconnect( vtab );
+}
+
+static int access_log_rollup_connect( sqlite3 *db, void *udp, int argc,
+        const char *const *argv, sqlite3_vtab **vtab, char **errmsg )
+{
+    access_log_rollup_vtab  *v;
+    const char              **args;
+    char                    *by = NULL, *value, *key, *sql;
+    int                     i, n = 0, seconds, key_col = -1, rc;
+
+    *vtab = NULL;
+    *errmsg = NULL;
+    if ( ( args = malloc( argc * sizeof( char * ) ) ) == NULL ) return SQLITE_NOMEM;
+    for ( i = 0; i < argc; i++ ) {
+        if ( i >= 3 && ( value = access_log_option( argv[i], "by" ) ) != NULL ) {
+            free( by );
+            by = value;
+        }
+        else {
+            args[n++] = argv[i];
+        }
+    }
+
+    /* by=minute, hour or day, then ,remote_host or ,url */
+    if ( by == NULL && ( by = malloc( 7 ) ) != NULL ) strcpy( by, "minute" );
+    if ( by == NULL ) {
+        free( args );
+        return SQLITE_NOMEM;
+    }
+    if ( ( key = strchr( by, ',' ) ) != NULL ) *key++ = '\0';
+    seconds = ( strcmp( by, "minute" ) == 0 ? 60 : strcmp( by, "hour" ) == 0 ? 3600 :
+                strcmp( by, "day" ) == 0 ? 86400 : 0 );
+    if ( key != NULL ) {
+        key_col = ( strcmp( key, "remote_host" ) == 0 ? COL_REMOTE_HOST :
+                    strcmp( key, "url" ) == 0 ? COL_URL : -2 );
+    }
+    if ( seconds == 0 || key_col == -2 ) {
+        *errmsg = sqlite3_mprintf( "by must be minute, hour or day, then ,remote_host or ,url" );
+        free( by );
+        free( args );
+        return SQLITE_ERROR;
+    }
+
+    rc = access_log_new( db, n, args, sizeof( access_log_rollup_vtab ), (access_log_vtab **)&v, errmsg );
+    free( args );
+    if ( rc != SQLITE_OK ) {
+        free( by );
+        return rc;
+    }
+    v->seconds = seconds;
+    v->key_col = key_col;
+    snprintf( v->name, sizeof( v->name ), "%s%s%s", by, key != NULL ? "-" : "", key != NULL ? key : "" );
+    sql = sqlite3_mprintf( "%s %s", v->name, v->log.cache_kind );
+    v->kind = ( sql != NULL ? log_zone_hash( sql, strlen( sql ) ) : 0 );
+    sqlite3_free( sql );
+    v->rollups = calloc( v->log.files->n + 1, sizeof( log_rollup * ) );
+    sql = sqlite3_mprintf( access_log_rollup_sql, key_col == COL_REMOTE_HOST ? "remote_host TEXT" :
+                           key_col == COL_URL ? "url TEXT" : "key TEXT HIDDEN" );
+    free( by );
+    if ( v->rollups == NULL || sql == NULL || sqlite3_declare_vtab( db, sql ) != SQLITE_OK ) {
+        sqlite3_free( sql );
+        access_log_rollup_disconnect( (sqlite3_vtab*)v );
+        return SQLITE_NOMEM;
+    }
+    sqlite3_free( sql );
+    *vtab = (sqlite3_vtab*)v;
+    return SQLITE_OK;
+}
+
+/* The rows are made in filter, whatever the constraints. */
+static int access_log_rollup_bestindex( sqlite3_vtab *vtab, sqlite3_index_info *info )
+{
+    info->estimatedCost = 1000;
+    info->estimatedRows = 1000;
+    return SQLITE_OK;
+}
+
+static int access_log_rollup_open( sqlite3_vtab *vtab, sqlite3_vtab_cursor **cur )
+{
+    access_log_rollup_cursor  *c;
+    sqlite3_vtab_cursor       *scan;
+    int                       rc;
+
+    *cur = NULL;
+    c = sqlite3_malloc( sizeof( access_log_rollup_cursor ) );
+    if ( c == NULL ) return SQLITE_NOMEM;
+    memset( c, 0, sizeof( access_log_rollup_cursor ) );
+    if ( ( rc = access_log_open( vtab, &scan ) ) != SQLITE_OK ) {
+        sqlite3_free( c );
+        return rc;
+    }
+    scan->pVtab = vtab;             /* SQLite only sets it for cursors it opens */
+    c->scan = (access_log_cursor*)scan;
+    *cur = (sqlite3_vtab_cursor*)c;
+    return SQLITE_OK;
+}
+
+static int access_log_rollup_close( sqlite3_vtab_cursor *cur )
+{
+    access_log_rollup_cursor *c = (access_log_rollup_cursor*)cur;
+
+    access_log_close( (sqlite3_vtab_cursor*)c->scan );
+    log_rollup_free( c->sum );
+    sqlite3_free( cur );
+    return SQLITE_OK;
+}
+
+/* Count the scan's current line in r. */
+static int access_log_rollup_line( access_log_rollup_vtab *v, access_log_cursor *a, log_rollup *r )
+{
+    sqlite_int64  epoch = access_log_epoch( a );
+    log_value     status, bytes, response, key;
+    const char    *q;
+    int           has_response;
+
+    if ( epoch == -1 ) return 0;
+    access_log_value( a, COL_STATUS, &status );
+    access_log_value( a, COL_BYTES, &bytes );
+    access_log_value( a, COL_RESPONSE_TIME, &response );
+    has_response = ( response.type == LOG_VALUE_TEXT && response.n > 0 &&
+                     response.s[0] >= '0' && response.s[0] <= '9' );
+    key.type = LOG_VALUE_NULL;
+    if ( v->key_col >= 0 ) access_log_value( a, v->key_col, &key );
+    if ( key.type == LOG_VALUE_TEXT && v->key_col == COL_URL &&
+         ( q = memchr( key.s, '?', key.n ) ) != NULL ) {
+        key.n = q - key.s;             /* the path, as for the inverted index */
+    }
+    return log_rollup_line( r, epoch, key.type == LOG_VALUE_TEXT ? key.s : NULL, key.n,
+                            status.type == LOG_VALUE_INT ? (int)status.i : 0,
+                            bytes.type == LOG_VALUE_INT ? bytes.i : 0, has_response,
+                            has_response ? access_log_atoi( response.s, response.n ) : 0 );
+}
+
+/*
+The rollup of file i: the one kept, or saved next to the log, if it is
+current, else one with the lines logged since it was made added, or
+one made from the whole file. NULL if the file cannot be read.
+ */
+static log_rollup * access_log_rollup_file( access_log_rollup_cursor *c, int i )
+{
+    access_log_rollup_vtab  *v = (access_log_rollup_vtab*)c->cur.pVtab;
+    access_log_cursor       *a = c->scan;
+    log_file                *f = &v->log.files->files[i];
+    log_rollup              *from = v->rollups[i], *r;
+    int                     state = LOG_ROLLUP_STALE;
+
+    if ( from == NULL && v->log.index_mode == LOG_INDEX_FILE ) {
+        from = v->rollups[i] = log_rollup_load( f->filename, v->name, v->kind );
+    }
+    if ( from != NULL ) state = log_rollup_state( from, f->filename );
+    if ( state == LOG_ROLLUP_CURRENT ) return from;
+    r = ( state == LOG_ROLLUP_GROWN ? log_rollup_grow( from ) : log_rollup_new( v->kind, v->seconds ) );
+    if ( r == NULL ) return NULL;
+
+    if ( a->reader != NULL ) access_log_close_reader( a, a->reader );
+    a->reader = log_file_open( f, v->log.index_mode, v->log.reader_flags );
+    a->file = a->reader_file = i;
+    if ( a->reader == NULL || log_reader_seek( a->reader, r->end_off ) != 0 ) {
+        log_rollup_free( r );
+        return NULL;
+    }
+    if ( v->log.threads > 0 ) log_reader_prefetch( a->reader );
+    a->row = r->rows;
+    a->eof = 0;
+    while ( 1 ) {
+        if ( access_log_read_line( a ) != SQLITE_OK ) {
+            log_rollup_free( r );
+            return NULL;
+        }
+        if ( a->eof ) break;
+        /* a last line still being written is counted once it is whole */
+        if ( a->line_partial > 0 && !log_reader_compressed( a->reader ) ) break;
+        a->row++;
+        a->stats.lines++;
+        a->stats.rows++;                /* none skipped, each is counted */
+        if ( access_log_rollup_line( v, a, r ) != 0 ) {
+            log_rollup_free( r );
+            return NULL;
+        }
+        r->rows = a->row;
+        r->end_off = log_reader_tell( a->reader );
+    }
+    if ( log_rollup_finish( r, f->filename, a->reader ) != 0 ) {
+        log_rollup_free( r );
+        return NULL;
+    }
+    if ( v->log.index_mode != LOG_INDEX_OFF ) {
+        log_rollup_free( v->rollups[i] );
+        v->rollups[i] = r;
+        if ( v->log.index_mode == LOG_INDEX_FILE ) log_rollup_save( r, f->filename, v->name );
+    }
+    return r;
+}
+
+static int access_log_rollup_filter( sqlite3_vtab_cursor *cur, int idxnum, const char *idxstr,
+        int argc, sqlite3_value **value )
+{
+    access_log_rollup_cursor  *c = (access_log_rollup_cursor*)cur;
+    access_log_rollup_vtab    *v = (access_log_rollup_vtab*)cur->pVtab;
+    log_rollup                *r;
+    int                       i, rc = SQLITE_OK;
+
+    log_stats_filter( v->log.stats, &c->scan->stats, idxnum, idxstr, argc, value );
+    log_rollup_free( c->sum );
+    c->i = 0;
+    if ( ( c->sum = log_rollup_new( v->kind, v->seconds ) ) == NULL ) return SQLITE_NOMEM;
+    for ( i = 0; i < v->log.files->n && rc == SQLITE_OK; i++ ) {
+        if ( ( r = access_log_rollup_file( c, i ) ) == NULL ) continue;   /* rotated away? */
+        if ( log_rollup_merge( c->sum, r ) != 0 ) rc = SQLITE_NOMEM;
+        if ( r != v->rollups[i] ) log_rollup_free( r );
+    }
+    log_rollup_sort( c->sum );
+    return rc;
+}
+
+static int access_log_rollup_next( sqlite3_vtab_cursor *cur )
+{
+    ((access_log_rollup_cursor*)cur)->i++;
+    return SQLITE_OK;
+}
+
+static int access_log_rollup_eof( sqlite3_vtab_cursor *cur )
+{
+    access_log_rollup_cursor *c = (access_log_rollup_cursor*)cur;
+
+    return ( c->sum == NULL || c->i >= c->sum->n );
+}
+
+static int access_log_rollup_rowid( sqlite3_vtab_cursor *cur, sqlite3_int64 *rowid )
+{
+    *rowid = ((access_log_rollup_cursor*)cur)->i + 1;
+    return SQLITE_OK;
+}
+
+static int access_log_rollup_column( sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int cidx )
+{
+    access_log_rollup_cursor  *c = (access_log_rollup_cursor*)cur;
+    const log_rollup_row      *row = &c->sum->row[c->i];
+    static const double       p[3] = { 0.5, 0.9, 0.99 };
+    char                      buf[32];
+
+    switch ( cidx ) {
+    case 0:  sqlite3_result_int64( ctx, row->time ); break;
+    case 1:
+        if ( row->key != NULL ) sqlite3_result_text( ctx, row->key, row->key_len, SQLITE_TRANSIENT );
+        break;
+    case 2:  sqlite3_result_int64( ctx, row->requests ); break;
+    case 3:  sqlite3_result_int64( ctx, row->bytes ); break;
+    case 4:  sqlite3_result_int64( ctx, row->status_4xx ); break;
+    case 5:  sqlite3_result_int64( ctx, row->status_5xx ); break;
+    case 6:  sqlite3_result_int64( ctx, row->response_n ); break;
+    case 7:
+    case 8:
+        if ( row->response_n > 0 ) {
+            sqlite3_result_int64( ctx, cidx == 7 ? row->response_sum : row->response_max );
+        }
+        break;
+    case 9:
+    case 10:
+    case 11:
+        if ( row->response_n > 0 ) sqlite3_result_int64( ctx, log_rollup_percentile( row, p[cidx - 9] ) );
+        break;
+    case 12:
+        sqlite3_result_text( ctx, buf, log_time_utc( row->time, buf ), SQLITE_TRANSIENT );
+        break;
+    }
+    return SQLITE_OK;
+}
+
+static sqlite3_module access_log_rollup_mod = {
+    1,                            /* iVersion        */
+    access_log_rollup_connect,    /* xCreate()       */
+    access_log_rollup_connect,    /* xConnect()      */
+    access_log_rollup_bestindex,  /* xBestIndex()    */
+    access_log_rollup_disconnect, /* xDisconnect()   */
+    access_log_rollup_disconnect, /* xDestroy()      */
+    access_log_rollup_open,       /* xOpen()         */
+    access_log_rollup_close,      /* xClose()        */
+    access_log_rollup_filter,     /* xFilter()       */
+    access_log_rollup_next,       /* xNext()         */
+    access_log_rollup_eof,        /* xEof()          */
+    access_log_rollup_column,     /* xColumn()       */
+    access_log_rollup_rowid,      /* xRowid()        */
+    NULL,                         /* xUpdate()       */
+    NULL,                         /* xBegin()        */
+    NULL,                         /* xSync()         */
+    NULL,                         /* xCommit()       */
+    NULL,                         /* xRollback()     */
+    NULL,                         /* xFindFunction() */
+    access_log_rename             /* xRename()       */
+};
+
+int sqlite3_extension_init( sqlite3 *db, char **error, const sqlite3_api_routines *api )
+{
+    int rc;
+
+    SQLITE_EXTENSION_INIT2(api);
+    rc = sqlite3_create_module( db, "access_log", &access_log_mod, NULL );
+    if ( rc == SQLITE_OK ) rc = sqlite3_create_module( db, "access_log_rollup", &access_log_rollup_mod, NULL );
+    if ( rc == SQLITE_OK ) rc = log_stats_init( db );
+    if ( rc == SQLITE_OK ) rc = log_correlate_init( db );
+    if ( rc == SQLITE_OK ) rc = log_approx_init( db );
+    if ( rc == SQLITE_OK ) rc = log_ip_init( db );
+    return rc;
 }
@@ -0,0 +1,168 @@
+#!/bin/bash
+#
+# Benchmarks: generate logs, time a fixed set of queries over them and
+# report throughput.
+#
+#   bench/bench.sh [SIZE ...]
+#
+# For each SIZE (default 100M; K, M and G suffixes) an access log of that
+# size and its error log are generated once into BENCH_DIR, plain and
+# gzipped. Every query is run BENCH_RUNS times over each and the fastest
+# run reported, with its lines/s and MB/s (of uncompressed log) and the
+# peak RSS of sqlite3. The results are also written, tab separated, to
+# BENCH_OUT; pass an earlier one as BENCH_BASELINE to compare with it.
+#
+# Environment:
+#   BENCH_DIR       generated logs              (bench/data)
+#   BENCH_OUT       results                     (bench_output.txt)
+#   BENCH_BASELINE  results to compare with     (none)
+#   BENCH_RUNS      runs of each query          (3)
+#   BENCH_FORMATS   log formats                 (plain gzip)
+#   BENCH_QUERIES   queries to run              (all, see below)
+#   BENCH_ARGS      table arguments             ('index=memory')
+
+set -e
+
+BENCHDIR=$( readlink -f -- "$( dirname -- "$0" )" )
+SRCDIR="$BENCHDIR/.."
+
+DATADIR="${BENCH_DIR:-$BENCHDIR/data}"
+OUT="${BENCH_OUT:-$SRCDIR/bench_output.txt}"
+RUNS="${BENCH_RUNS:-3}"
+FORMATS="${BENCH_FORMATS:-plain gzip}"
+QUERIES="${BENCH_QUERIES:-count slice host group_url join}"
+ARGS="${BENCH_ARGS-'index=memory'}"
+SIZES="${*:-100M}"
+
+LOGGEN="$BENCHDIR/loggen"
+RUNSTAT="$BENCHDIR/runstat"
+
+# loggen's error log time stamps are in this zone, see loggen.c
+export TZ='<-04>4'
+START_EPOCH=1414814400
+
+function error() {
+  echo "bench: $*" >&2
+  exit 1
+}
+
+for f in "$LOGGEN" "$RUNSTAT" "$SRCDIR/access_log.so" "$SRCDIR/error_log.so"; do
+  [[ -x "$f" || -f "$f" ]] || error "$f not found, run 'make bench'"
+done
+command -v sqlite3 > /dev/null || error "sqlite3 not found"
+
+mkdir -p "$DATADIR"
+TMP="$( mktemp -d )"
+trap 'rm -rf "$TMP"' EXIT
+
+COMMIT="$( git -C "$SRCDIR" rev-parse --short HEAD 2> /dev/null || echo - )"
+git -C "$SRCDIR" diff --quiet HEAD 2> /dev/null || COMMIT="$COMMIT+"
+
+# query NAME: the SQL of a benchmark query, using $HOST, $LO and $HI
+function query() {
+  case "$1" in
+    count)     echo "SELECT count(*) FROM access_log;" ;;
+    slice)     echo "SELECT count(*), sum(bytes) FROM access_log WHERE time_epoch BETWEEN $LO AND $HI;" ;;
+    host)      echo "SELECT count(*) FROM access_log WHERE remote_host = '$HOST';" ;;
+    group_url) echo "SELECT url, count(*) FROM access_log GROUP BY url ORDER BY 2 DESC LIMIT 10;" ;;
+    join)      echo "SELECT a.remote_host, a.status, e.message, a.url
+                     FROM access_log a, error_log e
+                     WHERE a.time_epoch = e.time_epoch AND a.status != 200;" ;;
+    *)         error "unknown query $1" ;;
+  esac
+}
+
+printf '%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n' \
+  commit size format query lines bytes seconds lines_per_s mb_per_s peak_rss_kb > "$OUT"
+
+printf '%-6s %-6s %-10s %10s %14s %10s %12s\n' size format query seconds lines/s MB/s "peak RSS KB"
+
+for SIZE in $SIZES; do
+  ACCESS="$DATADIR/access_log-$SIZE"
+  ERRORS="$DATADIR/error_log-$SIZE"
+
+  if [[ ! -s "$ACCESS" || ! -s "$ERRORS" ]]; then
+    echo "generating $SIZE of logs in $DATADIR" >&2
+    "$LOGGEN" "$SIZE" "$ACCESS" "$ERRORS" || error "cannot generate $SIZE of logs"
+    rm -f "$ACCESS.gz" "$ERRORS.gz"
+  fi
+  for f in "$ACCESS" "$ERRORS"; do
+    [[ -s "$f.gz" ]] || gzip -c < "$f" > "$f.gz"
+  done
+
+  ACCESS_LINES=$( wc -l < "$ACCESS" )
+  ERROR_LINES=$( wc -l < "$ERRORS" )
+  ACCESS_BYTES=$( stat -c %s "$ACCESS" )
+  ERROR_BYTES=$( stat -c %s "$ERRORS" )
+
+  # a tenth of the log's time from its middle, and its first client
+  SPAN=$(( ACCESS_LINES * 195 / 10000 ))
+  LO=$(( START_EPOCH + SPAN * 45 / 100 ))
+  HI=$(( LO + SPAN / 10 ))
+  HOST="$( head -n 1 "$ACCESS" | cut -d ' ' -f 1 )"
+
+  for FORMAT in $FORMATS; do
+    case "$FORMAT" in
+      plain) EXT= ;;
+      gzip)  EXT=.gz ;;
+      *)     error "unknown format $FORMAT" ;;
+    esac
+
+    for Q in $QUERIES; do
+      LINES=$ACCESS_LINES
+      BYTES=$ACCESS_BYTES
+      if [[ $Q == join ]]; then
+        LINES=$(( ACCESS_LINES + ERROR_LINES ))
+        BYTES=$(( ACCESS_BYTES + ERROR_BYTES ))
+      fi
+
+      cat > "$TMP/sql" <<EOF
+.load $SRCDIR/access_log.so
+.load $SRCDIR/error_log.so
+create virtual table access_log using access_log('$ACCESS$EXT'${ARGS:+, $ARGS});
+create virtual table error_log using error_log('$ERRORS$EXT'${ARGS:+, $ARGS});
+$( query "$Q" )
+EOF
+
+      BEST=
+      for (( run = 0; run < RUNS; run++ )); do
+        "$RUNSTAT" sqlite3 -batch -bail < "$TMP/sql" > /dev/null 2> "$TMP/err" \
+          || error "$Q on $SIZE $FORMAT failed: $( grep -v '^runstat ' "$TMP/err" )"
+        read -r _ ELAPSED RSS < <( grep '^runstat ' "$TMP/err" )
+        if [[ -z $BEST ]] || awk -v a="$ELAPSED" -v b="$BEST" 'BEGIN { exit !( a < b ) }'; then
+          BEST=$ELAPSED
+        fi
+        [[ -z $PEAK || $RSS -gt $PEAK ]] && PEAK=$RSS
+      done
+
+      awk -v commit="$COMMIT" -v size="$SIZE" -v format="$FORMAT" -v q="$Q" \
+          -v lines="$LINES" -v bytes="$BYTES" -v s="$BEST" -v rss="$PEAK" -v out="$OUT" '
+        BEGIN {
+          t = s > 0 ? s : 0.001
+          printf "%s\t%s\t%s\t%s\t%d\t%d\t%.3f\t%.0f\t%.1f\t%d\n",
+                 commit, size, format, q, lines, bytes, s, lines / t, bytes / t / 1048576, rss >> out
+          printf "%-6s %-6s %-10s %10.3f %14.0f %10.1f %12d\n",
+                 size, format, q, s, lines / t, bytes / t / 1048576, rss
+        }'
+      PEAK=
+    done
+  done
+done
+
+echo "results in $OUT" >&2
+
+# against an earlier run: the change in time of each query both ran
+if [[ -n $BENCH_BASELINE ]]; then
+  [[ -f $BENCH_BASELINE ]] || error "$BENCH_BASELINE not found"
+  echo
+  echo "compared with $BENCH_BASELINE:"
+  printf '%-6s %-6s %-10s %10s %10s %9s\n' size format query before after change
+  awk -F '\t' '
+    FNR == 1 { next }
+    NR == FNR { base[$2 FS $3 FS $4] = $7; next }
+    ( $2 FS $3 FS $4 ) in base {
+      b = base[$2 FS $3 FS $4]
+      change = b > 0 ? ( $7 - b ) * 100 / b : 0
+      printf "%-6s %-6s %-10s %10.3f %10.3f %+8.1f%%\n", $2, $3, $4, b, $7, change
+    }' "$BENCH_BASELINE" "$OUT"
+fi
@@ -0,0 +1,195 @@
+/**
+
+Synthetic logs for the benchmarks.
+
+    loggen SIZE ACCESS_LOG ERROR_LOG [SEED]
+
+writes SIZE bytes (K, M or G suffixes, powers of 1024) of access log
+in the combined format with %D, and the httpd 2.2 error log of the
+same requests: about one line for every twenty access lines, most of
+them for a request that failed, at the same second and from the same
+client, so the two can be joined on time_epoch. The same SIZE and SEED
+always give the same logs.
+
+Time stamps start at 2014-11-01 00:00:00 -0400 and advance about 20ms
+a line. Error log time stamps are that local time; read them with
+TZ='<-04>4' to get the access log's time_epoch.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define START_EPOCH     1414814400       /* 2014-11-01 00:00:00 -0400 */
+#define ZONE_OFFSET     ( -4 * 3600 )
+#define ZONE_NAME       "-0400"
+#define HOSTS           4096
+#define SESSIONS        512              /* distinct record ids in urls */
+
+static uint64_t state;
+
+/* xorshift64*, so the logs do not depend on the C library's rand() */
+static uint64_t next( void )
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+static unsigned pick( unsigned n )
+{
+    return (unsigned)( ( next() >> 32 ) % n );
+}
+
+/* 0 .. n-1, the low values much more often: a few busy clients and pages */
+static unsigned skewed( unsigned n )
+{
+    return pick( pick( n ) + 1 );
+}
+
+static const char *methods[] = { "GET", "GET", "GET", "GET", "GET", "GET", "GET", "GET", "POST", "HEAD" };
+
+static const char *pages[] = {
+    "/", "/foodb/", "/foodb/home.do", "/foodb/showRecord.do", "/foodb/showQuestion.do",
+    "/foodb/processQuestion.do", "/foodb/showSummary.do", "/foodb/processRegister.do",
+    "/cgi-bin/gbrowse/foodb/", "/cgi-bin/gbrowse_img/foodb/", "/cgi-bin/dataPlotter.pl",
+    "/a/images/foodb/title_s.png", "/a/css/foodb.css", "/a/js/foodb.js",
+    "/favicon.ico", "/robots.txt", "/common/downloads/release-24/",
+    "/webservices/GeneQuestions/GenesByTaxon.xml"
+};
+
+static const char *queries[] = {
+    "", "", "", "?name=GeneRecordClasses.GeneRecordClass&project_id=FooDB&source_id=LinJ.%02u.%04u",
+    "?type=Microarray::TwoChannel&project_id=FooDB&id=LinJ.%02u.%04u&fmt=png",
+    "?questionFullName=GeneQuestions.GenesByTextSearch&value=kinase&page=%u&size=%u"
+};
+
+static const char *referers[] = {
+    "-", "-", "http://foodb.org/foodb/", "http://foodb.org/foodb/showRecord.do",
+    "http://www.google.com/", "http://foodb.org/cgi-bin/gbrowse/foodb/"
+};
+
+static const char *agents[] = {
+    "Mozilla/5.0 (Windows NT 6.3; WOW64; rv:33.0) Gecko/20100101 Firefox/33.0",
+    "Mozilla/5.0 (Macintosh; Intel Mac OS X 10_10) AppleWebKit/600.1.25 (KHTML, like Gecko) Version/8.0 Safari/600.1.25",
+    "Mozilla/5.0 (compatible; Googlebot/2.1; +http://www.google.com/bot.html)",
+    "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/38.0.2125.111 Safari/537.36",
+    "curl/7.29.0", "Wget/1.12 (linux-gnu)"
+};
+
+static const char *failures[] = {
+    "File does not exist: /var/www/foodb.org/html%s",
+    "[%s] gbrowse: DBD::Oracle::db ping failed: ORA-03135: connection lost contact",
+    "Premature end of script headers: %s",
+    "proxy: error reading status line from remote server localhost:8080, referer: http://foodb.org%s"
+};
+
+static const char *chatter[] = {
+    "[debug] proxy_util.c(1852): proxy: worker already initialized",
+    "[notice] Digest: generating secret for digest authentication ...",
+    "[warn] RSA server certificate CommonName (CN) `localhost' does NOT match server name!?",
+    "[info] Server built: Jul 23 2014 14:17:29"
+};
+
+#define N( a )  ( sizeof( a ) / sizeof( (a)[0] ) )
+
+static int64_t parse_size( const char *s )
+{
+    char     *end;
+    int64_t  n = strtoll( s, &end, 10 );
+
+    switch ( *end ) {
+        case 'g': case 'G': n <<= 30; break;
+        case 'm': case 'M': n <<= 20; break;
+        case 'k': case 'K': n <<= 10; break;
+        case '\0': break;
+        default: return -1;
+    }
+    return n;
+}
+
+int main( int argc, char **argv )
+{
+    FILE        *access, *error;
+    int64_t     size, written = 0, ms = 0;
+    char        url[256], line[1024];
+    unsigned    host[HOSTS];
+    int         i, n;
+
+    if ( argc < 4 || argc > 5 || ( size = parse_size( argv[1] ) ) <= 0 ) {
+        fprintf( stderr, "usage: %s SIZE ACCESS_LOG ERROR_LOG [SEED]\n", argv[0] );
+        return 2;
+    }
+    state = argc > 4 ? strtoull( argv[4], NULL, 10 ) : 1;
+    state = state * 0x9E3779B97F4A7C15ULL + 1;
+
+    if ( ( access = fopen( argv[2], "w" ) ) == NULL ) { perror( argv[2] ); return 1; }
+    if ( ( error = fopen( argv[3], "w" ) ) == NULL ) { perror( argv[3] ); return 1; }
+
+    for ( i = 0; i < HOSTS; i++ ) {
+        host[i] = ( 10u << 24 ) | ( pick( 1 << 20 ) << 4 ) | pick( 16 );
+    }
+
+    while ( written < size ) {
+        time_t      t = START_EPOCH + ms / 1000;
+        time_t      local = t + ZONE_OFFSET;
+        struct tm   tm;
+        char        stamp[64], client[16];
+        const char  *method = methods[pick( N( methods ) )];
+        const char  *page = pages[skewed( N( pages ) )];
+        unsigned    h = host[skewed( HOSTS )];
+        unsigned    roll = pick( 1000 ), status;
+        long        bytes = 200 + pick( 60000 );
+
+        gmtime_r( &local, &tm );
+        snprintf( client, sizeof( client ), "%u.%u.%u.%u",
+                  h >> 24, ( h >> 16 ) & 255, ( h >> 8 ) & 255, h & 255 );
+
+        n = snprintf( url, sizeof( url ), "%s", page );
+        snprintf( url + n, sizeof( url ) - n, queries[pick( N( queries ) )],
+                  1 + pick( 36 ), skewed( SESSIONS ), 1 + pick( 20 ) );
+
+        status = roll < 850 ? 200 : roll < 900 ? 304 : roll < 950 ? 302 : roll < 985 ? 404 : 500;
+        if ( status == 304 ) bytes = 0;
+
+        strftime( stamp, sizeof( stamp ), "%d/%b/%Y:%H:%M:%S", &tm );
+        if ( bytes ) {
+            n = snprintf( line, sizeof( line ), "%s - - [%s %s] \"%s %s HTTP/1.1\" %u %ld \"%s\" \"%s\" %u\n",
+                          client, stamp, ZONE_NAME, method, url, status, bytes,
+                          referers[pick( N( referers ) )], agents[skewed( N( agents ) )],
+                          100 + pick( status == 200 ? 400000 : 5000 ) );
+        }
+        else {
+            n = snprintf( line, sizeof( line ), "%s - - [%s %s] \"%s %s HTTP/1.1\" %u - \"%s\" \"%s\" %u\n",
+                          client, stamp, ZONE_NAME, method, url, status,
+                          referers[pick( N( referers ) )], agents[skewed( N( agents ) )],
+                          100 + pick( 5000 ) );
+        }
+        fwrite( line, 1, n, access );
+        written += n;
+
+        /* the error log: most failed requests, and some server chatter */
+        strftime( stamp, sizeof( stamp ), "%a %b %d %H:%M:%S %Y", &tm );
+        if ( status >= 404 && pick( 4 ) ) {
+            char      message[512];
+            unsigned  f = status == 404 ? 0 : 1 + pick( 3 );
+
+            snprintf( message, sizeof( message ), failures[f], f == 0 ? page : f == 1 ? stamp : url );
+            fprintf( error, "[%s] [error] [client %s] %s\n", stamp, client, message );
+        }
+        else if ( pick( 100 ) == 0 ) {
+            fprintf( error, "[%s] %s\n", stamp, chatter[pick( N( chatter ) )] );
+        }
+
+        ms += pick( 40 );
+    }
+
+    if ( fclose( access ) || fclose( error ) ) {
+        perror( "loggen" );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+/**
+
+Run a command and report what it cost.
+
+    runstat COMMAND [ARG ...]
+
+runs COMMAND and, once it exits, prints to stderr its elapsed time in
+seconds and its peak resident set size in kilobytes:
+
+    runstat 1.234 56789
+
+The exit status is the command's. /usr/bin/time would do, where it is
+installed and takes -f.
+ **/
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+int main( int argc, char **argv )
+{
+    struct timespec  start, end;
+    struct rusage    ru;
+    pid_t            pid;
+    int              status;
+
+    if ( argc < 2 ) {
+        fprintf( stderr, "usage: %s COMMAND [ARG ...]\n", argv[0] );
+        return 2;
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    if ( ( pid = fork() ) < 0 ) {
+        perror( "fork" );
+        return 1;
+    }
+    if ( pid == 0 ) {
+        execvp( argv[1], argv + 1 );
+        perror( argv[1] );
+        _exit( 127 );
+    }
+    if ( wait4( pid, &status, 0, &ru ) < 0 ) {
+        perror( "wait4" );
+        return 1;
+    }
+    clock_gettime( CLOCK_MONOTONIC, &end );
+
+    fprintf( stderr, "runstat %.3f %ld\n",
+             ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9, ru.ru_maxrss );
+    return WIFEXITED( status ) ? WEXITSTATUS( status ) : 128 + WTERMSIG( status );
+}
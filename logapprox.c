@@ -0,0 +1,843 @@
+/**
+
+Approximate aggregate functions. See logapprox.h.
+
+Sketch blobs, native byte order as for the index, start with a magic
+number naming their kind:
+
+    "CTH1" HyperLogLog: the 2^LOG_APPROX_HLL_BITS registers, a byte each
+    "CTQ1" quantiles: int32 integer, pad; int64 n, zero; double min, max;
+           int32 pos_lo, pos_n, neg_lo, neg_n; then the int64 counts of
+           the positive buckets from pos_lo, and the negative ones
+    "CTK1" top k: int32 m, k, n, pad; int64 total; then n * { int64
+           count, error; int32 number, len; len bytes of value }
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "logapprox.h"
+#include "logzone.h"
+
+#define LOG_APPROX_SKETCH    ((void *)1) /* user data of the _sketch forms */
+
+#define LOG_APPROX_HLL_REGS  ( 1 << LOG_APPROX_HLL_BITS )
+#define LOG_APPROX_HLL_LINEAR 11500      /* below, linear counting is closer */
+
+#define LOG_APPROX_ALPHA     0.01        /* quantile relative error */
+
+#define LOG_APPROX_TOP_MIN   1024        /* Space-Saving counters at least */
+
+/* splitmix64's finaliser */
+static uint64_t log_approx_mix( uint64_t x )
+{
+    x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+    return x ^ ( x >> 31 );
+}
+
+/*
+The state of an aggregate, size bytes allocated on its first row. NULL
+if it has none yet and create is 0, or out of memory.
+ */
+static void * log_approx_state( sqlite3_context *ctx, size_t size, int create )
+{
+    void **p = sqlite3_aggregate_context( ctx, create ? sizeof( void * ) : 0 );
+
+    if ( p == NULL ) return NULL;
+    if ( *p == NULL && create ) *p = calloc( 1, size );
+    return *p;
+}
+
+/* The bytes of value if it is a sketch of the kind magic names, or NULL. */
+static const unsigned char * log_approx_sketch( sqlite3_value *value, const char *magic, int *len )
+{
+    const unsigned char *b;
+
+    if ( sqlite3_value_type( value ) != SQLITE_BLOB ) return NULL;
+    b = sqlite3_value_blob( value );
+    *len = sqlite3_value_bytes( value );
+    if ( b == NULL || *len < 4 || memcmp( b, magic, 4 ) != 0 ) return NULL;
+    return b;
+}
+
+/* HyperLogLog */
+
+typedef struct log_approx_hll_s {
+    unsigned char    reg[LOG_APPROX_HLL_REGS];
+} log_approx_hll;
+
+/*
+The hash of a value as DISTINCT tells them apart: 1 and 1.0 are the
+same, 1 and '1' are not.
+ */
+static uint64_t log_approx_hash( sqlite3_value *value )
+{
+    double   d;
+    int64_t  i;
+
+    switch ( sqlite3_value_type( value ) ) {
+    case SQLITE_INTEGER:
+        return log_approx_mix( (uint64_t)sqlite3_value_int64( value ) * 0x9e3779b97f4a7c15ULL + 1 );
+    case SQLITE_FLOAT:
+        d = sqlite3_value_double( value );
+        i = (int64_t)d;
+        if ( d == (double)i && d > -9.2e18 && d < 9.2e18 ) {
+            return log_approx_mix( (uint64_t)i * 0x9e3779b97f4a7c15ULL + 1 );
+        }
+        return log_approx_mix( log_zone_hash( (const char *)&d, sizeof( d ) ) + 2 );
+    default:
+        return log_approx_mix( log_zone_hash( (const char *)sqlite3_value_text( value ),
+                                              sqlite3_value_bytes( value ) ) + 3 );
+    }
+}
+
+static void log_approx_hll_step( sqlite3_context *ctx, int argc, sqlite3_value **argv )
+{
+    log_approx_hll       *h = log_approx_state( ctx, sizeof( log_approx_hll ), 1 );
+    const unsigned char  *b;
+    uint64_t             x;
+    int                  len, i, rho;
+
+    if ( h == NULL ) {
+        sqlite3_result_error_nomem( ctx );
+        return;
+    }
+    if ( sqlite3_value_type( argv[0] ) == SQLITE_NULL ) return;
+    if ( ( b = log_approx_sketch( argv[0], "CTH1", &len ) ) != NULL ) {
+        if ( len != 4 + LOG_APPROX_HLL_REGS ) {
+            sqlite3_result_error( ctx, "approx_count_distinct: not a whole sketch", -1 );
+            return;
+        }
+        for ( i = 0; i < LOG_APPROX_HLL_REGS; i++ ) {
+            if ( b[4 + i] > h->reg[i] ) h->reg[i] = b[4 + i];
+        }
+        return;
+    }
+    x = log_approx_hash( argv[0] );
+    i = x >> ( 64 - LOG_APPROX_HLL_BITS );
+    x = ( x << LOG_APPROX_HLL_BITS ) | ( (uint64_t)1 << ( LOG_APPROX_HLL_BITS - 1 ) );
+    for ( rho = 1; !( x & 0x8000000000000000ULL ); rho++ ) x <<= 1;
+    if ( rho > h->reg[i] ) h->reg[i] = rho;
+}
+
+static void log_approx_hll_final( sqlite3_context *ctx )
+{
+    log_approx_hll  *h = log_approx_state( ctx, sizeof( log_approx_hll ), 0 );
+    double          m = LOG_APPROX_HLL_REGS, sum = 0, e;
+    int             zeros = 0, i;
+
+    if ( sqlite3_user_data( ctx ) == LOG_APPROX_SKETCH ) {
+        unsigned char *b = sqlite3_malloc( 4 + LOG_APPROX_HLL_REGS );
+
+        if ( b == NULL ) {
+            sqlite3_result_error_nomem( ctx );
+        }
+        else {
+            memcpy( b, "CTH1", 4 );
+            if ( h != NULL ) memcpy( b + 4, h->reg, LOG_APPROX_HLL_REGS );
+            else memset( b + 4, 0, LOG_APPROX_HLL_REGS );
+            sqlite3_result_blob( ctx, b, 4 + LOG_APPROX_HLL_REGS, sqlite3_free );
+        }
+        free( h );
+        return;
+    }
+    if ( h == NULL ) {
+        sqlite3_result_int64( ctx, 0 );
+        return;
+    }
+    for ( i = 0; i < LOG_APPROX_HLL_REGS; i++ ) {
+        sum += ldexp( 1.0, -h->reg[i] );
+        zeros += ( h->reg[i] == 0 );
+    }
+    free( h );
+    e = 0.7213 / ( 1 + 1.079 / m ) * m * m / sum;
+    if ( zeros > 0 && m * log( m / zeros ) <= LOG_APPROX_HLL_LINEAR ) e = m * log( m / zeros );
+    sqlite3_result_int64( ctx, (sqlite3_int64)( e + 0.5 ) );
+}
+
+/* Quantiles */
+
+/* counts of the buckets lo to lo + n - 1 */
+typedef struct log_approx_store_s {
+    int              lo;
+    int              n;
+    int64_t          *count;
+} log_approx_store;
+
+typedef struct log_approx_quantile_s {
+    int              started;
+    int              integer;            /* every value so far an integer */
+    double           p;
+    int64_t          n;
+    int64_t          zero;               /* values too close to 0 for a bucket */
+    double           min;
+    double           max;
+    log_approx_store pos;
+    log_approx_store neg;                /* by magnitude */
+} log_approx_quantile;
+
+static int log_approx_store_add( log_approx_store *s, int k, int64_t c )
+{
+    int64_t  *count;
+    int      lo, n;
+
+    if ( s->n == 0 || k < s->lo || k >= s->lo + s->n ) {
+        lo = ( s->n == 0 || k < s->lo ? k : s->lo );
+        n = ( s->n == 0 ? 1 : k < s->lo ? s->lo + s->n - k : k - s->lo + 1 );
+        if ( ( count = malloc( n * sizeof( int64_t ) ) ) == NULL ) return -1;
+        memset( count, 0, n * sizeof( int64_t ) );
+        if ( s->n > 0 ) memcpy( count + ( s->lo - lo ), s->count, s->n * sizeof( int64_t ) );
+        free( s->count );
+        s->count = count;
+        s->lo = lo;
+        s->n = n;
+    }
+    s->count[k - s->lo] += c;
+    return 0;
+}
+
+/* The bucket of magnitude x, or INT32_MIN if it is too small for one. */
+static int log_approx_bucket( double x )
+{
+    double k = ceil( log( x ) / log1p( 2 * LOG_APPROX_ALPHA / ( 1 - LOG_APPROX_ALPHA ) ) );
+
+    if ( k < -LOG_APPROX_BUCKETS / 2 ) return INT32_MIN;
+    return ( k >= LOG_APPROX_BUCKETS / 2 ? LOG_APPROX_BUCKETS / 2 - 1 : (int)k );
+}
+
+/* The value in the middle of bucket k, within LOG_APPROX_ALPHA of its bounds. */
+static double log_approx_middle( int k )
+{
+    double gamma = ( 1 + LOG_APPROX_ALPHA ) / ( 1 - LOG_APPROX_ALPHA );
+
+    return 2 * pow( gamma, k ) / ( gamma + 1 );
+}
+
+static int log_approx_quantile_merge( log_approx_quantile *q, const unsigned char *b, int len )
+{
+    int32_t  hdr[2], lens[4];
+    int64_t  counts[2], c;
+    double   range[2];
+    int      off = 4 + sizeof( hdr ) + sizeof( counts ) + sizeof( range ) + sizeof( lens ), k;
+
+    if ( len < off ) return -1;
+    memcpy( hdr, b + 4, sizeof( hdr ) );
+    memcpy( counts, b + 4 + sizeof( hdr ), sizeof( counts ) );
+    memcpy( range, b + 4 + sizeof( hdr ) + sizeof( counts ), sizeof( range ) );
+    memcpy( lens, b + off - sizeof( lens ), sizeof( lens ) );
+    if ( lens[1] < 0 || lens[3] < 0 || lens[1] > LOG_APPROX_BUCKETS || lens[3] > LOG_APPROX_BUCKETS ||
+         len != off + (int)( ( lens[1] + lens[3] ) * sizeof( int64_t ) ) ) {
+        return -1;
+    }
+    if ( counts[0] == 0 ) return 0;
+    if ( q->n == 0 || range[0] < q->min ) q->min = range[0];
+    if ( q->n == 0 || range[1] > q->max ) q->max = range[1];
+    q->integer = ( q->n == 0 ? hdr[0] : q->integer && hdr[0] );
+    q->n += counts[0];
+    q->zero += counts[1];
+    for ( k = 0; k < lens[1] + lens[3]; k++ ) {
+        memcpy( &c, b + off + k * sizeof( int64_t ), sizeof( c ) );
+        if ( c == 0 ) continue;
+        if ( k < lens[1] ) {
+            if ( log_approx_store_add( &q->pos, lens[0] + k, c ) != 0 ) return -2;
+        }
+        else if ( log_approx_store_add( &q->neg, lens[2] + k - lens[1], c ) != 0 ) {
+            return -2;
+        }
+    }
+    return 0;
+}
+
+static void log_approx_quantile_step( sqlite3_context *ctx, int argc, sqlite3_value **argv )
+{
+    log_approx_quantile  *q = log_approx_state( ctx, sizeof( log_approx_quantile ), 1 );
+    const unsigned char  *b;
+    double               x;
+    int                  len, k, rc, type;
+
+    if ( q == NULL ) {
+        sqlite3_result_error_nomem( ctx );
+        return;
+    }
+    if ( !q->started ) {
+        q->started = 1;
+        q->integer = 1;
+        if ( argc > 1 ) {
+            q->p = sqlite3_value_double( argv[1] );
+            if ( sqlite3_value_numeric_type( argv[1] ) == SQLITE_NULL || !( q->p >= 0 && q->p <= 1 ) ) {
+                sqlite3_result_error( ctx, "approx_quantile: P must be from 0 to 1", -1 );
+                return;
+            }
+        }
+    }
+    if ( ( b = log_approx_sketch( argv[0], "CTQ1", &len ) ) != NULL ) {
+        if ( ( rc = log_approx_quantile_merge( q, b, len ) ) == -2 ) sqlite3_result_error_nomem( ctx );
+        if ( rc == -1 ) sqlite3_result_error( ctx, "approx_quantile: not a whole sketch", -1 );
+        return;
+    }
+
+    /* numbers, and text that reads as one; "-" and the like are skipped */
+    type = sqlite3_value_numeric_type( argv[0] );
+    if ( type != SQLITE_INTEGER && type != SQLITE_FLOAT ) return;
+    x = sqlite3_value_double( argv[0] );
+    if ( isnan( x ) ) return;
+    if ( type == SQLITE_FLOAT ) q->integer = 0;
+    if ( q->n == 0 || x < q->min ) q->min = x;
+    if ( q->n == 0 || x > q->max ) q->max = x;
+    q->n++;
+    k = log_approx_bucket( fabs( x ) );
+    if ( x == 0 || k == INT32_MIN ) q->zero++;
+    else if ( log_approx_store_add( x > 0 ? &q->pos : &q->neg, k, 1 ) != 0 ) sqlite3_result_error_nomem( ctx );
+}
+
+/* The value at rank p, counting from the most negative; 0 and 1 are exact. */
+static double log_approx_quantile_value( const log_approx_quantile *q )
+{
+    double   rank = q->p * ( q->n - 1 ), x = 0;
+    int64_t  seen = 0;
+    int      k;
+
+    if ( q->p == 0 ) return q->min;
+    if ( q->p == 1 ) return q->max;
+    for ( k = q->neg.n - 1; k >= 0; k-- ) {
+        if ( ( seen += q->neg.count[k] ) > rank ) return -log_approx_middle( q->neg.lo + k );
+    }
+    if ( ( seen += q->zero ) > rank ) return 0;
+    for ( k = 0; k < q->pos.n; k++ ) {
+        x = log_approx_middle( q->pos.lo + k );
+        if ( ( seen += q->pos.count[k] ) > rank ) break;
+    }
+    return x;
+}
+
+static void log_approx_quantile_final( sqlite3_context *ctx )
+{
+    log_approx_quantile  *q = log_approx_state( ctx, sizeof( log_approx_quantile ), 0 );
+    log_approx_quantile  none;
+    double               x;
+
+    if ( q == NULL ) {
+        memset( &none, 0, sizeof( none ) );
+        none.integer = 1;
+    }
+    if ( sqlite3_user_data( ctx ) == LOG_APPROX_SKETCH ) {
+        const log_approx_quantile  *s = ( q != NULL ? q : &none );
+        int32_t                    hdr[2] = { s->integer, 0 };
+        int32_t                    lens[4] = { s->pos.lo, s->pos.n, s->neg.lo, s->neg.n };
+        int64_t                    counts[2] = { s->n, s->zero };
+        double                     range[2] = { s->min, s->max };
+        int                        off = 4 + sizeof( hdr ) + sizeof( counts ) + sizeof( range ) + sizeof( lens );
+        int                        len = off + ( s->pos.n + s->neg.n ) * sizeof( int64_t );
+        unsigned char              *b = sqlite3_malloc( len );
+
+        if ( b == NULL ) {
+            sqlite3_result_error_nomem( ctx );
+        }
+        else {
+            memcpy( b, "CTQ1", 4 );
+            memcpy( b + 4, hdr, sizeof( hdr ) );
+            memcpy( b + 4 + sizeof( hdr ), counts, sizeof( counts ) );
+            memcpy( b + 4 + sizeof( hdr ) + sizeof( counts ), range, sizeof( range ) );
+            memcpy( b + off - sizeof( lens ), lens, sizeof( lens ) );
+            if ( s->pos.n > 0 ) memcpy( b + off, s->pos.count, s->pos.n * sizeof( int64_t ) );
+            if ( s->neg.n > 0 ) {
+                memcpy( b + off + s->pos.n * sizeof( int64_t ), s->neg.count, s->neg.n * sizeof( int64_t ) );
+            }
+            sqlite3_result_blob( ctx, b, len, sqlite3_free );
+        }
+    }
+    else if ( q != NULL && q->n > 0 ) {
+        x = log_approx_quantile_value( q );
+        if ( x < q->min ) x = q->min;
+        if ( x > q->max ) x = q->max;
+        if ( q->integer ) sqlite3_result_int64( ctx, (sqlite3_int64)llround( x ) );
+        else sqlite3_result_double( ctx, x );
+    }
+    if ( q != NULL ) {
+        free( q->pos.count );
+        free( q->neg.count );
+        free( q );
+    }
+}
+
+/* Top k, Space-Saving */
+
+typedef struct log_approx_counter_s {
+    int64_t          count;
+    int64_t          error;              /* count is at most this much too high */
+    uint64_t         hash;
+    int              number;             /* value was a number */
+    int              len;
+    char             *value;
+    int              heap;               /* position in the heap */
+} log_approx_counter;
+
+typedef struct log_approx_top_s {
+    int              k;
+    int              m;                  /* counters, 0 until the first row */
+    int              n;                  /* in use */
+    int              alloc;              /* allocated, up to m as needed */
+    int64_t          total;              /* rows counted */
+    log_approx_counter *c;
+    int              *heap;              /* counters, least count first */
+    int              *slot;              /* counters by hash, -1 for none */
+    int              mask;               /* slots - 1 */
+} log_approx_top;
+
+static void log_approx_top_free( log_approx_top *t )
+{
+    int i;
+
+    if ( t == NULL ) return;
+    for ( i = 0; i < t->n; i++ ) free( t->c[i].value );
+    free( t->c );
+    free( t->heap );
+    free( t->slot );
+    free( t );
+}
+
+static int log_approx_top_init( log_approx_top *t, int k, int m )
+{
+    t->k = k;
+    t->m = m;
+    t->mask = -1;
+    return 0;
+}
+
+static void log_approx_top_insert( log_approx_top *t, int i );
+
+/* Room for another counter: the arrays grow with the values seen, up to m. */
+static int log_approx_top_reserve( log_approx_top *t )
+{
+    int   alloc = ( t->alloc == 0 ? 64 : t->alloc * 2 ), slots = 1, i;
+    void  *c, *heap;
+
+    if ( alloc > t->m ) alloc = t->m;
+    while ( slots < 2 * alloc ) slots *= 2;
+    if ( ( c = realloc( t->c, alloc * sizeof( log_approx_counter ) ) ) == NULL ) return -1;
+    t->c = c;
+    if ( ( heap = realloc( t->heap, alloc * sizeof( int ) ) ) == NULL ) return -1;
+    t->heap = heap;
+    t->alloc = alloc;
+    if ( slots - 1 != t->mask ) {
+        free( t->slot );
+        if ( ( t->slot = malloc( slots * sizeof( int ) ) ) == NULL ) return -1;
+        memset( t->slot, 0xff, slots * sizeof( int ) );
+        t->mask = slots - 1;
+        for ( i = 0; i < t->n; i++ ) log_approx_top_insert( t, i );
+    }
+    return 0;
+}
+
+static uint64_t log_approx_top_hash( const char *value, int len, int number )
+{
+    return log_approx_mix( log_zone_hash( value, len ) + number );
+}
+
+static int log_approx_top_find( const log_approx_top *t, uint64_t hash, const char *value, int len, int number )
+{
+    int h, i;
+
+    if ( t->slot == NULL ) return -1;
+    for ( h = hash & t->mask; ( i = t->slot[h] ) >= 0; h = ( h + 1 ) & t->mask ) {
+        const log_approx_counter *c = &t->c[i];
+
+        if ( c->hash == hash && c->len == len && c->number == number && memcmp( c->value, value, len ) == 0 ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void log_approx_top_insert( log_approx_top *t, int i )
+{
+    int h;
+
+    for ( h = t->c[i].hash & t->mask; t->slot[h] >= 0; h = ( h + 1 ) & t->mask ) ;
+    t->slot[h] = i;
+}
+
+/* Take counter i out of the hash table, moving back those after it. */
+static void log_approx_top_remove( log_approx_top *t, int i )
+{
+    int h, j, home;
+
+    for ( h = t->c[i].hash & t->mask; t->slot[h] != i; h = ( h + 1 ) & t->mask ) ;
+    for ( j = ( h + 1 ) & t->mask; t->slot[j] >= 0; j = ( j + 1 ) & t->mask ) {
+        home = t->c[t->slot[j]].hash & t->mask;
+        if ( ( ( j - home ) & t->mask ) >= ( ( j - h ) & t->mask ) ) {
+            t->slot[h] = t->slot[j];
+            h = j;
+        }
+    }
+    t->slot[h] = -1;
+}
+
+static void log_approx_top_swap( log_approx_top *t, int a, int b )
+{
+    int x = t->heap[a];
+
+    t->heap[a] = t->heap[b];
+    t->heap[b] = x;
+    t->c[t->heap[a]].heap = a;
+    t->c[t->heap[b]].heap = b;
+}
+
+static void log_approx_top_up( log_approx_top *t, int p )
+{
+    while ( p > 0 && t->c[t->heap[( p - 1 ) / 2]].count > t->c[t->heap[p]].count ) {
+        log_approx_top_swap( t, p, ( p - 1 ) / 2 );
+        p = ( p - 1 ) / 2;
+    }
+}
+
+static void log_approx_top_down( log_approx_top *t, int p )
+{
+    int least, l;
+
+    while ( 1 ) {
+        least = p;
+        for ( l = 2 * p + 1; l <= 2 * p + 2 && l < t->n; l++ ) {
+            if ( t->c[t->heap[l]].count < t->c[t->heap[least]].count ) least = l;
+        }
+        if ( least == p ) return;
+        log_approx_top_swap( t, p, least );
+        p = least;
+    }
+}
+
+/*
+Count value count more times, with error, taking over the counter with
+the least count if it is new and all are in use.
+ */
+static int log_approx_top_add( log_approx_top *t, const char *value, int len, int number,
+                               int64_t count, int64_t error )
+{
+    uint64_t            hash = log_approx_top_hash( value, len, number );
+    int                 i = log_approx_top_find( t, hash, value, len, number );
+    log_approx_counter  *c;
+    char                *copy;
+
+    t->total += count;
+    if ( i >= 0 ) {
+        t->c[i].count += count;
+        t->c[i].error += error;
+        log_approx_top_down( t, t->c[i].heap );
+        return 0;
+    }
+    if ( t->n == t->alloc && t->n < t->m && log_approx_top_reserve( t ) != 0 ) return -1;
+    if ( ( copy = malloc( len + 1 ) ) == NULL ) return -1;
+    memcpy( copy, value, len );
+    copy[len] = '\0';
+    if ( t->n < t->m ) {
+        i = t->n++;
+        c = &t->c[i];
+        c->count = c->error = 0;
+        c->heap = i;
+        t->heap[i] = i;
+    }
+    else {
+        i = t->heap[0];
+        c = &t->c[i];
+        log_approx_top_remove( t, i );
+        free( c->value );
+        c->error = c->count;            /* it may have been seen that often */
+    }
+    c->count += count;
+    c->error += error;
+    c->hash = hash;
+    c->number = number;
+    c->len = len;
+    c->value = copy;
+    log_approx_top_insert( t, i );
+    if ( c->heap == 0 && t->n == t->m ) log_approx_top_down( t, 0 );
+    else log_approx_top_up( t, c->heap );
+    return 0;
+}
+
+/* Most counted first, ties by value so that the order does not depend on that of the rows. */
+static int log_approx_top_cmp( const void *a, const void *b )
+{
+    const log_approx_counter *x = *(log_approx_counter * const *)a, *y = *(log_approx_counter * const *)b;
+    int                      n = x->len < y->len ? x->len : y->len, c;
+
+    if ( x->count != y->count ) return ( x->count < y->count ) - ( x->count > y->count );
+    if ( x->error != y->error ) return ( x->error > y->error ) - ( x->error < y->error );
+    if ( n > 0 && ( c = memcmp( x->value, y->value, n ) ) != 0 ) return c;
+    return ( x->len > y->len ) - ( x->len < y->len );
+}
+
+/* The counters in use, most counted first; the caller frees the list. */
+static log_approx_counter ** log_approx_top_sorted( const log_approx_top *t )
+{
+    log_approx_counter  **list = malloc( ( t->n + 1 ) * sizeof( log_approx_counter * ) );
+    int                 i;
+
+    if ( list == NULL ) return NULL;
+    for ( i = 0; i < t->n; i++ ) list[i] = &t->c[i];
+    if ( t->n > 1 ) qsort( list, t->n, sizeof( log_approx_counter * ), log_approx_top_cmp );
+    return list;
+}
+
+/* Read a sketch blob into a new top k. */
+static log_approx_top * log_approx_top_load( const unsigned char *b, int len )
+{
+    log_approx_top  *t = calloc( 1, sizeof( log_approx_top ) );
+    int32_t         hdr[4], sizes[2];
+    int64_t         vals[2], total;
+    int             off = 4 + sizeof( hdr ) + sizeof( total ), i;
+
+    if ( t == NULL || len < off ) goto fail;
+    memcpy( hdr, b + 4, sizeof( hdr ) );
+    memcpy( &total, b + 4 + sizeof( hdr ), sizeof( total ) );
+    if ( hdr[1] < 1 || hdr[0] < 1 || hdr[0] > LOG_APPROX_TOP_MAX || hdr[2] < 0 || hdr[2] > hdr[0] ||
+         log_approx_top_init( t, hdr[1], hdr[0] ) != 0 ) {
+        goto fail;
+    }
+    for ( i = 0; i < hdr[2]; i++ ) {
+        if ( off + (int)( sizeof( vals ) + sizeof( sizes ) ) > len ) goto fail;
+        memcpy( vals, b + off, sizeof( vals ) );
+        memcpy( sizes, b + off + sizeof( vals ), sizeof( sizes ) );
+        off += sizeof( vals ) + sizeof( sizes );
+        if ( sizes[1] < 0 || sizes[1] > len - off ||
+             log_approx_top_add( t, (const char *)b + off, sizes[1], sizes[0], vals[0], vals[1] ) != 0 ) {
+            goto fail;
+        }
+        off += sizes[1];
+    }
+    if ( off != len ) goto fail;
+    t->total = total;
+    return t;
+
+fail:
+    log_approx_top_free( t );
+    return NULL;
+}
+
+/*
+Merge sketch from into t: a value counted in one only may have been
+counted up to the other's least count in it too, if that one is full.
+The m values with the highest counts are kept.
+ */
+static int log_approx_top_merge( log_approx_top *t, const log_approx_top *from )
+{
+    log_approx_top      *all = calloc( 1, sizeof( log_approx_top ) ), *keep;
+    log_approx_counter  **list = NULL, *c;
+    int64_t             min_t = 0, min_from = 0, total = t->total + from->total;
+    int                 i, j, m = ( t->m > from->m ? t->m : from->m ), rc = -1;
+
+    if ( t->n == t->m ) min_t = t->c[t->heap[0]].count;
+    if ( from->n == from->m ) min_from = from->c[from->heap[0]].count;
+    if ( all == NULL || log_approx_top_init( all, t->k, t->n + from->n + 1 ) != 0 ) goto done;
+    for ( i = 0; i < t->n; i++ ) {
+        c = &t->c[i];
+        j = log_approx_top_find( from, c->hash, c->value, c->len, c->number );
+        if ( log_approx_top_add( all, c->value, c->len, c->number,
+                                 c->count + ( j >= 0 ? from->c[j].count : min_from ),
+                                 c->error + ( j >= 0 ? from->c[j].error : min_from ) ) != 0 ) {
+            goto done;
+        }
+    }
+    for ( i = 0; i < from->n; i++ ) {
+        c = &from->c[i];
+        if ( log_approx_top_find( t, c->hash, c->value, c->len, c->number ) >= 0 ) continue;
+        if ( log_approx_top_add( all, c->value, c->len, c->number, c->count + min_t, c->error + min_t ) != 0 ) {
+            goto done;
+        }
+    }
+    if ( ( list = log_approx_top_sorted( all ) ) == NULL ) goto done;
+
+    /* rebuild t with the top m of them */
+    if ( ( keep = calloc( 1, sizeof( log_approx_top ) ) ) == NULL ) goto done;
+    if ( log_approx_top_init( keep, t->k, m ) != 0 ) {
+        log_approx_top_free( keep );
+        goto done;
+    }
+    for ( i = 0; i < all->n && i < m; i++ ) {
+        if ( log_approx_top_add( keep, list[i]->value, list[i]->len, list[i]->number,
+                                 list[i]->count, list[i]->error ) != 0 ) {
+            log_approx_top_free( keep );
+            goto done;
+        }
+    }
+    for ( i = 0; i < t->n; i++ ) free( t->c[i].value );
+    free( t->c );
+    free( t->heap );
+    free( t->slot );
+    *t = *keep;
+    t->total = total;
+    free( keep );
+    rc = 0;
+
+done:
+    free( list );
+    log_approx_top_free( all );
+    return rc;
+}
+
+static void log_approx_top_step( sqlite3_context *ctx, int argc, sqlite3_value **argv )
+{
+    log_approx_top       *t = log_approx_state( ctx, sizeof( log_approx_top ), 1 ), *from;
+    const unsigned char  *b;
+    sqlite3_int64        k;
+    int                  len, m;
+
+    if ( t == NULL ) {
+        sqlite3_result_error_nomem( ctx );
+        return;
+    }
+    if ( t->m == 0 ) {
+        k = sqlite3_value_int64( argv[1] );
+        if ( sqlite3_value_numeric_type( argv[1] ) != SQLITE_INTEGER || k < 1 || k > LOG_APPROX_TOP_MAX / 8 ) {
+            sqlite3_result_error( ctx, "approx_top_k: K must be from 1 to 1024", -1 );
+            return;
+        }
+        m = ( k * 8 < LOG_APPROX_TOP_MIN ? LOG_APPROX_TOP_MIN : k * 8 );
+        if ( log_approx_top_init( t, k, m ) != 0 ) {
+            sqlite3_result_error_nomem( ctx );
+            return;
+        }
+    }
+    if ( sqlite3_value_type( argv[0] ) == SQLITE_NULL ) return;
+    if ( ( b = log_approx_sketch( argv[0], "CTK1", &len ) ) != NULL ) {
+        if ( ( from = log_approx_top_load( b, len ) ) == NULL ) {
+            sqlite3_result_error( ctx, "approx_top_k: not a whole sketch", -1 );
+            return;
+        }
+        if ( log_approx_top_merge( t, from ) != 0 ) sqlite3_result_error_nomem( ctx );
+        log_approx_top_free( from );
+        return;
+    }
+    if ( log_approx_top_add( t, (const char *)sqlite3_value_text( argv[0] ), sqlite3_value_bytes( argv[0] ),
+                             sqlite3_value_type( argv[0] ) == SQLITE_INTEGER || sqlite3_value_type( argv[0] ) == SQLITE_FLOAT, 1, 0 ) != 0 ) {
+        sqlite3_result_error_nomem( ctx );
+    }
+}
+
+/* value as a JSON string, or a number if it was one */
+static void log_approx_json( sqlite3_str *out, const log_approx_counter *c )
+{
+    const unsigned char  *p = (const unsigned char *)c->value;
+    int                  i;
+
+    if ( c->number ) {
+        sqlite3_str_append( out, c->value, c->len );
+        return;
+    }
+    sqlite3_str_appendchar( out, 1, '"' );
+    for ( i = 0; i < c->len; i++ ) {
+        if ( p[i] == '"' || p[i] == '\\' ) sqlite3_str_appendf( out, "\\%c", p[i] );
+        else if ( p[i] < 0x20 ) sqlite3_str_appendf( out, "\\u%04x", p[i] );
+        else sqlite3_str_appendchar( out, 1, p[i] );
+    }
+    sqlite3_str_appendchar( out, 1, '"' );
+}
+
+static void log_approx_top_final( sqlite3_context *ctx )
+{
+    log_approx_top      *t = log_approx_state( ctx, sizeof( log_approx_top ), 0 );
+    log_approx_counter  **list;
+    sqlite3_str         *out;
+    int                 i;
+
+    if ( sqlite3_user_data( ctx ) == LOG_APPROX_SKETCH ) {
+        int32_t        hdr[4] = { 0, 1, 0, 0 }, sizes[2];
+        int64_t        total = 0, vals[2];
+        int            len = 4 + sizeof( hdr ) + sizeof( total ), off;
+        unsigned char  *b;
+
+        if ( t != NULL && t->m > 0 ) {
+            hdr[0] = t->m;
+            hdr[1] = t->k;
+            hdr[2] = t->n;
+            total = t->total;
+            for ( i = 0; i < t->n; i++ ) len += sizeof( vals ) + sizeof( sizes ) + t->c[i].len;
+        }
+        else {
+            hdr[0] = LOG_APPROX_TOP_MIN;
+        }
+        if ( ( b = sqlite3_malloc( len ) ) == NULL ) {
+            sqlite3_result_error_nomem( ctx );
+            log_approx_top_free( t );
+            return;
+        }
+        memcpy( b, "CTK1", 4 );
+        memcpy( b + 4, hdr, sizeof( hdr ) );
+        memcpy( b + 4 + sizeof( hdr ), &total, sizeof( total ) );
+        off = 4 + sizeof( hdr ) + sizeof( total );
+        for ( i = 0; i < hdr[2]; i++ ) {
+            vals[0] = t->c[i].count;
+            vals[1] = t->c[i].error;
+            sizes[0] = t->c[i].number;
+            sizes[1] = t->c[i].len;
+            memcpy( b + off, vals, sizeof( vals ) );
+            memcpy( b + off + sizeof( vals ), sizes, sizeof( sizes ) );
+            off += sizeof( vals ) + sizeof( sizes );
+            memcpy( b + off, t->c[i].value, t->c[i].len );
+            off += t->c[i].len;
+        }
+        sqlite3_result_blob( ctx, b, len, sqlite3_free );
+        log_approx_top_free( t );
+        return;
+    }
+
+    out = sqlite3_str_new( NULL );
+    sqlite3_str_appendchar( out, 1, '[' );
+    if ( t != NULL && t->n > 0 ) {
+        if ( ( list = log_approx_top_sorted( t ) ) == NULL ) {
+            sqlite3_free( sqlite3_str_finish( out ) );
+            sqlite3_result_error_nomem( ctx );
+            log_approx_top_free( t );
+            return;
+        }
+        for ( i = 0; i < t->n && i < t->k; i++ ) {
+            sqlite3_str_appendall( out, i > 0 ? ",{\"value\":" : "{\"value\":" );
+            log_approx_json( out, list[i] );
+            sqlite3_str_appendf( out, ",\"count\":%lld,\"error\":%lld}",
+                                 (long long)list[i]->count, (long long)list[i]->error );
+        }
+        free( list );
+    }
+    sqlite3_str_appendchar( out, 1, ']' );
+    if ( sqlite3_str_errcode( out ) != SQLITE_OK ) {
+        sqlite3_free( sqlite3_str_finish( out ) );
+        sqlite3_result_error_nomem( ctx );
+    }
+    else {
+        sqlite3_result_text( ctx, sqlite3_str_finish( out ), -1, sqlite3_free );
+    }
+    log_approx_top_free( t );
+}
+
+/* Register the functions, once per connection. */
+int log_approx_init( sqlite3 *db )
+{
+    static const struct {
+        const char  *name;
+        int         argc;
+        void        *sketch;
+        void        (*step)( sqlite3_context *, int, sqlite3_value ** );
+        void        (*final)( sqlite3_context * );
+    } f[] = {
+        { "approx_count_distinct",        1, NULL,               log_approx_hll_step,      log_approx_hll_final },
+        { "approx_count_distinct_sketch", 1, LOG_APPROX_SKETCH,  log_approx_hll_step,      log_approx_hll_final },
+        { "approx_quantile",              2, NULL,               log_approx_quantile_step, log_approx_quantile_final },
+        { "approx_quantile_sketch",       1, LOG_APPROX_SKETCH,  log_approx_quantile_step, log_approx_quantile_final },
+        { "approx_top_k",                 2, NULL,               log_approx_top_step,      log_approx_top_final },
+        { "approx_top_k_sketch",          2, LOG_APPROX_SKETCH,  log_approx_top_step,      log_approx_top_final },
+    };
+    int i, rc = SQLITE_OK;
+
+    for ( i = 0; i < (int)( sizeof( f ) / sizeof( f[0] ) ) && rc == SQLITE_OK; i++ ) {
+        rc = sqlite3_create_function( db, f[i].name, f[i].argc, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                      f[i].sketch, NULL, f[i].step, f[i].final );
+    }
+    return rc;
+}
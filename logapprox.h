@@ -0,0 +1,54 @@
+/**
+
+Approximate aggregate functions, for questions that otherwise make
+SQLite sort or hash every row: how many distinct clients, what is the
+99th percentile response_time, which are the busiest urls.
+
+    SELECT approx_count_distinct(remote_host),
+           approx_quantile(response_time, 0.99),
+           approx_top_k(url, 20)
+      FROM access_log;
+
+Each keeps a sketch of bounded size however many rows it sees:
+
+  - approx_count_distinct(X), a HyperLogLog of 2^14 registers (16KB),
+    within about 1% of the exact count; exact for a few hundred values.
+  - approx_quantile(X, P), with P from 0 to 1, numbers counted in
+    buckets whose bounds grow by 2% (as in DDSketch), so the value it
+    returns is within 1% of one at rank P. Integers give an integer.
+    At most LOG_APPROX_BUCKETS buckets, a few hundred in practice.
+  - approx_top_k(X, K), Space-Saving with 8K counters (at least 1024,
+    allocated as values turn up), the K most frequent values as JSON,
+    most frequent first:
+        [{"value":"/index.html","count":1200,"error":0}, ...]
+    A count is at most error more than the true count, and any value
+    in more than one row in every so many as there are counters is
+    found.
+
+NULLs are skipped. Each also has a _sketch form, e.g.
+approx_count_distinct_sketch(X), returning its sketch as a blob, and
+each takes those blobs in place of values and merges them, so the
+sketches of several logs, kept or computed apart, combine into the
+answer over all of them:
+
+    SELECT approx_count_distinct(s) FROM (
+        SELECT approx_count_distinct_sketch(remote_host) s FROM log1
+        UNION ALL
+        SELECT approx_count_distinct_sketch(remote_host) FROM log2 );
+
+Merged sketches answer as one built over all the rows would, to the
+same error.
+ **/
+
+#ifndef LOGAPPROX_H
+#define LOGAPPROX_H
+
+#include "sqlite3ext.h"
+
+#define LOG_APPROX_HLL_BITS  14          /* log2 of HyperLogLog registers */
+#define LOG_APPROX_BUCKETS   4096        /* quantile buckets, of each sign */
+#define LOG_APPROX_TOP_MAX   8192        /* Space-Saving counters at most */
+
+int          log_approx_init( sqlite3 *db );
+
+#endif
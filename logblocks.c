@@ -0,0 +1,213 @@
+/**
+
+A cache of decompressed blocks of compressed logs. See logblocks.h.
+
+Blocks are found by file and block number in a hash table of chains
+and kept on a list from the most to the least recently used, whose
+tail is dropped to make room.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "logblocks.h"
+
+typedef struct log_block_s {
+    int              file;
+    int64_t          block;              /* uncompressed offset / LOG_BLOCKS_SIZE */
+    unsigned char    *data;
+    int              len;                /* LOG_BLOCKS_SIZE but for the last */
+    int              last;               /* the log ends after it */
+    struct log_block_s *chain;           /* in the bucket */
+    struct log_block_s *newer;
+    struct log_block_s *older;
+} log_block;
+
+typedef struct log_blocks_name_s {
+    char             *filename;
+    int64_t          size;
+    int64_t          mtime;
+} log_blocks_name;
+
+struct log_blocks_s {
+    int64_t          cap;                /* bytes */
+    int64_t          used;               /* allocated, see log_blocks_size() */
+    log_block        **buckets;
+    int              n_buckets;          /* a power of 2 */
+    log_block        *newest;
+    log_block        *oldest;
+    log_blocks_name  *files;
+    int              n_files;
+};
+
+/* A cache of at most cap bytes, or NULL if that is less than one block. */
+log_blocks * log_blocks_new( int64_t cap )
+{
+    log_blocks  *c;
+    int         n = 16;
+
+    if ( cap < LOG_BLOCKS_SIZE ) return NULL;
+    while ( n < 2 * ( cap / LOG_BLOCKS_SIZE ) && n < ( 1 << 20 ) ) n *= 2;
+
+    if ( ( c = calloc( 1, sizeof( log_blocks ) ) ) == NULL ) return NULL;
+    if ( ( c->buckets = calloc( n, sizeof( log_block * ) ) ) == NULL ) {
+        free( c );
+        return NULL;
+    }
+    c->cap = cap;
+    c->n_buckets = n;
+    return c;
+}
+
+void log_blocks_free( log_blocks *c )
+{
+    log_block  *b, *next;
+    int        i;
+
+    if ( c == NULL ) return;
+    for ( b = c->newest; b != NULL; b = next ) {
+        next = b->older;
+        free( b->data );
+        free( b );
+    }
+    for ( i = 0; i < c->n_files; i++ ) free( c->files[i].filename );
+    free( c->files );
+    free( c->buckets );
+    free( c );
+}
+
+static log_block ** log_blocks_bucket( log_blocks *c, int file, int64_t block )
+{
+    uint64_t  h = ( (uint64_t)block ^ ( (uint64_t)file << 40 ) ) * 0x9e3779b97f4a7c15ULL;
+
+    return &c->buckets[( h >> 32 ) & ( c->n_buckets - 1 )];
+}
+
+static void log_blocks_unlink( log_blocks *c, log_block *b )
+{
+    if ( b->newer != NULL ) b->newer->older = b->older;
+    else                    c->newest = b->older;
+    if ( b->older != NULL ) b->older->newer = b->newer;
+    else                    c->oldest = b->newer;
+}
+
+static void log_blocks_link( log_blocks *c, log_block *b )
+{
+    b->newer = NULL;
+    b->older = c->newest;
+    if ( c->newest != NULL ) c->newest->newer = b;
+    else                     c->oldest = b;
+    c->newest = b;
+}
+
+/* Memory a block of len bytes takes, counted against the cap. */
+static int64_t log_blocks_size( int len )
+{
+    return ( len > 0 ? len : 1 ) + (int64_t)sizeof( log_block );
+}
+
+static void log_blocks_drop( log_blocks *c, log_block *b )
+{
+    log_block  **p;
+
+    for ( p = log_blocks_bucket( c, b->file, b->block ); *p != b; p = &(*p)->chain );
+    *p = b->chain;
+    log_blocks_unlink( c, b );
+    c->used -= log_blocks_size( b->len );
+    free( b->data );
+    free( b );
+}
+
+/*
+The number the blocks of filename are kept under, dropping those kept from
+it before it was last changed. Returns -1 if memory is short.
+ */
+int log_blocks_file( log_blocks *c, const char *filename, int64_t size, int64_t mtime )
+{
+    log_blocks_name  *files;
+    log_block        *b, *older;
+    int              i;
+
+    for ( i = 0; i < c->n_files; i++ ) {
+        if ( strcmp( c->files[i].filename, filename ) != 0 ) continue;
+        if ( c->files[i].size != size || c->files[i].mtime != mtime ) {
+            for ( b = c->newest; b != NULL; b = older ) {
+                older = b->older;
+                if ( b->file == i ) log_blocks_drop( c, b );
+            }
+            c->files[i].size = size;
+            c->files[i].mtime = mtime;
+        }
+        return i;
+    }
+
+    files = realloc( c->files, ( c->n_files + 1 ) * sizeof( log_blocks_name ) );
+    if ( files == NULL ) return -1;
+    c->files = files;
+    if ( ( files[i].filename = strdup( filename ) ) == NULL ) return -1;
+    files[i].size = size;
+    files[i].mtime = mtime;
+    return c->n_files++;
+}
+
+/*
+The data of a block of file, most recently used now, with its length
+and whether it is the last of the file. NULL if it is not kept. The
+data is valid until the next log_blocks_put() or log_blocks_file().
+ */
+const unsigned char * log_blocks_get( log_blocks *c, int file, int64_t block, int *len, int *last )
+{
+    log_block  *b;
+
+    for ( b = *log_blocks_bucket( c, file, block ); b != NULL; b = b->chain ) {
+        if ( b->block != block || b->file != file ) continue;
+        if ( c->newest != b ) {
+            log_blocks_unlink( c, b );
+            log_blocks_link( c, b );
+        }
+        *len = b->len;
+        *last = b->last;
+        return b->data;
+    }
+    return NULL;
+}
+
+/*
+Keep data, malloc()ed LOG_BLOCKS_SIZE, as a block of file of len bytes,
+dropping the least recently used blocks to make room. The cache owns
+data from then on, even if it could not keep it. Returns the block's
+data, as log_blocks_get() does, which is data (or its shrunk copy)
+unless the block was kept already.
+ */
+const unsigned char * log_blocks_put( log_blocks *c, int file, int64_t block,
+                          unsigned char *data, int len, int last )
+{
+    const unsigned char  *kept;
+    unsigned char        *shrunk;
+    log_block            *b, **p;
+    int                  n, l;
+
+    if ( ( kept = log_blocks_get( c, file, block, &n, &l ) ) != NULL ) {
+        free( data );
+        return kept;
+    }
+    if ( ( b = malloc( sizeof( log_block ) ) ) == NULL ) {
+        free( data );
+        return NULL;
+    }
+    /* a short last block gives back what it does not use */
+    if ( len < LOG_BLOCKS_SIZE && ( shrunk = realloc( data, len > 0 ? len : 1 ) ) != NULL ) data = shrunk;
+    while ( c->oldest != NULL && c->used + log_blocks_size( len ) > c->cap ) log_blocks_drop( c, c->oldest );
+
+    b->file = file;
+    b->block = block;
+    b->data = data;
+    b->len = len;
+    b->last = last;
+    p = log_blocks_bucket( c, file, block );
+    b->chain = *p;
+    *p = b;
+    log_blocks_link( c, b );
+    c->used += log_blocks_size( len );
+    return data;
+}
@@ -0,0 +1,49 @@
+/**
+
+A cache of decompressed blocks of compressed logs, shared by the
+cursors of a table.
+
+Each scan of a gzip, xz or zstd log decompresses it, and a join of the
+table with itself, or a correlated subquery on it, scans it again for
+every row of the outer loop. A reader with a cache keeps what it
+decompresses here, in LOG_BLOCKS_SIZE blocks at aligned uncompressed
+offsets, and fills from a block that is here with memcpy() instead of
+decompressing it again, whichever cursor put it here.
+
+The cache holds up to the table's block_cache=MB megabytes
+(LOG_BLOCKS_DEFAULT by default, block_cache=off for none), dropping
+the least recently used blocks first. A log that does not fit is
+decompressed again where its blocks were dropped; a gzip or seekable
+zstd log resumes from the index point before the block, but xz and
+zstd of one frame start over from the beginning of the log, so those
+want a cache that holds all of them.
+
+A file is known by its name, size and modification time: the blocks
+of a file that has changed since they were kept are dropped.
+
+Plain logs are not cached; they are mapped or read, as fast as a copy
+from here, and the kernel's page cache holds them.
+
+The cache has no lock: only the SQLite thread fills or reads it, the
+read ahead threads' readers have none.
+ **/
+
+#ifndef LOGBLOCKS_H
+#define LOGBLOCKS_H
+
+#include <stdint.h>
+
+#define LOG_BLOCKS_SIZE     1048576      /* uncompressed bytes per block */
+#define LOG_BLOCKS_DEFAULT  64           /* megabytes kept, by default */
+
+typedef struct log_blocks_s log_blocks;
+
+log_blocks  * log_blocks_new( int64_t cap );
+void          log_blocks_free( log_blocks *c );
+
+int           log_blocks_file( log_blocks *c, const char *filename, int64_t size, int64_t mtime );
+const unsigned char * log_blocks_get( log_blocks *c, int file, int64_t block, int *len, int *last );
+const unsigned char * log_blocks_put( log_blocks *c, int file, int64_t block,
+                          unsigned char *data, int len, int last );
+
+#endif
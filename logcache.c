@@ -0,0 +1,660 @@
+/**
+
+Columnar cache of the parsed lines of a log file. See logcache.h.
+
+File layout, native byte order as for the index:
+
+    "CATTOYCC"                      magic
+    int32 version, int32 ncols
+    int64 src_size, src_mtime, src_ino, rows
+    ncols * { int32 encoding, width, n_dict, pad; int64 data, blocks, dict }
+    column data, each section starting on an 8 byte boundary
+
+Offsets are from the start of the file. A value in a plain column or a
+dictionary is a varint tag followed by its data: 0 for NULL, 1 for an
+integer, which follows as a zigzag varint, or 2 + length for text. A
+delta column is zigzag varints, the first of each block relative to 0.
+Dict codes are packed least significant bit first, followed by 8 zero
+bytes so a code can always be read with one 8 byte load.
+
+The writer keeps each column's values in a temporary file while the log
+is scanned, along with the column's distinct values up to
+LOG_CACHE_DICT_MAX, and picks each column's encoding at the end.
+ **/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "logcache.h"
+
+#define LOG_CACHE_MAGIC       "CATTOYCC"
+#define LOG_CACHE_VERSION     1
+#define LOG_CACHE_DICT_MAX    ( 1 << 20 )  /* distinct values in a dict */
+#define LOG_CACHE_DICT_BYTES  ( 64 << 20 )
+#define LOG_CACHE_INT_DICT    256        /* more and ints are delta coded */
+
+#define ZIGZAG( x )     ( ( (uint64_t)(x) << 1 ) ^ (uint64_t)( (int64_t)(x) >> 63 ) )
+#define UNZIGZAG( x )   ( (int64_t)( (x) >> 1 ) ^ -(int64_t)( (x) & 1 ) )
+
+typedef struct log_cache_hdr_s {
+    int32_t          encoding;
+    int32_t          width;
+    int32_t          n_dict;
+    int32_t          pad;
+    int64_t          data;
+    int64_t          blocks;
+    int64_t          dict;
+} log_cache_hdr;
+
+static unsigned char * log_cache_put_varint( unsigned char *p, uint64_t x )
+{
+    while ( x >= 0x80 ) {
+        *p++ = (unsigned char)( x | 0x80 );
+        x >>= 7;
+    }
+    *p++ = (unsigned char)x;
+    return p;
+}
+
+static const unsigned char * log_cache_get_varint( const unsigned char *p, uint64_t *x )
+{
+    uint64_t  v = 0;
+    int       shift = 0;
+
+    while ( *p & 0x80 ) {
+        v |= (uint64_t)( *p++ & 0x7f ) << shift;
+        shift += 7;
+    }
+    *x = v | (uint64_t)*p++ << shift;
+    return p;
+}
+
+/* Plain encode v into p, which has room for v->n + 20 bytes. */
+static int log_cache_encode( const log_value *v, unsigned char *p )
+{
+    unsigned char *q = p;
+
+    switch ( v->type ) {
+    case LOG_VALUE_INT:
+        q = log_cache_put_varint( q, 1 );
+        q = log_cache_put_varint( q, ZIGZAG( v->i ) );
+        break;
+    case LOG_VALUE_TEXT:
+        q = log_cache_put_varint( q, 2 + (uint64_t)v->n );
+        memcpy( q, v->s, v->n );
+        q += v->n;
+        break;
+    default:
+        q = log_cache_put_varint( q, 0 );
+    }
+    return q - p;
+}
+
+static const unsigned char * log_cache_decode( const unsigned char *p, log_value *v )
+{
+    uint64_t tag, x;
+
+    p = log_cache_get_varint( p, &tag );
+    if ( tag == 0 ) {
+        v->type = LOG_VALUE_NULL;
+    }
+    else if ( tag == 1 ) {
+        p = log_cache_get_varint( p, &x );
+        v->type = LOG_VALUE_INT;
+        v->i = UNZIGZAG( x );
+    }
+    else {
+        v->type = LOG_VALUE_TEXT;
+        v->s = (const char *)p;
+        v->n = tag - 2;
+        p += v->n;
+    }
+    return p;
+}
+
+/*
+Cache file for filename in dir: the log's name, so a directory listing
+makes sense, and a hash of its full path and of the kind of table, so
+logs of the same name in different directories, or the same log read
+as two kinds of table, do not collide.
+ */
+static char * log_cache_path( const char *dir, const char *kind, const char *filename )
+{
+    char        real[PATH_MAX], *path;
+    const char  *name, *base, *p;
+    uint64_t    h = 14695981039346656037ULL;      /* FNV-1a */
+
+    name = ( realpath( filename, real ) != NULL ? real : filename );
+    for ( p = kind; *p != '\0'; p++ ) h = ( h ^ (unsigned char)*p ) * 1099511628211ULL;
+    h = ( h ^ '/' ) * 1099511628211ULL;
+    for ( p = name; *p != '\0'; p++ ) h = ( h ^ (unsigned char)*p ) * 1099511628211ULL;
+    base = strrchr( name, '/' );
+    base = ( base == NULL ? name : base + 1 );
+
+    if ( asprintf( &path, "%s/%s.%016llx%s", dir, base,
+                   (unsigned long long)h, LOG_CACHE_SUFFIX ) < 0 ) {
+        return NULL;
+    }
+    return path;
+}
+
+/*
+The cache of filename in dir if there is one, it is current and it has
+ncols columns, else NULL.
+ */
+log_cache * log_cache_open( const char *dir, const char *kind, const char *filename, int ncols )
+{
+    struct stat    st, cst;
+    char           *path;
+    const char     *map;
+    int32_t        hdr[2];
+    int64_t        meta[4];
+    log_cache_hdr  ch;
+    log_cache      *cache;
+    int64_t        start;
+    int            fd, i;
+
+    if ( stat( filename, &st ) != 0 ) return NULL;
+    if ( ( path = log_cache_path( dir, kind, filename ) ) == NULL ) return NULL;
+    fd = open( path, O_RDONLY );
+    free( path );
+    if ( fd < 0 ) return NULL;
+    if ( fstat( fd, &cst ) != 0 || cst.st_size < 8 + (off_t)( sizeof( hdr ) + sizeof( meta ) ) ) {
+        close( fd );
+        return NULL;
+    }
+    map = mmap( NULL, cst.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( map == MAP_FAILED ) return NULL;
+
+    memcpy( hdr, map + 8, sizeof( hdr ) );
+    memcpy( meta, map + 8 + sizeof( hdr ), sizeof( meta ) );
+    start = 8 + sizeof( hdr ) + sizeof( meta );
+    if ( memcmp( map, LOG_CACHE_MAGIC, 8 ) != 0 || hdr[0] != LOG_CACHE_VERSION ||
+         hdr[1] != ncols || start + hdr[1] * (int64_t)sizeof( ch ) > cst.st_size ||
+         meta[0] != st.st_size || meta[1] != st.st_mtime || meta[2] != (int64_t)st.st_ino ) {
+        munmap( (void *)map, cst.st_size );
+        return NULL;
+    }
+
+    cache = calloc( 1, sizeof( log_cache ) );
+    if ( cache == NULL || ( cache->cols = calloc( hdr[1], sizeof( log_cache_col ) ) ) == NULL ) {
+        free( cache );
+        munmap( (void *)map, cst.st_size );
+        return NULL;
+    }
+    cache->map = (void *)map;
+    cache->map_len = cst.st_size;
+    cache->rows = meta[3];
+    cache->ncols = hdr[1];
+
+    for ( i = 0; i < cache->ncols; i++ ) {
+        log_cache_col *c = &cache->cols[i];
+
+        memcpy( &ch, map + start + i * sizeof( ch ), sizeof( ch ) );
+        if ( ch.data > cst.st_size || ch.blocks > cst.st_size || ch.dict > cst.st_size ) {
+            log_cache_close( cache );
+            return NULL;
+        }
+        c->encoding = ch.encoding;
+        c->width = ch.width;
+        c->n_dict = ch.n_dict;
+        c->data = (const unsigned char *)map + ch.data;
+        c->blocks = (const unsigned char *)map + ch.blocks;
+        c->dict_data = (const unsigned char *)map + ch.dict;
+        c->row = -1;
+    }
+    return cache;
+}
+
+void log_cache_close( log_cache *cache )
+{
+    int i;
+
+    if ( cache == NULL ) return;
+    for ( i = 0; i < cache->ncols; i++ ) free( cache->cols[i].dict );
+    munmap( cache->map, cache->map_len );
+    free( cache->cols );
+    free( cache );
+}
+
+int log_cache_has( log_cache *cache, int col )
+{
+    return col < cache->ncols && cache->cols[col].encoding != LOG_CACHE_NONE;
+}
+
+static int log_cache_load_dict( log_cache_col *c )
+{
+    const unsigned char  *p = c->dict_data;
+    int                  i;
+
+    if ( ( c->dict = malloc( c->n_dict * sizeof( log_value ) ) ) == NULL ) return -1;
+    for ( i = 0; i < c->n_dict; i++ ) p = log_cache_decode( p, &c->dict[i] );
+    return 0;
+}
+
+/* Decode the value after c->cur, the next row of a delta or plain column. */
+static void log_cache_step( log_cache_col *c )
+{
+    uint64_t x;
+
+    c->row++;
+    if ( c->encoding == LOG_CACHE_DELTA ) {
+        c->pos = log_cache_get_varint( c->pos, &x );
+        if ( c->row % LOG_CACHE_BLOCK == 0 ) c->cur.i = 0;
+        c->cur.type = LOG_VALUE_INT;
+        c->cur.i += UNZIGZAG( x );
+    }
+    else {
+        c->pos = log_cache_decode( c->pos, &c->cur );
+    }
+}
+
+/* Value of column col of row, counting from 0. */
+void log_cache_get( log_cache *cache, int col, int64_t row, log_value *v )
+{
+    log_cache_col  *c = &cache->cols[col];
+    uint64_t       bits, code = 0;
+    int64_t        off;
+
+    v->type = LOG_VALUE_NULL;
+    if ( col >= cache->ncols || row < 0 || row >= cache->rows ) return;
+
+    switch ( c->encoding ) {
+    case LOG_CACHE_DICT:
+        if ( c->dict == NULL && log_cache_load_dict( c ) != 0 ) return;
+        if ( c->width > 0 ) {
+            memcpy( &bits, c->data + ( ( row * c->width ) >> 3 ), 8 );
+            code = ( bits >> ( ( row * c->width ) & 7 ) ) & ( ( (uint64_t)1 << c->width ) - 1 );
+        }
+        if ( code < (uint64_t)c->n_dict ) {
+            v->type = c->dict[code].type;
+            v->i = c->dict[code].i;
+            v->s = c->dict[code].s;
+            v->n = c->dict[code].n;
+        }
+        return;
+
+    case LOG_CACHE_DELTA:
+    case LOG_CACHE_PLAIN:
+        /* restart at the block start unless row is ahead in this block */
+        if ( c->row < 0 || row < c->row || row / LOG_CACHE_BLOCK != c->row / LOG_CACHE_BLOCK ) {
+            memcpy( &off, c->blocks + row / LOG_CACHE_BLOCK * sizeof( int64_t ), sizeof( off ) );
+            c->pos = c->data + off;
+            c->row = row / LOG_CACHE_BLOCK * LOG_CACHE_BLOCK - 1;
+        }
+        while ( c->row < row ) log_cache_step( c );
+        v->type = c->cur.type;
+        v->i = c->cur.i;
+        v->s = c->cur.s;
+        v->n = c->cur.n;
+        return;
+    }
+}
+
+/* writer */
+
+typedef struct log_cache_entry_s {
+    uint64_t         hash;
+    uint32_t         off;                /* in dict */
+    uint32_t         len;
+} log_cache_entry;
+
+typedef struct log_cache_wcol_s {
+    FILE             *tmp;               /* values, plain encoded */
+    int              used;
+    int              all_int;
+    int              dict_over;          /* too many distinct values */
+    unsigned char    *dict;              /* distinct values, plain encoded */
+    size_t           dict_len;
+    size_t           dict_alloc;
+    log_cache_entry  *entries;
+    int              n_dict;
+    uint32_t         *slots;             /* hash table of entry + 1 */
+    int              n_slots;
+} log_cache_wcol;
+
+struct log_cache_writer_s {
+    char             *path;
+    int              ncols;
+    int64_t          rows;
+    int64_t          src_size;
+    int64_t          src_mtime;
+    int64_t          src_ino;
+    log_cache_wcol   *cols;
+    unsigned char    *scratch;
+    size_t           scratch_len;
+};
+
+/*
+Start a cache of filename in dir. The log is stat()ed now, so if it
+changes while it is being read the cache is never used.
+ */
+log_cache_writer * log_cache_create( const char *dir, const char *kind, const char *filename, int ncols )
+{
+    log_cache_writer  *w;
+    struct stat       st;
+
+    if ( stat( filename, &st ) != 0 ) return NULL;
+    if ( ( w = calloc( 1, sizeof( log_cache_writer ) ) ) == NULL ) return NULL;
+    w->ncols = ncols;
+    w->src_size = st.st_size;
+    w->src_mtime = st.st_mtime;
+    w->src_ino = st.st_ino;
+    w->path = log_cache_path( dir, kind, filename );
+    w->cols = calloc( ncols, sizeof( log_cache_wcol ) );
+    if ( w->path == NULL || w->cols == NULL ) {
+        log_cache_abort( w );
+        return NULL;
+    }
+    return w;
+}
+
+static uint64_t log_cache_hash( const unsigned char *p, int len )
+{
+    uint64_t  h = 14695981039346656037ULL;
+    int       i;
+
+    for ( i = 0; i < len; i++ ) h = ( h ^ p[i] ) * 1099511628211ULL;
+    return h;
+}
+
+static void log_cache_drop_dict( log_cache_wcol *col )
+{
+    free( col->dict );
+    free( col->entries );
+    free( col->slots );
+    col->dict = NULL;
+    col->entries = NULL;
+    col->slots = NULL;
+    col->dict_over = 1;
+}
+
+/*
+The dict code of an encoded value, adding it if add is set. Returns -1
+if it is not there, or if the column has too many distinct values.
+ */
+static int log_cache_code( log_cache_wcol *col, const unsigned char *p, int len, int add )
+{
+    uint64_t         h = log_cache_hash( p, len );
+    log_cache_entry  *e;
+    uint32_t         i, k;
+    int              n;
+
+    if ( col->dict_over ) return -1;
+    if ( col->n_slots > 0 ) {
+        for ( i = h & ( col->n_slots - 1 ); col->slots[i] != 0; i = ( i + 1 ) & ( col->n_slots - 1 ) ) {
+            e = &col->entries[col->slots[i] - 1];
+            if ( e->hash == h && e->len == (uint32_t)len &&
+                 memcmp( col->dict + e->off, p, len ) == 0 ) {
+                return col->slots[i] - 1;
+            }
+        }
+    }
+    if ( !add ) return -1;
+
+    if ( col->n_dict == LOG_CACHE_DICT_MAX || col->dict_len + len > LOG_CACHE_DICT_BYTES ) {
+        log_cache_drop_dict( col );
+        return -1;
+    }
+
+    /* grow the table at half full */
+    if ( 2 * ( col->n_dict + 1 ) > col->n_slots ) {
+        n = ( col->n_slots == 0 ? 1024 : 2 * col->n_slots );
+        free( col->slots );
+        if ( ( col->slots = calloc( n, sizeof( uint32_t ) ) ) == NULL ||
+             ( e = realloc( col->entries, n / 2 * sizeof( log_cache_entry ) ) ) == NULL ) {
+            log_cache_drop_dict( col );
+            return -1;
+        }
+        col->entries = e;
+        col->n_slots = n;
+        for ( k = 0; k < (uint32_t)col->n_dict; k++ ) {
+            for ( i = col->entries[k].hash & ( n - 1 ); col->slots[i] != 0; i = ( i + 1 ) & ( n - 1 ) ) ;
+            col->slots[i] = k + 1;
+        }
+    }
+    if ( col->dict_len + len > col->dict_alloc ) {
+        size_t         alloc = ( col->dict_alloc == 0 ? 65536 : 2 * col->dict_alloc );
+        unsigned char  *dict;
+
+        while ( alloc < col->dict_len + len ) alloc *= 2;
+        if ( ( dict = realloc( col->dict, alloc ) ) == NULL ) {
+            log_cache_drop_dict( col );
+            return -1;
+        }
+        col->dict = dict;
+        col->dict_alloc = alloc;
+    }
+
+    e = &col->entries[col->n_dict];
+    e->hash = h;
+    e->off = col->dict_len;
+    e->len = len;
+    memcpy( col->dict + col->dict_len, p, len );
+    col->dict_len += len;
+    for ( i = h & ( col->n_slots - 1 ); col->slots[i] != 0; i = ( i + 1 ) & ( col->n_slots - 1 ) ) ;
+    col->slots[i] = ++col->n_dict;
+    return col->n_dict - 1;
+}
+
+/* Add the value of column col for the current row. Returns 0 or -1. */
+int log_cache_put( log_cache_writer *w, int col, const log_value *v )
+{
+    log_cache_wcol  *c = &w->cols[col];
+    int             len;
+
+    if ( (size_t)v->n + 20 > w->scratch_len ) {
+        unsigned char *s = realloc( w->scratch, v->n + 20 );
+
+        if ( s == NULL ) return -1;
+        w->scratch = s;
+        w->scratch_len = v->n + 20;
+    }
+    if ( !c->used ) {
+        if ( ( c->tmp = tmpfile() ) == NULL ) return -1;
+        c->used = 1;
+        c->all_int = 1;
+    }
+    len = log_cache_encode( v, w->scratch );
+    if ( fwrite( w->scratch, len, 1, c->tmp ) != 1 ) return -1;
+    if ( v->type != LOG_VALUE_INT ) c->all_int = 0;
+    log_cache_code( c, w->scratch, len, 1 );
+    return 0;
+}
+
+void log_cache_end_row( log_cache_writer *w )
+{
+    w->rows++;
+}
+
+/* Read the next plain encoded value from fp into w->scratch. */
+static int log_cache_read( log_cache_writer *w, FILE *fp )
+{
+    unsigned char  *p = w->scratch;
+    uint64_t       tag = 0;
+    int            ch, shift = 0, ints = 0;
+
+    do {
+        if ( ( ch = getc( fp ) ) == EOF ) return -1;
+        *p++ = ch;
+        tag |= (uint64_t)( ch & 0x7f ) << shift;
+        shift += 7;
+    } while ( ch & 0x80 );
+
+    if ( tag == 1 ) {
+        do {
+            if ( ( ch = getc( fp ) ) == EOF ) return -1;
+            *p++ = ch;
+        } while ( ( ch & 0x80 ) && ++ints < 10 );
+    }
+    else if ( tag >= 2 ) {
+        if ( fread( p, tag - 2, 1, fp ) != 1 && tag > 2 ) return -1;
+        p += tag - 2;
+    }
+    return p - w->scratch;
+}
+
+static int log_cache_align( FILE *fp )
+{
+    static const char  zero[8];
+    long               pos = ftell( fp );
+
+    return ( pos % 8 == 0 ? 0 : fwrite( zero, 8 - pos % 8, 1, fp ) != 1 );
+}
+
+static int log_cache_write_col( log_cache_writer *w, log_cache_wcol *c, log_cache_hdr *ch, FILE *fp )
+{
+    unsigned char  buf[20], *q;
+    log_value      v;
+    int64_t        *blocks = NULL, row, prev = 0, plain_bytes, nblocks;
+    uint64_t       acc = 0;
+    int            len, nacc = 0, code, rc = -1;
+
+    plain_bytes = ftell( c->tmp );
+    rewind( c->tmp );
+    while ( c->n_dict > 1 << ch->width ) ch->width++;
+
+    if ( c->all_int && ( c->dict_over || c->n_dict > LOG_CACHE_INT_DICT ) ) {
+        ch->encoding = LOG_CACHE_DELTA;
+    }
+    else if ( !c->dict_over && c->dict_len + w->rows * ch->width / 8 < (uint64_t)plain_bytes ) {
+        ch->encoding = LOG_CACHE_DICT;
+    }
+    else {
+        ch->encoding = ( c->all_int ? LOG_CACHE_DELTA : LOG_CACHE_PLAIN );
+    }
+
+    if ( log_cache_align( fp ) != 0 ) return -1;
+    if ( ch->encoding == LOG_CACHE_DICT ) {
+        ch->n_dict = c->n_dict;
+        ch->dict = ftell( fp );
+        if ( c->dict_len > 0 && fwrite( c->dict, c->dict_len, 1, fp ) != 1 ) return -1;
+        ch->data = ftell( fp );
+        for ( row = 0; row < w->rows; row++ ) {
+            if ( ( len = log_cache_read( w, c->tmp ) ) < 0 ) return -1;
+            if ( ( code = log_cache_code( c, w->scratch, len, 0 ) ) < 0 ) return -1;
+            acc |= (uint64_t)code << nacc;
+            nacc += ch->width;
+            while ( nacc >= 8 ) {
+                if ( putc( acc & 0xff, fp ) == EOF ) return -1;
+                acc >>= 8;
+                nacc -= 8;
+            }
+        }
+        if ( nacc > 0 && putc( acc & 0xff, fp ) == EOF ) return -1;
+        if ( fwrite( &prev, 8, 1, fp ) != 1 ) return -1;     /* 8 zero bytes */
+        return 0;
+    }
+
+    /* delta or plain, in blocks */
+    ch->width = 0;
+    nblocks = ( w->rows + LOG_CACHE_BLOCK - 1 ) / LOG_CACHE_BLOCK;
+    if ( ( blocks = malloc( ( nblocks + 1 ) * sizeof( int64_t ) ) ) == NULL ) return -1;
+    ch->data = ftell( fp );
+    for ( row = 0; row < w->rows; row++ ) {
+        if ( row % LOG_CACHE_BLOCK == 0 ) {
+            blocks[row / LOG_CACHE_BLOCK] = ftell( fp ) - ch->data;
+            prev = 0;
+        }
+        if ( ( len = log_cache_read( w, c->tmp ) ) < 0 ) goto done;
+        if ( ch->encoding == LOG_CACHE_DELTA ) {
+            log_cache_decode( w->scratch, &v );
+            q = log_cache_put_varint( buf, ZIGZAG( v.i - prev ) );
+            prev = v.i;
+            if ( fwrite( buf, q - buf, 1, fp ) != 1 ) goto done;
+        }
+        else if ( fwrite( w->scratch, len, 1, fp ) != 1 ) {
+            goto done;
+        }
+    }
+    if ( log_cache_align( fp ) != 0 ) goto done;
+    ch->blocks = ftell( fp );
+    if ( nblocks > 0 && fwrite( blocks, nblocks * sizeof( int64_t ), 1, fp ) != 1 ) goto done;
+    rc = 0;
+
+done:
+    free( blocks );
+    return rc;
+}
+
+/*
+Write the cache, to a temporary file that is renamed into place as for
+the index, and free w. Returns 0 on success.
+ */
+int log_cache_finish( log_cache_writer *w )
+{
+    log_cache_hdr  *hdrs;
+    char           *tmp = NULL;
+    int32_t        hdr[2];
+    int64_t        meta[4];
+    FILE           *fp = NULL;
+    int            i, rc = -1;
+
+    if ( ( hdrs = calloc( w->ncols, sizeof( log_cache_hdr ) ) ) == NULL ) goto done;
+    if ( asprintf( &tmp, "%s.%d", w->path, (int)getpid() ) < 0 ) {
+        tmp = NULL;
+        goto done;
+    }
+    if ( ( fp = fopen( tmp, "wb" ) ) == NULL ) goto done;
+
+    hdr[0] = LOG_CACHE_VERSION;
+    hdr[1] = w->ncols;
+    meta[0] = w->src_size;
+    meta[1] = w->src_mtime;
+    meta[2] = w->src_ino;
+    meta[3] = w->rows;
+    fwrite( LOG_CACHE_MAGIC, 8, 1, fp );
+    fwrite( hdr, sizeof( hdr ), 1, fp );
+    fwrite( meta, sizeof( meta ), 1, fp );
+    fwrite( hdrs, sizeof( log_cache_hdr ), w->ncols, fp );
+
+    for ( i = 0; i < w->ncols; i++ ) {
+        if ( w->cols[i].used && log_cache_write_col( w, &w->cols[i], &hdrs[i], fp ) != 0 ) {
+            goto done;
+        }
+    }
+    if ( fseek( fp, 8 + sizeof( hdr ) + sizeof( meta ), SEEK_SET ) != 0 ||
+         fwrite( hdrs, sizeof( log_cache_hdr ), w->ncols, fp ) != (size_t)w->ncols ) {
+        goto done;
+    }
+
+    i = ferror( fp );
+    i |= fclose( fp );
+    fp = NULL;
+    if ( i == 0 && rename( tmp, w->path ) == 0 ) rc = 0;
+
+done:
+    if ( fp != NULL ) fclose( fp );
+    if ( rc != 0 && tmp != NULL ) remove( tmp );
+    free( tmp );
+    free( hdrs );
+    log_cache_abort( w );
+    return rc;
+}
+
+/* Free w without writing the cache. */
+void log_cache_abort( log_cache_writer *w )
+{
+    int i;
+
+    if ( w == NULL ) return;
+    for ( i = 0; w->cols != NULL && i < w->ncols; i++ ) {
+        if ( w->cols[i].tmp != NULL ) fclose( w->cols[i].tmp );
+        free( w->cols[i].dict );
+        free( w->cols[i].entries );
+        free( w->cols[i].slots );
+    }
+    free( w->cols );
+    free( w->scratch );
+    free( w->path );
+    free( w );
+}
@@ -0,0 +1,91 @@
+/**
+
+Columnar cache of the parsed lines of a log file.
+
+With the cache= table argument, the first full scan of a log writes
+the value of every column of every line to a file in that directory,
+e.g.
+    cache/access_log-20141102.gz.3f2a9c1e5b7d8604.cattoy-col
+and later queries read the columns they ask for from it instead of
+inflating and parsing the log. A cache is used only while the log's
+size, mtime and inode are unchanged.
+
+Each column is stored on its own, in whichever of three encodings is
+smallest for it:
+    dict    a list of the distinct values and, per line, the value's
+            number in the list, packed into as few bits as the list
+            needs (status, method, user_agent, ...)
+    delta   integers, as the difference from the line before
+            (time_epoch, response_time, ...)
+    plain   each value in full (url, message, ...)
+Delta and plain columns are kept in blocks of LOG_CACHE_BLOCK lines
+so a rowid lookup only decodes part of one block.
+ **/
+
+#ifndef LOGCACHE_H
+#define LOGCACHE_H
+
+#include <stdint.h>
+
+#define LOG_CACHE_SUFFIX    ".cattoy-col"
+#define LOG_CACHE_BLOCK     4096         /* lines per delta or plain block */
+
+/* a column value, as handed to SQLite */
+#define LOG_VALUE_NULL      0
+#define LOG_VALUE_INT       1
+#define LOG_VALUE_TEXT      2
+#define LOG_VALUE_BLOB      3            /* bytes in s, not cached */
+
+typedef struct log_value_s {
+    int              type;               /* LOG_VALUE_* */
+    int64_t          i;
+    const char       *s;                 /* not NUL terminated */
+    int              n;
+    char             buf[32];            /* for text made on the fly */
+} log_value;
+
+/* column encodings */
+#define LOG_CACHE_NONE      0            /* not cached */
+#define LOG_CACHE_DICT      1
+#define LOG_CACHE_DELTA     2
+#define LOG_CACHE_PLAIN     3
+
+typedef struct log_cache_col_s {
+    int                  encoding;
+    int                  width;          /* bits per dict code */
+    const unsigned char  *data;          /* codes or blocks */
+    const unsigned char  *blocks;        /* int64 offsets of blocks in data */
+    const unsigned char  *dict_data;     /* dict values, plain encoded */
+    int                  n_dict;
+    log_value            *dict;          /* decoded on first use */
+
+    /* delta and plain columns are decoded forwards from a block start */
+    int64_t              row;            /* row of cur, -1 if none */
+    const unsigned char  *pos;           /* after cur */
+    log_value            cur;
+} log_cache_col;
+
+typedef struct log_cache_s {
+    void             *map;
+    int64_t          map_len;
+    int64_t          rows;
+    int              ncols;
+    log_cache_col    *cols;
+} log_cache;
+
+log_cache  * log_cache_open( const char *dir, const char *kind,
+                             const char *filename, int ncols );
+void         log_cache_close( log_cache *cache );
+int          log_cache_has( log_cache *cache, int col );
+void         log_cache_get( log_cache *cache, int col, int64_t row, log_value *v );
+
+typedef struct log_cache_writer_s log_cache_writer;
+
+log_cache_writer * log_cache_create( const char *dir, const char *kind,
+                                     const char *filename, int ncols );
+int          log_cache_put( log_cache_writer *w, int col, const log_value *v );
+void         log_cache_end_row( log_cache_writer *w );
+int          log_cache_finish( log_cache_writer *w );
+void         log_cache_abort( log_cache_writer *w );
+
+#endif
@@ -0,0 +1,575 @@
+/**
+
+The log_correlate table-valued function. See logcorrelate.h.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "logcorrelate.h"
+#include "logzone.h"
+
+#define LOG_CORRELATE_SECONDS  10        /* default match window */
+#define LOG_CORRELATE_SLACK    300       /* default, as TIME_SLACK_DEFAULT */
+#define LOG_CORRELATE_ID_MIN   6         /* shortest log id looked for */
+
+static const char *log_correlate_sql =
+"    CREATE TABLE log_correlate (         "
+"        error_rowid           INTEGER,        "  /*  0 */
+"        access_rowid          INTEGER,        "  /*  1 NULL without a match */
+"        time_epoch            INTEGER,        "  /*  2 of the error */
+"        access_time_epoch     INTEGER,        "  /*  3 */
+"        lag                   INTEGER,        "  /*  4 seconds from request to error */
+"        remote_host           TEXT,           "  /*  5 of the error */
+"        matched_by            TEXT,           "  /*  6 log_id, remote_host */
+"        log_level             TEXT,           "  /*  7 */
+"        message               TEXT,           "  /*  8 */
+"        method                TEXT,           "  /*  9 of the request */
+"        url                   TEXT,           "  /* 10 */
+"        status                INTEGER,        "  /* 11 */
+"        response_time         INTEGER,        "  /* 12 */
+"        access_table          HIDDEN,         "  /* 13 arguments */
+"        error_table           HIDDEN,         "  /* 14 */
+"        seconds               HIDDEN,         "  /* 15 */
+"        slack                 HIDDEN          "  /* 16 */
+"     );                                       ";
+
+#define COL_ARGS         13
+#define N_ARGS           4
+
+/* columns of the statements the tables are read with */
+#define ACCESS_ROWID     0
+#define ACCESS_TIME      1
+#define ACCESS_HOST      2
+#define ACCESS_METHOD    3
+#define ACCESS_URL       4
+#define ACCESS_STATUS    5
+#define ACCESS_RESPONSE  6
+#define ACCESS_LOG_ID    7
+
+#define ERROR_ROWID      0
+#define ERROR_TIME       1
+#define ERROR_HOST       2
+#define ERROR_LEVEL      3
+#define ERROR_MESSAGE    4
+#define ERROR_LINE       5
+
+typedef struct log_correlate_vtab_s {
+    sqlite3_vtab     vtab;               /* this must be first */
+    sqlite3          *db;                /* the tables are read from */
+} log_correlate_vtab;
+
+/* a request kept for matching */
+typedef struct log_correlate_req_s {
+    sqlite3_int64    rowid;
+    sqlite3_int64    time;
+    uint64_t         host;               /* hash of remote_host */
+    uint64_t         id;                 /* hash of log_id, 0 for none */
+    int64_t          prev;               /* the client's request before, or -1 */
+    sqlite3_int64    status;
+    sqlite3_int64    response_time;
+    int              nulls;              /* of status and response_time, bits 1 and 2 */
+    char             *method;            /* and url after it, one allocation */
+    char             *url;
+} log_correlate_req;
+
+/* hash to the latest request with it, by its number */
+typedef struct log_correlate_slot_s {
+    uint64_t         key;                /* 0 for an empty slot */
+    int64_t          seq;
+} log_correlate_slot;
+
+typedef struct log_correlate_map_s {
+    log_correlate_slot *slot;
+    int64_t          mask;               /* slots - 1 */
+    int64_t          used;
+} log_correlate_map;
+
+typedef struct log_correlate_cursor_s {
+    sqlite3_vtab_cursor   cur;           /* this must be first */
+    sqlite3_stmt     *access;
+    sqlite3_stmt     *error;
+    int              has_id;             /* access has log_id */
+    int              access_done;
+    sqlite3_int64    access_max;         /* latest time_epoch read */
+    sqlite3_int64    seconds;
+    sqlite3_int64    slack;
+
+    /* requests kept, numbered in the order read; seq & mask is the index */
+    log_correlate_req *reqs;
+    int64_t          mask;
+    int64_t          front;              /* oldest kept */
+    int64_t          end;                /* next to read */
+    log_correlate_map hosts;
+    log_correlate_map ids;
+
+    /* the current error */
+    int              eof;
+    sqlite3_int64    row;
+    log_correlate_req *match;
+    const char       *matched_by;
+} log_correlate_cursor;
+
+static uint64_t log_correlate_hash( const char *s, int n )
+{
+    uint64_t h = log_zone_hash( s, n );
+
+    return ( h != 0 ? h : 1 );
+}
+
+static void log_correlate_map_free( log_correlate_map *m )
+{
+    free( m->slot );
+    memset( m, 0, sizeof( *m ) );
+}
+
+static int log_correlate_map_init( log_correlate_map *m, int64_t slots )
+{
+    m->slot = calloc( slots, sizeof( log_correlate_slot ) );
+    m->mask = slots - 1;
+    m->used = 0;
+    return ( m->slot != NULL ? 0 : -1 );
+}
+
+/* The latest request with key, or -1. */
+static int64_t log_correlate_get( const log_correlate_map *m, uint64_t key )
+{
+    int64_t i;
+
+    if ( m->slot == NULL ) return -1;
+    for ( i = key & m->mask; m->slot[i].key != 0; i = ( i + 1 ) & m->mask ) {
+        if ( m->slot[i].key == key ) return m->slot[i].seq;
+    }
+    return -1;
+}
+
+/* Make seq the latest request with key; returns the one before, or -1. */
+static int64_t log_correlate_put( log_correlate_map *m, uint64_t key, int64_t seq )
+{
+    int64_t i, prev;
+
+    for ( i = key & m->mask; m->slot[i].key != 0; i = ( i + 1 ) & m->mask ) {
+        if ( m->slot[i].key == key ) {
+            prev = m->slot[i].seq;
+            m->slot[i].seq = seq;
+            return prev;
+        }
+    }
+    m->slot[i].key = key;
+    m->slot[i].seq = seq;
+    m->used++;
+    return -1;
+}
+
+/*
+Rebuild the maps from the requests still kept, dropping the keys of
+those gone, once they are half full. They grow if the kept requests
+alone would fill a quarter of them.
+ */
+static int log_correlate_rehash( log_correlate_cursor *c )
+{
+    int64_t  live = c->end - c->front, slots = c->hosts.mask + 1, seq;
+
+    if ( c->hosts.slot != NULL && c->hosts.used * 2 < slots && c->ids.used * 2 < slots ) return 0;
+    while ( live * 4 > slots || slots < 1024 ) slots *= 2;
+    log_correlate_map_free( &c->hosts );
+    log_correlate_map_free( &c->ids );
+    if ( log_correlate_map_init( &c->hosts, slots ) != 0 ) return -1;
+    if ( log_correlate_map_init( &c->ids, slots ) != 0 ) return -1;
+    for ( seq = c->front; seq < c->end; seq++ ) {
+        log_correlate_req *r = &c->reqs[seq & c->mask];
+
+        r->prev = log_correlate_put( &c->hosts, r->host, seq );
+        if ( r->id != 0 ) log_correlate_put( &c->ids, r->id, seq );
+    }
+    return 0;
+}
+
+/* Drop the requests that are too old to match an error at time t. */
+static void log_correlate_evict( log_correlate_cursor *c, sqlite3_int64 t )
+{
+    while ( c->front < c->end && c->reqs[c->front & c->mask].time < t - c->seconds - c->slack ) {
+        free( c->reqs[c->front & c->mask].method );
+        c->front++;
+    }
+}
+
+/* Keep the access statement's current row; returns 0, or -1 out of memory. */
+static int log_correlate_keep( log_correlate_cursor *c )
+{
+    sqlite3_stmt       *s = c->access;
+    log_correlate_req  *r;
+    const char         *host, *method, *url, *id;
+    int                nh, nm, nu, ni;
+
+    if ( c->reqs == NULL || c->end - c->front > c->mask ) {
+        int64_t            size = ( c->reqs != NULL ? ( c->mask + 1 ) * 2 : 1024 ), seq;
+        log_correlate_req  *reqs = malloc( size * sizeof( log_correlate_req ) );
+
+        if ( reqs == NULL ) return -1;
+        for ( seq = c->front; seq < c->end; seq++ ) reqs[seq & ( size - 1 )] = c->reqs[seq & c->mask];
+        free( c->reqs );
+        c->reqs = reqs;
+        c->mask = size - 1;
+    }
+    if ( log_correlate_rehash( c ) != 0 ) return -1;
+
+    host = (const char *)sqlite3_column_text( s, ACCESS_HOST );
+    nh = sqlite3_column_bytes( s, ACCESS_HOST );
+    method = (const char *)sqlite3_column_text( s, ACCESS_METHOD );
+    nm = sqlite3_column_bytes( s, ACCESS_METHOD );
+    url = (const char *)sqlite3_column_text( s, ACCESS_URL );
+    nu = sqlite3_column_bytes( s, ACCESS_URL );
+
+    r = &c->reqs[c->end & c->mask];
+    memset( r, 0, sizeof( *r ) );
+    if ( ( r->method = malloc( nm + nu + 2 ) ) == NULL ) return -1;
+    memcpy( r->method, method != NULL ? method : "", nm );
+    r->method[nm] = '\0';
+    r->url = r->method + nm + 1;
+    memcpy( r->url, url != NULL ? url : "", nu );
+    r->url[nu] = '\0';
+    if ( method == NULL ) r->nulls |= 4;
+    if ( url == NULL ) r->nulls |= 8;
+
+    r->rowid = sqlite3_column_int64( s, ACCESS_ROWID );
+    r->time = sqlite3_column_int64( s, ACCESS_TIME );
+    r->host = log_correlate_hash( host != NULL ? host : "", nh );
+    r->status = sqlite3_column_int64( s, ACCESS_STATUS );
+    r->response_time = sqlite3_column_int64( s, ACCESS_RESPONSE );
+    if ( sqlite3_column_type( s, ACCESS_STATUS ) == SQLITE_NULL ) r->nulls |= 1;
+    if ( sqlite3_column_type( s, ACCESS_RESPONSE ) == SQLITE_NULL ) r->nulls |= 2;
+
+    r->prev = log_correlate_put( &c->hosts, r->host, c->end );
+    if ( c->has_id && ( id = (const char *)sqlite3_column_text( s, ACCESS_LOG_ID ) ) != NULL &&
+         ( ni = sqlite3_column_bytes( s, ACCESS_LOG_ID ) ) >= LOG_CORRELATE_ID_MIN ) {
+        r->id = log_correlate_hash( id, ni );
+        log_correlate_put( &c->ids, r->id, c->end );
+    }
+    c->end++;
+    return 0;
+}
+
+/*
+Read requests until one is more than slack seconds after t, so that
+all those logged before t, up to slack seconds out of order, are kept.
+ */
+static int log_correlate_read( log_correlate_cursor *c, sqlite3_int64 t )
+{
+    int rc;
+
+    while ( !c->access_done && c->access_max <= t + c->slack ) {
+        rc = sqlite3_step( c->access );
+        if ( rc == SQLITE_DONE ) {
+            c->access_done = 1;
+            break;
+        }
+        if ( rc != SQLITE_ROW ) return rc;
+        if ( sqlite3_column_type( c->access, ACCESS_TIME ) == SQLITE_NULL ) continue;
+        if ( log_correlate_keep( c ) != 0 ) return SQLITE_NOMEM;
+        if ( c->reqs[( c->end - 1 ) & c->mask].time > c->access_max ) {
+            c->access_max = c->reqs[( c->end - 1 ) & c->mask].time;
+        }
+    }
+    return SQLITE_OK;
+}
+
+/* The request whose log id is one of the words of the error line. */
+static log_correlate_req * log_correlate_by_id( log_correlate_cursor *c )
+{
+    const char  *line = (const char *)sqlite3_column_text( c->error, ERROR_LINE );
+    int         n = sqlite3_column_bytes( c->error, ERROR_LINE ), i = 0, start;
+    int64_t     seq;
+
+    if ( line == NULL ) return NULL;
+    while ( i < n ) {
+        for ( start = i; i < n; i++ ) {
+            char ch = line[i];
+
+            if ( !( ( ch >= 'a' && ch <= 'z' ) || ( ch >= 'A' && ch <= 'Z' ) || ( ch >= '0' && ch <= '9' ) ||
+                    ch == '@' || ch == '-' || ch == '_' ) ) break;
+        }
+        if ( i - start >= LOG_CORRELATE_ID_MIN ) {
+            uint64_t id = log_correlate_hash( line + start, i - start );
+
+            seq = log_correlate_get( &c->ids, id );
+            if ( seq >= c->front && c->reqs[seq & c->mask].id == id ) return &c->reqs[seq & c->mask];
+        }
+        i++;
+    }
+    return NULL;
+}
+
+/*
+The latest request from the error's client at most seconds before it.
+A client's requests are chained newest first in the order they were
+logged, which is nearly time order, so the walk stops slack seconds
+past the window.
+ */
+static log_correlate_req * log_correlate_by_host( log_correlate_cursor *c, sqlite3_int64 t )
+{
+    const char         *host = (const char *)sqlite3_column_text( c->error, ERROR_HOST );
+    log_correlate_req  *best = NULL, *r;
+    uint64_t           key;
+    int64_t            seq;
+
+    if ( host == NULL || *host == '\0' ) return NULL;
+    key = log_correlate_hash( host, sqlite3_column_bytes( c->error, ERROR_HOST ) );
+    for ( seq = log_correlate_get( &c->hosts, key ); seq >= c->front; seq = r->prev ) {
+        r = &c->reqs[seq & c->mask];
+        if ( r->time < t - c->seconds - c->slack ) break;
+        if ( r->time <= t && r->time >= t - c->seconds && ( best == NULL || r->time > best->time ) ) {
+            best = r;
+        }
+    }
+    return best;
+}
+
+static int log_correlate_next( sqlite3_vtab_cursor *cur )
+{
+    log_correlate_cursor  *c = (log_correlate_cursor*)cur;
+    sqlite3_int64         t;
+    int                   rc;
+
+    c->match = NULL;
+    c->matched_by = NULL;
+    rc = sqlite3_step( c->error );
+    if ( rc == SQLITE_DONE ) {
+        c->eof = 1;
+        return SQLITE_OK;
+    }
+    if ( rc != SQLITE_ROW ) return rc;
+    c->row++;
+    if ( sqlite3_column_type( c->error, ERROR_TIME ) == SQLITE_NULL ) return SQLITE_OK;
+
+    t = sqlite3_column_int64( c->error, ERROR_TIME );
+    if ( ( rc = log_correlate_read( c, t ) ) != SQLITE_OK ) return rc;
+    log_correlate_evict( c, t );
+
+    if ( c->has_id && ( c->match = log_correlate_by_id( c ) ) != NULL ) {
+        c->matched_by = "log_id";
+    }
+    else if ( ( c->match = log_correlate_by_host( c, t ) ) != NULL ) {
+        c->matched_by = "remote_host";
+    }
+    return SQLITE_OK;
+}
+
+static int log_correlate_connect( sqlite3 *db, void *udp, int argc,
+        const char *const *argv, sqlite3_vtab **vtab, char **errmsg )
+{
+    log_correlate_vtab  *v;
+    int                 rc;
+
+    *vtab = NULL;
+    rc = sqlite3_declare_vtab( db, log_correlate_sql );
+    if ( rc != SQLITE_OK ) return rc;
+    v = sqlite3_malloc( sizeof( log_correlate_vtab ) );
+    if ( v == NULL ) return SQLITE_NOMEM;
+    memset( v, 0, sizeof( log_correlate_vtab ) );
+    v->db = db;
+    *vtab = (sqlite3_vtab*)v;
+    return SQLITE_OK;
+}
+
+static int log_correlate_disconnect( sqlite3_vtab *vtab )
+{
+    sqlite3_free( vtab );
+    return SQLITE_OK;
+}
+
+/*
+The arguments are equality constraints on the hidden columns. The two
+table names are required; idxNum has a bit for each argument given,
+and they are passed to filter in column order.
+ */
+static int log_correlate_bestindex( sqlite3_vtab *vtab, sqlite3_index_info *info )
+{
+    int  arg[N_ARGS] = { -1, -1, -1, -1 };
+    int  i, k, argc = 0;
+
+    for ( i = 0; i < info->nConstraint; i++ ) {
+        const struct sqlite3_index_constraint *con = &info->aConstraint[i];
+
+        if ( con->iColumn < COL_ARGS || con->op != SQLITE_INDEX_CONSTRAINT_EQ ) continue;
+        if ( !con->usable ) return SQLITE_CONSTRAINT;
+        arg[con->iColumn - COL_ARGS] = i;
+    }
+    if ( arg[0] < 0 || arg[1] < 0 ) {
+        vtab->zErrMsg = sqlite3_mprintf( "log_correlate needs an access_log and an error_log table" );
+        return SQLITE_ERROR;
+    }
+    info->idxNum = 0;
+    for ( k = 0; k < N_ARGS; k++ ) {
+        if ( arg[k] < 0 ) continue;
+        info->idxNum |= 1 << k;
+        info->aConstraintUsage[arg[k]].argvIndex = ++argc;
+        info->aConstraintUsage[arg[k]].omit = 1;
+    }
+    info->estimatedCost = 1000000;
+    return SQLITE_OK;
+}
+
+static int log_correlate_open( sqlite3_vtab *vtab, sqlite3_vtab_cursor **cur )
+{
+    log_correlate_cursor *c = sqlite3_malloc( sizeof( log_correlate_cursor ) );
+
+    *cur = NULL;
+    if ( c == NULL ) return SQLITE_NOMEM;
+    memset( c, 0, sizeof( log_correlate_cursor ) );
+    c->eof = 1;
+    *cur = (sqlite3_vtab_cursor*)c;
+    return SQLITE_OK;
+}
+
+static void log_correlate_clear( log_correlate_cursor *c )
+{
+    int64_t seq;
+
+    sqlite3_finalize( c->access );
+    sqlite3_finalize( c->error );
+    c->access = c->error = NULL;
+    for ( seq = c->front; seq < c->end; seq++ ) free( c->reqs[seq & c->mask].method );
+    free( c->reqs );
+    c->reqs = NULL;
+    c->mask = -1;
+    c->front = c->end = 0;
+    log_correlate_map_free( &c->hosts );
+    log_correlate_map_free( &c->ids );
+    c->match = NULL;
+}
+
+static int log_correlate_close( sqlite3_vtab_cursor *cur )
+{
+    log_correlate_clear( (log_correlate_cursor*)cur );
+    sqlite3_free( cur );
+    return SQLITE_OK;
+}
+
+static int log_correlate_filter( sqlite3_vtab_cursor *cur, int idxnum, const char *idxstr,
+        int argc, sqlite3_value **value )
+{
+    log_correlate_cursor  *c = (log_correlate_cursor*)cur;
+    log_correlate_vtab    *v = (log_correlate_vtab*)cur->pVtab;
+    const char            *access, *error;
+    char                  *sql;
+    int                   rc, k = 2;
+
+    log_correlate_clear( c );
+    c->eof = 1;
+    c->row = 0;
+    c->access_done = 0;
+    c->access_max = INT64_MIN;
+    c->seconds = LOG_CORRELATE_SECONDS;
+    c->slack = LOG_CORRELATE_SLACK;
+    access = (const char *)sqlite3_value_text( value[0] );
+    error = (const char *)sqlite3_value_text( value[1] );
+    if ( idxnum & 4 ) c->seconds = sqlite3_value_int64( value[k++] );
+    if ( idxnum & 8 ) c->slack = sqlite3_value_int64( value[k++] );
+    if ( access == NULL || error == NULL || c->seconds < 0 || c->slack < 0 ) {
+        v->vtab.zErrMsg = sqlite3_mprintf( "log_correlate needs two table names, and seconds and slack of 0 or more" );
+        return SQLITE_ERROR;
+    }
+
+    /* log_id is there only with a format= that has %L */
+    c->has_id = 1;
+    sql = sqlite3_mprintf( "SELECT rowid, time_epoch, remote_host, method, url, status, response_time, log_id "
+                           "FROM \"%w\"", access );
+    if ( sql == NULL ) return SQLITE_NOMEM;
+    rc = sqlite3_prepare_v2( v->db, sql, -1, &c->access, NULL );
+    sqlite3_free( sql );
+    if ( rc != SQLITE_OK ) {
+        c->has_id = 0;
+        sql = sqlite3_mprintf( "SELECT rowid, time_epoch, remote_host, method, url, status, response_time "
+                               "FROM \"%w\"", access );
+        if ( sql == NULL ) return SQLITE_NOMEM;
+        rc = sqlite3_prepare_v2( v->db, sql, -1, &c->access, NULL );
+        sqlite3_free( sql );
+    }
+    if ( rc == SQLITE_OK ) {
+        sql = sqlite3_mprintf( "SELECT rowid, time_epoch, remote_host, log_level, message, %s FROM \"%w\"",
+                               c->has_id ? "line" : "NULL", error );
+        if ( sql == NULL ) return SQLITE_NOMEM;
+        rc = sqlite3_prepare_v2( v->db, sql, -1, &c->error, NULL );
+        sqlite3_free( sql );
+    }
+    if ( rc != SQLITE_OK ) {
+        v->vtab.zErrMsg = sqlite3_mprintf( "log_correlate: %s", sqlite3_errmsg( v->db ) );
+        return rc;
+    }
+    c->eof = 0;
+    return log_correlate_next( cur );
+}
+
+static int log_correlate_eof( sqlite3_vtab_cursor *cur )
+{
+    return ((log_correlate_cursor*)cur)->eof;
+}
+
+static int log_correlate_rowid( sqlite3_vtab_cursor *cur, sqlite3_int64 *rowid )
+{
+    *rowid = ((log_correlate_cursor*)cur)->row;
+    return SQLITE_OK;
+}
+
+static int log_correlate_column( sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int cidx )
+{
+    log_correlate_cursor  *c = (log_correlate_cursor*)cur;
+    log_correlate_req     *r = c->match;
+
+    switch ( cidx ) {
+    case 0:  sqlite3_result_value( ctx, sqlite3_column_value( c->error, ERROR_ROWID ) ); break;
+    case 2:  sqlite3_result_value( ctx, sqlite3_column_value( c->error, ERROR_TIME ) ); break;
+    case 5:  sqlite3_result_value( ctx, sqlite3_column_value( c->error, ERROR_HOST ) ); break;
+    case 7:  sqlite3_result_value( ctx, sqlite3_column_value( c->error, ERROR_LEVEL ) ); break;
+    case 8:  sqlite3_result_value( ctx, sqlite3_column_value( c->error, ERROR_MESSAGE ) ); break;
+    case 6:
+        if ( c->matched_by != NULL ) sqlite3_result_text( ctx, c->matched_by, -1, SQLITE_STATIC );
+        break;
+    }
+    if ( r == NULL ) return SQLITE_OK;
+    switch ( cidx ) {
+    case 1:  sqlite3_result_int64( ctx, r->rowid ); break;
+    case 3:  sqlite3_result_int64( ctx, r->time ); break;
+    case 4:  sqlite3_result_int64( ctx, sqlite3_column_int64( c->error, ERROR_TIME ) - r->time ); break;
+    case 9:  if ( !( r->nulls & 4 ) ) sqlite3_result_text( ctx, r->method, -1, SQLITE_TRANSIENT ); break;
+    case 10: if ( !( r->nulls & 8 ) ) sqlite3_result_text( ctx, r->url, -1, SQLITE_TRANSIENT ); break;
+    case 11: if ( !( r->nulls & 1 ) ) sqlite3_result_int64( ctx, r->status ); break;
+    case 12: if ( !( r->nulls & 2 ) ) sqlite3_result_int64( ctx, r->response_time ); break;
+    }
+    return SQLITE_OK;
+}
+
+static sqlite3_module log_correlate_mod = {
+    1,                            /* iVersion        */
+    NULL,                         /* xCreate(), eponymous only */
+    log_correlate_connect,        /* xConnect()      */
+    log_correlate_bestindex,      /* xBestIndex()    */
+    log_correlate_disconnect,     /* xDisconnect()   */
+    log_correlate_disconnect,     /* xDestroy()      */
+    log_correlate_open,           /* xOpen()         */
+    log_correlate_close,          /* xClose()        */
+    log_correlate_filter,         /* xFilter()       */
+    log_correlate_next,           /* xNext()         */
+    log_correlate_eof,            /* xEof()          */
+    log_correlate_column,         /* xColumn()       */
+    log_correlate_rowid,          /* xRowid()        */
+    NULL,                         /* xUpdate()       */
+    NULL,                         /* xBegin()        */
+    NULL,                         /* xSync()         */
+    NULL,                         /* xCommit()       */
+    NULL,                         /* xRollback()     */
+    NULL,                         /* xFindFunction() */
+    NULL                          /* xRename()       */
+};
+
+/* Make log_correlate available, once per connection. */
+int log_correlate_init( sqlite3 *db )
+{
+    return sqlite3_create_module( db, "log_correlate", &log_correlate_mod, NULL );
+}
@@ -0,0 +1,35 @@
+/**
+
+The log_correlate table-valued function: each line of an error_log
+table with the request of an access_log table it most likely belongs
+to, found in one pass over each.
+
+    SELECT * FROM log_correlate('access_log', 'error_log', 10);
+
+Both tables are read once, in file order, with a plain SELECT, so
+every table argument (several files, format=, threads) applies. Error
+logs are written in time order and access logs nearly so, a request
+being logged when it completes, so the two are merged on time_epoch.
+The requests of the last seconds are kept in hash tables by client and
+by log id. An error is matched to:
+
+  - the request whose %L log id is in the error line, when the access
+    table has a log_id column (format= with %L) and the error log has
+    the ids (httpd 2.4 ErrorLogFormat with %L), or else
+  - the latest request from the same remote_host at most SECONDS (the
+    third argument, default 10) before it.
+
+Requests are read until one is more than SLACK seconds (the fourth
+argument, default 300, as time_slack) after the error, so ones logged
+up to SLACK seconds out of order are still found. Every error line is
+returned, with NULL request columns if there was no match.
+ **/
+
+#ifndef LOGCORRELATE_H
+#define LOGCORRELATE_H
+
+#include "sqlite3ext.h"
+
+int          log_correlate_init( sqlite3 *db );
+
+#endif
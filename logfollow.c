@@ -0,0 +1,304 @@
+/**
+
+Where a follow= table got to in each of its logs. See logfollow.h.
+ **/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "logfollow.h"
+
+#define LOG_FOLLOW_HEADER  "# cattoy follow state"
+
+static uint64_t log_follow_hash( const char *p, int n )
+{
+    uint64_t  h = 14695981039346656037ULL;      /* FNV-1a */
+    int       i;
+
+    for ( i = 0; i < n; i++ ) h = ( h ^ (unsigned char)p[i] ) * 1099511628211ULL;
+    return h;
+}
+
+static int log_follow_add( log_follow *fl, const log_follow_pos *pos )
+{
+    log_follow_pos  *list;
+
+    list = realloc( fl->pos, ( fl->n + 1 ) * sizeof( log_follow_pos ) );
+    if ( list == NULL ) return -1;
+    fl->pos = list;
+    list[fl->n] = *pos;
+    if ( ( list[fl->n].filename = strdup( pos->filename ) ) == NULL ) return -1;
+    fl->n++;
+    return 0;
+}
+
+/* Whether the state file can be written, by whether its directory can. */
+static int log_follow_writable( const char *state_file )
+{
+    char  *dir, *slash;
+    int   ok;
+
+    if ( ( dir = strdup( state_file ) ) == NULL ) return 0;
+    slash = strrchr( dir, '/' );
+    if      ( slash == NULL ) strcpy( dir, "." );
+    else if ( slash == dir )  slash[1] = '\0';
+    else                      *slash = '\0';
+    ok = ( access( dir, W_OK ) == 0 );
+    free( dir );
+    return ok;
+}
+
+static int log_follow_load( log_follow *fl )
+{
+    char            line[PATH_MAX + 256];
+    long long       f[5];
+    unsigned long long head;
+    log_follow_pos  pos;
+    FILE            *fp;
+    int             len, name, rc = 0;
+
+    if ( !log_follow_writable( fl->state_file ) ) return -1;
+    if ( ( fp = fopen( fl->state_file, "r" ) ) == NULL ) return ( errno == ENOENT ? 0 : -1 );
+
+    while ( rc == 0 && fgets( line, sizeof( line ), fp ) != NULL ) {
+        if ( line[0] == '#' || line[0] == '\n' ) continue;
+        len = strlen( line );
+        if ( line[len - 1] != '\n' ) {
+            rc = -1;                    /* too long, or cut short */
+            break;
+        }
+        line[len - 1] = '\0';
+        name = 0;
+        if ( sscanf( line, "%lld %lld %lld %lld %lld %d %llx %n", &f[0], &f[1], &f[2],
+                     &f[3], &f[4], &pos.head_len, &head, &name ) != 7 || name == 0 ||
+             line[name] == '\0' || pos.head_len < 0 || pos.head_len > LOG_FOLLOW_HEAD ) {
+            rc = -1;
+            break;
+        }
+        pos.filename = line + name;
+        pos.ino = f[0];
+        pos.size = f[1];
+        pos.mtime = f[2];
+        pos.off = f[3];
+        pos.rows = f[4];
+        pos.head = head;
+        pos.unchanged = 0;
+        rc = log_follow_add( fl, &pos );
+    }
+    fclose( fp );
+    return rc;
+}
+
+/*
+Positions kept in state_file, which need not exist yet, or only in
+memory if state_file is NULL. Returns NULL if the file cannot be read
+or its directory cannot be written.
+ */
+log_follow * log_follow_new( const char *state_file )
+{
+    log_follow *fl = calloc( 1, sizeof( log_follow ) );
+
+    if ( fl == NULL || state_file == NULL ) return fl;
+    if ( ( fl->state_file = strdup( state_file ) ) == NULL || log_follow_load( fl ) != 0 ) {
+        log_follow_free( fl );
+        return NULL;
+    }
+    return fl;
+}
+
+void log_follow_free( log_follow *fl )
+{
+    int i;
+
+    if ( fl == NULL ) return;
+    for ( i = 0; i < fl->n; i++ ) free( fl->pos[i].filename );
+    free( fl->pos );
+    free( fl->state_file );
+    free( fl );
+}
+
+/* Read up to LOG_FOLLOW_HEAD bytes from the start of the log. */
+static int log_follow_head( log_reader *r, char *buf )
+{
+    if ( log_reader_seek( r, 0 ) != 0 ) return -1;
+    return log_reader_read( r, buf, LOG_FOLLOW_HEAD );
+}
+
+/*
+The position to start each file of set from, in start[], which has a
+slot per file. A file with no position is read from the start. The
+saved positions are matched to files, each to one file at most, by
+    1. file name and inode: the log was appended to, or is unchanged,
+       in which case start[].unchanged is set and the log need not be
+       opened at all
+    2. inode: the log was renamed
+    3. the hash of its first bytes alone: the log was renamed and
+       compressed, or copied before being truncated
+and in each case only if the log still starts with the same bytes and
+is at least as long as the position.
+ */
+void log_follow_find( log_follow *fl, log_set *set, int index_mode,
+                      int flags, log_follow_pos *start )
+{
+    struct stat  *st = NULL;
+    char         *head = NULL;
+    int          *head_n = NULL, *claimed = NULL;
+    int64_t      *size = NULL;
+    int          pass, i, k;
+
+    memset( start, 0, set->n * sizeof( log_follow_pos ) );
+    if ( fl->n == 0 ) return;
+
+    st = calloc( set->n, sizeof( struct stat ) );
+    head = malloc( set->n * LOG_FOLLOW_HEAD );
+    head_n = calloc( set->n, sizeof( int ) );
+    size = calloc( set->n, sizeof( int64_t ) );
+    claimed = calloc( fl->n, sizeof( int ) );
+    if ( st == NULL || head == NULL || head_n == NULL || size == NULL || claimed == NULL ) goto done;
+
+    for ( i = 0; i < set->n; i++ ) {
+        head_n[i] = -2;                 /* not read yet */
+        if ( stat( set->files[i].filename, &st[i] ) != 0 ) head_n[i] = -1;
+    }
+
+    for ( pass = 1; pass <= 3; pass++ ) {
+        for ( i = 0; i < set->n; i++ ) {
+            log_file  *f = &set->files[i];
+
+            if ( start[i].filename != NULL || head_n[i] == -1 ) continue;
+            for ( k = 0; k < fl->n; k++ ) {
+                log_follow_pos  *p = &fl->pos[k];
+                int             same_name = ( strcmp( p->filename, f->filename ) == 0 );
+
+                if ( claimed[k] || p->off <= 0 ) continue;
+                if ( pass == 1 && ( !same_name || p->ino != (int64_t)st[i].st_ino ) ) continue;
+                if ( pass == 2 && p->ino != (int64_t)st[i].st_ino ) continue;
+
+                if ( pass == 1 && p->size == st[i].st_size && p->mtime == st[i].st_mtime ) {
+                    start[i].unchanged = 1;
+                }
+                else {
+                    if ( head_n[i] == -2 ) {
+                        log_reader *r = log_file_open( f, index_mode, flags );
+
+                        head_n[i] = ( r == NULL ? -1 : log_follow_head( r, head + i * LOG_FOLLOW_HEAD ) );
+                        size[i] = ( r == NULL ? -1 : log_reader_size( r ) );
+                        if ( r != NULL ) log_reader_close( r );
+                        if ( head_n[i] < 0 ) break;
+                    }
+                    if ( head_n[i] < p->head_len ||
+                         log_follow_hash( head + i * LOG_FOLLOW_HEAD, p->head_len ) != p->head ||
+                         ( size[i] >= 0 && size[i] < p->off ) ) {
+                        continue;
+                    }
+                }
+                start[i] = *p;
+                start[i].filename = f->filename;
+                claimed[k] = 1;
+                break;
+            }
+        }
+    }
+
+done:
+    free( st );
+    free( head );
+    free( head_n );
+    free( size );
+    free( claimed );
+}
+
+/*
+Record in pos that file f, open in r, has been read to offset end, of
+which the lines before off, rows of them, are done with. off is short
+of end by a last line still being written. Moves r.
+ */
+int log_follow_mark( log_follow_pos *pos, log_file *f, log_reader *r,
+                     int64_t end, int64_t off, int64_t rows )
+{
+    struct stat  st;
+    char         head[LOG_FOLLOW_HEAD];
+    int          n = ( off < LOG_FOLLOW_HEAD ? off : LOG_FOLLOW_HEAD );
+
+    if ( stat( f->filename, &st ) != 0 ) return -1;
+    if ( log_reader_seek( r, 0 ) != 0 || log_reader_read( r, head, n ) != n ) return -1;
+
+    pos->filename = f->filename;
+    pos->ino = st.st_ino;
+    pos->mtime = st.st_mtime;
+    /* a plain log that grew after it was read is not unchanged next time */
+    pos->size = ( log_reader_compressed( r ) || st.st_size == end ? st.st_size : -1 );
+    pos->off = off;
+    pos->rows = rows;
+    pos->head_len = n;
+    pos->head = log_follow_hash( head, n );
+    pos->unchanged = 0;
+    return 0;
+}
+
+/*
+Take the positions reached, n of them with filename NULL where a file
+was not read to its end, and write the state file. Positions of logs
+that no longer exist are dropped.
+ */
+int log_follow_save( log_follow *fl, log_follow_pos *reached, int n )
+{
+    struct stat  st;
+    char         *tmp;
+    FILE         *fp;
+    int          i, k, rc = 0;
+
+    for ( i = 0; i < n && reached[i].filename == NULL; i++ ) ;
+    if ( i == n ) return 0;             /* nothing read to the end */
+
+    for ( i = 0; i < n; i++ ) {
+        if ( reached[i].filename == NULL ) continue;
+        for ( k = 0; k < fl->n; k++ ) {
+            if ( strcmp( fl->pos[k].filename, reached[i].filename ) == 0 ) break;
+        }
+        if ( k < fl->n ) {
+            char *name = fl->pos[k].filename;
+
+            fl->pos[k] = reached[i];
+            fl->pos[k].filename = name;
+        }
+        else if ( log_follow_add( fl, &reached[i] ) != 0 ) {
+            rc = -1;
+        }
+    }
+    for ( i = k = 0; i < fl->n; i++ ) {
+        if ( stat( fl->pos[i].filename, &st ) != 0 ) free( fl->pos[i].filename );
+        else                                         fl->pos[k++] = fl->pos[i];
+    }
+    fl->n = k;
+
+    if ( fl->state_file == NULL ) return rc;
+
+    if ( ( tmp = malloc( strlen( fl->state_file ) + 16 ) ) == NULL ) return -1;
+    sprintf( tmp, "%s.%d", fl->state_file, (int)getpid() );
+    if ( ( fp = fopen( tmp, "w" ) ) == NULL ) {
+        free( tmp );
+        return -1;
+    }
+    fprintf( fp, "%s\n", LOG_FOLLOW_HEADER );
+    for ( i = 0; i < fl->n; i++ ) {
+        log_follow_pos *p = &fl->pos[i];
+
+        fprintf( fp, "%lld %lld %lld %lld %lld %d %016llx %s\n", (long long)p->ino,
+                 (long long)p->size, (long long)p->mtime, (long long)p->off,
+                 (long long)p->rows, p->head_len, (unsigned long long)p->head, p->filename );
+    }
+    if ( ( ferror( fp ) | fclose( fp ) ) || rename( tmp, fl->state_file ) != 0 ) {
+        remove( tmp );
+        rc = -1;
+    }
+    free( tmp );
+    return rc;
+}
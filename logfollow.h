@@ -0,0 +1,56 @@
+/**
+
+Where a follow= table got to in each of its logs, so the next query
+only reads the lines written since.
+
+A position is the offset just after the last whole line read, with the
+number of lines before it so rowids still count lines from the start
+of the log. It is tied to the log's inode and a hash of its first few
+bytes, which also find the log again after logrotate renames it, e.g.
+access_log to access_log-20141102, or compresses it. A log that has
+become shorter than its position was truncated and is read from the
+start.
+
+With follow=FILE the positions are kept in FILE, one line per log,
+    <inode> <size> <mtime> <offset> <lines> <head length> <head hash> <log>
+and read back when a table is created, so a report run from cron only
+reads what was logged since its last run. follow=on keeps them for the
+life of the table.
+ **/
+
+#ifndef LOGFOLLOW_H
+#define LOGFOLLOW_H
+
+#include <stdint.h>
+
+#include "logset.h"
+
+#define LOG_FOLLOW_HEAD     256          /* bytes hashed to recognise a log */
+
+typedef struct log_follow_pos_s {
+    char             *filename;          /* NULL if none */
+    int64_t          ino;
+    int64_t          size;               /* file size and mtime when saved */
+    int64_t          mtime;
+    int64_t          off;                /* after the last whole line read */
+    int64_t          rows;               /* lines before off */
+    int              head_len;
+    uint64_t         head;               /* hash of the first head_len bytes */
+    int              unchanged;          /* nothing new since, see log_follow_find() */
+} log_follow_pos;
+
+typedef struct log_follow_s {
+    char             *state_file;        /* NULL to keep positions in memory */
+    int              n;
+    log_follow_pos   *pos;
+} log_follow;
+
+log_follow * log_follow_new( const char *state_file );
+void         log_follow_free( log_follow *fl );
+void         log_follow_find( log_follow *fl, log_set *set, int index_mode,
+                              int flags, log_follow_pos *start );
+int          log_follow_mark( log_follow_pos *pos, log_file *f, log_reader *r,
+                              int64_t end, int64_t off, int64_t rows );
+int          log_follow_save( log_follow *fl, log_follow_pos *reached, int n );
+
+#endif
@@ -0,0 +1,427 @@
+/**
+
+Apache LogFormat strings. See logformat.h.
+ **/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "logformat.h"
+
+/* the nicknames of httpd's default configuration, and ours */
+static const char *log_format_nicknames[][2] = {
+    { "common",         "%h %l %u %t \"%r\" %>s %b" },
+    { "combined",       "%h %l %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-agent}i\"" },
+    { "combinedio",     "%h %l %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-agent}i\" %I %O" },
+    { "vhost_common",   "%v %h %l %u %t \"%r\" %>s %b" },
+    { "vhost_combined", "%v:%p %h %l %u %t \"%r\" %>s %O \"%{Referer}i\" \"%{User-Agent}i\"" },
+    { "default",        LOG_FORMAT_DEFAULT },
+    { NULL,             NULL }
+};
+
+/* names of extra columns, by directive letter */
+static const struct {
+    char             letter;
+    const char       *name;
+} log_format_names[] = {
+    { 'a', "client_ip" },           { 'A', "local_ip" },
+    { 'b', "bytes" },               { 'B', "bytes" },
+    { 'D', "response_time" },       { 'f', "filename" },
+    { 'h', "remote_host" },         { 'H', "protocol" },
+    { 'I', "bytes_in" },            { 'k', "keepalive" },
+    { 'l', "remote_logname" },      { 'L', "log_id" },
+    { 'm', "request_method" },      { 'O', "bytes_out" },
+    { 'p', "port" },                { 'P', "pid" },
+    { 'q', "query_string" },        { 'r', "request" },
+    { 'R', "handler" },             { 's', "status" },
+    { 'S', "bytes_transferred" },   { 't', "time" },
+    { 'T', "time_taken" },          { 'u', "remote_user" },
+    { 'U', "url_path" },            { 'v', "server_name" },
+    { 'V', "server_name_used" },    { 'X', "conn_status" },
+    { 0,   NULL }
+};
+
+/* directives whose extra columns are INTEGER */
+#define LOG_FORMAT_INTEGER   "bBDIkOpPsST"
+
+/* of bare %t: "DD/Mon/YYYY:HH:MM:SS +ZZZZ" */
+#define LOG_FORMAT_TIME_WIDTH 26
+
+/* a directive or a literal character of a format */
+typedef struct log_format_token_s {
+    int              directive;
+    char             ch;                 /* the literal */
+    int              col;                /* the directive's column */
+    int              bare_t;             /* %t, in brackets */
+} log_format_token;
+
+const char * log_format_nickname( const char *name )
+{
+    int i;
+
+    for ( i = 0; log_format_nicknames[i][0] != NULL; i++ ) {
+        if ( strcmp( log_format_nicknames[i][0], name ) == 0 ) return log_format_nicknames[i][1];
+    }
+    return NULL;
+}
+
+/* Whether name is a column of schema or an earlier extra column. */
+static int log_format_taken( const log_format *f, const char *schema, const char *name )
+{
+    char  word[LOG_FORMAT_NAME + 2];
+    int   i;
+
+    snprintf( word, sizeof( word ), " %s ", name );
+    if ( strcasestr( schema, word ) != NULL ) return 1;
+    for ( i = 0; i < f->n_extra; i++ ) {
+        if ( strcasecmp( f->extra[i].name, name ) == 0 ) return 1;
+    }
+    return 0;
+}
+
+/*
+Name the next extra column after directive letter, or after its
+argument arg of n bytes for headers, cookies, environment variables
+and notes.
+ */
+static void log_format_name( log_format *f, const char *schema, const char *prefix,
+                             const char *arg, int n, char letter )
+{
+    log_format_col  *x = &f->extra[f->n_extra];
+    char            base[LOG_FORMAT_NAME - 4];
+    int             i, k, len;
+
+    len = snprintf( base, sizeof( base ), "%s", prefix );
+    if ( arg != NULL && n > 0 ) {
+        for ( i = 0; i < n && len < (int)sizeof( base ) - 1; i++ ) {
+            char ch = arg[i];
+
+            if ( ch >= 'A' && ch <= 'Z' ) ch += 'a' - 'A';
+            base[len++] = ( ( ch >= 'a' && ch <= 'z' ) || ( ch >= '0' && ch <= '9' ) ? ch : '_' );
+        }
+        base[len] = '\0';
+    }
+    else {
+        for ( i = 0; log_format_names[i].letter != 0; i++ ) {
+            if ( log_format_names[i].letter == letter ) break;
+        }
+        if ( log_format_names[i].letter != 0 ) {
+            snprintf( base, sizeof( base ), "%s", log_format_names[i].name );
+        }
+        else {
+            snprintf( base, sizeof( base ), "field_%c", letter );
+        }
+    }
+
+    snprintf( x->name, sizeof( x->name ), "%s", base );
+    /* there are far fewer columns than 1000 to clash with, and k fits the name */
+    for ( k = 2; k < 1000 && log_format_taken( f, schema, x->name ); k++ ) {
+        snprintf( x->name, sizeof( x->name ), "%.40s_%d", base, k );
+    }
+    x->integer = ( strchr( LOG_FORMAT_INTEGER, letter ) != NULL );
+}
+
+static int log_format_emit( log_format *f, int kind, char ch, int col )
+{
+    if ( f->n_ops == LOG_FORMAT_OPS ) {
+        snprintf( f->error, sizeof( f->error ), "format is too long" );
+        return -1;
+    }
+    memset( &f->ops[f->n_ops], 0, sizeof( f->ops[0] ) );
+    f->ops[f->n_ops].kind = kind;
+    f->ops[f->n_ops].ch = ch;
+    f->ops[f->n_ops].col = col;
+    f->n_ops++;
+    return 0;
+}
+
+/*
+Fold each field's OPEN, and the CHAR that closes it and the SPACE after
+that, into the FIELD, so that a combined line is split in one step a
+field.
+ */
+static void log_format_fuse( log_format *f )
+{
+    log_format_op  *op = f->ops, *end = f->ops + f->n_ops, *to = f->ops;
+
+    while ( op < end ) {
+        if ( op->kind == LOG_FORMAT_OPEN && op + 1 < end && op[1].kind == LOG_FORMAT_FIELD ) {
+            op[1].open = op->ch;
+            op++;
+        }
+        *to = *op++;
+        if ( to->kind == LOG_FORMAT_FIELD ) {
+            if ( op < end && op->kind == LOG_FORMAT_CHAR && op->ch == to->ch ) {
+                to->flags |= LOG_FORMAT_CLOSE;
+                op++;
+            }
+            if ( op < end && op->kind == LOG_FORMAT_SPACE ) {
+                to->flags |= LOG_FORMAT_THEN_SPACE;
+                op++;
+            }
+        }
+        to++;
+    }
+    f->n_ops = to - f->ops;
+}
+
+/*
+Split format into directives and literal characters, giving each
+directive its column. Returns the number of tokens, or -1.
+ */
+static int log_format_tokens( log_format *f, const char *format, const log_format_std *std,
+                              const char *schema, log_format_token *t, int max )
+{
+    unsigned long long  used = 0;            /* columns of std filled */
+    const char          *p = format;
+    int                 n = 0, i;
+
+    while ( *p != '\0' ) {
+        const char  *arg = NULL, *start = p;
+        char        key[LOG_FORMAT_NAME + 4], letter;
+        int         argn = 0, klen = 0, trailer = 0;
+
+        if ( n == max ) {
+            snprintf( f->error, sizeof( f->error ), "format is too long" );
+            return -1;
+        }
+        memset( &t[n], 0, sizeof( t[n] ) );
+
+        if ( *p == '\\' && p[1] != '\0' ) {  /* as in httpd.conf */
+            p++;
+            t[n++].ch = ( *p == 't' ? '\t' : *p );
+            p++;
+            continue;
+        }
+        if ( *p != '%' ) {
+            t[n++].ch = *p++;
+            continue;
+        }
+        p++;
+        if ( *p == '%' ) {
+            t[n++].ch = *p++;
+            continue;
+        }
+        while ( *p != '\0' && strchr( "<>!,0123456789", *p ) != NULL ) p++;
+        if ( *p == '{' ) {
+            arg = ++p;
+            while ( *p != '\0' && *p != '}' ) p++;
+            if ( *p == '\0' ) {
+                snprintf( f->error, sizeof( f->error ), "unterminated %%{ in format: %.64s", start );
+                return -1;
+            }
+            argn = p++ - arg;
+        }
+        if ( p[0] == '^' && p[1] == 't' && ( p[2] == 'i' || p[2] == 'o' ) ) {
+            trailer = 1;                     /* %{name}^ti and ^to */
+            p += 2;
+        }
+        if ( *p == '\0' ) {
+            snprintf( f->error, sizeof( f->error ), "unterminated %% in format: %.64s", start );
+            return -1;
+        }
+        letter = *p++;
+        t[n].directive = 1;
+        t[n].bare_t = ( letter == 't' && arg == NULL );
+
+        /* the key std lists it by: header names are case insensitive */
+        if ( arg != NULL && argn < LOG_FORMAT_NAME ) {
+            key[klen++] = '{';
+            for ( i = 0; i < argn; i++ ) {
+                char ch = arg[i];
+
+                if ( ( letter == 'i' || letter == 'o' ) && ch >= 'A' && ch <= 'Z' ) ch += 'a' - 'A';
+                key[klen++] = ch;
+            }
+            key[klen++] = '}';
+        }
+        key[klen++] = letter;
+        key[klen] = '\0';
+
+        for ( i = 0; std != NULL && !trailer && std[i].directive != NULL; i++ ) {
+            if ( strcmp( std[i].directive, key ) == 0 && ( used & ( 1ULL << std[i].col ) ) == 0 ) break;
+        }
+        if ( std != NULL && !trailer && std[i].directive != NULL ) {
+            used |= 1ULL << std[i].col;
+            t[n++].col = std[i].col;
+            continue;
+        }
+
+        if ( f->n_extra == LOG_FORMAT_EXTRA ) {
+            snprintf( f->error, sizeof( f->error ), "format has more than %d extra columns", LOG_FORMAT_EXTRA );
+            return -1;
+        }
+        switch ( arg != NULL ? letter : 0 ) {
+        case 'i': log_format_name( f, schema, trailer ? "trailer_" : "", arg, argn, letter ); break;
+        case 'o': log_format_name( f, schema, trailer ? "resp_trailer_" : "resp_", arg, argn, letter ); break;
+        case 'C': log_format_name( f, schema, "cookie_", arg, argn, letter ); break;
+        case 'e': log_format_name( f, schema, "env_", arg, argn, letter ); break;
+        case 'n': log_format_name( f, schema, "note_", arg, argn, letter ); break;
+        default:  log_format_name( f, schema, "", NULL, 0, letter ); break;
+        }
+        t[n++].col = f->first_extra + f->n_extra++;
+    }
+    return n;
+}
+
+int log_format_compile( log_format *f, const char *format, const log_format_std *std,
+                        int first_extra, const char *schema )
+{
+    log_format_token  t[LOG_FORMAT_OPS];
+    int               n, k, rc = 0;
+
+    memset( f, 0, sizeof( *f ) );
+    f->first_extra = first_extra;
+    if ( ( n = log_format_tokens( f, format, std, schema, t, LOG_FORMAT_OPS ) ) < 0 ) return -1;
+
+    for ( k = 0; k < n && rc == 0; k++ ) {
+        const log_format_op  *last = ( f->n_ops > 0 ? &f->ops[f->n_ops - 1] : NULL );
+
+        if ( !t[k].directive ) {
+            char ch = t[k].ch;
+
+            if ( ch == ' ' ) {               /* leading spaces are skipped anyway */
+                if ( last != NULL && last->kind != LOG_FORMAT_SPACE ) {
+                    rc = log_format_emit( f, LOG_FORMAT_SPACE, ch, 0 );
+                }
+            }
+            else if ( ( ch == '"' || ch == '[' ) && k + 1 < n && t[k + 1].directive ) {
+                rc = log_format_emit( f, LOG_FORMAT_OPEN, ch, 0 );
+            }
+            else {
+                rc = log_format_emit( f, LOG_FORMAT_CHAR, ch, 0 );
+            }
+            continue;
+        }
+
+        if ( k > 0 && t[k - 1].directive ) {
+            snprintf( f->error, sizeof( f->error ), "format has two directives with nothing between them" );
+            return -1;
+        }
+        if ( t[k].bare_t ) {
+            if ( last == NULL || last->kind != LOG_FORMAT_OPEN || last->ch != '[' ) {
+                rc = log_format_emit( f, LOG_FORMAT_OPEN, '[', 0 );
+            }
+            if ( rc == 0 ) rc = log_format_emit( f, LOG_FORMAT_FIELD, ']', t[k].col );
+            if ( rc == 0 ) f->ops[f->n_ops - 1].width = LOG_FORMAT_TIME_WIDTH;
+            if ( rc == 0 && ( k + 1 == n || t[k + 1].ch != ']' ) ) {
+                rc = log_format_emit( f, LOG_FORMAT_CHAR, ']', 0 );
+            }
+        }
+        else {
+            rc = log_format_emit( f, LOG_FORMAT_FIELD, k + 1 < n ? t[k + 1].ch : ' ', t[k].col );
+        }
+    }
+    if ( rc == 0 ) log_format_fuse( f );
+    return rc;
+}
+
+/*
+The CREATE TABLE statement of schema with f's extra columns added at
+the end. The caller frees it.
+ */
+char * log_format_schema( const log_format *f, const char *schema )
+{
+    const char  *close = strrchr( schema, ')' );
+    char        *sql;
+    size_t      size, len;
+    int         i;
+
+    if ( close == NULL ) return NULL;
+    size = strlen( schema ) + f->n_extra * ( LOG_FORMAT_NAME + 32 ) + 1;
+    if ( ( sql = malloc( size ) ) == NULL ) return NULL;
+
+    len = close - schema;
+    memcpy( sql, schema, len );
+    for ( i = 0; i < f->n_extra; i++ ) {
+        len += snprintf( sql + len, size - len, ",  \"%s\" %s", f->extra[i].name,
+                         f->extra[i].integer ? "INTEGER" : "TEXT" );
+    }
+    snprintf( sql + len, size - len, "%s", close );
+    return sql;
+}
+
+/* Whether the quote at q is escaped by an odd number of backslashes. */
+static int log_format_escaped( const char *start, const char *q )
+{
+    int n = 0;
+
+    while ( q > start && q[-1] == '\\' ) {
+        q--;
+        n++;
+    }
+    return n & 1;
+}
+
+/*
+How many ops of f split a line as far as the last field of the columns
+in cols, bit n for column n and bit 63 for 63 on.
+ */
+int log_format_ops( const log_format *f, uint64_t cols )
+{
+    int  i, n = 0;
+
+    for ( i = 0; i < f->n_ops; i++ ) {
+        if ( f->ops[i].kind == LOG_FORMAT_FIELD &&
+             ( cols >> ( f->ops[i].col < 63 ? f->ops[i].col : 63 ) & 1 ) ) {
+            n = i + 1;
+        }
+    }
+    return n;
+}
+
+/*
+Split the len bytes of line into the fields of f, running its first
+n_ops ops (see log_format_ops()). ptrs and sizes are set for the
+fields found, and left as they are for the others. Fields come first,
+as almost every op is one once fused.
+ */
+void log_format_scan( const log_format *f, int n_ops, const char *line, int len, char **ptrs, int *sizes )
+{
+    const log_format_op  *op = f->ops, *last = f->ops + n_ops;
+    const char           *p = line, *eol = line + len, *end;
+    char                 term;
+
+    while ( p < eol && *p == ' ' ) p++;
+    for ( ; op < last; op++ ) {
+        if ( op->kind == LOG_FORMAT_FIELD ) {
+            if ( p == eol ) return;          /* the rest are missing */
+            term = op->ch;
+            if ( op->open != 0 ) {
+                if ( *p == op->open ) p++;
+                else term = ' ';
+            }
+            if ( term == op->ch && op->width != 0 && eol - p > op->width && p[op->width] == term ) {
+                end = p + op->width;         /* saves a memchr() */
+            }
+            else {
+                end = memchr( p, term, eol - p );
+            }
+            if ( end != NULL && end > p && term == '"' && end[-1] == '\\' ) {
+                while ( end != NULL && log_format_escaped( p, end ) ) {
+                    end = memchr( end + 1, term, eol - end - 1 );
+                }
+            }
+            if ( end == NULL ) end = eol;
+            ptrs[op->col] = (char *)p;
+            sizes[op->col] = end - p;
+            p = end;
+            if ( ( op->flags & LOG_FORMAT_CLOSE ) && p < eol && *p == op->ch ) p++;
+            if ( op->flags & LOG_FORMAT_THEN_SPACE ) {
+                while ( p < eol && *p != ' ' ) p++;
+                while ( p < eol && *p == ' ' ) p++;
+            }
+        }
+        else if ( op->kind == LOG_FORMAT_SPACE ) {
+            while ( p < eol && *p != ' ' ) p++;
+            while ( p < eol && *p == ' ' ) p++;
+        }
+        else if ( p < eol && *p == op->ch ) {
+            p++;                             /* CHAR, or an OPEN not before a field */
+        }
+    }
+}
@@ -0,0 +1,93 @@
+/**
+
+Apache LogFormat strings, compiled once when a table is created into a
+short program that splits a line into its fields.
+
+    log_format_compile( &f, "%h %l %u %t \"%r\" %>s %b", std, first, schema );
+    log_format_scan( &f, f.n_ops, line, len, ptrs, sizes );
+
+A directive listed in std fills that column of the table; the first of
+them does, a repeat is treated like any other directive. Every other
+directive gets an extra column, numbered from first on, named after
+it: %T time_taken, %{X-Forwarded-For}i x_forwarded_for and so on (see
+log_format_names in logformat.c). A name the table's
+schema already has, or an earlier extra column, is given a _2 suffix.
+
+The program is the literal text of the format between its directives:
+a space skips to the end of the current field and past the spaces
+after it, a quote or bracket before a directive opens a field that
+ends at the matching close, and any other character is skipped if it
+is there. A field ends at the character the format has after it, or at
+a space if it is last. A field in quotes skips \" escapes, and one
+whose opening quote is missing ends at a space. Bare %t is written by
+Apache in brackets and read that way, and is taken to be the 26
+characters it always is when the 27th is the bracket, without looking
+for it. Lines that do not match are split as far as they go; fields
+not reached are NULL. A scan can also stop early, after the last field
+a query uses: log_format_ops() tells how many ops that takes.
+
+Two directives with nothing between them cannot be told apart and are
+an error, as are unterminated directives and more than LOG_FORMAT_EXTRA
+extra columns; log_format_compile() then returns -1 with the reason in
+f->error.
+ **/
+
+#ifndef LOGFORMAT_H
+#define LOGFORMAT_H
+
+#include <stdint.h>
+
+#define LOG_FORMAT_EXTRA     16          /* extra columns at most */
+#define LOG_FORMAT_OPS       256         /* program size */
+#define LOG_FORMAT_NAME      48          /* of an extra column, with NUL */
+
+/* combined with %D, what access_log reads without format= */
+#define LOG_FORMAT_DEFAULT   "%h %l %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-agent}i\" %D"
+
+#define LOG_FORMAT_FIELD     0           /* ch ends it, or a space if open failed */
+#define LOG_FORMAT_SPACE     1           /* skip the rest of a field and the spaces after */
+#define LOG_FORMAT_OPEN      2           /* skip ch, a field's opening quote or bracket */
+#define LOG_FORMAT_CHAR      3           /* skip ch if it is there */
+
+/* a field's OPEN, and the CHAR and SPACE after it, fused into the FIELD */
+#define LOG_FORMAT_CLOSE     0x01        /* skip ch after the field */
+#define LOG_FORMAT_THEN_SPACE 0x02       /* then SPACE */
+
+typedef struct log_format_op_s {
+    unsigned char    kind;               /* LOG_FORMAT_* */
+    unsigned char    flags;              /* of a field, LOG_FORMAT_CLOSE etc. */
+    char             ch;
+    char             open;               /* of a field, its OPEN's ch or 0 */
+    unsigned char    width;              /* of a field, if it usually has one */
+    short            col;                /* of a field */
+} log_format_op;
+
+typedef struct log_format_col_s {
+    char             name[LOG_FORMAT_NAME];
+    int              integer;            /* declared INTEGER */
+} log_format_col;
+
+/* a directive, as in the format without modifiers, and the column it fills */
+typedef struct log_format_std_s {
+    const char       *directive;         /* e.g. "h", ">s" is "s", "{referer}i" */
+    int              col;
+} log_format_std;
+
+typedef struct log_format_s {
+    int              n_ops;
+    log_format_op    ops[LOG_FORMAT_OPS];
+    int              first_extra;        /* column number of extra[0] */
+    int              n_extra;
+    log_format_col   extra[LOG_FORMAT_EXTRA];
+    char             error[128];         /* why compiling failed */
+} log_format;
+
+const char * log_format_nickname( const char *name );
+int          log_format_compile( log_format *f, const char *format, const log_format_std *std,
+                 int first_extra, const char *schema );
+char       * log_format_schema( const log_format *f, const char *schema );
+int          log_format_ops( const log_format *f, uint64_t cols );
+void         log_format_scan( const log_format *f, int n_ops, const char *line, int len,
+                 char **ptrs, int *sizes );
+
+#endif
@@ -0,0 +1,237 @@
+/**
+
+Random access index for a log file. See logindex.h.
+
+Sidecar file layout, native byte order since an index is only read
+on the host that wrote it:
+
+    "CATTOYIX"                      magic
+    int32                           version
+    int32 codec, int32 n
+    int64 src_size, src_mtime, size, lines
+    n * { int64 out, in, lines; int32 bits, have; window[have] }
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "logindex.h"
+
+#define LOG_INDEX_MAGIC    "CATTOYIX"
+#define LOG_INDEX_VERSION  1
+
+log_index * log_index_new( int codec )
+{
+    log_index *idx = calloc( 1, sizeof( log_index ) );
+
+    if ( idx != NULL ) idx->codec = codec;
+    return idx;
+}
+
+void log_index_free( log_index *idx )
+{
+    int i;
+
+    if ( idx == NULL ) return;
+    for ( i = 0; i < idx->n; i++ ) {
+        free( idx->list[i].window );
+    }
+    free( idx->list );
+    free( idx );
+}
+
+int log_index_add( log_index *idx, int64_t out, int64_t in,
+        int64_t lines, int bits, const unsigned char *window, int have )
+{
+    log_index_point *p;
+
+    if ( idx->n == idx->alloc ) {
+        int   alloc = idx->alloc ? idx->alloc * 2 : 64;
+        void *list = realloc( idx->list, alloc * sizeof( log_index_point ) );
+        if ( list == NULL ) return -1;
+        idx->list = list;
+        idx->alloc = alloc;
+    }
+
+    p = &idx->list[idx->n];
+    p->out = out;
+    p->in = in;
+    p->lines = lines;
+    p->bits = bits;
+    p->have = 0;
+    p->window = NULL;
+    if ( window != NULL && have > 0 ) {
+        p->window = malloc( have );
+        if ( p->window == NULL ) return -1;
+        memcpy( p->window, window, have );
+        p->have = have;
+    }
+    idx->n++;
+    return 0;
+}
+
+/* Last point at or before uncompressed offset out, or NULL. */
+log_index_point * log_index_find( log_index *idx, int64_t out )
+{
+    int lo = 0, hi, mid;
+
+    if ( idx == NULL || idx->n == 0 || idx->list[0].out > out ) return NULL;
+
+    hi = idx->n - 1;
+    while ( lo < hi ) {
+        mid = lo + ( hi - lo + 1 ) / 2;
+        if ( idx->list[mid].out <= out ) lo = mid;
+        else                             hi = mid - 1;
+    }
+    return &idx->list[lo];
+}
+
+/*
+Last point from which line (1 based) can be reached by skipping at
+least one newline, i.e. a point with fewer than line - 1 lines before
+it. A point may fall mid-line, so one with exactly line - 1 lines
+before it could already be past the start of the line.
+ */
+log_index_point * log_index_find_line( log_index *idx, int64_t line )
+{
+    int lo = 0, hi, mid;
+
+    if ( idx == NULL || idx->n == 0 || idx->list[0].lines >= line - 1 ) return NULL;
+
+    hi = idx->n - 1;
+    while ( lo < hi ) {
+        mid = lo + ( hi - lo + 1 ) / 2;
+        if ( idx->list[mid].lines < line - 1 ) lo = mid;
+        else                                   hi = mid - 1;
+    }
+    return &idx->list[lo];
+}
+
+static char * log_index_path( const char *filename )
+{
+    char *path = malloc( strlen( filename ) + sizeof( LOG_INDEX_SUFFIX ) );
+
+    if ( path != NULL ) {
+        strcpy( path, filename );
+        strcat( path, LOG_INDEX_SUFFIX );
+    }
+    return path;
+}
+
+/* Load the sidecar index of filename if it is still valid, else NULL. */
+log_index * log_index_load( const char *filename )
+{
+    struct stat  st;
+    char         magic[8], *path;
+    int32_t      hdr[3];
+    int64_t      meta[4];
+    log_index    *idx = NULL;
+    FILE         *fp;
+    int          i;
+
+    if ( stat( filename, &st ) != 0 ) return NULL;
+    if ( ( path = log_index_path( filename ) ) == NULL ) return NULL;
+    fp = fopen( path, "rb" );
+    free( path );
+    if ( fp == NULL ) return NULL;
+
+    if ( fread( magic, sizeof( magic ), 1, fp ) != 1 ||
+         memcmp( magic, LOG_INDEX_MAGIC, sizeof( magic ) ) != 0 ||
+         fread( hdr, sizeof( hdr ), 1, fp ) != 1 ||
+         hdr[0] != LOG_INDEX_VERSION ||
+         fread( meta, sizeof( meta ), 1, fp ) != 1 ||
+         meta[0] != st.st_size || meta[1] != st.st_mtime ) {
+        goto fail;
+    }
+
+    if ( ( idx = log_index_new( hdr[1] ) ) == NULL ) goto fail;
+    idx->src_size = meta[0];
+    idx->src_mtime = meta[1];
+    idx->size = meta[2];
+    idx->lines = meta[3];
+
+    for ( i = 0; i < hdr[2]; i++ ) {
+        int64_t        pos[3];
+        int32_t        bits_have[2];
+        unsigned char  window[LOG_INDEX_WINSIZE];
+
+        if ( fread( pos, sizeof( pos ), 1, fp ) != 1 ||
+             fread( bits_have, sizeof( bits_have ), 1, fp ) != 1 ||
+             bits_have[1] < 0 || bits_have[1] > LOG_INDEX_WINSIZE ||
+             ( bits_have[1] > 0 &&
+               fread( window, bits_have[1], 1, fp ) != 1 ) ||
+             log_index_add( idx, pos[0], pos[1], pos[2], bits_have[0],
+                            window, bits_have[1] ) != 0 ) {
+            goto fail;
+        }
+    }
+    fclose( fp );
+    return idx;
+
+fail:
+    log_index_free( idx );
+    fclose( fp );
+    return NULL;
+}
+
+/*
+Save idx next to filename. The index is written to a temporary file
+and renamed so a concurrent reader never sees a partial index.
+Returns 0 on success; log directories are often not writable, so
+callers treat failure as "keep the index in memory".
+ */
+int log_index_save( log_index *idx, const char *filename )
+{
+    char     *path, *tmp;
+    int32_t  hdr[3];
+    int64_t  meta[4];
+    FILE     *fp;
+    int      i, rc = -1;
+
+    if ( ( path = log_index_path( filename ) ) == NULL ) return -1;
+    if ( ( tmp = malloc( strlen( path ) + 16 ) ) == NULL ) {
+        free( path );
+        return -1;
+    }
+    sprintf( tmp, "%s.%d", path, (int)getpid() );
+
+    if ( ( fp = fopen( tmp, "wb" ) ) == NULL ) goto done;
+
+    hdr[0] = LOG_INDEX_VERSION;
+    hdr[1] = idx->codec;
+    hdr[2] = idx->n;
+    meta[0] = idx->src_size;
+    meta[1] = idx->src_mtime;
+    meta[2] = idx->size;
+    meta[3] = idx->lines;
+    fwrite( LOG_INDEX_MAGIC, 8, 1, fp );
+    fwrite( hdr, sizeof( hdr ), 1, fp );
+    fwrite( meta, sizeof( meta ), 1, fp );
+    for ( i = 0; i < idx->n; i++ ) {
+        log_index_point *p = &idx->list[i];
+        int64_t pos[3] = { p->out, p->in, p->lines };
+        int32_t bits_have[2] = { p->bits, p->have };
+
+        fwrite( pos, sizeof( pos ), 1, fp );
+        fwrite( bits_have, sizeof( bits_have ), 1, fp );
+        if ( p->have > 0 ) fwrite( p->window, p->have, 1, fp );
+    }
+
+    if ( ferror( fp ) | fclose( fp ) ) {
+        remove( tmp );
+        goto done;
+    }
+    if ( rename( tmp, path ) != 0 ) {
+        remove( tmp );
+        goto done;
+    }
+    rc = 0;
+
+done:
+    free( tmp );
+    free( path );
+    return rc;
+}
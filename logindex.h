@@ -0,0 +1,65 @@
+/**
+
+Random access index for a log file.
+
+An index is a list of points spaced about LOG_INDEX_SPAN bytes apart in
+the uncompressed log. Each point records the number of lines before it,
+so a rowid can be found by seeking to the nearest point and counting the
+remaining lines. For gzip logs each point also carries the inflate state
+at a deflate block boundary (the input offset, the unused bits of the
+byte before it and the last 32K of output) so inflating can resume there
+instead of at byte 0, the technique from zlib's examples/zran.c. A
+point at the start of a gzip member or zstd frame needs only the input
+offset, and has no window.
+
+An index is built by log_reader while it reads a log from start to end,
+and can be saved next to the log, e.g.
+    access_log-20141102.gz.cattoy-idx
+It is reused only while the log's size and mtime are unchanged.
+ **/
+
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include <stdint.h>
+
+#define LOG_INDEX_SUFFIX    ".cattoy-idx"
+#define LOG_INDEX_SPAN      (4 << 20)    /* uncompressed bytes between points */
+#define LOG_INDEX_WINSIZE   32768        /* inflate dictionary size */
+
+/* where an index is kept, from the index= table argument */
+#define LOG_INDEX_OFF       0            /* never built */
+#define LOG_INDEX_MEMORY    1            /* built, kept while table exists */
+#define LOG_INDEX_FILE      2            /* built and saved next to the log */
+
+typedef struct log_index_point_s {
+    int64_t          out;                /* uncompressed offset */
+    int64_t          in;                 /* offset of next whole input byte */
+    int64_t          lines;              /* newlines before out */
+    int              bits;               /* unused bits of byte at in - 1 */
+    int              have;               /* bytes in window */
+    unsigned char    *window;            /* output before out, gzip only */
+} log_index_point;
+
+typedef struct log_index_s {
+    int64_t          src_size;           /* log size when indexed */
+    int64_t          src_mtime;          /* log mtime when indexed */
+    int              codec;              /* LOG_CODEC_* of the log, see logreader.h */
+    int64_t          size;               /* uncompressed length of log */
+    int64_t          lines;              /* newlines in log */
+    int              n;                  /* points in list */
+    int              alloc;              /* points allocated */
+    log_index_point  *list;
+} log_index;
+
+log_index       * log_index_new( int codec );
+void              log_index_free( log_index *idx );
+int               log_index_add( log_index *idx, int64_t out, int64_t in,
+                      int64_t lines, int bits,
+                      const unsigned char *window, int have );
+log_index_point * log_index_find( log_index *idx, int64_t out );
+log_index_point * log_index_find_line( log_index *idx, int64_t line );
+log_index       * log_index_load( const char *filename );
+int               log_index_save( log_index *idx, const char *filename );
+
+#endif
@@ -0,0 +1,262 @@
+/**
+
+IP address parsing and ip_in_cidr(). See logip.h.
+
+An IPv4 address is read in one pass over its bytes, a digit adding to
+the octet and a dot ending it, with no call per octet. An IPv6 address
+is read a group of up to four hex digits at a time, with a "::" noted
+where it falls and the groups after it moved to the end, and may end
+in an IPv4 address, "::ffff:10.0.0.1", or a zone, "fe80::1%eth0".
+ **/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "logip.h"
+
+static const unsigned char log_ip_mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+static int log_ip_hex( int ch )
+{
+    unsigned int  d = (unsigned int)( ch - '0' );
+
+    if ( d < 10 ) return d;
+    d = (unsigned int)( ( ch | 0x20 ) - 'a' );
+    return ( d < 6 ? (int)d + 10 : -1 );
+}
+
+/* Read "a.b.c.d" at s into 4 bytes, returning how much of s it is, 0 if none. */
+static int log_ip_parse4( const char *s, int n, unsigned char out[4] )
+{
+    unsigned int  oct = 0, digits = 0, dots = 0, d;
+    int           i;
+
+    for ( i = 0; i < n; i++ ) {
+        d = (unsigned int)( s[i] - '0' );
+        if ( d < 10 ) {
+            oct = oct * 10 + d;
+            if ( ++digits > 3 || oct > 255 ) return 0;
+            continue;
+        }
+        if ( s[i] != '.' || digits == 0 || dots == 3 ) break;
+        out[dots++] = (unsigned char)oct;
+        oct = digits = 0;
+    }
+    if ( dots != 3 || digits == 0 ) return 0;
+    out[3] = (unsigned char)oct;
+    return i;
+}
+
+/* Read an IPv6 address at s into 16 bytes, returning how much of s it is, 0 if none. */
+static int log_ip_parse6( const char *s, int n, unsigned char ip[16] )
+{
+    int  i = 0, k = 0, gap = -1, digits, v, h, m;
+
+    if ( n >= 2 && s[0] == ':' && s[1] == ':' ) {
+        gap = 0;
+        i = 2;
+    }
+    while ( i < n && k < 16 ) {
+        for ( v = 0, digits = 0; digits < 4 && i + digits < n && ( h = log_ip_hex( s[i + digits] ) ) >= 0; digits++ ) {
+            v = v * 16 + h;
+        }
+        if ( digits == 0 ) break;
+        if ( i + digits < n && s[i + digits] == '.' ) {
+            /* an IPv4 address in the last two groups */
+            if ( k > 12 || ( m = log_ip_parse4( s + i, n - i, ip + k ) ) == 0 ) return 0;
+            k += 4;
+            i += m;
+            break;
+        }
+        ip[k++] = (unsigned char)( v >> 8 );
+        ip[k++] = (unsigned char)v;
+        i += digits;
+        if ( k == 16 || i >= n || s[i] != ':' ) break;
+        if ( i + 1 < n && s[i + 1] == ':' ) {
+            if ( gap >= 0 ) return 0;
+            gap = k;
+            i += 2;
+        }
+        else if ( i + 1 < n && log_ip_hex( s[i + 1] ) >= 0 ) {
+            i++;
+        }
+        else {
+            return 0;
+        }
+    }
+    if ( gap >= 0 ) {
+        if ( k == 16 ) return 0;
+        memmove( ip + 16 - ( k - gap ), ip + gap, k - gap );
+        memset( ip + gap, 0, 16 - k );
+    }
+    else if ( k != 16 ) {
+        return 0;
+    }
+    if ( i < n && s[i] == '%' ) {
+        for ( i++; i < n && ( s[i] == '.' || s[i] == '-' || s[i] == '_' || log_ip_hex( s[i] ) >= 0 ||
+                              ( ( s[i] | 0x20 ) >= 'a' && ( s[i] | 0x20 ) <= 'z' ) ); i++ );
+    }
+    return i;
+}
+
+/* Whether s is a port, ":" and 1 to 5 digits, or nothing at all. */
+static int log_ip_port( const char *s, int n )
+{
+    int  i;
+
+    if ( n == 0 ) return 1;
+    if ( s[0] != ':' || n < 2 || n > 6 ) return 0;
+    for ( i = 1; i < n && (unsigned int)( s[i] - '0' ) < 10; i++ );
+    return i == n;
+}
+
+/* Read s, all of it an address, as for a CIDR block. */
+static int log_ip_addr( const char *s, int n, unsigned char ip[16] )
+{
+    if ( n > 0 && log_ip_parse4( s, n, ip + 12 ) == n ) {
+        memcpy( ip, log_ip_mapped, 12 );
+        return 4;
+    }
+    return ( n > 0 && log_ip_parse6( s, n, ip ) == n ? 6 : 0 );
+}
+
+/*
+Read the address of a remote host, from s for n bytes, into ip.
+Returns 4 or 6 for the kind of address, 0 if s is not one.
+ */
+int log_ip_parse( const char *s, int n, int flags, unsigned char ip[16] )
+{
+    const char  *e;
+    int         m;
+
+    if ( n > 0 && s[0] == '[' ) {
+        if ( ( e = memchr( s, ']', n ) ) == NULL || !log_ip_port( e + 1, s + n - e - 1 ) ) return 0;
+        return log_ip_addr( s + 1, e - s - 1, ip );
+    }
+    if ( ( m = log_ip_parse4( s, n, ip + 12 ) ) > 0 && log_ip_port( s + m, n - m ) ) {
+        memcpy( ip, log_ip_mapped, 12 );
+        return 4;
+    }
+    if ( flags & LOG_IP_PORT ) {
+        for ( m = n - 1; m > 0 && (unsigned int)( s[m] - '0' ) < 10; m-- );
+        if ( m > 0 && m < n - 1 && s[m] == ':' && log_ip_port( s + m, n - m ) &&
+             log_ip_parse6( s, m, ip ) == m ) {
+            return 6;
+        }
+    }
+    return ( n > 0 && log_ip_parse6( s, n, ip ) == n ? 6 : 0 );
+}
+
+/* The IPv4 address of ip as an integer, -1 if it is not a mapped IPv4 one. */
+int64_t log_ip_v4( const unsigned char ip[16] )
+{
+    if ( memcmp( ip, log_ip_mapped, 12 ) != 0 ) return -1;
+    return ( (int64_t)ip[12] << 24 ) | ( ip[13] << 16 ) | ( ip[14] << 8 ) | ip[15];
+}
+
+/*
+Read a CIDR block, "10.0.0.0/8", "2001:db8::/32", or a single address,
+into its lowest and highest addresses. Returns 0, -1 if s is not one.
+ */
+int log_ip_cidr( const char *s, int n, unsigned char lo[16], unsigned char hi[16] )
+{
+    const char  *slash = memchr( s, '/', n );
+    int         kind, bits, i, b;
+
+    if ( ( kind = log_ip_addr( s, slash == NULL ? n : slash - s, lo ) ) == 0 ) return -1;
+    bits = 128;
+    if ( slash != NULL ) {
+        if ( slash + 1 == s + n || s + n - slash > 4 ) return -1;
+        for ( bits = 0, i = slash - s + 1; i < n; i++ ) {
+            if ( (unsigned int)( s[i] - '0' ) >= 10 ) return -1;
+            bits = bits * 10 + ( s[i] - '0' );
+        }
+        if ( bits > ( kind == 4 ? 32 : 128 ) ) return -1;
+        if ( kind == 4 ) bits += 96;
+    }
+    for ( i = 0; i < 16; i++ ) {
+        b = bits - i * 8;
+        b = ( b >= 8 ? 0xff : b <= 0 ? 0 : ( 0xff << ( 8 - b ) ) & 0xff );
+        lo[i] &= b;
+        hi[i] = lo[i] | ( ~b & 0xff );
+    }
+    return 0;
+}
+
+/* Whether ip is from lo to hi. */
+int log_ip_in( const unsigned char ip[16], const unsigned char lo[16], const unsigned char hi[16] )
+{
+    return memcmp( ip, lo, 16 ) >= 0 && memcmp( ip, hi, 16 ) <= 0;
+}
+
+/* The address a value stands for: text, a 16 byte blob or an IPv4 integer. */
+static int log_ip_value( sqlite3_value *value, int flags, unsigned char ip[16] )
+{
+    sqlite3_int64  v;
+
+    switch ( sqlite3_value_type( value ) ) {
+    case SQLITE_INTEGER:
+        if ( ( v = sqlite3_value_int64( value ) ) < 0 || v > 0xffffffffLL ) return 0;
+        memcpy( ip, log_ip_mapped, 12 );
+        ip[12] = (unsigned char)( v >> 24 );
+        ip[13] = (unsigned char)( v >> 16 );
+        ip[14] = (unsigned char)( v >> 8 );
+        ip[15] = (unsigned char)v;
+        return 4;
+    case SQLITE_BLOB:
+        if ( sqlite3_value_bytes( value ) != 16 ) return 0;
+        memcpy( ip, sqlite3_value_blob( value ), 16 );
+        return 6;
+    case SQLITE_TEXT:
+        return log_ip_parse( (const char *)sqlite3_value_text( value ), sqlite3_value_bytes( value ), flags, ip );
+    }
+    return 0;
+}
+
+/*
+ip_in_cidr(X, CIDR). The block's bounds are kept with the statement,
+so a constant CIDR is read once. The user data is the flags X is
+parsed with.
+ */
+void log_ip_in_cidr( sqlite3_context *ctx, int argc, sqlite3_value **argv )
+{
+    unsigned char  *range, block[32], ip[16];
+
+    if ( sqlite3_value_type( argv[0] ) == SQLITE_NULL || sqlite3_value_type( argv[1] ) == SQLITE_NULL ) return;
+    if ( ( range = sqlite3_get_auxdata( ctx, 1 ) ) == NULL ) {
+        if ( log_ip_cidr( (const char *)sqlite3_value_text( argv[1] ), sqlite3_value_bytes( argv[1] ),
+                          block, block + 16 ) != 0 ) {
+            sqlite3_result_error( ctx, "ip_in_cidr: not an address or CIDR block", -1 );
+            return;
+        }
+        if ( ( range = sqlite3_malloc( 32 ) ) != NULL ) {
+            memcpy( range, block, 32 );
+            sqlite3_set_auxdata( ctx, 1, range, sqlite3_free );
+        }
+        range = block;
+    }
+    sqlite3_result_int( ctx, log_ip_value( argv[0], (int)(intptr_t)sqlite3_user_data( ctx ), ip ) != 0 &&
+                             log_ip_in( ip, range, range + 16 ) );
+}
+
+/*
+For a module's xFindFunction: ip_in_cidr() on one of its columns, with
+its remote hosts read with flags, is constraint LOG_IP_IN_CIDR.
+ */
+int log_ip_find_function( int flags, int argc, const char *name,
+                          void (**func)( sqlite3_context *, int, sqlite3_value ** ), void **arg )
+{
+    if ( argc != 2 || sqlite3_stricmp( name, "ip_in_cidr" ) != 0 ) return 0;
+    *func = log_ip_in_cidr;
+    *arg = (void *)(intptr_t)flags;
+    return LOG_IP_IN_CIDR;
+}
+
+int log_ip_init( sqlite3 *db )
+{
+    return sqlite3_create_function( db, "ip_in_cidr", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                    NULL, log_ip_in_cidr, NULL, NULL );
+}
@@ -0,0 +1,53 @@
+/**
+
+IP addresses of remote hosts, IPv4 and IPv6, parsed without going
+through floating point or the C library.
+
+An address is kept as 16 bytes, most significant first, with an IPv4
+address a.b.c.d as the IPv4-mapped ::ffff:a.b.c.d, so addresses of
+both kinds compare, and sort, as their bytes do. remote_host_ip is the
+remote_host in that form, a 16 byte blob; remote_host_int is the IPv4
+address as an integer, NULL for an IPv6 client other than a mapped
+IPv4 one and for a host name.
+
+Besides a bare address, "a.b.c.d:port" and "[v6]:port" are read. A
+bare IPv6 address followed by a port is ambiguous, "2001:db8::1:80";
+with LOG_IP_PORT a last ":digits" is taken for a port when what comes
+before it is an address, as the error_log's "[client 2001:db8::1:80]"
+of httpd 2.4 always has one.
+
+    SELECT count(*) FROM access_log WHERE ip_in_cidr(remote_host, '10.0.0.0/8');
+
+ip_in_cidr(X, CIDR) is 1 if X, the text of an address, a 16 byte blob
+as in remote_host_ip or an IPv4 address as an integer, is in the block
+CIDR, "10.0.0.0/8", "2001:db8::/32" or a single address; 0 if not or
+if X is not an address, NULL if either is NULL. An IPv4 block holds
+the mapped addresses of its IPv4 addresses. On remote_host,
+remote_host_int or remote_host_ip of a log table it is checked on
+each line as the line is read, as a range of addresses, before
+SQLite is handed the row.
+ **/
+
+#ifndef LOGIP_H
+#define LOGIP_H
+
+#include <stdint.h>
+
+#include "sqlite3ext.h"
+
+#define LOG_IP_PORT         1            /* a bare IPv6 address may end in :port */
+
+/* constraint op for ip_in_cidr(column, CIDR), see xFindFunction */
+#define LOG_IP_IN_CIDR      SQLITE_INDEX_CONSTRAINT_FUNCTION
+
+int          log_ip_parse( const char *s, int n, int flags, unsigned char ip[16] );
+int64_t      log_ip_v4( const unsigned char ip[16] );
+int          log_ip_cidr( const char *s, int n, unsigned char lo[16], unsigned char hi[16] );
+int          log_ip_in( const unsigned char ip[16], const unsigned char lo[16], const unsigned char hi[16] );
+
+void         log_ip_in_cidr( sqlite3_context *ctx, int argc, sqlite3_value **argv );
+int          log_ip_find_function( int flags, int argc, const char *name,
+                                   void (**func)( sqlite3_context *, int, sqlite3_value ** ), void **arg );
+int          log_ip_init( sqlite3 *db );
+
+#endif
@@ -0,0 +1,96 @@
+/**
+
+Raw byte checks of lines. See logmatch.h.
+ **/
+
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "logmatch.h"
+
+#define LOG_MATCH_LOWER( ch )  ( (ch) >= 'A' && (ch) <= 'Z' ? (ch) + 'a' - 'A' : (ch) )
+#define LOG_MATCH_UPPER( ch )  ( (ch) >= 'a' && (ch) <= 'z' ? (ch) - 'a' + 'A' : (ch) )
+
+/*
+The longest run of characters a LIKE (or, if glob is set, a GLOB)
+pattern matches only literally: its offset in pattern and, in *len,
+its length, 0 if the pattern is all wildcards. LIKE's wildcards are %
+and _, GLOB's *, ? and [...] classes. Neither is given an ESCAPE
+clause by SQLite when it passes the constraint to a virtual table.
+ */
+int log_match_literal( const char *pattern, int n, int glob, int *len )
+{
+    int  i = 0, start, best = 0;
+
+    *len = 0;
+    while ( i < n ) {
+        for ( start = i; i < n; i++ ) {
+            char ch = pattern[i];
+
+            if ( glob ? ( ch == '*' || ch == '?' || ch == '[' ) : ( ch == '%' || ch == '_' ) ) break;
+        }
+        if ( i - start > *len ) {
+            best = start;
+            *len = i - start;
+        }
+        if ( i < n && glob && pattern[i] == '[' ) {
+            i++;                        /* a class, "]" first is one of it */
+            if ( i < n && pattern[i] == '^' ) i++;
+            if ( i < n && pattern[i] == ']' ) i++;
+            while ( i < n && pattern[i] != ']' ) i++;
+        }
+        i++;
+    }
+    return best;
+}
+
+/* Whether the m bytes at p are needle's, ignoring ASCII case. */
+static int log_match_caseeq( const char *p, const char *needle, int m )
+{
+    int k;
+
+    for ( k = 0; k < m; k++ ) {
+        if ( LOG_MATCH_LOWER( (unsigned char)p[k] ) != LOG_MATCH_LOWER( (unsigned char)needle[k] ) ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+The first occurrence of needle in hay, or NULL. With nocase, ASCII
+letters match either case, as LIKE's do: candidates are found with
+memchr() on a byte of needle that has no case or, if it is all
+letters, on both cases of its first.
+ */
+const char * log_match_find( const char *hay, int n, const char *needle, int m, int nocase )
+{
+    const char  *p, *lo, *up, *stop = hay + n;
+    int         a, lc, uc;
+
+    if ( m == 0 ) return hay;
+    if ( m > n ) return NULL;
+    if ( !nocase ) return memmem( hay, n, needle, m );
+
+    for ( a = 0; a < m && LOG_MATCH_LOWER( (unsigned char)needle[a] ) !=
+                          LOG_MATCH_UPPER( (unsigned char)needle[a] ); a++ ) ;
+    if ( a < m ) {
+        for ( p = hay + a; ( p = memchr( p, needle[a], stop - m + a + 1 - p ) ) != NULL; p++ ) {
+            if ( log_match_caseeq( p - a, needle, m ) ) return p - a;
+        }
+        return NULL;
+    }
+
+    lc = LOG_MATCH_LOWER( (unsigned char)needle[0] );
+    uc = LOG_MATCH_UPPER( (unsigned char)needle[0] );
+    lo = memchr( hay, lc, n - m + 1 );
+    up = memchr( hay, uc, n - m + 1 );
+    while ( lo != NULL || up != NULL ) {
+        p = ( up == NULL || ( lo != NULL && lo < up ) ? lo : up );
+        if ( log_match_caseeq( p, needle, m ) ) return p;
+        if ( p == lo ) lo = memchr( p + 1, lc, stop - m - p );
+        else           up = memchr( p + 1, uc, stop - m - p );
+    }
+    return NULL;
+}
@@ -0,0 +1,17 @@
+/**
+
+Checks of a line's raw bytes for constraints the modules push down
+from SQLite, made before the line is split into fields: a line that
+does not hold the literal part of a LIKE or GLOB pattern, or the value
+a text column must equal, cannot match and is skipped without being
+parsed or handed to SQLite. The checks only ever let through more
+lines than match; SQLite still evaluates the constraints.
+ **/
+
+#ifndef LOGMATCH_H
+#define LOGMATCH_H
+
+int          log_match_literal( const char *pattern, int n, int glob, int *len );
+const char * log_match_find( const char *hay, int n, const char *needle, int m, int nocase );
+
+#endif
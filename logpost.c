@@ -0,0 +1,476 @@
+/**
+
+Inverted index of a log. See logpost.h.
+
+Sidecar file layout, native byte order as for the index:
+
+    "CATTOYPL"                      magic
+    int32                           version
+    int32 compressed
+    int64 src_size, src_mtime, rows, end_off
+    int32 head_len, int32 pad
+    uint64 head
+    int64 n
+    n * { uint64 key; int64 n, last_row, last_off, len }
+    the data of each list, in the same order
+
+A list's data is, for each line with the key, the difference of its
+line number and of its offset from the line before, as varints.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "logpost.h"
+#include "logzone.h"
+
+#define LOG_POST_MAGIC     "CATTOYPL"
+#define LOG_POST_VERSION   1
+
+log_post * log_post_new( void )
+{
+    return calloc( 1, sizeof( log_post ) );
+}
+
+void log_post_free( log_post *p )
+{
+    int64_t i;
+
+    if ( p == NULL ) return;
+    for ( i = 0; i < p->n; i++ ) {
+        if ( p->list[i].alloc > 0 ) free( p->list[i].data );
+    }
+    free( p->list );
+    free( p->blob );
+    free( p->slot );
+    log_post_free( p->prev );
+    free( p );
+}
+
+/* splitmix64's finaliser, so the keys of close values spread out */
+static uint64_t log_post_mix( uint64_t x )
+{
+    x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+    return x ^ ( x >> 31 );
+}
+
+/*
+The key of value in the column the module numbers tag. Text values are
+passed as their log_zone_hash().
+ */
+uint64_t log_post_key( int tag, uint64_t value )
+{
+    return log_post_mix( value + (uint64_t)( tag + 1 ) * 0x9e3779b97f4a7c15ULL );
+}
+
+static int log_post_rehash( log_post *p, int64_t slots )
+{
+    int64_t  *slot = malloc( slots * sizeof( int64_t ) ), i, h;
+
+    if ( slot == NULL ) return -1;
+    memset( slot, 0xff, slots * sizeof( int64_t ) );
+    for ( i = 0; i < p->n; i++ ) {
+        for ( h = p->list[i].key & ( slots - 1 ); slot[h] >= 0; h = ( h + 1 ) & ( slots - 1 ) ) ;
+        slot[h] = i;
+    }
+    free( p->slot );
+    p->slot = slot;
+    p->slots = slots;
+    return 0;
+}
+
+/* The list of key, added if it is new, while building. */
+static log_post_list * log_post_list_for( log_post *p, uint64_t key )
+{
+    int64_t  h;
+
+    if ( p->n * 2 >= p->slots &&
+         log_post_rehash( p, p->slots == 0 ? 1024 : p->slots * 2 ) != 0 ) {
+        return NULL;
+    }
+    for ( h = key & ( p->slots - 1 ); p->slot[h] >= 0; h = ( h + 1 ) & ( p->slots - 1 ) ) {
+        if ( p->list[p->slot[h]].key == key ) return &p->list[p->slot[h]];
+    }
+    if ( p->n == p->alloc ) {
+        int64_t  alloc = ( p->alloc == 0 ? 256 : p->alloc * 2 );
+        void     *list = realloc( p->list, alloc * sizeof( log_post_list ) );
+
+        if ( list == NULL ) return NULL;
+        p->list = list;
+        p->alloc = alloc;
+    }
+    memset( &p->list[p->n], 0, sizeof( log_post_list ) );
+    p->list[p->n].key = key;
+    p->slot[h] = p->n;
+    return &p->list[p->n++];
+}
+
+/*
+A builder holding the lines from indexes, to add the lines logged
+since to. from is left as it is, other cursors may be reading it.
+ */
+log_post * log_post_grow( const log_post *from )
+{
+    log_post  *p = log_post_new();
+    int64_t   i;
+
+    if ( p == NULL ) return NULL;
+    p->rows = from->rows;
+    p->end_off = from->end_off;
+    for ( i = 0; i < from->n; i++ ) {
+        const log_post_list  *f = &from->list[i];
+        log_post_list        *l = log_post_list_for( p, f->key );
+
+        if ( l == NULL || ( l->data = malloc( f->len + 1 ) ) == NULL ) {
+            log_post_free( p );
+            return NULL;
+        }
+        memcpy( l->data, f->data, f->len );
+        l->n = f->n;
+        l->last_row = f->last_row;
+        l->last_off = f->last_off;
+        l->len = f->len;
+        l->alloc = f->len + 1;
+    }
+    return p;
+}
+
+static void log_post_put( unsigned char *data, int64_t *len, uint64_t v )
+{
+    while ( v >= 0x80 ) {
+        data[( *len )++] = (unsigned char)( v | 0x80 );
+        v >>= 7;
+    }
+    data[( *len )++] = (unsigned char)v;
+}
+
+static const unsigned char * log_post_get( const unsigned char *p, const unsigned char *end,
+                                           uint64_t *v )
+{
+    int shift = 0;
+
+    *v = 0;
+    while ( p < end && shift < 64 ) {
+        *v |= (uint64_t)( *p & 0x7f ) << shift;
+        if ( !( *p++ & 0x80 ) ) return p;
+        shift += 7;
+    }
+    return NULL;
+}
+
+/*
+Add line number row of the log, which starts at offset off and ends
+at end, with the n keys of its values. Lines are added in order.
+ */
+int log_post_line( log_post *p, int64_t row, int64_t off, int64_t end,
+                   int n, const uint64_t *keys )
+{
+    log_post_list  *l;
+    int            i;
+
+    for ( i = 0; i < n; i++ ) {
+        if ( ( l = log_post_list_for( p, keys[i] ) ) == NULL ) return -1;
+        if ( l->n > 0 && l->last_row == row ) continue;     /* key twice in a line */
+        if ( l->len + 20 > l->alloc ) {
+            int64_t  alloc = ( l->alloc < 32 ? 32 : l->alloc * 2 );
+            void     *data = realloc( l->data, alloc );
+
+            if ( data == NULL ) return -1;
+            l->data = data;
+            l->alloc = alloc;
+        }
+        log_post_put( l->data, &l->len, row - l->last_row );
+        log_post_put( l->data, &l->len, off - l->last_off );
+        l->last_row = row;
+        l->last_off = off;
+        l->n++;
+    }
+    p->rows = row;
+    p->end_off = end;
+    return 0;
+}
+
+static int log_post_cmp( const void *a, const void *b )
+{
+    uint64_t x = ((const log_post_list *)a)->key, y = ((const log_post_list *)b)->key;
+
+    return ( x > y ) - ( x < y );
+}
+
+/*
+Close the index of filename, which r has read to the end. Moves r.
+The lines after end_off, a last line still being written or lines
+logged while r read, are left for the next lookup.
+ */
+int log_post_finish( log_post *p, const char *filename, log_reader *r )
+{
+    struct stat  st;
+    char         head[LOG_POST_HEAD];
+
+    free( p->slot );
+    p->slot = NULL;
+    p->slots = 0;
+    if ( p->n > 0 ) qsort( p->list, p->n, sizeof( log_post_list ), log_post_cmp );
+
+    if ( stat( filename, &st ) != 0 ) return -1;
+    p->src_size = st.st_size;
+    p->src_mtime = st.st_mtime;
+    p->compressed = log_reader_compressed( r );
+    p->head_len = ( p->end_off < LOG_POST_HEAD ? p->end_off : LOG_POST_HEAD );
+    if ( log_reader_seek( r, 0 ) != 0 || log_reader_read( r, head, p->head_len ) != p->head_len ) {
+        return -1;
+    }
+    p->head = log_zone_hash( head, p->head_len );
+    return 0;
+}
+
+/*
+Whether p is the index of filename as it is now, LOG_POST_CURRENT, or
+of the start of it, LOG_POST_GROWN, or of some other log.
+ */
+int log_post_state( log_post *p, const char *filename )
+{
+    struct stat  st;
+    char         head[LOG_POST_HEAD];
+    FILE         *fp;
+    int          n;
+
+    if ( stat( filename, &st ) != 0 ) return LOG_POST_STALE;
+    if ( st.st_size == p->src_size && st.st_mtime == p->src_mtime ) {
+        return ( p->compressed || p->end_off == st.st_size ? LOG_POST_CURRENT : LOG_POST_GROWN );
+    }
+    if ( p->compressed || st.st_size < p->end_off ) return LOG_POST_STALE;
+
+    if ( ( fp = fopen( filename, "rb" ) ) == NULL ) return LOG_POST_STALE;
+    n = fread( head, 1, p->head_len, fp );
+    fclose( fp );
+    if ( n != p->head_len || log_zone_hash( head, n ) != p->head ) return LOG_POST_STALE;
+    return LOG_POST_GROWN;
+}
+
+static log_post_list * log_post_find( log_post *p, uint64_t key )
+{
+    int64_t lo = 0, hi = p->n;
+
+    while ( lo < hi ) {
+        int64_t mid = lo + ( hi - lo ) / 2;
+
+        if ( p->list[mid].key < key ) lo = mid + 1;
+        else                          hi = mid;
+    }
+    return ( lo < p->n && p->list[lo].key == key ? &p->list[lo] : NULL );
+}
+
+/*
+The lines that have all n keys, in order: their line numbers in *rows
+and offsets in *offs, which the caller frees. Returns how many, or -1
+if out of memory.
+ */
+int64_t log_post_rows( log_post *p, const uint64_t *keys, int n,
+                       int64_t **rows, int64_t **offs )
+{
+    log_post_list        *l, *first = NULL;
+    const unsigned char  *d, *end;
+    uint64_t             v;
+    int64_t              row, off, count = 0, i, k;
+    int                  j;
+
+    *rows = *offs = NULL;
+    for ( j = 0; j < n; j++ ) {
+        if ( ( l = log_post_find( p, keys[j] ) ) == NULL ) return 0;
+        if ( first == NULL || l->n < first->n ) first = l;
+    }
+    if ( first == NULL ) return 0;
+
+    *rows = malloc( ( first->n + 1 ) * sizeof( int64_t ) );
+    *offs = malloc( ( first->n + 1 ) * sizeof( int64_t ) );
+    if ( *rows == NULL || *offs == NULL ) goto fail;
+
+    /* the shortest list, then keep those of its lines the others have */
+    row = off = 0;
+    d = first->data;
+    end = d + first->len;
+    while ( d != NULL && d < end && count < first->n ) {
+        if ( ( d = log_post_get( d, end, &v ) ) == NULL ) break;
+        row += v;
+        if ( ( d = log_post_get( d, end, &v ) ) == NULL ) break;
+        off += v;
+        (*rows)[count] = row;
+        (*offs)[count++] = off;
+    }
+    for ( j = 0; j < n && count > 0; j++ ) {
+        l = log_post_find( p, keys[j] );
+        if ( l == first ) continue;
+        row = off = 0;
+        d = l->data;
+        end = d + l->len;
+        for ( i = k = 0; i < count && d != NULL && d < end; ) {
+            if ( ( d = log_post_get( d, end, &v ) ) == NULL ) break;
+            row += v;
+            if ( ( d = log_post_get( d, end, &v ) ) == NULL ) break;
+            while ( i < count && (*rows)[i] < row ) i++;
+            if ( i < count && (*rows)[i] == row ) {
+                (*rows)[k] = (*rows)[i];
+                (*offs)[k++] = (*offs)[i++];
+            }
+        }
+        count = k;
+    }
+    return count;
+
+fail:
+    free( *rows );
+    free( *offs );
+    *rows = *offs = NULL;
+    return -1;
+}
+
+static char * log_post_path( const char *filename )
+{
+    char *path = malloc( strlen( filename ) + sizeof( LOG_POST_SUFFIX ) );
+
+    if ( path != NULL ) {
+        strcpy( path, filename );
+        strcat( path, LOG_POST_SUFFIX );
+    }
+    return path;
+}
+
+/*
+Load the saved index of filename. Whether it is still of the log is up
+to log_post_state().
+ */
+log_post * log_post_load( const char *filename )
+{
+    struct stat  st;
+    char         magic[8], *path;
+    int32_t      hdr[2], head_len[2];
+    int64_t      meta[4], dir[4], n, total = 0, i;
+    uint64_t     head, key;
+    log_post     *p = NULL;
+    FILE         *fp;
+
+    if ( ( path = log_post_path( filename ) ) == NULL ) return NULL;
+    fp = fopen( path, "rb" );
+    free( path );
+    if ( fp == NULL ) return NULL;
+    if ( fstat( fileno( fp ), &st ) != 0 ) goto fail;
+
+    if ( fread( magic, sizeof( magic ), 1, fp ) != 1 ||
+         memcmp( magic, LOG_POST_MAGIC, sizeof( magic ) ) != 0 ||
+         fread( hdr, sizeof( hdr ), 1, fp ) != 1 || hdr[0] != LOG_POST_VERSION ||
+         fread( meta, sizeof( meta ), 1, fp ) != 1 ||
+         fread( head_len, sizeof( head_len ), 1, fp ) != 1 ||
+         head_len[0] < 0 || head_len[0] > LOG_POST_HEAD ||
+         fread( &head, sizeof( head ), 1, fp ) != 1 ||
+         fread( &n, sizeof( n ), 1, fp ) != 1 ||
+         n < 0 || n > st.st_size / 40 ) {
+        goto fail;
+    }
+
+    if ( ( p = log_post_new() ) == NULL ) goto fail;
+    p->compressed = hdr[1];
+    p->src_size = meta[0];
+    p->src_mtime = meta[1];
+    p->rows = meta[2];
+    p->end_off = meta[3];
+    p->head_len = head_len[0];
+    p->head = head;
+    if ( n > 0 && ( p->list = calloc( n, sizeof( log_post_list ) ) ) == NULL ) goto fail;
+    p->alloc = n;
+
+    for ( i = 0; i < n; i++ ) {
+        log_post_list *l = &p->list[i];
+
+        if ( fread( &key, sizeof( key ), 1, fp ) != 1 ||
+             fread( dir, sizeof( dir ), 1, fp ) != 1 ||
+             dir[3] < 0 || dir[3] > st.st_size ) {
+            goto fail;
+        }
+        l->key = key;
+        l->n = dir[0];
+        l->last_row = dir[1];
+        l->last_off = dir[2];
+        l->len = dir[3];
+        total += l->len;
+    }
+    p->n = n;
+    if ( total > st.st_size || ( p->blob = malloc( total + 1 ) ) == NULL ||
+         ( total > 0 && fread( p->blob, total, 1, fp ) != 1 ) ) {
+        goto fail;
+    }
+    for ( i = total = 0; i < n; i++ ) {
+        p->list[i].data = p->blob + total;
+        total += p->list[i].len;
+    }
+    fclose( fp );
+    return p;
+
+fail:
+    log_post_free( p );
+    fclose( fp );
+    return NULL;
+}
+
+int log_post_save( log_post *p, const char *filename )
+{
+    char     *path, *tmp;
+    int32_t  hdr[2], head_len[2];
+    int64_t  meta[4], i;
+    FILE     *fp;
+    int      rc = -1;
+
+    if ( p->slot != NULL ) return -1;           /* not finished */
+    if ( ( path = log_post_path( filename ) ) == NULL ) return -1;
+    if ( ( tmp = malloc( strlen( path ) + 16 ) ) == NULL ) {
+        free( path );
+        return -1;
+    }
+    sprintf( tmp, "%s.%d", path, (int)getpid() );
+
+    if ( ( fp = fopen( tmp, "wb" ) ) == NULL ) goto done;
+
+    hdr[0] = LOG_POST_VERSION;
+    hdr[1] = p->compressed;
+    meta[0] = p->src_size;
+    meta[1] = p->src_mtime;
+    meta[2] = p->rows;
+    meta[3] = p->end_off;
+    head_len[0] = p->head_len;
+    head_len[1] = 0;
+    fwrite( LOG_POST_MAGIC, 8, 1, fp );
+    fwrite( hdr, sizeof( hdr ), 1, fp );
+    fwrite( meta, sizeof( meta ), 1, fp );
+    fwrite( head_len, sizeof( head_len ), 1, fp );
+    fwrite( &p->head, sizeof( p->head ), 1, fp );
+    fwrite( &p->n, sizeof( p->n ), 1, fp );
+    for ( i = 0; i < p->n; i++ ) {
+        log_post_list *l = &p->list[i];
+        int64_t dir[4] = { l->n, l->last_row, l->last_off, l->len };
+
+        fwrite( &l->key, sizeof( l->key ), 1, fp );
+        fwrite( dir, sizeof( dir ), 1, fp );
+    }
+    for ( i = 0; i < p->n; i++ ) {
+        if ( p->list[i].len > 0 ) fwrite( p->list[i].data, p->list[i].len, 1, fp );
+    }
+
+    if ( ferror( fp ) | fclose( fp ) ) {
+        remove( tmp );
+        goto done;
+    }
+    if ( rename( tmp, path ) != 0 ) {
+        remove( tmp );
+        goto done;
+    }
+    rc = 0;
+
+done:
+    free( tmp );
+    free( path );
+    return rc;
+}
@@ -0,0 +1,77 @@
+/**
+
+Inverted index of a log: for each value of a few columns, the lines
+that hold it, so an equality lookup reads only those lines.
+
+A key is a column tag and a value, hashed to 64 bits. Its posting list
+is the line number and starting offset of every line with that value,
+delta encoded as varints. Keys that collide only cost extra lines: the
+modules never omit the constraint, so SQLite still checks each line.
+
+Posting lists are built by the modules while a query with constraints
+they can use reads a whole log, kept with the table for index=memory
+and saved next to the log for index=on, e.g.
+    access_log.cattoy-post
+A plain log that has grown since, and still starts with the same
+bytes, keeps its index for the lines it covers; the lines logged since
+are read and added to it by the next lookup.
+ **/
+
+#ifndef LOGPOST_H
+#define LOGPOST_H
+
+#include <stdint.h>
+
+#include "logreader.h"
+
+#define LOG_POST_SUFFIX     ".cattoy-post"
+#define LOG_POST_HEAD       256          /* bytes hashed to recognise a log */
+
+/* log_post_state() */
+#define LOG_POST_STALE      -1
+#define LOG_POST_CURRENT    0
+#define LOG_POST_GROWN      1            /* lines after end_off not indexed */
+
+typedef struct log_post_list_s {
+    uint64_t         key;
+    int64_t          n;                  /* lines with the key */
+    int64_t          last_row;           /* last posting, the base of the next */
+    int64_t          last_off;
+    int64_t          len;                /* bytes of data */
+    int64_t          alloc;              /* 0 if data is in the loaded blob */
+    unsigned char    *data;
+} log_post_list;
+
+typedef struct log_post_s {
+    int64_t          src_size;           /* log size and mtime when built */
+    int64_t          src_mtime;
+    int              compressed;
+    int              head_len;
+    uint64_t         head;               /* hash of the first head_len bytes */
+    int64_t          rows;               /* lines indexed */
+    int64_t          end_off;            /* offset after the last of them */
+    int64_t          n;                  /* lists, sorted by key once finished */
+    int64_t          alloc;
+    log_post_list    *list;
+    unsigned char    *blob;              /* lists' data as loaded */
+    struct log_post_s *prev;             /* index it replaced, see logset.c */
+
+    /* while building, list index by key, open addressing */
+    int64_t          *slot;
+    int64_t          slots;
+} log_post;
+
+log_post   * log_post_new( void );
+log_post   * log_post_grow( const log_post *from );
+void         log_post_free( log_post *p );
+uint64_t     log_post_key( int tag, uint64_t value );
+int          log_post_line( log_post *p, int64_t row, int64_t off, int64_t end,
+                            int n, const uint64_t *keys );
+int          log_post_finish( log_post *p, const char *filename, log_reader *r );
+int          log_post_state( log_post *p, const char *filename );
+int64_t      log_post_rows( log_post *p, const uint64_t *keys, int n,
+                            int64_t **rows, int64_t **offs );
+log_post   * log_post_load( const char *filename );
+int          log_post_save( log_post *p, const char *filename );
+
+#endif
@@ -0,0 +1,1562 @@
+/**
+
+Sequential and random access reader for plain and compressed logs.
+See logreader.h.
+
+Decompressed data is kept in out[], which always retains the last
+LOG_INDEX_WINSIZE bytes before the read position. That history is the
+inflate dictionary needed for an index point, and it also makes short
+backward seeks free.
+
+Logs are read or decompressed up to a megabyte at a time and
+log_reader_line() splits lines with memchr() over out[], returning each
+one where it lies. A line that runs off the end of out[] is moved to
+the front with the history when out[] is filled again, so lines come
+out whole however the blocks fall. A line too long for out[] to hold
+with the history doubles it, up to LOG_READER_LINE_MAX, so a long
+line costs a realloc() now and then rather than anything per line;
+out[] stays that size until the reader is closed.
+
+Each codec is driven through strm.next_in/avail_in (unread input in
+in[]) and strm.next_out/avail_out, the z_stream's, whichever library
+does the work, so that filling, index points and seeking are the same
+for all of them.
+
+Plain logs opened with LOG_READER_MMAP are mapped instead, and out[] is
+the mapping: there is nothing to fill or drop, out_len is the mapped
+length, and lines point straight into the file. A log that grows is
+mapped again when the reader gets to the end of the old mapping. A log
+truncated under a mapping (logrotate's copytruncate) raises SIGBUS on
+access, so such logs must be read without LOG_READER_MMAP, as
+log_file_open() reads the live log.
+
+With a cache of decompressed blocks (log_reader_share()), what is
+decompressed into out[] is copied into the cache a whole block at a
+time. Once the log has an index, so that no index is being built from
+what passes through out[], out[] is filled from the cache instead and
+only a block that is not there is decompressed, into the cache first.
+The decoder is then apart from out[], at dec_pos, and a miss after
+hits brings it to the block from the index point before it
+(log_reader_sync()). A scan that starts in the cache is not read ahead.
+
+With log_reader_prefetch() the reader stops decompressing itself. A
+second reader on the same file, run by a producer thread, reads ahead
+into a ring of LOG_READER_BLOCK sized blocks and fill() copies ready
+blocks into out[]. Anything that moves the read position outside out[]
+stops the thread first, so only sequential reading is ever done in the
+background, and the thread never touches the table's index slot: an
+index it builds is handed over by the consumer (log_reader_adopt).
+
+A BGZF log read ahead from the start has several worker threads instead
+of one producer. Each in turn claims the next ring block and, holding
+the input lock so that claims and reads stay in order, reads as many
+whole members as will fit it once inflated; it then inflates them
+while the others claim theirs. Blocks are filled out of order but taken
+in order, and as each is filled the blocks before it that are complete
+are retired in order, which is where the index is built.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <lzma.h>
+#ifdef LOG_ZSTD
+#include <zstd.h>
+#endif
+
+#include "logreader.h"
+
+#define LOG_READER_INSIZE   65536
+#define LOG_READER_OUTSIZE  ( LOG_INDEX_WINSIZE + 1048576 )   /* to start with */
+#define LOG_READER_LINE_MAX ( 256 * 1048576 )  /* longest line read whole */
+#define LOG_READER_BLOCK    262144       /* must fit out[] after the window */
+#define LOG_READER_RING     4            /* blocks read ahead */
+#define LOG_READER_WORKERS  4            /* BGZF inflating threads, at most */
+#define LOG_READER_MEMBERS  256          /* BGZF members per block, at most */
+#define LOG_READER_BGZF_MAX 65536        /* BGZF member size, in and out */
+#define LOG_READER_BGZF_HEAD 64          /* bytes of a member header looked at */
+
+typedef struct log_reader_block_s {
+    unsigned char    *data;
+    int              len;                /* 0 at the end, -1 on error */
+    int              ready;              /* data and len are filled in */
+
+    /* BGZF workers only */
+    int              clean;              /* len 0 at a clean end of input */
+    int64_t          in;                 /* offset of the first member */
+    int64_t          out;                /* uncompressed offset of data */
+    int64_t          lines;              /* newlines in data */
+    int64_t          read;               /* compressed bytes in data */
+} log_reader_block;
+
+typedef struct log_reader_worker_s {
+    log_reader       *r;
+    pthread_t        thread;
+    z_stream         strm;
+    unsigned char    *zin;               /* members read for a block */
+} log_reader_worker;
+
+struct log_reader_s {
+    int              fd;
+    char             *filename;
+    int              codec;              /* LOG_CODEC_* */
+    int              bgzf;               /* gzip in BGZF members */
+    int              flags;              /* LOG_READER_* */
+    int              mapped;             /* out is a mapping of the file */
+
+    /* decompressing state */
+    z_stream         strm;               /* and the buffers of all codecs */
+    int              raw;                /* resumed at an index point */
+    lzma_stream      xz;
+#ifdef LOG_ZSTD
+    ZSTD_DStream     *zstd;
+#endif
+    int              frame;              /* zstd: inside a frame */
+    int              done;               /* no more output */
+    int              clean;              /* input ended at a member end */
+    unsigned char    *in;
+    int64_t          in_pos;             /* file offset after in[] */
+
+    /* decompressed data, out[0] is at uncompressed offset out_off */
+    unsigned char    *out;
+    int64_t          out_size;           /* allocated, if not mapped */
+    int64_t          out_len;
+    int64_t          out_pos;
+    int64_t          out_off;
+    int              eof;                /* read past the end */
+    int              skip;               /* rest of a too long line */
+
+    /* index */
+    log_index        **index;            /* owned by the table */
+    int              index_mode;
+    log_index        *build;             /* while reading from the start */
+    int64_t          lines;              /* newlines in out before out_len */
+    int64_t          last_point;
+
+    /* decompressed blocks, see log_reader_share() */
+    log_blocks       *blocks;            /* the table's cache, or NULL */
+    int              blocks_file;        /* the log's number in it */
+    unsigned char    *keep;              /* block being kept as out[] fills */
+    int64_t          keep_off;           /* its uncompressed offset */
+    int              keep_len;
+    int64_t          dec_pos;            /* uncompressed offset of the decoder */
+
+    /* background reading, see log_reader_prefetch() */
+    log_reader       *ahead;             /* reader run by the thread */
+    log_index        *ahead_index;       /* its index slot */
+    pthread_t        thread;
+    pthread_mutex_t  lock;
+    pthread_cond_t   ready;              /* a block was filled */
+    pthread_cond_t   space;              /* a block was freed */
+    log_reader_block ring[LOG_READER_RING];
+    int              ring_head;          /* next block to copy */
+    int              ring_count;         /* blocks filled or being filled */
+    int              ring_pos;           /* bytes of the head block copied */
+    int              stop;               /* tell the threads to quit */
+
+    /* BGZF workers instead of the thread, see log_reader_work() */
+    log_reader_worker *workers;
+    int              n_workers;
+    pthread_mutex_t  input;              /* held to claim a block and read for it */
+    int64_t          next_in;            /* offset of the next member */
+    int64_t          next_out;           /* and its uncompressed offset */
+    int64_t          claimed;            /* blocks claimed */
+    int64_t          retired;            /* blocks retired, in order */
+    int              input_end;          /* a block got the end or an error */
+    int              stale;              /* fd and inflate state are not at out_len */
+
+    /* counts, see log_reader_stats() */
+    int64_t          bytes_read;         /* from the file, or mapped */
+    int64_t          bytes_inflated;
+    int64_t          ahead_read;         /* the thread's, as of its last block */
+    int64_t          ahead_inflated;
+};
+
+static void log_reader_stop_build( log_reader *r )
+{
+    log_index_free( r->build );
+    r->build = NULL;
+}
+
+static void log_reader_start_build( log_reader *r )
+{
+    log_reader_stop_build( r );
+    if ( r->index_mode != LOG_INDEX_OFF && *r->index == NULL && !r->mapped ) {
+        r->build = log_index_new( r->codec );
+    }
+    r->lines = 0;
+    r->last_point = 0;
+}
+
+/* The whole log has been read from the start: the index is complete. */
+static void log_reader_finish_build( log_reader *r )
+{
+    struct stat  st;
+    log_index    *idx = r->build;
+
+    r->build = NULL;
+    if ( idx == NULL ) return;
+    if ( *r->index != NULL || fstat( r->fd, &st ) != 0 ) {
+        log_index_free( idx );
+        return;
+    }
+    idx->src_size = st.st_size;
+    idx->src_mtime = st.st_mtime;
+    idx->size = r->out_off + r->out_len;
+    idx->lines = r->lines;
+    *r->index = idx;
+
+    /*
+    Plain logs seek without an index and are usually still growing, and
+    small logs are quick to scan; neither is worth a file.
+    */
+    if ( r->index_mode == LOG_INDEX_FILE && idx->codec != LOG_CODEC_PLAIN &&
+         idx->size >= LOG_INDEX_SPAN ) {
+        log_index_save( idx, r->filename );
+    }
+}
+
+static void log_reader_count( log_reader *r, unsigned char *p, unsigned char *end )
+{
+    if ( r->build == NULL ) return;
+    while ( ( p = memchr( p, '\n', end - p ) ) != NULL ) {
+        r->lines++;
+        p++;
+    }
+}
+
+static int log_reader_refill( log_reader *r )
+{
+    int n = read( r->fd, r->in, LOG_READER_INSIZE );
+
+    if ( n > 0 ) {
+        r->strm.next_in = r->in;
+        r->strm.avail_in = n;
+        r->in_pos += n;
+        r->bytes_read += n;
+    }
+    return n;
+}
+
+/* The codec of a log that starts with the n bytes at m. */
+static int log_reader_codec( const unsigned char *m, int n )
+{
+    if ( n >= 2 && m[0] == 0x1f && m[1] == 0x8b ) return LOG_CODEC_GZIP;
+    if ( n >= 6 && memcmp( m, "\xfd" "7zXZ\0", 6 ) == 0 ) return LOG_CODEC_XZ;
+    if ( n >= 4 && memcmp( m, "\x28\xb5\x2f\xfd", 4 ) == 0 ) return LOG_CODEC_ZSTD;
+
+    /* a zstd log may start with a skippable frame */
+    if ( n >= 4 && ( m[0] & 0xf0 ) == 0x50 && memcmp( m + 1, "\x2a\x4d\x18", 3 ) == 0 ) {
+        return LOG_CODEC_ZSTD;
+    }
+    return LOG_CODEC_PLAIN;
+}
+
+/*
+The length of the BGZF member whose header is the n bytes at h, or -1
+if it is not one: a gzip header with an extra field holding a "BC"
+subfield, whose value is the member length less one. The least member,
+of no data, is 28 bytes.
+ */
+static int log_reader_bgzf_size( const unsigned char *h, int n )
+{
+    int i, xlen, slen;
+
+    if ( n < 12 || h[0] != 0x1f || h[1] != 0x8b || h[2] != 8 || !( h[3] & 4 ) ) return -1;
+    xlen = h[10] | h[11] << 8;
+    for ( i = 12; i + 4 <= 12 + xlen && i + 4 <= n; i += 4 + slen ) {
+        slen = h[i + 2] | h[i + 3] << 8;
+        if ( h[i] == 'B' && h[i + 1] == 'C' && slen == 2 && i + 6 <= n ) {
+            int size = ( h[i + 4] | h[i + 5] << 8 ) + 1;
+            return size >= 28 ? size : -1;
+        }
+    }
+    return -1;
+}
+
+/*
+Called at the end of a gzip member. Returns 0 if another member
+follows, 1 at a clean end of input and -1 if the input is truncated.
+Anything after the last member that is not a gzip header is ignored,
+as gzip(1) does.
+ */
+static int log_reader_next_member( log_reader *r )
+{
+    int need;
+
+    /* raw inflate stops before the member trailer, skip it */
+    if ( r->raw ) {
+        for ( need = 8; need > 0; ) {
+            int k;
+            if ( r->strm.avail_in == 0 && log_reader_refill( r ) <= 0 ) return -1;
+            k = r->strm.avail_in < need ? r->strm.avail_in : need;
+            r->strm.next_in += k;
+            r->strm.avail_in -= k;
+            need -= k;
+        }
+    }
+
+    if ( r->strm.avail_in == 0 && log_reader_refill( r ) <= 0 ) return 1;
+    if ( r->strm.next_in[0] != 0x1f ) return 1;
+
+    inflateReset2( &r->strm, 15 + 16 );
+    r->raw = 0;
+    return 0;
+}
+
+/*
+Record an index point at the output so far, if LOG_INDEX_SPAN bytes have
+passed since the last. in is where the input resumes; a point inside a
+deflate stream keeps the window before it, one where decoding starts
+afresh (a gzip member or zstd frame) keeps nothing.
+ */
+static void log_reader_point( log_reader *r, int64_t in, int bits, int window )
+{
+    int64_t  total;
+    int      have = 0;
+
+    if ( r->build == NULL ) return;
+    total = r->out_off + ( r->strm.next_out - r->out );
+    if ( total - r->last_point < LOG_INDEX_SPAN ) return;
+    if ( window ) {
+        have = r->strm.next_out - r->out;
+        if ( have > LOG_INDEX_WINSIZE ) have = LOG_INDEX_WINSIZE;
+    }
+    log_index_add( r->build, total, in, r->lines, bits, r->strm.next_out - have, have );
+    r->last_point = total;
+}
+
+/*
+One step of decompressing into strm.next_out, for each codec. Returns 0
+to go on, 1 at a clean end of input, 2 if the input is truncated and -1
+on a data error.
+ */
+static int log_reader_inflate( log_reader *r )
+{
+    unsigned char  *before = r->strm.next_out;
+    int            ret, more;
+
+    if ( r->strm.avail_in == 0 && log_reader_refill( r ) <= 0 ) return 2;
+
+    ret = inflate( &r->strm, Z_BLOCK );
+    if ( ret == Z_NEED_DICT || ret == Z_DATA_ERROR ||
+         ret == Z_MEM_ERROR || ret == Z_STREAM_ERROR ) {
+        return -1;
+    }
+    log_reader_count( r, before, r->strm.next_out );
+
+    /* at a block boundary; BGZF members are small, so use their starts */
+    if ( !r->bgzf && ( r->strm.data_type & 128 ) && !( r->strm.data_type & 64 ) ) {
+        log_reader_point( r, r->in_pos - r->strm.avail_in, r->strm.data_type & 7, 1 );
+    }
+
+    if ( ret == Z_STREAM_END ) {
+        if ( ( more = log_reader_next_member( r ) ) != 0 ) return more == 1 ? 1 : 2;
+        log_reader_point( r, r->in_pos - r->strm.avail_in, 0, 0 );
+    }
+    return 0;
+}
+
+static int log_reader_unxz( log_reader *r )
+{
+    unsigned char  *before = r->strm.next_out;
+    lzma_action    action = LZMA_RUN;
+    lzma_ret       ret;
+
+    if ( r->strm.avail_in == 0 && log_reader_refill( r ) <= 0 ) action = LZMA_FINISH;
+
+    r->xz.next_in = r->strm.next_in;
+    r->xz.avail_in = r->strm.avail_in;
+    r->xz.next_out = r->strm.next_out;
+    r->xz.avail_out = r->strm.avail_out;
+    ret = lzma_code( &r->xz, action );
+    r->strm.next_in = (unsigned char *)r->xz.next_in;
+    r->strm.avail_in = r->xz.avail_in;
+    r->strm.next_out = r->xz.next_out;
+    r->strm.avail_out = r->xz.avail_out;
+    log_reader_count( r, before, r->strm.next_out );
+
+    if ( ret == LZMA_STREAM_END ) return 1;
+    if ( ret == LZMA_OK ) return 0;
+    return ( ret == LZMA_BUF_ERROR && action == LZMA_FINISH ? 2 : -1 );
+}
+
+#ifdef LOG_ZSTD
+static int log_reader_unzstd( log_reader *r )
+{
+    ZSTD_inBuffer   in;
+    ZSTD_outBuffer  out;
+    size_t          ret;
+    int             end = 0;
+
+    /* at the end of input a frame may still have output to flush */
+    if ( r->strm.avail_in == 0 && log_reader_refill( r ) <= 0 ) {
+        if ( !r->frame ) return 1;
+        end = 1;
+    }
+
+    in.src = r->strm.next_in;
+    in.size = r->strm.avail_in;
+    in.pos = 0;
+    out.dst = r->strm.next_out;
+    out.size = r->strm.avail_out;
+    out.pos = 0;
+    ret = ZSTD_decompressStream( r->zstd, &out, &in );
+    if ( ZSTD_isError( ret ) ) return -1;
+    r->strm.next_in += in.pos;
+    r->strm.avail_in -= in.pos;
+    r->strm.next_out += out.pos;
+    r->strm.avail_out -= out.pos;
+    log_reader_count( r, r->strm.next_out - out.pos, r->strm.next_out );
+    if ( end && out.pos == 0 ) return 2;
+
+    /* a frame has ended, and any next one starts afresh at the next input byte */
+    r->frame = ( ret != 0 );
+    if ( !r->frame ) {
+        if ( r->strm.avail_in == 0 && log_reader_refill( r ) <= 0 ) return 1;
+        log_reader_point( r, r->in_pos - r->strm.avail_in, 0, 0 );
+    }
+    return 0;
+}
+#endif
+
+/*
+Start decoding afresh at the start of a gzip member, xz stream or zstd
+frame. Returns 0, or -1 if the decoder could not be set up again.
+ */
+static int log_reader_reset( log_reader *r )
+{
+    r->strm.avail_in = 0;
+    switch ( r->codec ) {
+    case LOG_CODEC_GZIP:
+        r->raw = 0;
+        return inflateReset2( &r->strm, 15 + 16 ) == Z_OK ? 0 : -1;
+    case LOG_CODEC_XZ:
+        return lzma_stream_decoder( &r->xz, UINT64_MAX, LZMA_CONCATENATED ) == LZMA_OK ? 0 : -1;
+#ifdef LOG_ZSTD
+    case LOG_CODEC_ZSTD:
+        r->frame = 0;
+        return ZSTD_isError( ZSTD_DCtx_reset( r->zstd, ZSTD_reset_session_only ) ) ? -1 : 0;
+#endif
+    }
+    return 0;
+}
+
+/*
+Map the whole log, or map it again if it has grown. Returns the number
+of bytes added to out[], 0 if the log has not grown or -1 on error.
+ */
+static int64_t log_reader_map( log_reader *r )
+{
+    struct stat  st;
+    void         *map;
+
+    if ( fstat( r->fd, &st ) != 0 ) return -1;
+    if ( st.st_size <= r->out_len ) return 0;
+
+    map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, r->fd, 0 );
+    if ( map == MAP_FAILED ) return -1;
+    madvise( map, st.st_size, MADV_SEQUENTIAL );
+    if ( r->mapped ) munmap( r->out, r->out_len );
+    else             free( r->out );
+
+    r->out = map;
+    r->mapped = 1;
+    r->out_off = 0;
+    st.st_size -= r->out_len;
+    r->out_len += st.st_size;
+    r->bytes_read += st.st_size;
+    return st.st_size;
+}
+
+/* Take over an index the thread built while reading from the start. */
+static void log_reader_adopt( log_reader *r )
+{
+    if ( r->ahead_index != NULL && r->ahead_index != *r->index ) {
+        if ( *r->index == NULL ) *r->index = r->ahead_index;
+        else                     log_index_free( r->ahead_index );
+    }
+    r->ahead_index = NULL;
+}
+
+static void * log_reader_produce( void *arg )
+{
+    log_reader        *r = arg;
+    log_reader_block  *b;
+    int               n;
+
+    do {
+        pthread_mutex_lock( &r->lock );
+        while ( r->ring_count == LOG_READER_RING && !r->stop ) {
+            pthread_cond_wait( &r->space, &r->lock );
+        }
+        b = &r->ring[( r->ring_head + r->ring_count ) % LOG_READER_RING];
+        n = r->stop;
+        pthread_mutex_unlock( &r->lock );
+        if ( n ) break;
+
+        n = log_reader_read( r->ahead, (char *)b->data, LOG_READER_BLOCK );
+        if ( n == 0 && !log_reader_eof( r->ahead ) ) n = -1;
+
+        pthread_mutex_lock( &r->lock );
+        b->len = n;
+        b->ready = 1;
+        r->ring_count++;
+        r->ahead_read = r->ahead->bytes_read;
+        r->ahead_inflated = r->ahead->bytes_inflated;
+        pthread_cond_signal( &r->ready );
+        pthread_mutex_unlock( &r->lock );
+    } while ( n > 0 );
+    return NULL;
+}
+
+/*
+Read the members for block b into zin: as many whole BGZF members from
+next_in on as fit LOG_READER_BLOCK once inflated, their lengths into
+size[]. Returns the number of members, 0 at the end of the log (b->clean
+if it is a clean end) or -1 on an error. Called holding r->input, so
+that blocks get their members in order.
+ */
+static int log_reader_gather( log_reader *r, log_reader_block *b,
+        unsigned char *zin, int *size )
+{
+    unsigned char  head[LOG_READER_BGZF_HEAD], *t;
+    int64_t        in = r->next_in;
+    int            n = 0, used = 0, out = 0, error = 0, k, len;
+    unsigned int   isize;
+
+    b->clean = 0;
+    while ( n < LOG_READER_MEMBERS ) {
+        k = pread( r->ahead->fd, head, sizeof( head ), in );
+        if ( k == 0 || ( k > 0 && head[0] != 0x1f ) ) {
+            /* anything after the last member that is not gzip is ignored */
+            b->clean = 1;
+            break;
+        }
+        if ( k < 0 || ( len = log_reader_bgzf_size( head, k ) ) < 0 ) {
+            error = 1;
+            break;
+        }
+        if ( used + len > LOG_READER_BLOCK ) break;
+        if ( pread( r->ahead->fd, zin + used, len, in ) != len ) break;   /* truncated */
+
+        t = zin + used + len - 4;
+        isize = t[0] | t[1] << 8 | t[2] << 16 | (unsigned int)t[3] << 24;
+        if ( isize > LOG_READER_BGZF_MAX ) {
+            error = 1;
+            break;
+        }
+        if ( out + (int)isize > LOG_READER_BLOCK ) break;
+        size[n++] = len;
+        used += len;
+        out += isize;
+        in += len;
+    }
+
+    b->in = r->next_in;
+    b->out = r->next_out;
+    b->read = used;
+    r->next_in = in;
+    r->next_out += out;
+    return ( n == 0 && error ? -1 : n );
+}
+
+/*
+Retire the filled blocks that come next in order, building the index
+with the thread's reader as log_reader_fill() would, but with a point
+only at the start of a block. Called holding r->lock.
+ */
+static void log_reader_retire( log_reader *r )
+{
+    log_reader        *a = r->ahead;
+    log_reader_block  *b;
+
+    while ( r->retired < r->claimed &&
+            ( b = &r->ring[r->retired % LOG_READER_RING] )->ready ) {
+        r->retired++;
+        a->bytes_read += b->read;
+        if ( b->len > 0 ) a->bytes_inflated += b->len;
+
+        if ( a->build != NULL && b->len > 0 && b->out - a->last_point >= LOG_INDEX_SPAN ) {
+            log_index_add( a->build, b->out, b->in, a->lines, 0, NULL, 0 );
+            a->last_point = b->out;
+        }
+        a->lines += b->lines;
+        if ( b->len == 0 && b->clean ) {
+            a->out_off = b->out;
+            a->out_len = 0;
+            log_reader_finish_build( a );
+        }
+        else if ( b->len <= 0 ) {
+            log_reader_stop_build( a );
+        }
+    }
+    r->ahead_read = a->bytes_read;
+    r->ahead_inflated = a->bytes_inflated;
+}
+
+/*
+A BGZF worker: claim the next block, read its members and inflate them,
+until the end of the log or until told to stop.
+ */
+static void * log_reader_work( void *arg )
+{
+    log_reader_worker  *w = arg;
+    log_reader         *r = w->r;
+    log_reader_block   *b;
+    int                size[LOG_READER_MEMBERS];
+    int                i, m, n, used;
+    int64_t            lines;
+    unsigned char      *p, *end;
+
+    while ( 1 ) {
+        pthread_mutex_lock( &r->input );
+        pthread_mutex_lock( &r->lock );
+        while ( r->ring_count == LOG_READER_RING && !r->stop ) {
+            pthread_cond_wait( &r->space, &r->lock );
+        }
+        if ( r->stop || r->input_end ) {
+            pthread_mutex_unlock( &r->lock );
+            pthread_mutex_unlock( &r->input );
+            break;
+        }
+        b = &r->ring[( r->ring_head + r->ring_count ) % LOG_READER_RING];
+        b->ready = 0;
+        r->ring_count++;
+        r->claimed++;
+        pthread_mutex_unlock( &r->lock );
+
+        m = log_reader_gather( r, b, w->zin, size );
+        if ( m <= 0 ) {
+            pthread_mutex_lock( &r->lock );
+            r->input_end = 1;
+            pthread_mutex_unlock( &r->lock );
+        }
+        pthread_mutex_unlock( &r->input );
+
+        for ( i = 0, n = 0, used = 0; i < m; used += size[i++] ) {
+            inflateReset( &w->strm );
+            w->strm.next_in = w->zin + used;
+            w->strm.avail_in = size[i];
+            w->strm.next_out = b->data + n;
+            w->strm.avail_out = LOG_READER_BLOCK - n;
+            if ( inflate( &w->strm, Z_FINISH ) != Z_STREAM_END || w->strm.avail_in != 0 ) {
+                n = -1;
+                break;
+            }
+            n = LOG_READER_BLOCK - w->strm.avail_out;
+        }
+        if ( m <= 0 ) n = m;
+
+        lines = 0;
+        for ( p = b->data, end = b->data + ( n > 0 ? n : 0 );
+              ( p = memchr( p, '\n', end - p ) ) != NULL; p++ ) {
+            lines++;
+        }
+
+        pthread_mutex_lock( &r->lock );
+        b->len = n;
+        b->lines = lines;
+        b->ready = 1;
+        if ( n < 0 ) r->input_end = 1;
+        log_reader_retire( r );
+        pthread_cond_signal( &r->ready );
+        pthread_mutex_unlock( &r->lock );
+    }
+    return NULL;
+}
+
+/*
+Copy the next block the thread has read to start, the end of out[].
+Returns like log_reader_fill().
+ */
+static int log_reader_take( log_reader *r, unsigned char *start )
+{
+    log_reader_block  *b;
+    int               n;
+
+    pthread_mutex_lock( &r->lock );
+    while ( r->ring_count == 0 || !r->ring[r->ring_head].ready ) {
+        pthread_cond_wait( &r->ready, &r->lock );
+    }
+    b = &r->ring[r->ring_head];
+    pthread_mutex_unlock( &r->lock );
+
+    if ( b->len <= 0 ) {
+        /* the end block stays in the ring, so it is seen again */
+        if ( b->len == 0 ) log_reader_adopt( r );
+        return b->len;
+    }
+
+    n = b->len - r->ring_pos;
+    if ( n > r->out_size - r->out_len ) n = r->out_size - r->out_len;
+    memcpy( start, b->data + r->ring_pos, n );
+    r->out_len += n;
+    r->ring_pos += n;
+    if ( r->ring_pos < b->len ) return n;
+
+    pthread_mutex_lock( &r->lock );
+    r->ring_pos = 0;
+    r->ring_head = ( r->ring_head + 1 ) % LOG_READER_RING;
+    r->ring_count--;
+    pthread_cond_signal( &r->space );
+    pthread_mutex_unlock( &r->lock );
+    return n;
+}
+
+/* Join the first n workers, which have been told to stop, and free them all. */
+static void log_reader_end_workers( log_reader *r, int n )
+{
+    int i;
+
+    for ( i = 0; i < r->n_workers; i++ ) {
+        if ( i < n ) pthread_join( r->workers[i].thread, NULL );
+        inflateEnd( &r->workers[i].strm );
+        free( r->workers[i].zin );
+    }
+    free( r->workers );
+    r->workers = NULL;
+    r->n_workers = 0;
+    pthread_mutex_destroy( &r->input );
+}
+
+/*
+Start BGZF workers reading from the start of the log, one per core up
+to LOG_READER_WORKERS. Returns 0, or -1 if they could not be started.
+ */
+static int log_reader_start_workers( log_reader *r )
+{
+    long  cores = sysconf( _SC_NPROCESSORS_ONLN );
+    int   i, n = ( cores < 2 ? 2 : cores > LOG_READER_WORKERS ? LOG_READER_WORKERS : (int)cores );
+
+    r->workers = calloc( n, sizeof( log_reader_worker ) );
+    if ( r->workers == NULL ) return -1;
+    r->n_workers = n;
+    pthread_mutex_init( &r->input, NULL );
+    r->next_in = 0;
+    r->next_out = 0;
+    r->claimed = 0;
+    r->retired = 0;
+    r->input_end = 0;
+
+    for ( i = 0; i < n; i++ ) {
+        log_reader_worker *w = &r->workers[i];
+
+        w->r = r;
+        if ( ( w->zin = malloc( LOG_READER_BLOCK ) ) == NULL ||
+             inflateInit2( &w->strm, 15 + 16 ) != Z_OK ) {
+            log_reader_end_workers( r, 0 );
+            return -1;
+        }
+    }
+    for ( i = 0; i < n; i++ ) {
+        if ( pthread_create( &r->workers[i].thread, NULL, log_reader_work, &r->workers[i] ) != 0 ) {
+            pthread_mutex_lock( &r->lock );
+            r->stop = 1;
+            pthread_cond_broadcast( &r->space );
+            pthread_mutex_unlock( &r->lock );
+            log_reader_end_workers( r, i );
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+Stop reading in the background. out[] is still good, but the reader's
+own fd and inflate state did not follow it, so the next seek has to
+start them over.
+ */
+static void log_reader_stop( log_reader *r )
+{
+    int i;
+
+    if ( r->ahead == NULL ) return;
+
+    pthread_mutex_lock( &r->lock );
+    r->stop = 1;
+    pthread_cond_broadcast( &r->space );
+    pthread_mutex_unlock( &r->lock );
+    if ( r->workers != NULL ) {
+        log_reader_end_workers( r, r->n_workers );
+    }
+    else {
+        pthread_join( r->thread, NULL );
+    }
+    pthread_mutex_destroy( &r->lock );
+    pthread_cond_destroy( &r->ready );
+    pthread_cond_destroy( &r->space );
+
+    r->bytes_read += r->ahead->bytes_read;
+    r->bytes_inflated += r->ahead->bytes_inflated;
+    r->ahead_read = r->ahead_inflated = 0;
+    log_reader_close( r->ahead );
+    r->ahead = NULL;
+    log_reader_adopt( r );
+    for ( i = 0; i < LOG_READER_RING; i++ ) {
+        free( r->ring[i].data );
+        r->ring[i].data = NULL;
+    }
+    r->stale = 1;
+}
+
+/*
+Decompress up to n bytes into buf. Returns the number of bytes, fewer
+than n only at the end of the log, which sets done, or -1 on a read or
+inflate error.
+ */
+static int log_reader_decode( log_reader *r, unsigned char *buf, int n )
+{
+    r->strm.next_out = buf;
+    r->strm.avail_out = n;
+    while ( r->strm.avail_out > 0 && !r->done ) {
+        int ret;
+
+        switch ( r->codec ) {
+        case LOG_CODEC_GZIP: ret = log_reader_inflate( r ); break;
+        case LOG_CODEC_XZ:   ret = log_reader_unxz( r ); break;
+#ifdef LOG_ZSTD
+        case LOG_CODEC_ZSTD: ret = log_reader_unzstd( r ); break;
+#endif
+        default:             ret = -1;
+        }
+        if ( ret < 0 ) {
+            r->done = 1;
+            return -1;
+        }
+        if ( ret > 0 ) {
+            r->done = 1;
+            r->clean = ( ret == 1 );
+        }
+    }
+
+    n = r->strm.next_out - buf;
+    r->bytes_inflated += n;
+    r->dec_pos += n;
+    return n;
+}
+
+/*
+Start the decoder over at index point p, or at the start of the log if
+p is NULL, leaving out[] as it is. Returns 0, or -1 on error.
+ */
+static int log_reader_restart( log_reader *r, log_index_point *p )
+{
+    r->stale = 0;
+    r->done = 0;
+    r->clean = 0;
+    if ( p == NULL ) {
+        if ( lseek( r->fd, 0, SEEK_SET ) != 0 ) return -1;
+        r->in_pos = 0;
+        r->dec_pos = 0;
+        return log_reader_reset( r );
+    }
+
+    r->in_pos = p->in - ( p->bits ? 1 : 0 );
+    if ( lseek( r->fd, r->in_pos, SEEK_SET ) != r->in_pos ) return -1;
+    r->strm.avail_in = 0;
+    r->dec_pos = p->out;
+
+    /* a member or frame starts here */
+    if ( p->have == 0 ) return log_reader_reset( r );
+
+    if ( log_reader_refill( r ) <= 0 ) return -1;
+    inflateReset2( &r->strm, -15 );
+    r->raw = 1;
+    if ( p->bits ) {
+        inflatePrime( &r->strm, p->bits, r->strm.next_in[0] >> ( 8 - p->bits ) );
+        r->strm.next_in++;
+        r->strm.avail_in--;
+    }
+    inflateSetDictionary( &r->strm, p->window, p->have );
+    return 0;
+}
+
+/*
+Keep the n bytes at p, just added to the end of out[], in the table's
+block cache as they make up whole blocks. At the end of the log the
+block they end is kept however short, as its last.
+ */
+static void log_reader_keep( log_reader *r, const unsigned char *p, int n, int end )
+{
+    int64_t  off = r->out_off + r->out_len - n;
+    int      k;
+
+    if ( r->blocks == NULL ) return;
+    if ( r->keep != NULL && r->keep_off + r->keep_len != off ) {
+        free( r->keep );
+        r->keep = NULL;
+    }
+    while ( n > 0 || end ) {
+        if ( r->keep == NULL ) {
+            /* blocks start at multiples of LOG_BLOCKS_SIZE */
+            k = ( LOG_BLOCKS_SIZE - off % LOG_BLOCKS_SIZE ) % LOG_BLOCKS_SIZE;
+            if ( k > n || ( k == n && !end ) ) return;
+            if ( ( r->keep = malloc( LOG_BLOCKS_SIZE ) ) == NULL ) return;
+            r->keep_off = off + k;
+            r->keep_len = 0;
+            p += k;
+            off += k;
+            n -= k;
+        }
+        k = ( n < LOG_BLOCKS_SIZE - r->keep_len ? n : LOG_BLOCKS_SIZE - r->keep_len );
+        memcpy( r->keep + r->keep_len, p, k );
+        r->keep_len += k;
+        p += k;
+        off += k;
+        n -= k;
+        if ( r->keep_len == LOG_BLOCKS_SIZE || ( end && n == 0 ) ) {
+            log_blocks_put( r->blocks, r->blocks_file, r->keep_off / LOG_BLOCKS_SIZE,
+                            r->keep, r->keep_len, end && n == 0 );
+            r->keep = NULL;
+            if ( end && n == 0 ) return;
+        }
+    }
+}
+
+/*
+Bring the decoder to uncompressed offset off: onwards from where it is
+if that is before off with no index point in between, else from the
+index point before off or the start of the log. What it passes over is
+not kept. Returns 0, or -1 on error or if the log ends before off.
+ */
+static int log_reader_sync( log_reader *r, int64_t off )
+{
+    log_index_point  *p = log_index_find( *r->index, off );
+    unsigned char    *skip;
+    int              n;
+
+    if ( !r->stale && r->dec_pos == off ) return 0;
+    if ( r->stale || r->dec_pos > off || ( p != NULL && p->out > r->dec_pos ) ) {
+        if ( log_reader_restart( r, p ) != 0 ) return -1;
+        if ( r->dec_pos == off ) return 0;
+    }
+    if ( ( skip = malloc( LOG_BLOCKS_SIZE ) ) == NULL ) return -1;
+    while ( r->dec_pos < off ) {
+        n = ( off - r->dec_pos < LOG_BLOCKS_SIZE ? off - r->dec_pos : LOG_BLOCKS_SIZE );
+        if ( log_reader_decode( r, skip, n ) != n ) break;
+    }
+    free( skip );
+    return ( r->dec_pos == off ? 0 : -1 );
+}
+
+/*
+Fill out[] from the table's block cache, first decompressing the block
+that holds the end of out[] into it if it is not there. done is left
+to the decoder: the cache's last block tells where the log ends.
+Returns like log_reader_fill().
+ */
+static int log_reader_fill_cached( log_reader *r, unsigned char *start )
+{
+    int64_t              off = r->out_off + r->out_len;
+    int64_t              block = off / LOG_BLOCKS_SIZE;
+    const unsigned char  *data;
+    unsigned char        *buf;
+    int                  len, last, n;
+
+    if ( log_blocks_get( r->blocks, r->blocks_file, block, &len, &last ) == NULL ) {
+        if ( log_reader_sync( r, block * LOG_BLOCKS_SIZE ) != 0 ||
+             ( buf = malloc( LOG_BLOCKS_SIZE ) ) == NULL ) {
+            return -1;
+        }
+        if ( ( n = log_reader_decode( r, buf, LOG_BLOCKS_SIZE ) ) < 0 ) {
+            free( buf );
+            return -1;
+        }
+        log_blocks_put( r->blocks, r->blocks_file, block, buf, n, n < LOG_BLOCKS_SIZE );
+    }
+    if ( ( data = log_blocks_get( r->blocks, r->blocks_file, block, &len, &last ) ) == NULL ) return -1;
+
+    n = len - ( off - block * LOG_BLOCKS_SIZE );
+    if ( n > r->out_size - r->out_len ) n = r->out_size - r->out_len;
+    if ( n <= 0 ) return ( last && n == 0 ? 0 : -1 );
+    memcpy( start, data + ( off - block * LOG_BLOCKS_SIZE ), n );
+    r->out_len += n;
+    return n;
+}
+
+/*
+Add more data to out[]. Returns the number of bytes added, 0 at the
+end of the log or -1 on a read or inflate error.
+ */
+static int log_reader_fill( log_reader *r )
+{
+    unsigned char  *start;
+    int            cached, drop, n;
+
+    /* filling from the cache, done is only the decoder's */
+    cached = ( r->blocks != NULL && r->build == NULL && r->ahead == NULL );
+    if ( r->done && !cached ) return 0;
+    if ( r->mapped ) {
+        int64_t added = log_reader_map( r );
+        return added > 0x7fffffff ? 0x7fffffff : (int)added;
+    }
+
+    /* drop data already read, but keep a window of history */
+    drop = r->out_len - LOG_INDEX_WINSIZE;
+    if ( drop > r->out_pos ) drop = r->out_pos;
+    if ( drop > 0 ) {
+        memmove( r->out, r->out + drop, r->out_len - drop );
+        r->out_off += drop;
+        r->out_len -= drop;
+        r->out_pos -= drop;
+    }
+    start = r->out + r->out_len;
+
+    if ( r->ahead != NULL ) {
+        n = log_reader_take( r, start );
+        if ( n >= 0 ) log_reader_keep( r, start, n, n == 0 );
+        return n;
+    }
+
+    if ( r->codec == LOG_CODEC_PLAIN ) {
+        n = read( r->fd, start, r->out_size - r->out_len );
+        if ( n < 0 ) return -1;
+        if ( n == 0 ) {
+            r->done = 1;
+            log_reader_finish_build( r );
+            return 0;
+        }
+        log_reader_count( r, start, start + n );
+        r->out_len += n;
+        r->bytes_read += n;
+        if ( r->build != NULL &&
+             r->out_off + r->out_len - r->last_point >= LOG_INDEX_SPAN ) {
+            r->last_point = r->out_off + r->out_len;
+            log_index_add( r->build, r->last_point, r->last_point,
+                           r->lines, 0, NULL, 0 );
+        }
+        return n;
+    }
+
+    if ( cached ) return log_reader_fill_cached( r, start );
+
+    n = log_reader_decode( r, start, r->out_size - r->out_len );
+    if ( n < 0 ) {
+        log_reader_stop_build( r );
+        return -1;
+    }
+    r->out_len += n;
+    log_reader_keep( r, start, n, r->done );
+    if ( r->done ) {
+        if ( r->clean ) log_reader_finish_build( r );
+        log_reader_stop_build( r );
+    }
+    return n;
+}
+
+/* Start again at byte 0, building an index if there is none. */
+static int log_reader_rewind( log_reader *r )
+{
+    log_reader_stop( r );
+    r->stale = 0;
+    r->skip = 0;
+    if ( r->mapped ) {
+        r->out_pos = 0;
+        r->eof = 0;
+        return 0;
+    }
+    if ( lseek( r->fd, 0, SEEK_SET ) != 0 ) return -1;
+    r->in_pos = 0;
+    r->dec_pos = 0;
+    r->out_off = 0;
+    r->out_len = 0;
+    r->out_pos = 0;
+    r->done = 0;
+    r->clean = 0;
+    r->eof = 0;
+    if ( r->codec != LOG_CODEC_PLAIN && log_reader_reset( r ) != 0 ) return -1;
+    log_reader_start_build( r );
+    return 0;
+}
+
+/* Resume decompressing at an index point. */
+static int log_reader_resume( log_reader *r, log_index_point *p )
+{
+    log_reader_stop_build( r );
+    if ( log_reader_restart( r, p ) != 0 ) return -1;
+    memcpy( r->out, p->window, p->have );
+
+    r->out_off = p->out - p->have;
+    r->out_len = p->have;
+    r->out_pos = p->have;
+    r->eof = 0;
+    return 0;
+}
+
+/* Set up the decoder for r's codec. Returns 0, or -1 if there is none. */
+static int log_reader_init( log_reader *r )
+{
+    switch ( r->codec ) {
+    case LOG_CODEC_GZIP:
+        return inflateInit2( &r->strm, 15 + 16 ) == Z_OK ? 0 : -1;
+    case LOG_CODEC_XZ:
+        return lzma_stream_decoder( &r->xz, UINT64_MAX, LZMA_CONCATENATED ) == LZMA_OK ? 0 : -1;
+    case LOG_CODEC_ZSTD:
+#ifdef LOG_ZSTD
+        return ( r->zstd = ZSTD_createDStream() ) != NULL ? 0 : -1;
+#else
+        return -1;                       /* built without libzstd */
+#endif
+    }
+    return 0;
+}
+
+log_reader * log_reader_open( const char *filename,
+        log_index **index, int index_mode, int flags )
+{
+    log_reader     *r;
+    unsigned char  head[LOG_READER_BGZF_HEAD];
+    int            n;
+
+    r = calloc( 1, sizeof( log_reader ) );
+    if ( r == NULL ) return NULL;
+
+    r->fd = open( filename, O_RDONLY );
+    r->filename = strdup( filename );
+    r->in = malloc( LOG_READER_INSIZE );
+    r->out = malloc( LOG_READER_OUTSIZE );
+    r->out_size = LOG_READER_OUTSIZE;
+    r->index = index;
+    r->index_mode = index_mode;
+    r->flags = flags;
+    if ( r->fd < 0 || r->filename == NULL || r->in == NULL || r->out == NULL ) {
+        log_reader_close( r );
+        return NULL;
+    }
+
+    n = pread( r->fd, head, sizeof( head ), 0 );
+    r->codec = log_reader_codec( head, n );
+    r->bgzf = ( r->codec == LOG_CODEC_GZIP && log_reader_bgzf_size( head, n ) > 0 );
+    if ( log_reader_init( r ) != 0 ) {
+        log_reader_close( r );
+        return NULL;
+    }
+
+    /* an empty log cannot be mapped, nor a pipe; read those */
+    if ( r->codec == LOG_CODEC_PLAIN && ( flags & LOG_READER_MMAP ) ) log_reader_map( r );
+
+    if ( log_reader_rewind( r ) != 0 ) {
+        log_reader_close( r );
+        return NULL;
+    }
+    return r;
+}
+
+void log_reader_close( log_reader *r )
+{
+    if ( r == NULL ) return;
+    log_reader_stop( r );
+    switch ( r->codec ) {
+    case LOG_CODEC_GZIP: inflateEnd( &r->strm ); break;
+    case LOG_CODEC_XZ:   lzma_end( &r->xz ); break;
+#ifdef LOG_ZSTD
+    case LOG_CODEC_ZSTD: ZSTD_freeDStream( r->zstd ); break;
+#endif
+    }
+    log_reader_stop_build( r );
+    if ( r->fd >= 0 ) close( r->fd );
+    free( r->filename );
+    free( r->in );
+    free( r->keep );
+    if ( r->mapped ) munmap( r->out, r->out_len );
+    else             free( r->out );
+    free( r );
+}
+
+/* Read up to len bytes like gzread(). Returns bytes read, or -1. */
+int log_reader_read( log_reader *r, char *buf, int len )
+{
+    int n = 0;
+
+    while ( n < len ) {
+        int64_t k;
+
+        if ( r->out_pos == r->out_len ) {
+            k = log_reader_fill( r );
+            if ( k < 0 ) return n > 0 ? n : -1;
+            if ( k == 0 ) {
+                r->eof = 1;
+                break;
+            }
+        }
+        k = r->out_len - r->out_pos;
+        if ( k > len - n ) k = len - n;
+        memcpy( buf + n, r->out + r->out_pos, k );
+        n += k;
+        r->out_pos += k;
+    }
+    return n;
+}
+
+int log_reader_eof( log_reader *r )
+{
+    return r->eof;
+}
+
+/*
+Bytes read from the file (compressed, for a compressed log; mapped, for a mapped
+log) and bytes inflated since the reader was opened, counting those of
+its read ahead thread.
+ */
+void log_reader_stats( log_reader *r, int64_t *read, int64_t *inflated )
+{
+    *read = r->bytes_read;
+    *inflated = r->bytes_inflated;
+    if ( r->ahead != NULL ) {
+        pthread_mutex_lock( &r->lock );
+        *read += r->ahead_read;
+        *inflated += r->ahead_inflated;
+        pthread_mutex_unlock( &r->lock );
+    }
+}
+
+int64_t log_reader_tell( log_reader *r )
+{
+    return r->out_off + r->out_pos;
+}
+
+/*
+Move to uncompressed offset off. Plain logs seek directly. Compressed
+logs resume from the nearest index point, or decompress forward from
+where they are (or from the start) when there is no closer point. Returns
+0, or -1 if off is past the end of the log.
+ */
+int log_reader_seek( log_reader *r, int64_t off )
+{
+    log_index_point  *p;
+
+    if ( off < 0 ) return -1;
+    r->eof = 0;
+    r->skip = 0;
+
+    if ( !r->stale && off >= r->out_off && off <= r->out_off + r->out_len ) {
+        r->out_pos = off - r->out_off;
+        return 0;
+    }
+    if ( r->mapped ) {
+        if ( log_reader_map( r ) <= 0 || off > r->out_len ) return -1;
+        r->out_pos = off;
+        return 0;
+    }
+    log_reader_stop( r );
+    if ( off == 0 ) return log_reader_rewind( r );
+
+    if ( r->codec == LOG_CODEC_PLAIN ) {
+        if ( lseek( r->fd, off, SEEK_SET ) != off ) return -1;
+        log_reader_stop_build( r );
+        r->stale = 0;
+        r->out_off = off;
+        r->out_len = 0;
+        r->out_pos = 0;
+        r->done = 0;
+        return 0;
+    }
+
+    p = log_index_find( *r->index, off );
+    if ( r->stale || off < r->out_off ||
+         ( p != NULL && p->out > r->out_off + r->out_len ) ) {
+        if ( ( p != NULL ? log_reader_resume( r, p ) : log_reader_rewind( r ) ) != 0 ) {
+            return -1;
+        }
+    }
+    while ( r->out_off + r->out_len < off ) {
+        r->out_pos = r->out_len;
+        if ( log_reader_fill( r ) <= 0 ) {
+            r->eof = 1;
+            return -1;
+        }
+    }
+    r->out_pos = off - r->out_off;
+    return 0;
+}
+
+/* Plain logs can always seek, compressed logs once they have an index. */
+int log_reader_seekable( log_reader *r )
+{
+    return r->codec == LOG_CODEC_PLAIN || *r->index != NULL;
+}
+
+int log_reader_compressed( log_reader *r )
+{
+    return r->codec != LOG_CODEC_PLAIN;
+}
+
+/* Uncompressed length of the log, or -1 if not known yet. */
+int64_t log_reader_size( log_reader *r )
+{
+    struct stat st;
+
+    if ( r->codec != LOG_CODEC_PLAIN ) return *r->index != NULL ? (*r->index)->size : -1;
+    return fstat( r->fd, &st ) == 0 ? st.st_size : -1;
+}
+
+/*
+The closest offset at or before off that can be reached without
+inflating. Bisecting over these keeps each probe cheap.
+ */
+int64_t log_reader_align( log_reader *r, int64_t off )
+{
+    log_index_point *p;
+
+    if ( r->codec == LOG_CODEC_PLAIN ) return off;
+    p = log_index_find( *r->index, off );
+    return p != NULL ? p->out : 0;
+}
+
+/*
+Index a mapped log by counting the new-lines of the mapping, which is
+much quicker than reading it. Not saved, as for other plain logs.
+ */
+static int log_reader_index_mapped( log_reader *r )
+{
+    struct stat    st;
+    log_index      *idx;
+    unsigned char  *nl;
+    int64_t        off = 0, stop, lines = 0;
+
+    if ( fstat( r->fd, &st ) != 0 || ( idx = log_index_new( 0 ) ) == NULL ) return -1;
+    while ( off < r->out_len ) {
+        stop = ( r->out_len - off > LOG_INDEX_SPAN ? off + LOG_INDEX_SPAN : r->out_len );
+        while ( ( nl = memchr( r->out + off, '\n', stop - off ) ) != NULL ) {
+            lines++;
+            off = nl - r->out + 1;
+        }
+        off = stop;
+        if ( stop < r->out_len && log_index_add( idx, stop, stop, lines, 0, NULL, 0 ) != 0 ) {
+            log_index_free( idx );
+            return -1;
+        }
+    }
+    idx->src_size = r->out_len;
+    idx->src_mtime = st.st_mtime;
+    idx->size = r->out_len;
+    idx->lines = lines;
+    *r->index = idx;
+    return 0;
+}
+
+/*
+Make sure the table has an index, reading the whole log once to build
+it if needed. Returns 0 if an index is available. The read position
+is left undefined.
+ */
+int log_reader_index( log_reader *r )
+{
+    if ( *r->index != NULL ) return 0;
+    if ( r->index_mode == LOG_INDEX_OFF ) return -1;
+    if ( r->mapped ) return log_reader_index_mapped( r );
+
+    if ( log_reader_rewind( r ) != 0 ) return -1;
+    while ( log_reader_fill( r ) > 0 ) {
+        r->out_pos = r->out_len;
+    }
+    return *r->index != NULL ? 0 : -1;
+}
+
+/*
+Count the lines that end before offset off, starting from the nearest
+index point. Leaves the reader at off.
+ */
+int64_t log_reader_lines_before( log_reader *r, int64_t off )
+{
+    log_index_point  *p = log_index_find( *r->index, off );
+    int64_t          lines = ( p != NULL ? p->lines : 0 );
+    unsigned char    *s, *end;
+
+    if ( log_reader_seek( r, p != NULL ? p->out : 0 ) != 0 ) return -1;
+
+    while ( r->out_off + r->out_pos < off ) {
+        if ( r->out_pos == r->out_len && log_reader_fill( r ) <= 0 ) break;
+        s = r->out + r->out_pos;
+        end = r->out + r->out_len;
+        if ( end - r->out > off - r->out_off ) end = r->out + ( off - r->out_off );
+        while ( ( s = memchr( s, '\n', end - s ) ) != NULL ) {
+            lines++;
+            s++;
+        }
+        r->out_pos = end - r->out;
+    }
+    return lines;
+}
+
+/*
+Move to the start of line (1 based), starting from the nearest index
+point. Returns 0, or -1 if the log has fewer lines.
+ */
+int log_reader_seek_line( log_reader *r, int64_t line )
+{
+    log_index_point  *p = log_index_find_line( *r->index, line );
+    int64_t          skip = line - 1 - ( p != NULL ? p->lines : 0 );
+
+    if ( log_reader_seek( r, p != NULL ? p->out : 0 ) != 0 ) return -1;
+
+    while ( skip > 0 ) {
+        unsigned char *s, *nl;
+
+        if ( r->out_pos == r->out_len && log_reader_fill( r ) <= 0 ) {
+            r->eof = 1;
+            return -1;
+        }
+        s = r->out + r->out_pos;
+        nl = memchr( s, '\n', r->out_len - r->out_pos );
+        if ( nl != NULL ) {
+            r->out_pos = nl - r->out + 1;
+            skip--;
+        }
+        else {
+            r->out_pos = r->out_len;
+        }
+    }
+    return 0;
+}
+
+/*
+Read ahead from the current position in a background thread until the
+next seek. Only worth it for a sequential scan. Returns 0 if a thread
+was started; if not, the reader carries on reading by itself.
+ */
+int log_reader_prefetch( log_reader *r )
+{
+    int i, len, last;
+
+    if ( r->ahead != NULL ) return 0;
+    if ( r->mapped ) return -1;          /* the kernel reads ahead */
+    if ( r->done && r->out_pos == r->out_len ) return -1;
+
+    /* the thread starts over at out_len, which must be cheap to reach */
+    if ( r->codec != LOG_CODEC_PLAIN && *r->index == NULL && r->out_off + r->out_len > 0 ) return -1;
+
+    /* nor is it worth it for a log that is in the block cache */
+    if ( r->blocks != NULL && r->build == NULL &&
+         log_blocks_get( r->blocks, r->blocks_file, ( r->out_off + r->out_len ) / LOG_BLOCKS_SIZE, &len, &last ) != NULL ) {
+        return -1;
+    }
+
+    r->ahead_index = *r->index;
+    r->ahead = log_reader_open( r->filename, &r->ahead_index, r->index_mode, 0 );
+    if ( r->ahead == NULL ||
+         log_reader_seek( r->ahead, r->out_off + r->out_len ) != 0 ) {
+        goto fail;
+    }
+    for ( i = 0; i < LOG_READER_RING; i++ ) {
+        r->ring[i].data = malloc( LOG_READER_BLOCK );
+        if ( r->ring[i].data == NULL ) goto fail;
+    }
+    r->ring_head = 0;
+    r->ring_count = 0;
+    r->ring_pos = 0;
+    r->stop = 0;
+
+    pthread_mutex_init( &r->lock, NULL );
+    pthread_cond_init( &r->ready, NULL );
+    pthread_cond_init( &r->space, NULL );
+    if ( r->bgzf && r->out_off + r->out_len == 0 ? log_reader_start_workers( r ) != 0 :
+         pthread_create( &r->thread, NULL, log_reader_produce, r ) != 0 ) {
+        pthread_mutex_destroy( &r->lock );
+        pthread_cond_destroy( &r->ready );
+        pthread_cond_destroy( &r->space );
+        goto fail;
+    }
+
+    /* the opportunistic index is built by the thread's reader now */
+    log_reader_stop_build( r );
+    return 0;
+
+fail:
+    log_reader_close( r->ahead );
+    r->ahead = NULL;
+    r->ahead_index = NULL;
+    for ( i = 0; i < LOG_READER_RING; i++ ) {
+        free( r->ring[i].data );
+        r->ring[i].data = NULL;
+    }
+    return -1;
+}
+
+/*
+Share the table's cache of decompressed blocks, see logblocks.h. The
+reader keeps the blocks it decompresses there and, once the log has an
+index (which the first scan from the start builds), reads those it
+finds there rather than decompressing them. Plain logs are not cached.
+ */
+void log_reader_share( log_reader *r, log_blocks *blocks )
+{
+    struct stat  st;
+
+    if ( blocks == NULL || r->codec == LOG_CODEC_PLAIN || fstat( r->fd, &st ) != 0 ) return;
+    if ( ( r->blocks_file = log_blocks_file( blocks, r->filename, st.st_size, st.st_mtime ) ) >= 0 ) {
+        r->blocks = blocks;
+    }
+}
+
+/*
+Make room in out[] for a line of n bytes and the history before it.
+Returns 0, -1 if the line is too long or memory is short.
+ */
+static int log_reader_grow( log_reader *r, int64_t n )
+{
+    unsigned char  *out;
+    int64_t        size = r->out_size * 2;
+
+    if ( n > LOG_READER_LINE_MAX ) return -1;
+    while ( size < n + LOG_INDEX_WINSIZE + 1 ) size *= 2;
+    if ( ( out = realloc( r->out, size ) ) == NULL ) return -1;
+    r->out = out;
+    r->out_size = size;
+    return 0;
+}
+
+/*
+The next line, in place: sets *len to its length including the
+newline, if it has one. Returns NULL at the end of the log or on
+error; log_reader_eof() tells which. The line stays valid until the
+next call. A line longer than LOG_READER_LINE_MAX is cut short there
+and the rest of it skipped, as is any line when memory is short; a
+mapped log has room for any line.
+ */
+const char * log_reader_line( log_reader *r, int *len )
+{
+    unsigned char  *nl = NULL;
+    int64_t        scanned = 0, n;
+    int            k;
+
+    while ( r->skip ) {
+        if ( r->out_pos == r->out_len && ( k = log_reader_fill( r ) ) <= 0 ) {
+            if ( k == 0 ) r->eof = 1;
+            return NULL;
+        }
+        nl = memchr( r->out + r->out_pos, '\n', r->out_len - r->out_pos );
+        r->out_pos = ( nl != NULL ? nl - r->out + 1 : r->out_len );
+        r->skip = ( nl == NULL );
+    }
+
+    while ( 1 ) {
+        n = r->out_len - r->out_pos;
+        nl = memchr( r->out + r->out_pos + scanned, '\n', n - scanned );
+        if ( nl != NULL ) break;
+        if ( !r->mapped && n + LOG_INDEX_WINSIZE >= r->out_size && log_reader_grow( r, n ) != 0 ) {
+            r->skip = 1;
+            break;
+        }
+        scanned = n;
+        k = log_reader_fill( r );        /* may move the line to the front */
+        if ( k < 0 ) return NULL;
+        if ( k == 0 ) break;
+    }
+
+    n = ( nl != NULL ? nl - ( r->out + r->out_pos ) + 1 : r->out_len - r->out_pos );
+    if ( n == 0 ) {
+        r->eof = 1;
+        return NULL;
+    }
+    if ( n > 0x7fffffff ) n = 0x7fffffff;
+    *len = n;
+    r->out_pos += n;
+    return (const char *)( r->out + r->out_pos - n );
+}
@@ -0,0 +1,85 @@
+/**
+
+Sequential and random access reader for plain and compressed logs,
+shared by the access_log and error_log modules.
+
+The format is told by a log's first bytes, not its name:
+
+  - gzip, inflated with zlib directly rather than through gzFile so
+    that inflating can resume from a log_index point. BGZF (bgzip's
+    gzip of independent members of at most 64K) is gzip too, but its
+    index points are member starts, which need no window.
+  - zstd, when built with libzstd (see the Makefile). Each frame is
+    independent, so a log of many frames, such as the seekable format
+    (whose seek table is a skippable frame), gets an index point at a
+    frame start every LOG_INDEX_SPAN bytes; a log of one frame is
+    decompressed from the start on every seek. Without libzstd a
+    zstd log cannot be opened.
+  - xz, decompressed with liblzma from the start on every seek.
+  - anything else is read as it is.
+
+While a log is read from the start, the reader records index points as
+it goes; once it reaches the end the index is handed to the table (and
+saved next to the log for LOG_INDEX_FILE) so later cursors can seek.
+
+A sequential scan can hand decompressing to a background thread with
+log_reader_prefetch(), so that it runs on another core while the
+caller parses lines. A BGZF log scanned from the start is inflated by
+several threads at once, a few members each. Seeking stops the threads.
+
+log_reader_line() returns each line where it lies in the reader's
+buffer, without copying it, however long: the buffer grows to hold a
+line of up to 256MB. Plain logs opened with LOG_READER_MMAP are
+mapped rather than read, so their lines are in the file itself.
+
+The readers of a table share a cache of decompressed blocks
+(log_reader_share(), see logblocks.h), so a compressed log scanned
+again, as the inner loop of a join scans it, is copied rather than
+decompressed again.
+
+Offsets are in the uncompressed log.
+ **/
+
+#ifndef LOGREADER_H
+#define LOGREADER_H
+
+#include <stdint.h>
+
+#include "logblocks.h"
+#include "logindex.h"
+
+#define LOG_READER_MMAP  0x01            /* map plain logs */
+
+/* what a log is compressed with, from its first bytes */
+#define LOG_CODEC_PLAIN  0
+#define LOG_CODEC_GZIP   1               /* and BGZF */
+#define LOG_CODEC_XZ     2
+#define LOG_CODEC_ZSTD   3
+
+typedef struct log_reader_s log_reader;
+
+log_reader * log_reader_open( const char *filename,
+                 log_index **index, int index_mode, int flags );
+void         log_reader_close( log_reader *r );
+
+const char * log_reader_line( log_reader *r, int *len );
+int          log_reader_read( log_reader *r, char *buf, int len );
+int          log_reader_eof( log_reader *r );
+
+int          log_reader_seek( log_reader *r, int64_t off );
+int64_t      log_reader_tell( log_reader *r );
+int          log_reader_seekable( log_reader *r );
+int          log_reader_compressed( log_reader *r );
+int64_t      log_reader_size( log_reader *r );
+int64_t      log_reader_align( log_reader *r, int64_t off );
+
+int          log_reader_index( log_reader *r );
+int64_t      log_reader_lines_before( log_reader *r, int64_t off );
+int          log_reader_seek_line( log_reader *r, int64_t line );
+
+int          log_reader_prefetch( log_reader *r );
+void         log_reader_share( log_reader *r, log_blocks *blocks );
+
+void         log_reader_stats( log_reader *r, int64_t *read, int64_t *inflated );
+
+#endif
@@ -0,0 +1,460 @@
+/**
+
+Rollups of a log. See logrollup.h.
+
+Sidecar file layout, native byte order as for the index:
+
+    "CATTOYRU"                      magic
+    int32                           version
+    int32 compressed
+    int64 src_size, src_mtime, rows, end_off
+    int32 head_len, int32 seconds
+    uint64 head, kind
+    int64 n
+    n * { int64 time, requests, bytes, status_4xx, status_5xx,
+                response_n, response_sum, response_max;
+          int32 key_len (-1 for none), int32 buckets;
+          key_len bytes of key;
+          buckets * { int32 bucket; uint32 count } }
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "logrollup.h"
+#include "logzone.h"
+
+#define LOG_ROLLUP_MAGIC    "CATTOYRU"
+#define LOG_ROLLUP_VERSION  1
+
+log_rollup * log_rollup_new( uint64_t kind, int seconds )
+{
+    log_rollup *r = calloc( 1, sizeof( log_rollup ) );
+
+    if ( r != NULL ) {
+        r->kind = kind;
+        r->seconds = seconds;
+    }
+    return r;
+}
+
+void log_rollup_free( log_rollup *r )
+{
+    int64_t i;
+
+    if ( r == NULL ) return;
+    for ( i = 0; i < r->n; i++ ) free( r->row[i].key );
+    free( r->row );
+    free( r->slot );
+    free( r );
+}
+
+static uint64_t log_rollup_hash( int64_t time, const char *key, int key_len )
+{
+    uint64_t h = (uint64_t)time * 0x9e3779b97f4a7c15ULL;
+
+    if ( key != NULL ) h ^= log_zone_hash( key, key_len );
+    h = ( h ^ ( h >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    return h ^ ( h >> 27 );
+}
+
+static int log_rollup_rehash( log_rollup *r, int64_t slots )
+{
+    int64_t  *slot = malloc( slots * sizeof( int64_t ) ), i, h;
+
+    if ( slot == NULL ) return -1;
+    memset( slot, 0xff, slots * sizeof( int64_t ) );
+    for ( i = 0; i < r->n; i++ ) {
+        h = log_rollup_hash( r->row[i].time, r->row[i].key, r->row[i].key_len ) & ( slots - 1 );
+        while ( slot[h] >= 0 ) h = ( h + 1 ) & ( slots - 1 );
+        slot[h] = i;
+    }
+    free( r->slot );
+    r->slot = slot;
+    r->slots = slots;
+    return 0;
+}
+
+/* The row of an interval and key, added if it is new. */
+static log_rollup_row * log_rollup_row_for( log_rollup *r, int64_t time, const char *key, int key_len )
+{
+    log_rollup_row  *row;
+    int64_t         h;
+
+    if ( r->n * 2 >= r->slots &&
+         log_rollup_rehash( r, r->slots == 0 ? 1024 : r->slots * 2 ) != 0 ) {
+        return NULL;
+    }
+    for ( h = log_rollup_hash( time, key, key_len ) & ( r->slots - 1 ); r->slot[h] >= 0;
+          h = ( h + 1 ) & ( r->slots - 1 ) ) {
+        row = &r->row[r->slot[h]];
+        if ( row->time == time && ( key == NULL ? row->key == NULL :
+             row->key != NULL && row->key_len == key_len && memcmp( row->key, key, key_len ) == 0 ) ) {
+            return row;
+        }
+    }
+    if ( r->n == r->alloc ) {
+        int64_t  alloc = ( r->alloc == 0 ? 256 : r->alloc * 2 );
+        void     *list = realloc( r->row, alloc * sizeof( log_rollup_row ) );
+
+        if ( list == NULL ) return NULL;
+        r->row = list;
+        r->alloc = alloc;
+    }
+    row = &r->row[r->n];
+    memset( row, 0, sizeof( log_rollup_row ) );
+    row->time = time;
+    if ( key != NULL ) {
+        if ( ( row->key = malloc( key_len + 1 ) ) == NULL ) return NULL;
+        memcpy( row->key, key, key_len );
+        row->key[key_len] = '\0';
+        row->key_len = key_len;
+    }
+    r->slot[h] = r->n++;
+    return row;
+}
+
+/*
+A builder holding the rows of from, to add the lines logged since to.
+from is left as it is.
+ */
+log_rollup * log_rollup_grow( const log_rollup *from )
+{
+    log_rollup  *r = log_rollup_new( from->kind, from->seconds );
+
+    if ( r == NULL ) return NULL;
+    if ( log_rollup_merge( r, from ) != 0 ) {
+        log_rollup_free( r );
+        return NULL;
+    }
+    r->rows = from->rows;
+    r->end_off = from->end_off;
+    return r;
+}
+
+/* Two buckets for each power of two: its lower and upper half. */
+static int log_rollup_bucket( int64_t v )
+{
+    int b = 0, k;
+
+    if ( v < 1 ) return 0;
+    while ( ( v >> b ) > 1 ) b++;
+    k = 1 + 2 * b + ( b > 0 ? ( v >> ( b - 1 ) ) & 1 : 0 );
+    return ( k < LOG_ROLLUP_BUCKETS ? k : LOG_ROLLUP_BUCKETS - 1 );
+}
+
+/* The middle of bucket k. */
+static int64_t log_rollup_middle( int k )
+{
+    int      b = ( k - 1 ) / 2;
+    int64_t  lo, width;
+
+    if ( k <= 0 ) return 0;
+    if ( b == 0 ) return 1;
+    width = (int64_t)1 << ( b - 1 );
+    lo = ( (int64_t)1 << b ) + ( ( k - 1 ) % 2 ) * width;
+    return lo + width / 2;
+}
+
+/*
+Count a line: its interval starts at time rounded down to the rollup's
+seconds, key is NULL when rows are by time alone.
+ */
+int log_rollup_line( log_rollup *r, int64_t time, const char *key, int key_len,
+                     int status, int64_t bytes, int has_response, int64_t response )
+{
+    int64_t         start = time - ( ( time % r->seconds ) + r->seconds ) % r->seconds;
+    log_rollup_row  *row = log_rollup_row_for( r, start, key, key_len );
+
+    if ( row == NULL ) return -1;
+    row->requests++;
+    row->bytes += bytes;
+    if ( status >= 400 && status < 500 ) row->status_4xx++;
+    if ( status >= 500 && status < 600 ) row->status_5xx++;
+    if ( has_response ) {
+        row->response_n++;
+        row->response_sum += response;
+        if ( response > row->response_max ) row->response_max = response;
+        row->hist[log_rollup_bucket( response )]++;
+    }
+    return 0;
+}
+
+/* Add the rows of from to those of to. */
+int log_rollup_merge( log_rollup *to, const log_rollup *from )
+{
+    int64_t  i;
+    int      k;
+
+    for ( i = 0; i < from->n; i++ ) {
+        const log_rollup_row  *f = &from->row[i];
+        log_rollup_row        *t = log_rollup_row_for( to, f->time, f->key, f->key_len );
+
+        if ( t == NULL ) return -1;
+        t->requests += f->requests;
+        t->bytes += f->bytes;
+        t->status_4xx += f->status_4xx;
+        t->status_5xx += f->status_5xx;
+        t->response_n += f->response_n;
+        t->response_sum += f->response_sum;
+        if ( f->response_max > t->response_max ) t->response_max = f->response_max;
+        for ( k = 0; k < LOG_ROLLUP_BUCKETS; k++ ) t->hist[k] += f->hist[k];
+    }
+    return 0;
+}
+
+static int log_rollup_cmp( const void *a, const void *b )
+{
+    const log_rollup_row  *x = a, *y = b;
+
+    if ( x->time != y->time ) return ( x->time > y->time ) - ( x->time < y->time );
+    if ( x->key == NULL || y->key == NULL ) return ( x->key != NULL ) - ( y->key != NULL );
+    return strcmp( x->key, y->key );
+}
+
+/* Order the rows by interval, then key. Rows cannot be added after. */
+void log_rollup_sort( log_rollup *r )
+{
+    free( r->slot );
+    r->slot = NULL;
+    r->slots = 0;
+    if ( r->n > 0 ) qsort( r->row, r->n, sizeof( log_rollup_row ), log_rollup_cmp );
+}
+
+/*
+The response_time that a fraction p of a row's requests took at most,
+as the middle of its bucket, but no more than the longest. -1 if the
+row has no response_time.
+ */
+int64_t log_rollup_percentile( const log_rollup_row *row, double p )
+{
+    int64_t  want, seen = 0, v;
+    int      k;
+
+    if ( row->response_n == 0 ) return -1;
+    want = (int64_t)( p * row->response_n + 0.5 );
+    if ( want < 1 ) want = 1;
+    for ( k = 0; k < LOG_ROLLUP_BUCKETS - 1; k++ ) {
+        if ( ( seen += row->hist[k] ) >= want ) break;
+    }
+    v = log_rollup_middle( k );
+    return ( v < row->response_max ? v : row->response_max );
+}
+
+/*
+Close the rollup of filename, which reader has read to the end. Moves
+reader. The lines after end_off are left for the next query.
+ */
+int log_rollup_finish( log_rollup *r, const char *filename, log_reader *reader )
+{
+    struct stat  st;
+    char         head[LOG_ROLLUP_HEAD];
+
+    free( r->slot );
+    r->slot = NULL;
+    r->slots = 0;
+
+    if ( stat( filename, &st ) != 0 ) return -1;
+    r->src_size = st.st_size;
+    r->src_mtime = st.st_mtime;
+    r->compressed = log_reader_compressed( reader );
+    r->head_len = ( r->end_off < LOG_ROLLUP_HEAD ? r->end_off : LOG_ROLLUP_HEAD );
+    if ( log_reader_seek( reader, 0 ) != 0 || log_reader_read( reader, head, r->head_len ) != r->head_len ) {
+        return -1;
+    }
+    r->head = log_zone_hash( head, r->head_len );
+    return 0;
+}
+
+/*
+Whether r is the rollup of filename as it is now, LOG_ROLLUP_CURRENT,
+or of the start of it, LOG_ROLLUP_GROWN, or of some other log.
+ */
+int log_rollup_state( log_rollup *r, const char *filename )
+{
+    struct stat  st;
+    char         head[LOG_ROLLUP_HEAD];
+    FILE         *fp;
+    int          n;
+
+    if ( stat( filename, &st ) != 0 ) return LOG_ROLLUP_STALE;
+    if ( st.st_size == r->src_size && st.st_mtime == r->src_mtime ) {
+        return ( r->compressed || r->end_off == st.st_size ? LOG_ROLLUP_CURRENT : LOG_ROLLUP_GROWN );
+    }
+    if ( r->compressed || st.st_size < r->end_off ) return LOG_ROLLUP_STALE;
+
+    if ( ( fp = fopen( filename, "rb" ) ) == NULL ) return LOG_ROLLUP_STALE;
+    n = fread( head, 1, r->head_len, fp );
+    fclose( fp );
+    if ( n != r->head_len || log_zone_hash( head, n ) != r->head ) return LOG_ROLLUP_STALE;
+    return LOG_ROLLUP_GROWN;
+}
+
+/* filename.cattoy-rollup-name */
+static char * log_rollup_path( const char *filename, const char *name )
+{
+    char *path = malloc( strlen( filename ) + sizeof( LOG_ROLLUP_SUFFIX ) + strlen( name ) + 1 );
+
+    if ( path != NULL ) sprintf( path, "%s%s-%s", filename, LOG_ROLLUP_SUFFIX, name );
+    return path;
+}
+
+/*
+Load the saved rollup called name of filename, if it counted the lines
+the way kind says. Whether it is still of the log is up to
+log_rollup_state().
+ */
+log_rollup * log_rollup_load( const char *filename, const char *name, uint64_t kind )
+{
+    struct stat     st;
+    char            magic[8], *path;
+    int32_t         hdr[2], head_len[2], sizes[2], bucket[2];
+    int64_t         meta[4], vals[8], n, i, b;
+    uint64_t        ids[2];
+    log_rollup      *r = NULL;
+    log_rollup_row  *row;
+    FILE            *fp;
+
+    if ( ( path = log_rollup_path( filename, name ) ) == NULL ) return NULL;
+    fp = fopen( path, "rb" );
+    free( path );
+    if ( fp == NULL ) return NULL;
+    if ( fstat( fileno( fp ), &st ) != 0 ) goto fail;
+
+    if ( fread( magic, sizeof( magic ), 1, fp ) != 1 ||
+         memcmp( magic, LOG_ROLLUP_MAGIC, sizeof( magic ) ) != 0 ||
+         fread( hdr, sizeof( hdr ), 1, fp ) != 1 || hdr[0] != LOG_ROLLUP_VERSION ||
+         fread( meta, sizeof( meta ), 1, fp ) != 1 ||
+         fread( head_len, sizeof( head_len ), 1, fp ) != 1 ||
+         head_len[0] < 0 || head_len[0] > LOG_ROLLUP_HEAD || head_len[1] < 1 ||
+         fread( ids, sizeof( ids ), 1, fp ) != 1 || ids[1] != kind ||
+         fread( &n, sizeof( n ), 1, fp ) != 1 ||
+         n < 0 || n > st.st_size / 72 ) {
+        goto fail;
+    }
+
+    if ( ( r = log_rollup_new( kind, head_len[1] ) ) == NULL ) goto fail;
+    r->compressed = hdr[1];
+    r->src_size = meta[0];
+    r->src_mtime = meta[1];
+    r->rows = meta[2];
+    r->end_off = meta[3];
+    r->head_len = head_len[0];
+    r->head = ids[0];
+    if ( n > 0 && ( r->row = calloc( n, sizeof( log_rollup_row ) ) ) == NULL ) goto fail;
+    r->alloc = n;
+
+    for ( i = 0; i < n; i++ ) {
+        row = &r->row[i];
+        if ( fread( vals, sizeof( vals ), 1, fp ) != 1 ||
+             fread( sizes, sizeof( sizes ), 1, fp ) != 1 ||
+             sizes[0] < -1 || sizes[0] > st.st_size || sizes[1] < 0 || sizes[1] > LOG_ROLLUP_BUCKETS ) {
+            goto fail;
+        }
+        r->n = i + 1;                   /* so the key is freed */
+        row->time = vals[0];
+        row->requests = vals[1];
+        row->bytes = vals[2];
+        row->status_4xx = vals[3];
+        row->status_5xx = vals[4];
+        row->response_n = vals[5];
+        row->response_sum = vals[6];
+        row->response_max = vals[7];
+        if ( sizes[0] >= 0 ) {
+            if ( ( row->key = malloc( sizes[0] + 1 ) ) == NULL ||
+                 ( sizes[0] > 0 && fread( row->key, sizes[0], 1, fp ) != 1 ) ) {
+                goto fail;
+            }
+            row->key[sizes[0]] = '\0';
+            row->key_len = sizes[0];
+        }
+        for ( b = 0; b < sizes[1]; b++ ) {
+            if ( fread( bucket, sizeof( bucket ), 1, fp ) != 1 ||
+                 bucket[0] < 0 || bucket[0] >= LOG_ROLLUP_BUCKETS ) {
+                goto fail;
+            }
+            row->hist[bucket[0]] = (uint32_t)bucket[1];
+        }
+    }
+    fclose( fp );
+    return r;
+
+fail:
+    log_rollup_free( r );
+    fclose( fp );
+    return NULL;
+}
+
+int log_rollup_save( log_rollup *r, const char *filename, const char *name )
+{
+    char     *path, *tmp;
+    int32_t  hdr[2], head_len[2], sizes[2], bucket[2];
+    int64_t  meta[4], i;
+    uint64_t ids[2];
+    FILE     *fp;
+    int      rc = -1, k;
+
+    if ( r->slot != NULL ) return -1;           /* not finished */
+    if ( ( path = log_rollup_path( filename, name ) ) == NULL ) return -1;
+    if ( ( tmp = malloc( strlen( path ) + 16 ) ) == NULL ) {
+        free( path );
+        return -1;
+    }
+    sprintf( tmp, "%s.%d", path, (int)getpid() );
+
+    if ( ( fp = fopen( tmp, "wb" ) ) == NULL ) goto done;
+
+    hdr[0] = LOG_ROLLUP_VERSION;
+    hdr[1] = r->compressed;
+    meta[0] = r->src_size;
+    meta[1] = r->src_mtime;
+    meta[2] = r->rows;
+    meta[3] = r->end_off;
+    head_len[0] = r->head_len;
+    head_len[1] = r->seconds;
+    ids[0] = r->head;
+    ids[1] = r->kind;
+    fwrite( LOG_ROLLUP_MAGIC, 8, 1, fp );
+    fwrite( hdr, sizeof( hdr ), 1, fp );
+    fwrite( meta, sizeof( meta ), 1, fp );
+    fwrite( head_len, sizeof( head_len ), 1, fp );
+    fwrite( ids, sizeof( ids ), 1, fp );
+    fwrite( &r->n, sizeof( r->n ), 1, fp );
+    for ( i = 0; i < r->n; i++ ) {
+        log_rollup_row  *row = &r->row[i];
+        int64_t         vals[8] = { row->time, row->requests, row->bytes, row->status_4xx,
+                                    row->status_5xx, row->response_n, row->response_sum,
+                                    row->response_max };
+
+        sizes[0] = ( row->key == NULL ? -1 : row->key_len );
+        sizes[1] = 0;
+        for ( k = 0; k < LOG_ROLLUP_BUCKETS; k++ ) sizes[1] += ( row->hist[k] != 0 );
+        fwrite( vals, sizeof( vals ), 1, fp );
+        fwrite( sizes, sizeof( sizes ), 1, fp );
+        if ( row->key_len > 0 ) fwrite( row->key, row->key_len, 1, fp );
+        for ( k = 0; k < LOG_ROLLUP_BUCKETS; k++ ) {
+            if ( row->hist[k] == 0 ) continue;
+            bucket[0] = k;
+            bucket[1] = (int32_t)row->hist[k];
+            fwrite( bucket, sizeof( bucket ), 1, fp );
+        }
+    }
+
+    if ( ferror( fp ) | fclose( fp ) ) {
+        remove( tmp );
+        goto done;
+    }
+    if ( rename( tmp, path ) != 0 ) {
+        remove( tmp );
+        goto done;
+    }
+    rc = 0;
+
+done:
+    free( tmp );
+    free( path );
+    return rc;
+}
@@ -0,0 +1,83 @@
+/**
+
+Rollups of a log: for each minute (or hour, or day) and optionally each
+client or url path, the number of requests, bytes sent, 4xx and 5xx
+responses and the distribution of response_time, so that a dashboard
+reads a few thousand rows instead of every line.
+
+A rollup is built for each file of a table by a query on an
+access_log_rollup table, kept with the table and, for index=on, saved
+next to the log, e.g.
+    access_log.cattoy-rollup-minute-url
+A plain log that has grown since, and still starts with the same
+bytes, keeps its rollup for the lines it covers; the lines logged since
+are read and added to it by the next query, as for logpost.h.
+
+response_time is counted in LOG_ROLLUP_BUCKETS buckets, two for each
+power of two, so a percentile is known to within a fifth either way.
+Rollups of several files, or of one interval split across two, add up.
+ **/
+
+#ifndef LOGROLLUP_H
+#define LOGROLLUP_H
+
+#include <stdint.h>
+
+#include "logreader.h"
+
+#define LOG_ROLLUP_SUFFIX   ".cattoy-rollup"
+#define LOG_ROLLUP_HEAD     256          /* bytes hashed to recognise a log */
+#define LOG_ROLLUP_BUCKETS  72           /* of response_time, up to 2^35 */
+
+/* log_rollup_state() */
+#define LOG_ROLLUP_STALE    -1
+#define LOG_ROLLUP_CURRENT  0
+#define LOG_ROLLUP_GROWN    1            /* lines after end_off not counted */
+
+typedef struct log_rollup_row_s {
+    int64_t          time;               /* start of the interval */
+    char             *key;               /* NUL terminated, NULL without by= key */
+    int              key_len;
+    int64_t          requests;
+    int64_t          bytes;
+    int64_t          status_4xx;
+    int64_t          status_5xx;
+    int64_t          response_n;         /* requests with a response_time */
+    int64_t          response_sum;
+    int64_t          response_max;
+    uint32_t         hist[LOG_ROLLUP_BUCKETS];
+} log_rollup_row;
+
+typedef struct log_rollup_s {
+    uint64_t         kind;               /* hash of what was counted, and how */
+    int              seconds;            /* of an interval */
+    int64_t          src_size;           /* log size and mtime when built */
+    int64_t          src_mtime;
+    int              compressed;
+    int              head_len;
+    uint64_t         head;               /* hash of the first head_len bytes */
+    int64_t          rows;               /* lines counted */
+    int64_t          end_off;            /* offset after the last of them */
+    int64_t          n;                  /* rows of the rollup */
+    int64_t          alloc;
+    log_rollup_row   *row;
+
+    /* row index by interval and key, open addressing */
+    int64_t          *slot;
+    int64_t          slots;
+} log_rollup;
+
+log_rollup * log_rollup_new( uint64_t kind, int seconds );
+log_rollup * log_rollup_grow( const log_rollup *from );
+void         log_rollup_free( log_rollup *r );
+int          log_rollup_line( log_rollup *r, int64_t time, const char *key, int key_len,
+                              int status, int64_t bytes, int has_response, int64_t response );
+int          log_rollup_merge( log_rollup *to, const log_rollup *from );
+void         log_rollup_sort( log_rollup *r );
+int64_t      log_rollup_percentile( const log_rollup_row *row, double p );
+int          log_rollup_finish( log_rollup *r, const char *filename, log_reader *reader );
+int          log_rollup_state( log_rollup *r, const char *filename );
+log_rollup * log_rollup_load( const char *filename, const char *name, uint64_t kind );
+int          log_rollup_save( log_rollup *r, const char *filename, const char *name );
+
+#endif
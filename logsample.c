@@ -0,0 +1,89 @@
+/**
+
+Block sampling of a log. See logsample.h.
+
+Block b holds lines b * LOG_SAMPLE_LINES + 1 to (b + 1) * LOG_SAMPLE_LINES.
+It is picked if a hash of the file name mixed with b falls below rate
+of the range of a uint64_t; nothing about the blocks is stored, so a
+block's pick costs a few multiplications to work out again.
+ **/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "logsample.h"
+#include "logzone.h"
+
+/* splitmix64's finaliser */
+static uint64_t log_sample_mix( uint64_t x )
+{
+    x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+    return x ^ ( x >> 31 );
+}
+
+static uint64_t log_sample_hash( const log_sample *s, int64_t b )
+{
+    return log_sample_mix( s->seed ^ log_sample_mix( (uint64_t)b + 0x9e3779b97f4a7c15ULL ) );
+}
+
+static int log_sample_picked( const log_sample *s, int64_t b )
+{
+    return s->rate >= 1 || b == s->forced || log_sample_hash( s, b ) < s->threshold;
+}
+
+/*
+Set up sampling of a file of the given number of lines, -1 if not
+known, at rate, 0 for none. A file of known length with no block picked
+has the one with the least hash picked, so that every file is in the
+sample and its lines are counted.
+ */
+void log_sample_init( log_sample *s, double rate, const char *filename, int64_t lines )
+{
+    int64_t   blocks, b, least = 0, n;
+    uint64_t  h, least_h = UINT64_MAX;
+
+    s->rate = rate;
+    s->seed = log_zone_hash( filename, strlen( filename ) );
+    s->threshold = ( rate >= 1 ? UINT64_MAX : (uint64_t)( rate * 18446744073709551616.0 ) );
+    s->lines = lines;
+    s->forced = -1;
+    s->sampled = 0;
+    s->scale = ( rate > 0 ? 1 / rate : 1 );
+    s->block = -1;
+    if ( rate <= 0 || lines < 0 ) return;
+
+    blocks = ( lines + LOG_SAMPLE_LINES - 1 ) / LOG_SAMPLE_LINES;
+    for ( b = 0; b < blocks; b++ ) {
+        n = ( b == blocks - 1 ? lines - b * LOG_SAMPLE_LINES : LOG_SAMPLE_LINES );
+        if ( ( h = log_sample_hash( s, b ) ) < s->threshold || rate >= 1 ) {
+            s->sampled += n;
+        }
+        else if ( h < least_h ) {
+            least_h = h;
+            least = b;
+        }
+    }
+    if ( s->sampled == 0 && blocks > 0 ) {
+        s->forced = least;
+        s->sampled = ( least == blocks - 1 ? lines - least * LOG_SAMPLE_LINES : LOG_SAMPLE_LINES );
+    }
+    s->scale = ( s->sampled > 0 ? (double)lines / s->sampled : 1 );
+}
+
+/*
+The first line from line (1 based) on that is in a picked block: line
+itself if its block is picked, else the first of the next picked block.
+Returns -1 if no block after it in a file of known length is picked.
+ */
+int64_t log_sample_next( log_sample *s, int64_t line )
+{
+    int64_t  b = ( line - 1 ) / LOG_SAMPLE_LINES;
+    int64_t  blocks = ( s->lines < 0 ? INT64_MAX : ( s->lines + LOG_SAMPLE_LINES - 1 ) / LOG_SAMPLE_LINES );
+
+    if ( s->rate <= 0 || b == s->block ) return line;
+    while ( b < blocks && !log_sample_picked( s, b ) ) b++;
+    if ( b >= blocks ) return -1;
+    s->block = b;
+    return ( b * LOG_SAMPLE_LINES + 1 > line ? b * LOG_SAMPLE_LINES + 1 : line );
+}
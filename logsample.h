@@ -0,0 +1,41 @@
+/**
+
+Block sampling of a log, for quick approximate answers over archives
+too big to read whole. A table with sample=RATE (or a query with
+sample_rate = RATE) reads only the blocks of LOG_SAMPLE_LINES lines
+that a hash of the file name and block number picks, about RATE of
+them, seeking over the rest: a plain log seeks straight to a block, a
+gzip log to the index point before it (see logindex.h). The same
+blocks are picked by every query, so repeated and joined queries agree.
+
+Each file with an index has at least one block picked. Its rows carry
+sample_scale, the lines in the file over the lines in its picked
+blocks, so sum(sample_scale) is the file's line count and sum(X *
+sample_scale) estimates sum(X). Without an index, for index=off, every
+line is still read but only those of picked blocks are parsed, and
+sample_scale is 1 / RATE.
+ **/
+
+#ifndef LOGSAMPLE_H
+#define LOGSAMPLE_H
+
+#include <stdint.h>
+
+#define LOG_SAMPLE_LINES    4096         /* lines per block */
+#define LOG_SAMPLE_MIN      0.000001     /* least rate */
+
+typedef struct log_sample_s {
+    double           rate;               /* 0 when not sampling */
+    uint64_t         seed;               /* hash of the file name */
+    uint64_t         threshold;          /* blocks hashing below it are picked */
+    int64_t          lines;              /* in the file, -1 if not known */
+    int64_t          forced;             /* block picked as none was, or -1 */
+    int64_t          sampled;            /* lines in picked blocks */
+    double           scale;              /* lines over sampled */
+    int64_t          block;              /* last block found picked */
+} log_sample;
+
+void         log_sample_init( log_sample *s, double rate, const char *filename, int64_t lines );
+int64_t      log_sample_next( log_sample *s, int64_t line );
+
+#endif
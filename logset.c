@@ -0,0 +1,368 @@
+/**
+
+The set of log files behind one table. See logset.h.
+ **/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glob.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "logset.h"
+#include "logrollup.h"
+
+#define DAY   86400
+
+log_set * log_set_new( void )
+{
+    return calloc( 1, sizeof( log_set ) );
+}
+
+void log_set_free( log_set *set )
+{
+    int i;
+
+    if ( set == NULL ) return;
+    for ( i = 0; i < set->n; i++ ) {
+        free( set->files[i].filename );
+        free( set->files[i].vhost );
+        log_index_free( set->files[i].index );
+        log_zone_free( set->files[i].zone );
+        log_post_free( set->files[i].post );
+    }
+    free( set->files );
+    log_blocks_free( set->blocks );
+    free( set );
+}
+
+static int log_set_has_suffix( const char *filename, const char *suffix )
+{
+    int len = strlen( filename ), slen = strlen( suffix );
+
+    return len >= slen && strcmp( filename + len - slen, suffix ) == 0;
+}
+
+/* index, zone map, inverted index and rollup files kept next to the logs */
+static int log_set_is_index( const char *filename )
+{
+    return log_set_has_suffix( filename, LOG_INDEX_SUFFIX ) ||
+           log_set_has_suffix( filename, LOG_ZONE_SUFFIX ) ||
+           log_set_has_suffix( filename, LOG_POST_SUFFIX ) ||
+           strstr( filename, LOG_ROLLUP_SUFFIX "-" ) != NULL;
+}
+
+/*
+The rotation date in a file name, "-YYYYMMDD" optionally followed by
+an extension, as local midnight. Returns 0 if there is none and sets
+*stem to the length of the name before the date.
+ */
+static int64_t log_set_name_date( const char *filename, int *stem )
+{
+    const char  *base = strrchr( filename, '/' );
+    const char  *p;
+    struct tm   tm;
+    int         i;
+
+    base = ( base == NULL ? filename : base + 1 );
+    *stem = strlen( filename );
+    for ( p = strchr( base, '-' ); p != NULL; p = strchr( p + 1, '-' ) ) {
+        for ( i = 1; i <= 8 && p[i] >= '0' && p[i] <= '9'; i++ ) ;
+        if ( i != 9 || ( p[9] != '\0' && p[9] != '.' ) ) continue;
+
+        memset( &tm, 0, sizeof( tm ) );
+        tm.tm_year = ( p[1] - '0' ) * 1000 + ( p[2] - '0' ) * 100 +
+                     ( p[3] - '0' ) * 10 + ( p[4] - '0' ) - 1900;
+        tm.tm_mon  = ( p[5] - '0' ) * 10 + ( p[6] - '0' ) - 1;
+        tm.tm_mday = ( p[7] - '0' ) * 10 + ( p[8] - '0' );
+        tm.tm_isdst = -1;
+        *stem = p - filename;
+        return mktime( &tm );
+    }
+    return 0;
+}
+
+static int log_set_add_file( log_set *set, const char *filename )
+{
+    log_file    *f;
+    const char  *slash, *dir;
+    int         i;
+
+    if ( log_set_is_index( filename ) ) return 0;
+    for ( i = 0; i < set->n; i++ ) {
+        if ( strcmp( set->files[i].filename, filename ) == 0 ) return 0;
+    }
+
+    if ( ( set->n & 15 ) == 0 ) {
+        void *files = realloc( set->files, ( set->n + 16 ) * sizeof( log_file ) );
+        if ( files == NULL ) return -1;
+        set->files = files;
+    }
+    f = &set->files[set->n];
+    memset( f, 0, sizeof( log_file ) );
+    f->blocks = set->blocks;
+    f->filename = strdup( filename );
+    if ( f->filename == NULL ) return -1;
+
+    /* vhost is the directory the log is in, /var/log/httpd/<vhost>/access_log */
+    slash = strrchr( filename, '/' );
+    if ( slash != NULL && slash > filename ) {
+        for ( dir = slash; dir > filename && dir[-1] != '/'; dir-- ) ;
+        f->vhost = strndup( dir, slash - dir );
+    }
+    f->name_lo = LOG_TIME_MIN;
+    f->name_hi = LOG_TIME_MAX;
+    set->n++;
+    return 1;
+}
+
+static int log_set_add_dir( log_set *set, const char *dirname )
+{
+    DIR            *dir;
+    struct dirent  *ent;
+    struct stat    st;
+    char           *path;
+    int            n = 0, rc;
+
+    if ( ( dir = opendir( dirname ) ) == NULL ) return 0;
+    while ( ( ent = readdir( dir ) ) != NULL ) {
+        if ( ent->d_name[0] == '.' ) continue;
+        if ( asprintf( &path, "%s/%s", dirname, ent->d_name ) < 0 ) {
+            n = -1;
+            break;
+        }
+        rc = 0;
+        if ( stat( path, &st ) == 0 && S_ISREG( st.st_mode ) ) {
+            rc = log_set_add_file( set, path );
+        }
+        free( path );
+        if ( rc < 0 ) {
+            n = -1;
+            break;
+        }
+        n += rc;
+    }
+    closedir( dir );
+    return n;
+}
+
+/*
+Add the files matching a glob pattern, or a single file, or the files
+in a directory. Returns the number of files added or -1 if out of
+memory.
+ */
+int log_set_add( log_set *set, const char *pattern )
+{
+    glob_t       g;
+    struct stat  st;
+    size_t       i;
+    int          n = 0, rc;
+
+    if ( glob( pattern, GLOB_BRACE | GLOB_TILDE | GLOB_NOCHECK, NULL, &g ) != 0 ) {
+        return 0;
+    }
+    for ( i = 0; i < g.gl_pathc; i++ ) {
+        if ( stat( g.gl_pathv[i], &st ) != 0 ) continue;
+        if ( S_ISDIR( st.st_mode ) ) {
+            rc = log_set_add_dir( set, g.gl_pathv[i] );
+        }
+        else {
+            rc = log_set_add_file( set, g.gl_pathv[i] );
+        }
+        if ( rc < 0 ) {
+            n = -1;
+            break;
+        }
+        n += rc;
+    }
+    globfree( &g );
+    return n;
+}
+
+typedef struct log_set_key_s {
+    log_file  *f;
+    int64_t   date;
+    int       stem;
+} log_set_key;
+
+static int log_set_compare( const void *a, const void *b )
+{
+    const log_set_key  *x = a, *y = b;
+    int                c;
+
+    c = strncmp( x->f->filename, y->f->filename, x->stem < y->stem ? x->stem : y->stem );
+    if ( c != 0 || x->stem != y->stem ) return c != 0 ? c : x->stem - y->stem;
+    if ( ( x->date == 0 ) != ( y->date == 0 ) ) return x->date == 0 ? 1 : -1;
+    if ( x->date != y->date ) return x->date < y->date ? -1 : 1;
+    return strcmp( x->f->filename, y->f->filename );
+}
+
+/*
+Order files by log (directory and name without the date), then by
+rotation date with the live log last, and work out the time range
+each file can hold. A file rotated on day D holds lines from after the
+previous rotation up to D; a day of margin on each side covers the
+time of day rotation runs and time zone differences.
+ */
+void log_set_sort( log_set *set )
+{
+    log_set_key  *keys;
+    log_file     *files;
+    int          i;
+
+    if ( set->n == 0 ) return;
+    keys = malloc( set->n * sizeof( log_set_key ) );
+    files = malloc( set->n * sizeof( log_file ) );
+    if ( keys == NULL || files == NULL ) {
+        free( keys );
+        free( files );
+        return;
+    }
+
+    for ( i = 0; i < set->n; i++ ) {
+        keys[i].f = &set->files[i];
+        keys[i].date = log_set_name_date( set->files[i].filename, &keys[i].stem );
+    }
+    qsort( keys, set->n, sizeof( log_set_key ), log_set_compare );
+
+    for ( i = 0; i < set->n; i++ ) {
+        files[i] = *keys[i].f;
+        files[i].name_lo = LOG_TIME_MIN;
+        files[i].name_hi = ( keys[i].date != 0 ? keys[i].date + 2 * DAY : LOG_TIME_MAX );
+        if ( i > 0 && keys[i - 1].date != 0 && keys[i - 1].stem == keys[i].stem &&
+             strncmp( keys[i - 1].f->filename, keys[i].f->filename, keys[i].stem ) == 0 ) {
+            files[i].name_lo = keys[i - 1].date - DAY;
+        }
+    }
+    free( set->files );
+    set->files = files;
+    free( keys );
+}
+
+/*
+Share a cache of up to cap bytes of decompressed blocks among the
+readers of the set's files, see logblocks.h. Less than a block is none.
+ */
+void log_set_cache( log_set *set, int64_t cap )
+{
+    int i;
+
+    log_blocks_free( set->blocks );
+    set->blocks = log_blocks_new( cap );
+    for ( i = 0; i < set->n; i++ ) set->files[i].blocks = set->blocks;
+}
+
+/*
+Open a reader on f, loading its saved index the first time. An index
+built from an earlier version of a live log is dropped.
+
+Only rotated logs are mapped with LOG_READER_MMAP, unless flags has
+LOG_FILE_MAP_LIVE as well: the live (undated) log may be truncated
+under the mapping by logrotate's copytruncate, which raises SIGBUS,
+where read() just comes to the end of it.
+ */
+log_reader * log_file_open( log_file *f, int index_mode, int flags )
+{
+    struct stat st;
+    log_reader  *r;
+
+    if ( !f->index_loaded ) {
+        if ( index_mode == LOG_INDEX_FILE ) f->index = log_index_load( f->filename );
+        f->index_loaded = 1;
+    }
+    if ( f->index != NULL && ( stat( f->filename, &st ) != 0 ||
+         st.st_size != f->index->src_size || st.st_mtime != f->index->src_mtime ) ) {
+        log_index_free( f->index );
+        f->index = NULL;
+    }
+    if ( f->name_hi == LOG_TIME_MAX && !( flags & LOG_FILE_MAP_LIVE ) ) flags &= ~LOG_READER_MMAP;
+    r = log_reader_open( f->filename, &f->index, index_mode, flags );
+    if ( r != NULL ) log_reader_share( r, f->blocks );
+    return r;
+}
+
+/* The zone map of f if there is one for the log as it is now, or NULL. */
+log_zone * log_file_zone( log_file *f, int index_mode )
+{
+    struct stat st;
+
+    if ( index_mode == LOG_INDEX_OFF ) return NULL;
+    if ( !f->zone_loaded ) {
+        if ( index_mode == LOG_INDEX_FILE ) f->zone = log_zone_load( f->filename );
+        f->zone_loaded = 1;
+    }
+    if ( f->zone != NULL && ( stat( f->filename, &st ) != 0 ||
+         st.st_size != f->zone->src_size || st.st_mtime != f->zone->src_mtime ) ) {
+        return NULL;                    /* kept, another cursor may be using it */
+    }
+    return f->zone;
+}
+
+/* Keep z, a zone map built for f, and save it for LOG_INDEX_FILE. */
+void log_file_set_zone( log_file *f, log_zone *z, int index_mode )
+{
+    z->prev = f->zone;                  /* freed with the set */
+    f->zone = z;
+    f->zone_loaded = 1;
+    if ( index_mode == LOG_INDEX_FILE ) log_zone_save( z, f->filename );
+}
+
+/*
+The inverted index of f if there is one for the log as it is now, or
+for the start of it, in which case *grown is set, or NULL.
+ */
+log_post * log_file_post( log_file *f, int index_mode, int *grown )
+{
+    int state;
+
+    if ( index_mode == LOG_INDEX_OFF ) return NULL;
+    if ( !f->post_loaded ) {
+        if ( index_mode == LOG_INDEX_FILE ) f->post = log_post_load( f->filename );
+        f->post_loaded = 1;
+    }
+    if ( f->post == NULL ) return NULL;
+    state = log_post_state( f->post, f->filename );
+    if ( state == LOG_POST_STALE ) return NULL;    /* kept, another cursor may be using it */
+    *grown = ( state == LOG_POST_GROWN );
+    return f->post;
+}
+
+/* Keep p, an inverted index built for f, and save it for LOG_INDEX_FILE. */
+void log_file_set_post( log_file *f, log_post *p, int index_mode )
+{
+    p->prev = f->post;                  /* freed with the set */
+    f->post = p;
+    f->post_loaded = 1;
+    if ( index_mode == LOG_INDEX_FILE ) log_post_save( p, f->filename );
+}
+
+static int log_set_overlaps( int64_t lo, int64_t hi, int64_t first, int64_t last, int slack )
+{
+    if ( last != LOG_TIME_MAX && lo != LOG_TIME_MIN && lo - slack > last ) return 0;
+    if ( first != LOG_TIME_MIN && hi != LOG_TIME_MAX && hi + slack < first ) return 0;
+    return 1;
+}
+
+/*
+Whether f can hold lines with a time_epoch in [lo, hi], going by its
+name and, if known and still current, its first and last time stamps.
+ */
+int log_file_may_contain( log_file *f, int64_t lo, int64_t hi, int slack )
+{
+    struct stat st;
+
+    if ( !log_set_overlaps( lo, hi, f->name_lo, f->name_hi, slack ) ) return 0;
+    if ( f->has_span ) {
+        if ( stat( f->filename, &st ) != 0 || st.st_size != f->span_size ) {
+            f->has_span = 0;
+        }
+        else if ( !log_set_overlaps( lo, hi, f->first, f->last, slack ) ) {
+            return 0;
+        }
+    }
+    return 1;
+}
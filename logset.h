@@ -0,0 +1,73 @@
+/**
+
+The set of log files behind one table.
+
+A table can be created over one log, a glob such as
+    /var/log/httpd/{dev,qa}.toxodb.org/access_log-2014*
+or a directory, and over several of those at once. Files are ordered by
+directory, then by the rotation date in their name, with the live
+(undated) log last, so each host's lines come out in time order.
+
+Rotated logs are named with logrotate's dateext, e.g. access_log-20141102.gz,
+the date the file was rotated out. A file can only hold lines from after
+the previous rotation until its own rotation date, which lets a time range
+skip files without opening them.
+ **/
+
+#ifndef LOGSET_H
+#define LOGSET_H
+
+#include <stdint.h>
+
+#include "logblocks.h"
+#include "logindex.h"
+#include "logpost.h"
+#include "logreader.h"
+#include "logzone.h"
+
+#define LOG_TIME_MIN     INT64_MIN
+#define LOG_TIME_MAX     INT64_MAX
+
+#define LOG_FILE_MAP_LIVE 0x100          /* map the live log too, see log_file_open() */
+
+typedef struct log_file_s {
+    char             *filename;
+    char             *vhost;             /* name of the directory */
+    int64_t          name_lo;            /* time range from rotation dates */
+    int64_t          name_hi;
+
+    log_index        *index;             /* see logindex.h */
+    int              index_loaded;
+    log_zone         *zone;              /* see logzone.h */
+    int              zone_loaded;
+    log_post         *post;              /* see logpost.h */
+    int              post_loaded;
+    log_blocks       *blocks;            /* the set's, see log_set_cache() */
+
+    /* first and last time stamps, valid while the file size is span_size */
+    int              has_span;
+    int64_t          span_size;
+    int64_t          first;
+    int64_t          last;
+} log_file;
+
+typedef struct log_set_s {
+    int              n;
+    log_file         *files;
+    log_blocks       *blocks;            /* decompressed blocks, see logblocks.h */
+} log_set;
+
+log_set    * log_set_new( void );
+int          log_set_add( log_set *set, const char *pattern );
+void         log_set_sort( log_set *set );
+void         log_set_cache( log_set *set, int64_t cap );
+void         log_set_free( log_set *set );
+
+log_reader * log_file_open( log_file *f, int index_mode, int flags );
+log_zone   * log_file_zone( log_file *f, int index_mode );
+void         log_file_set_zone( log_file *f, log_zone *z, int index_mode );
+log_post   * log_file_post( log_file *f, int index_mode, int *grown );
+void         log_file_set_post( log_file *f, log_post *p, int index_mode );
+int          log_file_may_contain( log_file *f, int64_t lo, int64_t hi, int slack );
+
+#endif
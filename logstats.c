@@ -0,0 +1,480 @@
+/**
+
+Scan statistics and the cattoy_stats table. See logstats.h.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sqlite3ext.h"
+SQLITE_EXTENSION_INIT3
+
+#include "logstats.h"
+
+struct log_stats_table_s {
+    sqlite3          *db;
+    char             *module;
+    char             *name;
+    FILE             *trace;             /* NULL, stderr or trace= file */
+    int              timing;             /* timing=on */
+    int64_t          bestindex;          /* xBestIndex calls */
+    int64_t          offered;            /* usable constraints they were given */
+    int64_t          accepted;           /* of them, passed to xFilter */
+    int64_t          cursors;            /* opened, to number them */
+    log_stats        total;              /* of the closed cursors */
+    log_stats        *open;              /* open cursors, newest first */
+    log_stats        recent[LOG_STATS_RECENT];  /* closed, by id */
+    struct log_stats_table_s *next;
+};
+
+/* all tables of all connections, in the order they were created */
+static pthread_mutex_t  log_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static log_stats_table  *log_stats_tables;
+
+static void log_stats_add( log_stats *to, const log_stats *s )
+{
+    int k;
+
+    to->filters += s->filters;
+    to->bytes_read += s->bytes_read;
+    to->bytes_inflated += s->bytes_inflated;
+    to->lines += s->lines;
+    to->lines_jumped += s->lines_jumped;
+    to->rows += s->rows;
+    to->ns_get_line += s->ns_get_line;
+    to->ns_scanline += s->ns_scanline;
+    to->ns_column += s->ns_column;
+    for ( k = 0; k < LOG_STATS_COLS; k++ ) to->columns[k] += s->columns[k];
+}
+
+/*
+Register a table. trace is the trace= argument, NULL or "off" for none.
+Returns NULL if out of memory or the trace file cannot be opened.
+ */
+log_stats_table * log_stats_table_new( sqlite3 *db, const char *module,
+        const char *name, const char *trace, int timing )
+{
+    log_stats_table  *t, **p;
+
+    t = calloc( 1, sizeof( log_stats_table ) );
+    if ( t == NULL ) return NULL;
+    t->db = db;
+    t->module = strdup( module );
+    t->name = strdup( name );
+    t->timing = timing;
+    if ( trace != NULL && strcmp( trace, "off" ) != 0 ) {
+        t->trace = ( strcmp( trace, "on" ) == 0 ? stderr : fopen( trace, "a" ) );
+        if ( t->trace == NULL ) {
+            log_stats_table_free( t );
+            return NULL;
+        }
+    }
+    if ( t->module == NULL || t->name == NULL ) {
+        log_stats_table_free( t );
+        return NULL;
+    }
+
+    pthread_mutex_lock( &log_stats_lock );
+    for ( p = &log_stats_tables; *p != NULL; p = &(*p)->next ) ;
+    *p = t;
+    pthread_mutex_unlock( &log_stats_lock );
+    return t;
+}
+
+void log_stats_table_free( log_stats_table *t )
+{
+    log_stats_table **p;
+
+    if ( t == NULL ) return;
+    pthread_mutex_lock( &log_stats_lock );
+    for ( p = &log_stats_tables; *p != NULL; p = &(*p)->next ) {
+        if ( *p == t ) {
+            *p = t->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock( &log_stats_lock );
+
+    if ( t->trace != NULL && t->trace != stderr ) fclose( t->trace );
+    free( t->module );
+    free( t->name );
+    free( t );
+}
+
+/* Count the constraints of a finished xBestIndex. */
+void log_stats_bestindex( log_stats_table *t, sqlite3_index_info *info )
+{
+    int k;
+
+    pthread_mutex_lock( &log_stats_lock );
+    t->bestindex++;
+    for ( k = 0; k < info->nConstraint; k++ ) {
+        if ( !info->aConstraint[k].usable ) continue;
+        t->offered++;
+        if ( info->aConstraintUsage[k].argvIndex > 0 ) t->accepted++;
+    }
+    pthread_mutex_unlock( &log_stats_lock );
+}
+
+/* Start counting for a cursor; s is zeroed by the caller. */
+void log_stats_open( log_stats_table *t, log_stats *s )
+{
+    pthread_mutex_lock( &log_stats_lock );
+    s->id = ++t->cursors;
+    s->next = t->open;
+    t->open = s;
+    pthread_mutex_unlock( &log_stats_lock );
+}
+
+void log_stats_filter( log_stats_table *t, log_stats *s, int idxnum,
+        const char *idxstr, int argc, sqlite3_value **value )
+{
+    char  *args = NULL;
+    int   k;
+
+    s->filters++;
+    s->idx_num = idxnum;
+    snprintf( s->idx_str, sizeof( s->idx_str ), "%s", idxstr != NULL ? idxstr : "" );
+    if ( t->trace == NULL ) return;
+
+    for ( k = 0; k < argc; k++ ) {
+        const char *sep = ( k > 0 ? ", " : "" );
+
+        switch ( sqlite3_value_type( value[k] ) ) {
+        case SQLITE_INTEGER:
+            args = sqlite3_mprintf( "%z%s%lld", args, sep, sqlite3_value_int64( value[k] ) );
+            break;
+        case SQLITE_FLOAT:
+            args = sqlite3_mprintf( "%z%s%!g", args, sep, sqlite3_value_double( value[k] ) );
+            break;
+        case SQLITE_TEXT:
+            args = sqlite3_mprintf( "%z%s%Q", args, sep, sqlite3_value_text( value[k] ) );
+            break;
+        case SQLITE_BLOB:
+            args = sqlite3_mprintf( "%z%s<blob>", args, sep );
+            break;
+        default:
+            args = sqlite3_mprintf( "%z%sNULL", args, sep );
+        }
+    }
+    fprintf( t->trace, "cattoy: %s cursor %lld filter idxNum 0x%x idxStr \"%s\" args (%s)\n",
+             t->name, (long long)s->id, idxnum, s->idx_str, args != NULL ? args : "" );
+    fflush( t->trace );
+    sqlite3_free( args );
+}
+
+/* Add what a reader read to a cursor's counts, before it is closed. */
+void log_stats_reader( log_stats *s, log_reader *r )
+{
+    int64_t read, inflated;
+
+    if ( r == NULL ) return;
+    log_reader_stats( r, &read, &inflated );
+    s->bytes_read += read;
+    s->bytes_inflated += inflated;
+}
+
+/* Add a closing cursor's counts to its table's. */
+void log_stats_close( log_stats_table *t, log_stats *s )
+{
+    log_stats  **p;
+
+    pthread_mutex_lock( &log_stats_lock );
+    for ( p = &t->open; *p != NULL; p = &(*p)->next ) {
+        if ( *p == s ) {
+            *p = s->next;
+            break;
+        }
+    }
+    log_stats_add( &t->total, s );
+    t->recent[( s->id - 1 ) % LOG_STATS_RECENT] = *s;
+    t->recent[( s->id - 1 ) % LOG_STATS_RECENT].next = NULL;
+    pthread_mutex_unlock( &log_stats_lock );
+
+    if ( t->trace != NULL ) {
+        fprintf( t->trace, "cattoy: %s cursor %lld close filters %lld lines %lld skipped %lld"
+                 " rows %lld read %lld inflated %lld\n",
+                 t->name, (long long)s->id, (long long)s->filters, (long long)s->lines,
+                 (long long)( s->lines - s->rows + s->lines_jumped ), (long long)s->rows,
+                 (long long)s->bytes_read, (long long)s->bytes_inflated );
+        fflush( t->trace );
+    }
+}
+
+/* Nanoseconds, for timing=on. */
+int64_t log_stats_clock( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+The cattoy_stats table. xFilter copies the rows for the connection out
+of the registry, so cursors can come and go while it is read.
+ **/
+
+static const char *cattoy_stats_sql =
+"    CREATE TABLE cattoy_stats (          "
+"        table_name            TEXT,           "  /*  0 */
+"        module                TEXT,           "  /*  1 */
+"        cursor                INTEGER,        "  /*  2 NULL for the table */
+"        state                 TEXT,           "  /*  3 open, closed */
+"        filters               INTEGER,        "  /*  4 */
+"        lines_read            INTEGER,        "  /*  5 */
+"        lines_skipped         INTEGER,        "  /*  6 */
+"        rows                  INTEGER,        "  /*  7 */
+"        bytes_read            INTEGER,        "  /*  8 */
+"        bytes_inflated        INTEGER,        "  /*  9 */
+"        get_line_s            REAL,           "  /* 10 with timing=on */
+"        scanline_s            REAL,           "  /* 11 */
+"        column_s              REAL,           "  /* 12 */
+"        columns               TEXT,           "  /* 13 column:calls ... */
+"        best_index            INTEGER,        "  /* 14 table only */
+"        constraints           INTEGER,        "  /* 15 */
+"        constraints_used      INTEGER,        "  /* 16 */
+"        idx_num               INTEGER,        "  /* 17 cursor only */
+"        idx_str               TEXT            "  /* 18 */
+"     );                                       ";
+
+typedef struct cattoy_stats_row_s {
+    char             *table_name;
+    char             *module;
+    int              state;              /* 0 table, 1 open, 2 closed */
+    int              timing;
+    log_stats        s;
+    int64_t          bestindex;
+    int64_t          offered;
+    int64_t          accepted;
+} cattoy_stats_row;
+
+typedef struct cattoy_stats_vtab_s {
+    sqlite3_vtab     vtab;
+    sqlite3          *db;
+} cattoy_stats_vtab;
+
+typedef struct cattoy_stats_cursor_s {
+    sqlite3_vtab_cursor   cur;           /* this must be first */
+    cattoy_stats_row      *rows;
+    int                   n;
+    int                   i;
+} cattoy_stats_cursor;
+
+static int cattoy_stats_connect( sqlite3 *db, void *udp, int argc,
+        const char *const *argv, sqlite3_vtab **vtab, char **errmsg )
+{
+    cattoy_stats_vtab  *v;
+    int                rc;
+
+    *vtab = NULL;
+    rc = sqlite3_declare_vtab( db, cattoy_stats_sql );
+    if ( rc != SQLITE_OK ) return rc;
+    v = sqlite3_malloc( sizeof( cattoy_stats_vtab ) );
+    if ( v == NULL ) return SQLITE_NOMEM;
+    memset( v, 0, sizeof( cattoy_stats_vtab ) );
+    v->db = db;
+    *vtab = (sqlite3_vtab*)v;
+    return SQLITE_OK;
+}
+
+static int cattoy_stats_disconnect( sqlite3_vtab *vtab )
+{
+    sqlite3_free( vtab );
+    return SQLITE_OK;
+}
+
+static int cattoy_stats_bestindex( sqlite3_vtab *vtab, sqlite3_index_info *info )
+{
+    info->estimatedCost = 100;
+    return SQLITE_OK;
+}
+
+static int cattoy_stats_open( sqlite3_vtab *vtab, sqlite3_vtab_cursor **cur )
+{
+    cattoy_stats_cursor *c = sqlite3_malloc( sizeof( cattoy_stats_cursor ) );
+
+    *cur = NULL;
+    if ( c == NULL ) return SQLITE_NOMEM;
+    memset( c, 0, sizeof( cattoy_stats_cursor ) );
+    *cur = (sqlite3_vtab_cursor*)c;
+    return SQLITE_OK;
+}
+
+static void cattoy_stats_clear( cattoy_stats_cursor *c )
+{
+    int i;
+
+    for ( i = 0; i < c->n; i++ ) {
+        free( c->rows[i].table_name );
+        free( c->rows[i].module );
+    }
+    free( c->rows );
+    c->rows = NULL;
+    c->n = c->i = 0;
+}
+
+static int cattoy_stats_close( sqlite3_vtab_cursor *cur )
+{
+    cattoy_stats_clear( (cattoy_stats_cursor*)cur );
+    sqlite3_free( cur );
+    return SQLITE_OK;
+}
+
+static int cattoy_stats_by_id( const void *a, const void *b )
+{
+    int64_t x = ((const cattoy_stats_row *)a)->s.id, y = ((const cattoy_stats_row *)b)->s.id;
+
+    return ( x > y ) - ( x < y );
+}
+
+static int cattoy_stats_filter( sqlite3_vtab_cursor *cur, int idxnum, const char *idxstr,
+        int argc, sqlite3_value **value )
+{
+    cattoy_stats_cursor  *c = (cattoy_stats_cursor*)cur;
+    sqlite3              *db = ((cattoy_stats_vtab*)cur->pVtab)->db;
+    log_stats_table      *t;
+    log_stats            *s;
+    cattoy_stats_row     *r;
+    int                  n = 0, k, first;
+
+    cattoy_stats_clear( c );
+
+    pthread_mutex_lock( &log_stats_lock );
+    for ( t = log_stats_tables; t != NULL; t = t->next ) {
+        if ( t->db != db ) continue;
+        n += 1 + LOG_STATS_RECENT;
+        for ( s = t->open; s != NULL; s = s->next ) n++;
+    }
+    c->rows = calloc( n + 1, sizeof( cattoy_stats_row ) );
+    if ( c->rows == NULL ) {
+        pthread_mutex_unlock( &log_stats_lock );
+        return SQLITE_NOMEM;
+    }
+
+    for ( t = log_stats_tables; t != NULL; t = t->next ) {
+        if ( t->db != db ) continue;
+
+        /* the table, with its open cursors in the totals */
+        r = &c->rows[c->n++];
+        r->s = t->total;
+        for ( s = t->open; s != NULL; s = s->next ) log_stats_add( &r->s, s );
+        r->bestindex = t->bestindex;
+        r->offered = t->offered;
+        r->accepted = t->accepted;
+
+        /* then its cursors by number */
+        first = c->n;
+        for ( s = t->open; s != NULL; s = s->next ) {
+            c->rows[c->n].s = *s;
+            c->rows[c->n++].state = 1;
+        }
+        for ( k = 0; k < LOG_STATS_RECENT; k++ ) {
+            if ( t->recent[k].id == 0 ) continue;
+            c->rows[c->n].s = t->recent[k];
+            c->rows[c->n++].state = 2;
+        }
+        qsort( c->rows + first, c->n - first, sizeof( cattoy_stats_row ), cattoy_stats_by_id );
+
+        for ( k = first - 1; k < c->n; k++ ) {
+            c->rows[k].table_name = strdup( t->name );
+            c->rows[k].module = strdup( t->module );
+            c->rows[k].timing = t->timing;
+        }
+    }
+    pthread_mutex_unlock( &log_stats_lock );
+    return SQLITE_OK;
+}
+
+static int cattoy_stats_next( sqlite3_vtab_cursor *cur )
+{
+    ((cattoy_stats_cursor*)cur)->i++;
+    return SQLITE_OK;
+}
+
+static int cattoy_stats_eof( sqlite3_vtab_cursor *cur )
+{
+    return ((cattoy_stats_cursor*)cur)->i >= ((cattoy_stats_cursor*)cur)->n;
+}
+
+static int cattoy_stats_rowid( sqlite3_vtab_cursor *cur, sqlite3_int64 *rowid )
+{
+    *rowid = ((cattoy_stats_cursor*)cur)->i + 1;
+    return SQLITE_OK;
+}
+
+static int cattoy_stats_column( sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int cidx )
+{
+    cattoy_stats_row  *r = &((cattoy_stats_cursor*)cur)->rows[((cattoy_stats_cursor*)cur)->i];
+    log_stats      *s = &r->s;
+    char           *list = NULL;
+    int            k;
+
+    switch ( cidx ) {
+    case 0:  sqlite3_result_text( ctx, r->table_name, -1, SQLITE_TRANSIENT ); return SQLITE_OK;
+    case 1:  sqlite3_result_text( ctx, r->module, -1, SQLITE_TRANSIENT ); return SQLITE_OK;
+    case 2:  if ( r->state ) sqlite3_result_int64( ctx, s->id ); return SQLITE_OK;
+    case 3:
+        if ( r->state ) sqlite3_result_text( ctx, r->state == 1 ? "open" : "closed", -1, SQLITE_STATIC );
+        return SQLITE_OK;
+    case 4:  sqlite3_result_int64( ctx, s->filters ); return SQLITE_OK;
+    case 5:  sqlite3_result_int64( ctx, s->lines ); return SQLITE_OK;
+    case 6:  sqlite3_result_int64( ctx, s->lines - s->rows + s->lines_jumped ); return SQLITE_OK;
+    case 7:  sqlite3_result_int64( ctx, s->rows ); return SQLITE_OK;
+    case 8:  sqlite3_result_int64( ctx, s->bytes_read ); return SQLITE_OK;
+    case 9:  sqlite3_result_int64( ctx, s->bytes_inflated ); return SQLITE_OK;
+    case 10: if ( r->timing ) sqlite3_result_double( ctx, s->ns_get_line / 1e9 ); return SQLITE_OK;
+    case 11: if ( r->timing ) sqlite3_result_double( ctx, s->ns_scanline / 1e9 ); return SQLITE_OK;
+    case 12: if ( r->timing ) sqlite3_result_double( ctx, s->ns_column / 1e9 ); return SQLITE_OK;
+    case 13:
+        for ( k = 0; k < LOG_STATS_COLS; k++ ) {
+            if ( s->columns[k] == 0 ) continue;
+            list = sqlite3_mprintf( "%z%s%d:%lld", list, list != NULL ? " " : "", k,
+                                    (long long)s->columns[k] );
+        }
+        sqlite3_result_text( ctx, list != NULL ? list : "", -1, SQLITE_TRANSIENT );
+        sqlite3_free( list );
+        return SQLITE_OK;
+    case 14: if ( !r->state ) sqlite3_result_int64( ctx, r->bestindex ); return SQLITE_OK;
+    case 15: if ( !r->state ) sqlite3_result_int64( ctx, r->offered ); return SQLITE_OK;
+    case 16: if ( !r->state ) sqlite3_result_int64( ctx, r->accepted ); return SQLITE_OK;
+    case 17: if ( r->state && s->filters ) sqlite3_result_int( ctx, s->idx_num ); return SQLITE_OK;
+    case 18:
+        if ( r->state && s->filters ) sqlite3_result_text( ctx, s->idx_str, -1, SQLITE_TRANSIENT );
+        return SQLITE_OK;
+    }
+    return SQLITE_OK;
+}
+
+static sqlite3_module cattoy_stats_mod = {
+    1,                       /* iVersion        */
+    NULL,                    /* xCreate(), eponymous only */
+    cattoy_stats_connect,       /* xConnect()      */
+    cattoy_stats_bestindex,    /* xBestIndex()    */
+    cattoy_stats_disconnect,    /* xDisconnect()   */
+    cattoy_stats_disconnect,    /* xDestroy()      */
+    cattoy_stats_open,         /* xOpen()         */
+    cattoy_stats_close,        /* xClose()        */
+    cattoy_stats_filter,       /* xFilter()       */
+    cattoy_stats_next,          /* xNext()         */
+    cattoy_stats_eof,           /* xEof()          */
+    cattoy_stats_column,        /* xColumn()       */
+    cattoy_stats_rowid,         /* xRowid()        */
+    NULL,                    /* xUpdate()       */
+    NULL,                    /* xBegin()        */
+    NULL,                    /* xSync()         */
+    NULL,                    /* xCommit()       */
+    NULL,                    /* xRollback()     */
+    NULL,                    /* xFindFunction() */
+    NULL                     /* xRename()       */
+};
+
+/* Make cattoy_stats available, once per connection. */
+int log_stats_init( sqlite3 *db )
+{
+    return sqlite3_create_module( db, "cattoy_stats", &cattoy_stats_mod, NULL );
+}
@@ -0,0 +1,79 @@
+/**
+
+Scan statistics of the access_log and error_log tables, shown by the
+eponymous cattoy_stats table:
+
+    SELECT * FROM cattoy_stats;
+
+Each table registers itself when it is created and every cursor on it
+counts what it does in a log_stats: xFilter calls, bytes read and
+inflated, lines read, lines skipped by pushed down constraints or zone
+maps, rows returned and xColumn calls by column. cattoy_stats has a
+row for each table, with the totals of all its cursors, and one for
+each of its open cursors and the last LOG_STATS_RECENT it closed. The
+table row also counts the constraints xBestIndex was offered and how
+many of them it passed to xFilter.
+
+Bytes are added once a cursor is done with a log, so a cursor still
+reading one shows those of the logs before it.
+
+With the timing=on table argument the cursors also time get_line (the
+scan to the next row, xFilter and xNext), scanline (splitting a line
+into fields, whoever asked for it) and xColumn. Reading the clock costs
+about as much as parsing a short line, so it is off by default.
+
+With trace=on, or trace=FILE to append to FILE, each xFilter call is
+logged to stderr with its idxNum, idxStr and arguments, and each cursor
+logs its counts when it is closed.
+
+The registry is shared by every connection of the process. SQLite
+loads extensions with RTLD_GLOBAL, so when both modules are loaded the
+second uses the first's copy of this code and either one's cattoy_stats
+lists the tables of both.
+ **/
+
+#ifndef LOGSTATS_H
+#define LOGSTATS_H
+
+#include <stdint.h>
+
+#include "sqlite3ext.h"
+#include "logreader.h"
+
+#define LOG_STATS_COLS      48           /* columns counted, by index */
+#define LOG_STATS_RECENT    8            /* closed cursors kept per table */
+#define LOG_STATS_IDXSTR    128          /* of idxStr kept */
+
+typedef struct log_stats_s {
+    int64_t          id;                 /* cursor number in its table, from 1 */
+    int64_t          filters;            /* xFilter calls */
+    int64_t          bytes_read;         /* see log_reader_stats() */
+    int64_t          bytes_inflated;
+    int64_t          lines;              /* read from the log or the cache */
+    int64_t          lines_jumped;       /* passed over by zone maps, unparsed */
+    int64_t          rows;               /* returned to SQLite */
+    int64_t          ns_get_line;        /* with timing=on */
+    int64_t          ns_scanline;
+    int64_t          ns_column;
+    int64_t          columns[LOG_STATS_COLS];  /* xColumn calls */
+    int              idx_num;            /* of the last xFilter */
+    char             idx_str[LOG_STATS_IDXSTR];
+    struct log_stats_s *next;            /* open cursors of the table */
+} log_stats;
+
+typedef struct log_stats_table_s log_stats_table;
+
+int               log_stats_init( sqlite3 *db );
+log_stats_table * log_stats_table_new( sqlite3 *db, const char *module,
+                      const char *name, const char *trace, int timing );
+void              log_stats_table_free( log_stats_table *t );
+
+void         log_stats_bestindex( log_stats_table *t, sqlite3_index_info *info );
+void         log_stats_open( log_stats_table *t, log_stats *s );
+void         log_stats_filter( log_stats_table *t, log_stats *s, int idxnum,
+                 const char *idxstr, int argc, sqlite3_value **value );
+void         log_stats_reader( log_stats *s, log_reader *r );
+void         log_stats_close( log_stats_table *t, log_stats *s );
+int64_t      log_stats_clock( void );
+
+#endif
@@ -0,0 +1,187 @@
+/**
+
+Time stamps of log lines. See logtime.h.
+
+Dates are turned into days since 1970-01-01 with the proleptic Gregorian
+arithmetic from Howard Hinnant's "chrono-Compatible Low-Level Date
+Algorithms", so no libc call is made for a time stamp with an offset.
+ **/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "logtime.h"
+
+#define D2( p )   ( ( (p)[0] - '0' ) * 10 + ( (p)[1] - '0' ) )
+
+static int log_time_digits( const char *p, int n )
+{
+    int i;
+
+    for ( i = 0; i < n; i++ ) {
+        if ( p[i] < '0' || p[i] > '9' ) return 0;
+    }
+    return 1;
+}
+
+void log_time_init( log_time *t )
+{
+    t->key_len = 0;
+    t->minute = -1;
+}
+
+/* "Jan" to 1 ... "Dec" to 12, 0 if not a month */
+int log_time_month( const char *p )
+{
+    static const char  months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    int                m;
+
+    for ( m = 0; m < 12; m++ ) {
+        if ( memcmp( p, months + 3 * m, 3 ) == 0 ) return m + 1;
+    }
+    return 0;
+}
+
+/* days from 1970-01-01 to year-month-day */
+int64_t log_time_days( int year, int month, int day )
+{
+    int64_t  era, yoe, doy, doe;
+
+    year -= ( month <= 2 );
+    era = ( year >= 0 ? year : year - 399 ) / 400;
+    yoe = year - era * 400;
+    doy = ( 153 * ( month + ( month > 2 ? -3 : 9 ) ) + 2 ) / 5 + day - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* epoch of a minute of local time */
+static int64_t log_time_local( int year, int month, int day, int hour, int min )
+{
+    struct tm  tm;
+
+    memset( &tm, 0, sizeof( tm ) );
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = min;
+    tm.tm_isdst = -1;
+    return mktime( &tm );
+}
+
+/*
+Epoch of an access log time stamp, "DD/Mon/YYYY:HH:MM:SS +hhmm". A time
+stamp without the offset is taken as local time. Returns -1 if p is not
+a time stamp.
+ */
+int64_t log_time_clf( log_time *t, const char *p, int len )
+{
+    int      zone, key_len, year, month, day, hour, min, off;
+    int64_t  minute;
+
+    if ( len < 20 || !log_time_digits( p + 18, 2 ) ) return -1;
+    zone = ( len >= 26 && p[20] == ' ' && ( p[21] == '+' || p[21] == '-' ) &&
+             log_time_digits( p + 22, 4 ) );
+    key_len = ( zone ? 23 : 17 );
+
+    if ( t->key_len != key_len || memcmp( t->key, p, 17 ) != 0 ||
+         ( zone && memcmp( t->key + 17, p + 20, 6 ) != 0 ) ) {
+        if ( !log_time_digits( p, 2 ) || !log_time_digits( p + 7, 4 ) ||
+             !log_time_digits( p + 12, 2 ) || !log_time_digits( p + 15, 2 ) ||
+             p[2] != '/' || p[6] != '/' || p[11] != ':' || p[14] != ':' || p[17] != ':' ) {
+            return -1;
+        }
+        if ( ( month = log_time_month( p + 3 ) ) == 0 ) return -1;
+        day = D2( p );
+        year = D2( p + 7 ) * 100 + D2( p + 9 );
+        hour = D2( p + 12 );
+        min = D2( p + 15 );
+
+        if ( zone ) {
+            off = D2( p + 22 ) * 3600 + D2( p + 24 ) * 60;
+            minute = ( log_time_days( year, month, day ) * 24 + hour ) * 3600 + min * 60;
+            minute += ( p[21] == '-' ? off : -off );
+        }
+        else {
+            minute = log_time_local( year, month, day, hour, min );
+            if ( minute == -1 ) return -1;
+        }
+
+        memcpy( t->key, p, 17 );
+        if ( zone ) memcpy( t->key + 17, p + 20, 6 );
+        t->key_len = key_len;
+        t->minute = minute;
+    }
+    return t->minute + D2( p + 18 );
+}
+
+/*
+Epoch of an error log time stamp, "Www Mon DD HH:MM:SS YYYY" in local
+time, with an optional fraction of a second after the seconds whose
+milliseconds are put in *msec. Returns -1 if p is not a time stamp.
+ */
+int64_t log_time_ctime( log_time *t, const char *p, int len, int *msec )
+{
+    const char  *y = p + 19, *end = p + len;
+    int         ms = 0, scale = 100, year, month, day, hour, min;
+    int64_t     minute;
+
+    if ( len < 24 || !log_time_digits( p + 17, 2 ) ) return -1;
+    if ( *y == '.' ) {
+        for ( y++; y < end && *y >= '0' && *y <= '9'; y++ ) {
+            ms += ( *y - '0' ) * scale;
+            scale /= 10;
+        }
+    }
+    if ( end - y < 5 || *y != ' ' || !log_time_digits( y + 1, 4 ) ) return -1;
+    y++;
+
+    if ( t->key_len != 16 || memcmp( t->key, p + 4, 12 ) != 0 ||
+         memcmp( t->key + 12, y, 4 ) != 0 ) {
+        if ( !log_time_digits( p + 9, 1 ) || ( p[8] != ' ' && !log_time_digits( p + 8, 1 ) ) ||
+             !log_time_digits( p + 11, 2 ) || !log_time_digits( p + 14, 2 ) ||
+             p[3] != ' ' || p[7] != ' ' || p[10] != ' ' || p[13] != ':' || p[16] != ':' ) {
+            return -1;
+        }
+        if ( ( month = log_time_month( p + 4 ) ) == 0 ) return -1;
+        day = ( p[8] == ' ' ? 0 : p[8] - '0' ) * 10 + ( p[9] - '0' );
+        year = D2( y ) * 100 + D2( y + 2 );
+        hour = D2( p + 11 );
+        min = D2( p + 14 );
+        if ( ( minute = log_time_local( year, month, day, hour, min ) ) == -1 ) return -1;
+
+        memcpy( t->key, p + 4, 12 );
+        memcpy( t->key + 12, y, 4 );
+        t->key_len = 16;
+        t->minute = minute;
+    }
+    if ( msec != NULL ) *msec = ms;
+    return t->minute + D2( p + 17 );
+}
+
+/* Write epoch as "YYYY-MM-DD HH:MM:SS" UTC, SQLite's datetime() format. */
+int log_time_utc( int64_t epoch, char *buf )
+{
+    int64_t  days, secs, z, era, doe, yoe, doy, mp, year, month, day;
+
+    days = epoch / 86400;
+    secs = epoch % 86400;
+    if ( secs < 0 ) {
+        secs += 86400;
+        days--;
+    }
+    z = days + 719468;
+    era = ( z >= 0 ? z : z - 146096 ) / 146097;
+    doe = z - era * 146097;
+    yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;
+    doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );
+    mp = ( 5 * doy + 2 ) / 153;
+    day = doy - ( 153 * mp + 2 ) / 5 + 1;
+    month = mp + ( mp < 10 ? 3 : -9 );
+    year = yoe + era * 400 + ( month <= 2 );
+
+    return sprintf( buf, "%04d-%02d-%02d %02d:%02d:%02d", (int)year, (int)month, (int)day,
+                    (int)( secs / 3600 ), (int)( secs / 60 % 60 ), (int)( secs % 60 ) );
+}
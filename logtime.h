@@ -0,0 +1,36 @@
+/**
+
+Time stamps of log lines, parsed without strptime() and mktime().
+
+Access logs carry their UTC offset, e.g. "04/Nov/2014:13:15:48 -0500",
+and it is applied. Error logs, "Tue Nov 04 13:15:48 2014" or with
+microseconds "Tue Nov 04 13:15:48.123456 2014" from httpd 2.4, are in
+the server's local time, which is worked out with mktime() once per
+minute of log rather than once per line.
+
+Consecutive lines mostly share their time stamp up to the minute, so a
+log_time remembers the last minute it converted and a line in the same
+minute costs a compare and the seconds.
+ **/
+
+#ifndef LOGTIME_H
+#define LOGTIME_H
+
+#include <stdint.h>
+
+#define LOG_TIME_KEY     24              /* longest minute key */
+
+typedef struct log_time_s {
+    char             key[LOG_TIME_KEY];  /* time stamp up to the minute */
+    int              key_len;
+    int64_t          minute;             /* epoch of key */
+} log_time;
+
+void         log_time_init( log_time *t );
+int          log_time_month( const char *p );
+int64_t      log_time_days( int year, int month, int day );
+int64_t      log_time_clf( log_time *t, const char *p, int len );
+int64_t      log_time_ctime( log_time *t, const char *p, int len, int *msec );
+int          log_time_utc( int64_t epoch, char *buf );
+
+#endif
@@ -0,0 +1,350 @@
+/**
+
+Zone maps of a log. See logzone.h.
+
+Sidecar file layout, native byte order as for the index:
+
+    "CATTOYZM"                      magic
+    int32                           version
+    int32 n
+    int64 src_size, src_mtime
+    n * { int64 off, rows, time_lo, time_hi; int32 classes;
+          int32 bloom_bits[LOG_ZONE_KEYS]; int32 pad;
+          the words of each Bloom filter }
+
+A Bloom filter has 2^bloom_bits bits, at least 8 per distinct value of
+its block, and sets LOG_ZONE_PROBES of them for each value.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "logzone.h"
+
+#define LOG_ZONE_MAGIC     "CATTOYZM"
+#define LOG_ZONE_VERSION   1
+#define LOG_ZONE_PROBES    3
+#define LOG_ZONE_MIN_BITS  6             /* one word */
+
+log_zone * log_zone_new( void )
+{
+    return calloc( 1, sizeof( log_zone ) );
+}
+
+void log_zone_free( log_zone *z )
+{
+    int i, k;
+
+    if ( z == NULL ) return;
+    for ( i = 0; i < z->n; i++ ) {
+        for ( k = 0; k < LOG_ZONE_KEYS; k++ ) free( z->list[i].bloom[k] );
+    }
+    for ( k = 0; k < LOG_ZONE_KEYS; k++ ) free( z->keys[k] );
+    free( z->list );
+    log_zone_free( z->prev );
+    free( z );
+}
+
+uint64_t log_zone_hash( const char *p, int n )
+{
+    uint64_t  h = 14695981039346656037ULL;      /* FNV-1a */
+    int       i;
+
+    for ( i = 0; i < n; i++ ) h = ( h ^ (unsigned char)p[i] ) * 1099511628211ULL;
+    return h;
+}
+
+/* splitmix64's finaliser, so close keys such as IP numbers spread out */
+static uint64_t log_zone_mix( uint64_t x )
+{
+    x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+    return x ^ ( x >> 31 );
+}
+
+static int log_zone_cmp( const void *a, const void *b )
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return ( x > y ) - ( x < y );
+}
+
+static int log_zone_bloom_has( const uint64_t *bloom, int bits, uint64_t key )
+{
+    uint64_t  h = log_zone_mix( key ), step = ( h >> 32 ) | 1, mask = ( 1ULL << bits ) - 1;
+    int       i;
+
+    for ( i = 0; i < LOG_ZONE_PROBES; i++, h += step ) {
+        if ( !( bloom[( h & mask ) >> 6] & ( 1ULL << ( h & 63 ) ) ) ) return 0;
+    }
+    return 1;
+}
+
+/* Build the Bloom filters of the last block from its values. */
+static int log_zone_close_block( log_zone *z )
+{
+    log_zone_block  *b = &z->list[z->n - 1];
+    int             k, i, n, bits;
+
+    for ( k = 0; k < LOG_ZONE_KEYS; k++ ) {
+        uint64_t *v = z->keys[k];
+
+        n = 0;
+        if ( z->n_keys[k] > 0 ) {
+            qsort( v, z->n_keys[k], sizeof( uint64_t ), log_zone_cmp );
+            for ( i = 0; i < z->n_keys[k]; i++ ) {
+                if ( n == 0 || v[i] != v[n - 1] ) v[n++] = v[i];
+            }
+        }
+        z->n_keys[k] = 0;
+        if ( n == 0 ) continue;         /* no line has the value at all */
+
+        for ( bits = LOG_ZONE_MIN_BITS; ( 1 << bits ) < n * 8; bits++ ) ;
+        b->bloom[k] = calloc( ( 1 << bits ) / 64, sizeof( uint64_t ) );
+        if ( b->bloom[k] == NULL ) return -1;
+        b->bloom_bits[k] = bits;
+        for ( i = 0; i < n; i++ ) {
+            uint64_t h = log_zone_mix( v[i] ), step = ( h >> 32 ) | 1;
+            uint64_t mask = ( 1ULL << bits ) - 1;
+            int      p;
+
+            for ( p = 0; p < LOG_ZONE_PROBES; p++, h += step ) {
+                b->bloom[k][( h & mask ) >> 6] |= 1ULL << ( h & 63 );
+            }
+        }
+    }
+    z->lines = 0;
+    return 0;
+}
+
+/*
+Add the next line of the log, which starts at offset off, to the zone
+map being built. cls is its class, 0 to 30 or LOG_ZONE_CLASS_OTHER, and
+key[k] its values for the Bloom filters where has_key[k] is set.
+ */
+int log_zone_line( log_zone *z, int64_t off, int64_t epoch, int cls,
+                   const int *has_key, const uint64_t *key )
+{
+    log_zone_block  *b;
+    int             k;
+
+    if ( z->lines == 0 ) {
+        if ( z->n == z->alloc ) {
+            int   alloc = ( z->alloc == 0 ? 64 : z->alloc * 2 );
+            void  *list = realloc( z->list, alloc * sizeof( log_zone_block ) );
+
+            if ( list == NULL ) return -1;
+            z->list = list;
+            z->alloc = alloc;
+        }
+        for ( k = 0; k < LOG_ZONE_KEYS; k++ ) {
+            if ( z->keys[k] == NULL &&
+                 ( z->keys[k] = malloc( LOG_ZONE_LINES * sizeof( uint64_t ) ) ) == NULL ) {
+                return -1;
+            }
+        }
+        b = &z->list[z->n++];
+        memset( b, 0, sizeof( log_zone_block ) );
+        b->off = off;
+        b->rows = (int64_t)( z->n - 1 ) * LOG_ZONE_LINES;
+        b->time_lo = epoch;
+        b->time_hi = epoch;
+    }
+    b = &z->list[z->n - 1];
+
+    if ( epoch < b->time_lo ) b->time_lo = epoch;
+    if ( epoch > b->time_hi ) b->time_hi = epoch;
+    if ( cls < 0 || cls > LOG_ZONE_CLASS_OTHER ) cls = LOG_ZONE_CLASS_OTHER;
+    b->classes |= 1U << cls;
+    for ( k = 0; k < LOG_ZONE_KEYS; k++ ) {
+        if ( has_key[k] ) z->keys[k][z->n_keys[k]++] = key[k];
+    }
+
+    if ( ++z->lines == LOG_ZONE_LINES ) return log_zone_close_block( z );
+    return 0;
+}
+
+/*
+Close the zone map of filename, which r has read to the end. It is
+valid for the log as it is now only if r saw all of it: a plain log
+that grew while it was read gets a size that will not match.
+ */
+int log_zone_finish( log_zone *z, const char *filename, log_reader *r )
+{
+    struct stat  st;
+    int          k;
+
+    if ( z->lines > 0 && log_zone_close_block( z ) != 0 ) return -1;
+    for ( k = 0; k < LOG_ZONE_KEYS; k++ ) {
+        free( z->keys[k] );
+        z->keys[k] = NULL;
+    }
+    if ( stat( filename, &st ) != 0 ) return -1;
+    z->src_size = ( log_reader_compressed( r ) || st.st_size == log_reader_tell( r ) ?
+                    st.st_size : -1 );
+    z->src_mtime = st.st_mtime;
+    return 0;
+}
+
+/* Whether block b can hold a line that matches q. */
+int log_zone_may( const log_zone_block *b, const log_zone_query *q )
+{
+    int k;
+
+    if ( q->time_lo > b->time_hi || q->time_hi < b->time_lo ) return 0;
+    if ( ( b->classes & q->classes ) == 0 ) return 0;
+    for ( k = 0; k < LOG_ZONE_KEYS; k++ ) {
+        if ( !q->has_key[k] ) continue;
+        if ( b->bloom[k] == NULL ) return 0;
+        if ( !log_zone_bloom_has( b->bloom[k], b->bloom_bits[k], q->key[k] ) ) return 0;
+    }
+    return 1;
+}
+
+/* The first block that starts at or after line rows + 1, or z->n. */
+int log_zone_find( log_zone *z, int64_t rows )
+{
+    int lo = 0, hi = z->n;
+
+    while ( lo < hi ) {
+        int mid = lo + ( hi - lo ) / 2;
+
+        if ( z->list[mid].rows < rows ) lo = mid + 1;
+        else                            hi = mid;
+    }
+    return lo;
+}
+
+static char * log_zone_path( const char *filename )
+{
+    char *path = malloc( strlen( filename ) + sizeof( LOG_ZONE_SUFFIX ) );
+
+    if ( path != NULL ) {
+        strcpy( path, filename );
+        strcat( path, LOG_ZONE_SUFFIX );
+    }
+    return path;
+}
+
+log_zone * log_zone_load( const char *filename )
+{
+    struct stat  st;
+    char         magic[8], *path;
+    int32_t      hdr[2], bh[2 + LOG_ZONE_KEYS];
+    int64_t      meta[2], pos[4];
+    log_zone     *z = NULL;
+    FILE         *fp;
+    int          i, k;
+
+    if ( stat( filename, &st ) != 0 ) return NULL;
+    if ( ( path = log_zone_path( filename ) ) == NULL ) return NULL;
+    fp = fopen( path, "rb" );
+    free( path );
+    if ( fp == NULL ) return NULL;
+
+    if ( fread( magic, sizeof( magic ), 1, fp ) != 1 ||
+         memcmp( magic, LOG_ZONE_MAGIC, sizeof( magic ) ) != 0 ||
+         fread( hdr, sizeof( hdr ), 1, fp ) != 1 ||
+         hdr[0] != LOG_ZONE_VERSION || hdr[1] < 0 ||
+         fread( meta, sizeof( meta ), 1, fp ) != 1 ||
+         meta[0] != st.st_size || meta[1] != st.st_mtime ) {
+        goto fail;
+    }
+
+    if ( ( z = log_zone_new() ) == NULL ) goto fail;
+    z->src_size = meta[0];
+    z->src_mtime = meta[1];
+    if ( hdr[1] > 0 && ( z->list = calloc( hdr[1], sizeof( log_zone_block ) ) ) == NULL ) goto fail;
+    z->alloc = hdr[1];
+
+    for ( i = 0; i < hdr[1]; i++ ) {
+        log_zone_block *b = &z->list[i];
+
+        if ( fread( pos, sizeof( pos ), 1, fp ) != 1 ||
+             fread( bh, sizeof( bh ), 1, fp ) != 1 ) {
+            goto fail;
+        }
+        z->n++;
+        b->off = pos[0];
+        b->rows = pos[1];
+        b->time_lo = pos[2];
+        b->time_hi = pos[3];
+        b->classes = bh[0];
+        for ( k = 0; k < LOG_ZONE_KEYS; k++ ) {
+            int bits = bh[1 + k];
+
+            if ( bits == 0 ) continue;
+            if ( bits < LOG_ZONE_MIN_BITS || bits > 30 ||
+                 ( b->bloom[k] = malloc( ( 1 << bits ) / 8 ) ) == NULL ||
+                 fread( b->bloom[k], ( 1 << bits ) / 8, 1, fp ) != 1 ) {
+                goto fail;
+            }
+            b->bloom_bits[k] = bits;
+        }
+    }
+    fclose( fp );
+    return z;
+
+fail:
+    log_zone_free( z );
+    fclose( fp );
+    return NULL;
+}
+
+int log_zone_save( log_zone *z, const char *filename )
+{
+    char     *path, *tmp;
+    int32_t  hdr[2], bh[2 + LOG_ZONE_KEYS];
+    int64_t  meta[2];
+    FILE     *fp;
+    int      i, k, rc = -1;
+
+    if ( z->src_size < 0 ) return -1;
+    if ( ( path = log_zone_path( filename ) ) == NULL ) return -1;
+    if ( ( tmp = malloc( strlen( path ) + 16 ) ) == NULL ) {
+        free( path );
+        return -1;
+    }
+    sprintf( tmp, "%s.%d", path, (int)getpid() );
+
+    if ( ( fp = fopen( tmp, "wb" ) ) == NULL ) goto done;
+
+    hdr[0] = LOG_ZONE_VERSION;
+    hdr[1] = z->n;
+    meta[0] = z->src_size;
+    meta[1] = z->src_mtime;
+    fwrite( LOG_ZONE_MAGIC, 8, 1, fp );
+    fwrite( hdr, sizeof( hdr ), 1, fp );
+    fwrite( meta, sizeof( meta ), 1, fp );
+    for ( i = 0; i < z->n; i++ ) {
+        log_zone_block *b = &z->list[i];
+        int64_t pos[4] = { b->off, b->rows, b->time_lo, b->time_hi };
+
+        bh[0] = b->classes;
+        for ( k = 0; k < LOG_ZONE_KEYS; k++ ) bh[1 + k] = b->bloom_bits[k];
+        bh[1 + LOG_ZONE_KEYS] = 0;
+        fwrite( pos, sizeof( pos ), 1, fp );
+        fwrite( bh, sizeof( bh ), 1, fp );
+        for ( k = 0; k < LOG_ZONE_KEYS; k++ ) {
+            if ( b->bloom[k] != NULL ) fwrite( b->bloom[k], ( 1 << b->bloom_bits[k] ) / 8, 1, fp );
+        }
+    }
+
+    if ( ferror( fp ) | fclose( fp ) ) {
+        remove( tmp );
+        goto done;
+    }
+    if ( rename( tmp, path ) != 0 ) {
+        remove( tmp );
+        goto done;
+    }
+    rc = 0;
+
+done:
+    free( tmp );
+    free( path );
+    return rc;
+}
@@ -0,0 +1,75 @@
+/**
+
+Zone maps of a log: a summary of each block of LOG_ZONE_LINES lines,
+so that a query can skip the blocks that cannot hold a matching line
+without inflating or parsing them.
+
+A block records where it starts, the lowest and highest time_epoch of
+its lines, a bitmap of the classes its lines fall in (the hundreds of
+the access_log status, the error_log level) and a Bloom filter over
+each of LOG_ZONE_KEYS values per line (remote_host_int, method).
+
+Zone maps are built by the modules while a query with constraints they
+can use reads a whole log, kept with the table for index=memory and
+saved next to the log for index=on, e.g.
+    access_log-20141102.gz.cattoy-zone
+They are reused only while the log's size and mtime are unchanged.
+ **/
+
+#ifndef LOGZONE_H
+#define LOGZONE_H
+
+#include <stdint.h>
+
+#include "logreader.h"
+
+#define LOG_ZONE_SUFFIX     ".cattoy-zone"
+#define LOG_ZONE_LINES      4096         /* lines per block */
+#define LOG_ZONE_KEYS       2            /* Bloom filters per block */
+#define LOG_ZONE_CLASS_OTHER 31          /* class of values out of range */
+
+typedef struct log_zone_block_s {
+    int64_t          off;                /* offset of the first line */
+    int64_t          rows;               /* lines before it */
+    int64_t          time_lo;            /* time_epoch range of its lines */
+    int64_t          time_hi;
+    uint32_t         classes;            /* bit per class present */
+    int              bloom_bits[LOG_ZONE_KEYS];  /* log2 of filter size */
+    uint64_t         *bloom[LOG_ZONE_KEYS];
+} log_zone_block;
+
+typedef struct log_zone_s {
+    int64_t          src_size;           /* log size when built */
+    int64_t          src_mtime;          /* log mtime when built */
+    int              n;                  /* blocks in list */
+    int              alloc;
+    log_zone_block   *list;
+    struct log_zone_s *prev;             /* zone map it replaced, see logset.c */
+
+    /* while building, the values of the block being filled */
+    int              lines;
+    int              n_keys[LOG_ZONE_KEYS];
+    uint64_t         *keys[LOG_ZONE_KEYS];
+} log_zone;
+
+/* what a block must be able to hold for a query to read it */
+typedef struct log_zone_query_s {
+    int64_t          time_lo;            /* LOG_TIME_MIN/MAX if no range */
+    int64_t          time_hi;
+    uint32_t         classes;            /* ~0 for any */
+    int              has_key[LOG_ZONE_KEYS];
+    uint64_t         key[LOG_ZONE_KEYS];
+} log_zone_query;
+
+log_zone   * log_zone_new( void );
+void         log_zone_free( log_zone *z );
+int          log_zone_line( log_zone *z, int64_t off, int64_t epoch, int cls,
+                            const int *has_key, const uint64_t *key );
+int          log_zone_finish( log_zone *z, const char *filename, log_reader *r );
+int          log_zone_may( const log_zone_block *b, const log_zone_query *q );
+int          log_zone_find( log_zone *z, int64_t rows );
+uint64_t     log_zone_hash( const char *p, int n );
+log_zone   * log_zone_load( const char *filename );
+int          log_zone_save( log_zone *z, const char *filename );
+
+#endif
@@ -40,6 +40,7 @@ echo -n "Checking all $expected rows returned: "
 # Testing:
 #   - epoch calculation when Daylight Saving Time is in effect
 #   - referer
+#   - time_utc, time_epoch_ms
 ####################################
 declare -A columns
 rowid=1
@@ -49,7 +50,7 @@ y='2014'
 t='00:26:42'
 z='-0400'
 time_str="$d/$m/$y:$t $z"
-time_epoch="$(date --date "$m $d $t $y" +%s)"
+time_epoch="$(date --date "$m $d $y $t $z" +%s)"
 remote_host='192.168.210.200'
 remote_host_int="$(echo "$remote_host" | tr . '\n' | awk '{s = s*256 + $1} END{print s}')"
 columns=(
@@ -69,6 +70,8 @@ columns=(
   [time_min]="26"
   [time_sec]="42"
   [time_epoch]="$time_epoch"
+  [time_epoch_ms]="${time_epoch}000"
+  [time_utc]="$(date -u --date "@$time_epoch" '+%F %T')"
   [method]="GET"
   [url]="/cgi-bin/dataPlotter.pl?type=Microarray::TwoChannel&project_id=FooDB&dataset=linfJPCM5_microarrayExpression_GSE13983_Papadoupou_Amastigote_RSRC&template=1&fmt=png&id=LinJ.33.2740&vp=_LEGEND,exprn_val"
 )
@@ -81,6 +84,7 @@ OK
 # Testing:
 #   - no referer
 #   - epoc calc of EST time
+#   - time_utc
 #   - 302 status
 ####################################
 declare -A columns
@@ -91,7 +95,7 @@ y='2014'
 t='10:26:29'
 z='-0500'
 time_str="$d/$m/$y:$t $z"
-time_epoch="$(date --date "$m $d $t $y" +%s)"
+time_epoch="$(date --date "$m $d $y $t $z" +%s)"
 remote_host='192.168.210.200'
 remote_host_int="$(echo "$remote_host" | tr . '\n' | awk '{s = s*256 + $1} END{print s}')"
 columns=(
@@ -111,6 +115,7 @@ columns=(
   [time_min]="26"
   [time_sec]="29"
   [time_epoch]="$time_epoch"
+  [time_utc]="$(date -u --date "@$time_epoch" '+%F %T')"
   [method]="GET"
   [url]="/"
 )
@@ -133,7 +138,7 @@ y='2014'
 t='10:24:20'
 z='-0400'
 time_str="$d/$m/$y:$t $z"
-time_epoch="$(date --date "$m $d $t $y" +%s)"
+time_epoch="$(date --date "$m $d $y $t $z" +%s)"
 remote_host='10.11.228.10'
 remote_host_int="$(echo "$remote_host" | tr . '\n' | awk '{s = s*256 + $1} END{print s}')"
 columns=(
@@ -175,7 +180,7 @@ y='2014'
 t='19:36:37'
 z='-0400'
 time_str="$d/$m/$y:$t $z"
-time_epoch="$(date --date "$m $d $t $y" +%s)"
+time_epoch="$(date --date "$m $d $y $t $z" +%s)"
 remote_host='10.11.220.128'
 remote_host_int="$(echo "$remote_host" | tr . '\n' | awk '{s = s*256 + $1} END{print s}')"
 columns=(
@@ -216,7 +221,7 @@ y='2014'
 t='10:31:29'
 z='-0500'
 time_str="$d/$m/$y:$t $z"
-time_epoch="$(date --date "$m $d $t $y" +%s)"
+time_epoch="$(date --date "$m $d $y $t $z" +%s)"
 remote_host='127.1.1.1'
 remote_host_int="$(echo "$remote_host" | tr . '\n' | awk '{s = s*256 + $1} END{print s}')"
 columns=(
@@ -243,6 +248,510 @@ echo -n "Checking values of columns in row $rowid: "
 for col in "${!columns[@]}"; do check_col_val  "$TABLE"   "$rowid" "$col" "${columns[$col]}"; done
 OK
 
+####################################
+# time_epoch range
+# Testing:
+#   - out of order rows are skipped, not returned
+#   - rowid is still the line number
+####################################
+lo="$(date --date 'Nov 06 2014 10:00:00 -0500' +%s)"
+hi="$(date --date 'Nov 06 2014 11:00:00 -0500' +%s)"
+expected="2 5 "
+actual="$(echo "select rowid from $TABLE where time_epoch between $lo and $hi;" | $CMD | tr '\n' ' ')"
+echo -n "Checking time_epoch range: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# rowid range
+####################################
+expected="2 3 4 "
+actual="$(echo "select rowid from $TABLE where rowid > 1 and rowid <= 4;" | $CMD | tr '\n' ' ')"
+echo -n "Checking rowid range: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# multiple files
+# Testing:
+#   - rows of every file are returned
+#   - rowid holds the file in the upper bits
+#   - vhost is the name of the log's directory
+####################################
+expected="10 1099511627777 5 "
+actual="$( ( echo "create virtual table multi using $TABLE('$TESTLOG', '$TESTDIR/$TESTLOG');"
+             echo "select count(*) from multi;"
+             echo "select min(rowid) from multi where rowid >= 1099511627776;"
+             echo "select count(*) from multi where vhost = 'test';" ) | $CMD | tr '\n' ' ')"
+echo -n "Checking multiple files: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# background reading
+# Testing:
+#   - the same rows with and without read ahead threads
+####################################
+expected="$( ( echo "create virtual table fg using $TABLE('$TESTLOG', '$TESTDIR/$TESTLOG', 'threads=0');"
+               echo "select rowid, line from fg;" ) | $CMD | md5sum )"
+actual="$( ( echo "create virtual table bg using $TABLE('$TESTLOG', '$TESTDIR/$TESTLOG', 'threads=2');"
+             echo "select rowid, line from bg;" ) | $CMD | md5sum )"
+echo -n "Checking threads: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# mapped logs
+# Testing:
+#   - the same rows whether the log is mapped or read
+#   - the live log, not mapped by default, can be truncated during a scan
+#     (copytruncate), which ends the scan rather than sqlite3
+####################################
+expected="$( ( echo "create virtual table rd using $TABLE('$TESTLOG', 'mmap=off');"
+               echo "select * from rd;" ) | $CMD | md5sum )"
+actual="$( ( echo "create virtual table mm using $TABLE('$TESTLOG', 'mmap=on');"
+             echo "select * from mm;" ) | $CMD | md5sum )"
+MMAPDIR="$( mktemp -d )"
+for i in $( seq 2000 ); do cat "$TESTLOG"; done > "$MMAPDIR/access_log"
+echo "create virtual table t using $TABLE('$MMAPDIR/access_log', 'index=off');
+select count(*) from t where length(randomblob(50000)) > length(url);" | $CMD > /dev/null &
+sleep 0.2
+: > "$MMAPDIR/access_log"
+truncated=0
+wait $! || truncated=$?
+rm -rf "$MMAPDIR"
+echo -n "Checking mmap: "
+[[ "$expected" == "$actual" && "$truncated" == 0 ]] && OK || error "Expected '$expected', found '$actual', and exit status $truncated after truncating"
+
+####################################
+# columnar cache
+# Testing:
+#   - the same rows from the log, the run that builds the cache and
+#     the run that reads it, rowid lookups included
+####################################
+CACHEDIR="$( mktemp -d )"
+query="select rowid, *, time_epoch_ms, time_utc from t; select rowid, line, time_epoch from t where rowid = 3;"
+expected="$( ( echo "create virtual table t using $TABLE('$TESTLOG');"
+               echo "$query" ) | $CMD | md5sum )"
+build="$( ( echo "create virtual table t using $TABLE('$TESTLOG', 'cache=$CACHEDIR');"
+            echo "$query" ) | $CMD | md5sum )"
+actual="$( ( echo "create virtual table t using $TABLE('$TESTLOG', 'cache=$CACHEDIR');"
+             echo "$query" ) | $CMD | md5sum )"
+ls "$CACHEDIR"/$TESTLOG.*.cattoy-col >/dev/null 2>&1 || actual="no cache file"
+rm -rf "$CACHEDIR"
+echo -n "Checking cache: "
+[[ "$expected" == "$build" && "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$build' and '$actual'"
+
+####################################
+# follow
+# Testing:
+#   - a query reads the whole log, the next one nothing new
+#   - a line appended is read by the next query, as the next rowid
+#   - a line still being written is left for later
+####################################
+FOLLOWDIR="$( mktemp -d )"
+head -n 2 "$TESTLOG" > "$FOLLOWDIR/log"
+follow="create virtual table f using $TABLE('$FOLLOWDIR/log', 'follow=$FOLLOWDIR/state'); select group_concat(rowid) from f;"
+actual="$( echo "$follow" | $CMD )"
+actual="$actual $( echo "$follow" | $CMD )"
+sed -n 3p "$TESTLOG" >> "$FOLLOWDIR/log"
+sed -n 4p "$TESTLOG" | tr -d '\n' >> "$FOLLOWDIR/log"
+actual="$actual $( echo "$follow" | $CMD )"
+echo >> "$FOLLOWDIR/log"
+actual="$actual $( echo "$follow" | $CMD )"
+rm -rf "$FOLLOWDIR"
+expected="1,2  3 4"
+echo -n "Checking follow: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# zone maps
+# Testing:
+#   - the first query builds a zone map next to the log
+#   - queries that can skip blocks with it find the same lines
+#   - equality under NOCASE skips none
+####################################
+ZONEDIR="$( mktemp -d )"
+cp "$TESTLOG" "$ZONEDIR/log"
+query="select group_concat(rowid) from t where remote_host = '10.11.228.10'; select group_concat(rowid) from t where method = 'GET' and status >= 300; select count(*) from t where remote_host = '1.2.3.4'; select group_concat(rowid) from t where method = 'post' collate nocase;"
+expected="$( ( echo "create virtual table t using $TABLE('$ZONEDIR/log', 'index=off');"
+               echo "$query" ) | $CMD )"
+build="$( ( echo "create virtual table t using $TABLE('$ZONEDIR/log');"
+            echo "$query" ) | $CMD )"
+actual="$( ( echo "create virtual table t using $TABLE('$ZONEDIR/log');"
+             echo "$query" ) | $CMD )"
+[ -f "$ZONEDIR/log.cattoy-zone" ] || actual="no zone map"
+rm -rf "$ZONEDIR"
+echo -n "Checking zone maps: "
+[[ "$expected" == "$build" && "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$build' and '$actual'"
+
+####################################
+# lookup=on
+# Testing:
+#   - the first lookup builds an inverted index next to the log
+#   - lookups with it, = and IN, find the same lines
+#   - lines appended since are found too, and added to it
+#   - = under NOCASE is not looked up
+####################################
+POSTDIR="$( mktemp -d )"
+head -n 3 "$TESTLOG" > "$POSTDIR/log"
+query="select group_concat(rowid) from t where remote_host = '10.11.228.10'; select group_concat(rowid) from t where status in (200, 302) and method = 'GET'; select group_concat(rowid) from t where url = '/'; select group_concat(rowid) from t where url = '/FOODB/processRegister.do' collate nocase; select count(*) from t where remote_host_int = 1;"
+lookup="create virtual table t using $TABLE('$POSTDIR/log', 'lookup=on'); $query"
+build="$( echo "$lookup" | $CMD )"
+actual="$( echo "$lookup" | $CMD )"
+[ -f "$POSTDIR/log.cattoy-post" ] || actual="no index"
+sed -n '4,$p' "$TESTLOG" >> "$POSTDIR/log"
+grown="$( echo "$lookup" | $CMD )"
+expected="$( ( echo "create virtual table t using $TABLE('$POSTDIR/log', 'index=off');"
+               echo "$query" ) | $CMD )"
+head -n 3 "$TESTLOG" > "$POSTDIR/log"
+expected_head="$( ( echo "create virtual table t using $TABLE('$POSTDIR/log', 'index=off');"
+                    echo "$query" ) | $CMD )"
+rm -rf "$POSTDIR"
+echo -n "Checking lookup: "
+[[ "$expected_head" == "$build" && "$expected_head" == "$actual" && "$expected" == "$grown" ]] && OK || error "Expected '$expected_head' and '$expected', found '$build', '$actual' and '$grown'"
+
+####################################
+# pushed down constraints
+# Testing:
+#   - comparisons, LIKE and GLOB checked on each line find the same lines
+#     as SQLite alone does, a unary + keeps a constraint from bestindex
+#   - comparisons under NOCASE are left to SQLite
+####################################
+actual="$( echo "select count(*), group_concat(rowid) from access_log where status = 302 and method = 'GET'; select count(*), group_concat(rowid) from access_log where method > 'a' collate nocase and url < '/FOODB' collate nocase; select count(*), group_concat(rowid) from access_log where status >= 300 and status < 500.5; select count(*), group_concat(rowid) from access_log where url like '%/FOODB/%'; select count(*), group_concat(rowid) from access_log where request glob '*.do *'; select count(*), group_concat(rowid) from access_log where remote_host > '10.11' and remote_host <= '127.1.1.1'; select count(*), group_concat(rowid) from access_log where remote_host in ('127.1.1.1', '10.11.228.10');" | $CMD )"
+expected="$( echo "select count(*), group_concat(rowid) from access_log where +status = 302 and +method = 'GET'; select count(*), group_concat(rowid) from access_log where +method > 'a' collate nocase and +url < '/FOODB' collate nocase; select count(*), group_concat(rowid) from access_log where +status >= 300 and +status < 500.5; select count(*), group_concat(rowid) from access_log where +url like '%/FOODB/%'; select count(*), group_concat(rowid) from access_log where +request glob '*.do *'; select count(*), group_concat(rowid) from access_log where +remote_host > '10.11' and +remote_host <= '127.1.1.1'; select count(*), group_concat(rowid) from access_log where +remote_host in ('127.1.1.1', '10.11.228.10');" | $CMD )"
+echo -n "Checking pushed down constraints: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# cattoy_stats, trace=on
+# Testing:
+#   - the table row counts the lines read and skipped, the rows returned
+#     and the columns SQLite asked for of each
+#   - the cursor is listed once closed
+#   - trace=on logs its filter and close
+####################################
+lines="$( wc -l < "$TESTLOG" )"
+matching="$( echo "select count(*) from $TABLE where +status = 200;" | $CMD )"
+actual="$( echo "select count(*) from $TABLE where status = 200; select filters, lines_read, lines_skipped, rows, bytes_read > 0, columns from cattoy_stats where table_name = '$TABLE' and cursor is null; select cursor, state from cattoy_stats where table_name = '$TABLE' and cursor is not null;" | $CMD )"
+expected="$( printf '%s\n' "$matching" "1|$lines|$(( lines - matching ))|$matching|1|5:$matching" "1|closed" )"
+trace="$( echo "create virtual table t using $TABLE('$TESTLOG', 'trace=on'); select count(*) from t where status = 200;" | $CMD 2>&1 >/dev/null | cut -d ' ' -f 1-5 )"
+echo -n "Checking cattoy_stats: "
+[[ "$expected" == "$actual" && "$trace" == "$( printf '%s\n' "cattoy: t cursor 1 filter" "cattoy: t cursor 1 close" )" ]] && OK || error "Expected '$expected', found '$actual' and '$trace'"
+
+####################################
+# format=
+# Testing:
+#   - the default format, spelled out, reads every column the same
+#   - common leaves the columns it has no directive for NULL
+#   - a directive without a column of its own adds one at the end
+#   - two directives with nothing between them are an error
+####################################
+columns="remote_host, remote_logname, remote_user, time, request, status, bytes, referer, user_agent, response_time, remote_host_int, time_epoch, method, url, line"
+expected="$( echo "select $columns from $TABLE;" | $CMD )"
+actual="$( echo "create virtual table t using $TABLE('$TESTLOG', 'format=%h %l %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-agent}i\" %D'); select $columns from t;" | $CMD )"
+common="$( echo "create virtual table t using $TABLE('$TESTLOG', format=common); select count(*) from t where status is not null and referer is null and user_agent is null and response_time is null;" | $CMD )"
+extra="$( echo "create virtual table t using $TABLE('$TESTLOG', 'format=%h %l %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-agent}i\" %{us}T'); select count(*) from t join $TABLE a on t.rowid = a.rowid where t.time_taken = a.response_time and t.response_time is null;" | $CMD )"
+invalid="$( echo "create virtual table t using $TABLE('$TESTLOG', 'format=%h%l');" | $CMD 2>&1 )" || true
+echo -n "Checking format=: "
+[[ "$expected" == "$actual" && "$common" == "$( wc -l < "$TESTLOG" )" && "$extra" == "$common" && "$invalid" == *"nothing between them"* ]] && OK || error "Expected '$expected', found '$actual', '$common', '$extra' and '$invalid'"
+
+####################################
+# log_correlate
+# Testing:
+#   - an error is matched to the latest request from its client within
+#     the window, not a later one logged out of order or one too old
+#   - with %L, the request whose log id is in the error line
+#   - errors without a match are returned with NULL request columns
+####################################
+CORRDIR="$( mktemp -d )"
+cat > "$CORRDIR/access" <<'LOG'
+10.0.0.1 - - [11/Oct/2014:00:26:30 +0000] "GET /old HTTP/1.1" 200 10 "-" "ua" 100 Req0000001
+10.0.0.1 - - [11/Oct/2014:00:26:40 +0000] "GET /cgi-bin/a.pl HTTP/1.1" 500 10 "-" "ua" 2000 Req0000002
+10.0.0.2 - - [11/Oct/2014:00:26:41 +0000] "GET /b HTTP/1.1" 200 10 "-" "ua" 300 Req0000003
+10.0.0.1 - - [11/Oct/2014:00:26:39 +0000] "GET /late HTTP/1.1" 200 10 "-" "ua" 300 Req0000004
+10.0.0.1 - - [11/Oct/2014:00:26:50 +0000] "GET /after HTTP/1.1" 200 10 "-" "ua" 300 Req0000005
+LOG
+cat > "$CORRDIR/error" <<'LOG'
+[Sat Oct 11 00:26:42 2014] [error] [client 10.0.0.1] script failed
+[Sat Oct 11 00:26:43 2014] [error] [client 10.0.0.9] nobody
+[Sat Oct 11 00:26:44 2014] [error] [client 10.0.0.5] [Req0000003] by id
+LOG
+actual="$( echo ".load error_log.so
+create virtual table a using $TABLE('$CORRDIR/access');
+create virtual table b using $TABLE('$CORRDIR/access', 'format=%h %l %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-agent}i\" %D %L');
+create virtual table e using error_log('$CORRDIR/error');
+select error_rowid, access_rowid, lag, matched_by, url, status from log_correlate('a', 'e');
+select error_rowid, access_rowid, matched_by from log_correlate('b', 'e', 1);" | TZ=UTC $CMD )"
+rm -rf "$CORRDIR"
+expected="$( printf '%s\n' "1|2|2|remote_host|/cgi-bin/a.pl|500" "2|||||" "3|||||" "1||" "2||" "3|3|log_id" )"
+echo -n "Checking log_correlate: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# access_log_rollup
+# Testing:
+#   - by=minute adds up to what a group by on the log gives
+#   - the rollup is saved next to the log and read back
+#   - lines appended since are added to it, as a new rollup would count them
+#   - by= must be an interval, then a key column
+####################################
+ROLLDIR="$( mktemp -d )"
+cp "$TESTLOG" "$ROLLDIR/log"
+expected="$( echo "create virtual table t using $TABLE('$ROLLDIR/log'); select time_epoch / 60 * 60, count(*), sum(bytes), sum(status >= 500), sum(response_time) from t where time_epoch != -1 group by 1 order by 1;" | $CMD )"
+query="select time_epoch, requests, bytes, status_5xx, response_time_sum from r;"
+build="$( echo "create virtual table r using access_log_rollup('$ROLLDIR/log', by=minute); $query" | $CMD )"
+[ -f "$ROLLDIR/log.cattoy-rollup-minute" ] || build="no rollup file"
+actual="$( echo "create virtual table r using access_log_rollup('$ROLLDIR/log', by=minute); $query" | $CMD )"
+echo "create virtual table r using access_log_rollup('$ROLLDIR/log', 'by=hour,url'); $query" | $CMD > /dev/null
+cat "$TESTLOG" >> "$ROLLDIR/log"
+grown="$( echo "create virtual table r using access_log_rollup('$ROLLDIR/log', 'by=hour,url'); $query" | $CMD )"
+fresh="$( echo "create virtual table r using access_log_rollup('$ROLLDIR/log', 'by=hour,url', index=off); $query" | $CMD )"
+invalid="$( echo "create virtual table r using access_log_rollup('$ROLLDIR/log', by=week);" | $CMD 2>&1 )" || true
+rm -rf "$ROLLDIR"
+echo -n "Checking access_log_rollup: "
+[[ "$expected" == "$build" && "$expected" == "$actual" && "$grown" == "$fresh" && -n "$fresh" && "$invalid" == *"by must be"* ]] && OK || error "Expected '$expected', found '$build', '$actual', '$grown' and '$invalid'"
+
+####################################
+# approx_count_distinct, approx_quantile, approx_top_k
+# Testing:
+#   - a few distinct values are counted exactly
+#   - a quantile is within 1% of the value at its rank, 0 and 1 exactly
+#   - the most frequent value is the first of the top k
+#   - sketches merged give the same answers as the rows themselves
+####################################
+expected="$( echo "select count(distinct remote_host), 1, min(response_time + 0), max(response_time + 0), (select status from $TABLE group by status order by count(*) desc, status limit 1) from $TABLE;" | $CMD )"
+actual="$( echo "select approx_count_distinct(remote_host), abs(approx_quantile(response_time, 0.5) - m) <= m / 100, approx_quantile(response_time, 0), approx_quantile(response_time, 1), json_extract(approx_top_k(status, 3), '\$[0].value') from $TABLE, (select response_time + 0 m from $TABLE order by 1 limit 1 offset (select (count(*) - 1) / 2 from $TABLE));" | $CMD )"
+merged="$( echo "select approx_count_distinct(d), approx_quantile(q, 1), approx_top_k(k, 3) = (select approx_top_k(status, 3) from $TABLE) from (select approx_count_distinct_sketch(remote_host) d, approx_quantile_sketch(response_time) q, approx_top_k_sketch(status, 3) k from $TABLE where rowid % 2 = 0 union all select approx_count_distinct_sketch(remote_host), approx_quantile_sketch(response_time), approx_top_k_sketch(status, 3) from $TABLE where rowid % 2 = 1);" | $CMD )"
+echo -n "Checking approximate aggregates: "
+[[ "$expected" == "$actual" && "$merged" == "$( echo "$expected" | cut -d '|' -f 1,4 )|1" ]] && OK || error "Expected '$expected', found '$actual' and '$merged'"
+
+####################################
+# sample=, sample_rate and sample_scale
+# Testing:
+#   - a sample is whole blocks of lines, the same lines with the same rowids as a full scan
+#   - sum(sample_scale) is the number of lines, plain or gzip
+#   - sample_rate = ? samples as sample= does
+#   - without an index sample_scale is 1 / sample_rate
+#   - a rate must be from 0.000001 to 1
+####################################
+SAMPLEDIR="$( mktemp -d )"
+awk '{ l[NR] = $0 } END { for ( i = 0; i < 4000; i++ ) for ( j = 1; j <= NR; j++ ) print l[j] }' "$TESTLOG" > "$SAMPLEDIR/log"
+gzip -c "$SAMPLEDIR/log" > "$SAMPLEDIR/log.gz"
+lines="$( wc -l < "$SAMPLEDIR/log" )"
+actual="$( echo "create virtual table t using $TABLE('$SAMPLEDIR/log', index=off);
+create virtual table s using $TABLE('$SAMPLEDIR/log', sample=0.1);
+create virtual table g using $TABLE('$SAMPLEDIR/log.gz', sample=0.1);
+create virtual table o using $TABLE('$SAMPLEDIR/log', sample=0.5, index=off);
+create virtual table u using $TABLE('$SAMPLEDIR/log');
+create temp table f as select rowid, line from t;
+select count(*) = (select count(*) from s cross join f on f.rowid = s.rowid and f.line = s.line), count(*) < $lines, count(distinct (rowid - 1) / 4096) * 4096 >= count(*), sum(sample_scale) from s;
+select count(*) = (select count(*) from g cross join f on f.rowid = g.rowid and f.line = g.line), sum(sample_scale) from g;
+select (select group_concat(rowid) from s) = (select group_concat(rowid) from u where sample_rate = 0.1);
+select coalesce(sum(sample_scale), 0) = count(*) / 0.5 from o;
+select count(*) from t where sample_rate = 2;" | $CMD 2>&1 )" || true
+rm -rf "$SAMPLEDIR"
+expected="$( printf '%s\n' "1|1|1|$lines.0" "1|$lines.0" "1" "1" "Runtime error near line 11: sample_rate must be from 0.000001 to 1" )"
+echo -n "Checking sample: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# gzip, BGZF, xz and zstd logs
+# Testing:
+#   - the format is told from the first bytes, not the name
+#   - each reads as the plain log does, by rowid and in a sample too
+#   - BGZF and gzip or zstd of many members seek to member starts
+#   - zstd only if built with libzstd and zstd(1) is installed
+####################################
+CODECDIR="$( mktemp -d )"
+awk '{ l[NR] = $0 } END { for ( i = 0; i < 8000; i++ ) for ( j = 1; j <= NR; j++ ) print l[j] }' "$TESTLOG" > "$CODECDIR/log"
+codecs="gzip members bgzf"
+gzip -c "$CODECDIR/log" > "$CODECDIR/gzip"
+split -b 1000000 --filter 'gzip -c' "$CODECDIR/log" > "$CODECDIR/members"
+split -b 60000 "$CODECDIR/log" "$CODECDIR/part."
+for part in "$CODECDIR"/part.*; do
+  gzip -n -c "$part" > "$CODECDIR/member"
+  size=$(( $( wc -c < "$CODECDIR/member" ) + 7 ))
+  printf '\037\213\010\004\0\0\0\0\0\377\006\0BC\002\0'"$( printf '\\%03o\\%03o' $(( size & 255 )) $(( size >> 8 )) )" >> "$CODECDIR/bgzf"
+  tail -c +11 "$CODECDIR/member" >> "$CODECDIR/bgzf"
+done
+printf '\037\213\010\004\0\0\0\0\0\377\006\0BC\002\0\033\0\003\0\0\0\0\0\0\0\0\0' >> "$CODECDIR/bgzf"
+if command -v xz > /dev/null; then
+  xz -c "$CODECDIR/log" > "$CODECDIR/xz"
+  codecs="$codecs xz"
+fi
+if command -v zstd > /dev/null && grep -q ZSTD_decompressStream "$LIBDIR/$TABLE.so"; then
+  zstd -q -c "$CODECDIR/log" > "$CODECDIR/zstd"
+  split -b 60000 --filter 'zstd -q -c' "$CODECDIR/log" > "$CODECDIR/frames"
+  codecs="$codecs zstd frames"
+fi
+query() {
+  echo "create virtual table t using $TABLE('$CODECDIR/$1');
+create virtual table p using $TABLE('$CODECDIR/log');
+create temp table s as select rowid, line from t where sample_rate = 0.2;
+select count(*), sum(length(line)), sum(bytes) from t;
+select line = (select line from p where rowid = 39996) from t where rowid = 39996;
+select count(*) > 0, count(*) = (select count(*) from s cross join p on p.rowid = s.rowid and p.line = s.line) from s;" | $CMD
+}
+expected="$( query log )"
+for codec in $codecs; do
+  actual="$( query $codec )"
+  [[ "$expected" == "$actual" ]] || break
+done
+rm -rf "$CODECDIR"
+echo -n "Checking compressed logs ($codecs): "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual' for $codec"
+
+####################################
+# IPv6 hosts and ip_in_cidr
+# Testing:
+#   - remote_host_int only for IPv4 hosts, mapped ones too
+#   - remote_host_ip as 16 bytes for IPv4 and IPv6 hosts
+#   - ip_in_cidr on each remote host column answers as on an expression
+#   - a bad block is an error
+####################################
+IPDIR="$( mktemp -d )"
+for host in 10.1.2.3 2001:db8::1 ::ffff:10.9.9.9 www.example.com 192.168.0.1 fe80::1%eth0 2001:db8:0:0:0:0:1:2 10.300.0.1; do
+  echo "$host - - [04/Nov/2014:00:26:42 -0500] \"GET /$host HTTP/1.1\" 200 10 \"-\" \"-\""
+done > "$IPDIR/log"
+actual="$( echo "create virtual table t using $TABLE('$IPDIR/log');
+select group_concat(coalesce(remote_host_int, '-') || ' ' || hex(remote_host_ip), ',') from t;
+select count(*) from t where ip_in_cidr(remote_host, '10.0.0.0/8') and ip_in_cidr(remote_host_int, '10.0.0.0/8')
+  and ip_in_cidr(remote_host_ip, '10.0.0.0/8');
+select group_concat(rowid) from t where ip_in_cidr(remote_host, '2001:db8::/32');
+select (select group_concat(rowid) from t where ip_in_cidr(remote_host, '::/1'))
+     = (select group_concat(rowid) from t where ip_in_cidr(remote_host || '', '::/1'));
+select group_concat(rowid) from t where remote_host_int > 3000000000;
+select ip_in_cidr('10.0.0.1', '10.0.0.0/33');" | $CMD 2>&1 )" || true
+rm -rf "$IPDIR"
+expected="$( printf '%s\n' "167838211 00000000000000000000FFFF0A010203,- 20010DB8000000000000000000000001,168364297 00000000000000000000FFFF0A090909,- ,3232235521 00000000000000000000FFFFC0A80001,- FE800000000000000000000000000001,- 20010DB8000000000000000000010002,- " "2" "2,7" "1" "5" "Runtime error near line 9: ip_in_cidr: not an address or CIDR block" )"
+echo -n "Checking ip_in_cidr: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# lines split only as far as a query needs
+# Testing:
+#   - narrow queries find what they do with every field split
+#   - a format= table stops early too
+####################################
+narrow="select count(*), sum(bytes) from t where status = 200 and W;
+select group_concat(method || ' ' || url) from t where rowid < 50 and W;
+select sum(time_hour), max(time_epoch), min(time_utc) from t where W;
+select count(distinct remote_host_int), count(remote_host_ip) from t where W;
+select group_concat(remote_user) from u where W;"
+query() {
+  echo "create virtual table u using $TABLE('$TESTLOG', 'format=%h %l %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-agent}i\" %D');
+create virtual table t using $TABLE('$TESTLOG');
+${narrow//W/$1}" | $CMD
+}
+expected="$( query "coalesce(user_agent, response_time, 1) is not null" )"
+actual="$( query "1" )"
+echo -n "Checking lazy splitting: "
+[[ -n "$expected" && "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# lines longer than the reader's buffer
+# Testing:
+#   - a 3MB url is read whole, plain read or mapped and gzipped
+#   - the lines after it are unchanged
+####################################
+LONGDIR="$( mktemp -d )"
+awk 'BEGIN { for ( q = "q"; length( q ) < 3000000; q = q q ); q = substr( q, 1, 3000000 ) }
+     NR % 3 == 2 { sub( / HTTP\//, "?" q " HTTP/" ) } { print }' "$TESTLOG" > "$LONGDIR/log"
+gzip -c "$LONGDIR/log" > "$LONGDIR/log.gz"
+query() {
+  echo "create virtual table t using $TABLE($1);
+select count(*), sum(length(url)), sum(length(line)), group_concat(bytes) from t;" | $CMD
+}
+expected="$( awk 'NR % 3 == 2 { n += 3000001 } END { print n }' "$TESTLOG" )"
+actual="$( query "'$LONGDIR/log', 'mmap=on'" )"
+plain="$( query "'$LONGDIR/log', 'mmap=off'" )"
+gzipped="$( query "'$LONGDIR/log.gz'" )"
+short="$( query "'$TESTLOG'" )"
+rm -rf "$LONGDIR"
+echo -n "Checking long lines: "
+[[ "$actual" == "$plain" && "$actual" == "$gzipped" &&
+   "$( cut -d '|' -f 2 <<< "$actual" )" == "$(( $( cut -d '|' -f 2 <<< "$short" ) + expected ))" &&
+   "$( cut -d '|' -f 4 <<< "$actual" )" == "$( cut -d '|' -f 4 <<< "$short" )" ]] && OK || error "Expected '$short' with $expected more url bytes, found '$actual', '$plain' and '$gzipped'"
+
+####################################
+# aggregates that keep a column's text
+# Testing:
+#   - max() and min() of text columns are those of a copy of the table,
+#     mapped, read, gzipped and over two mapped files, however often the
+#     reader's buffer is refilled or a file unmapped under them
+####################################
+AGGDIR="$( mktemp -d )"
+awk '{ l[NR] = $0 } END { for ( i = 0; i < 3000; i++ ) for ( j = 1; j <= NR; j++ ) { s = l[j]; sub( / HTTP\//, "?n=" ( i * 7919 ) % 3001 " HTTP/", s ); print s } }' "$TESTLOG" > "$AGGDIR/log"
+gzip -c "$AGGDIR/log" > "$AGGDIR/log.gz"
+mkdir "$AGGDIR/parts"
+split -l 7500 "$AGGDIR/log" "$AGGDIR/parts/access_log-part"
+query() {
+  echo "create virtual table t using $TABLE($1);
+select max(response_time), max(url), min(user_agent), max(referer), min(request) from t;" | $CMD
+}
+expected="$( echo "create virtual table t using $TABLE('$AGGDIR/log');
+create table c(response_time, url, user_agent, referer, request);
+insert into c select response_time, url, user_agent, referer, request from t;
+select max(response_time), max(url), min(user_agent), max(referer), min(request) from c;" | $CMD )"
+mapped="$( query "'$AGGDIR/log', 'mmap=on'" )"
+plain="$( query "'$AGGDIR/log', 'mmap=off'" )"
+gzipped="$( query "'$AGGDIR/log.gz'" )"
+parts="$( query "'$AGGDIR/parts', 'mmap=on'" )"
+rm -rf "$AGGDIR"
+echo -n "Checking text aggregates: "
+[[ -n "$expected" && "$expected" == "$mapped" && "$expected" == "$plain" && "$expected" == "$gzipped" && "$expected" == "$parts" ]] && OK || error "Expected '$expected', found '$mapped', '$plain', '$gzipped' and '$parts'"
+
+####################################
+# aggregates over a rollup in a join
+# Testing:
+#   - max() and min() of url keep it while the rollup is filtered again
+#     for each row of the outer loop
+####################################
+ROLLDIR="$( mktemp -d )"
+cp "$TESTLOG" "$ROLLDIR/log"
+setup="create virtual table r using access_log_rollup('$ROLLDIR/log', 'by=hour,url', index=off);
+create table t(x); insert into t values (0), (1), (2), (0);"
+expected="$( echo "$setup create table c as select * from r; select max(c.url), min(c.url), count(*) from t, c where c.requests > t.x;" | $CMD )"
+actual="$( echo "$setup select max(r.url), min(r.url), count(*) from t, r where r.requests > t.x;" | $CMD )"
+rm -rf "$ROLLDIR"
+echo -n "Checking rollup aggregates in a join: "
+[[ -n "$expected" && "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# block_cache=, decompressed blocks shared by a table's cursors
+# Testing:
+#   - a correlated subquery over a gzip or xz log finds the same with
+#     the cache, without it and with one smaller than the log
+#   - with the cache the log is inflated about once, not once a scan
+#   - read ahead threads fill the cache too
+####################################
+BLOCKDIR="$( mktemp -d )"
+awk '{ l[NR] = $0 } END { for ( i = 0; i < 3000; i++ ) for ( j = 1; j <= NR; j++ ) print l[j] }' "$TESTLOG" > "$BLOCKDIR/log"
+gzip -c "$BLOCKDIR/log" > "$BLOCKDIR/log.gz"
+logs="log.gz"
+if command -v xz > /dev/null; then
+  xz -c "$BLOCKDIR/log" > "$BLOCKDIR/log.xz"
+  logs="$logs log.xz"
+fi
+query() {
+  echo "create virtual table t using $TABLE('$BLOCKDIR/$1', $2);
+select sum(( select count(*) from t b where b.bytes > a.bytes and b.rowid % 7 = a.rowid % 7 )) from t a where a.rowid <= 4;
+select count(*), sum(length(line)) from t;
+select bytes_inflated / $( wc -c < "$BLOCKDIR/log" ) from cattoy_stats where table_name = 't' and cursor is null;" | $CMD
+}
+same() {
+  [[ "$( head -2 <<< "$expected" )" == "$( head -2 <<< "$cached" )" && "$( head -2 <<< "$expected" )" == "$( head -2 <<< "$small" )" &&
+     "$( head -2 <<< "$expected" )" == "$( head -2 <<< "$ahead" )" && "$( tail -1 <<< "$expected" )" -ge 5 &&
+     "$( tail -1 <<< "$cached" )" -le 1 && "$( tail -1 <<< "$ahead" )" -le 1 ]]
+}
+for log in $logs; do
+  expected="$( query $log "'block_cache=off', 'threads=0'" )"
+  cached="$( query $log "'threads=0'" )"
+  small="$( query $log "'block_cache=2', 'threads=0'" )"
+  ahead="$( query $log "'threads=2'" )"
+  same || break
+done
+rm -rf "$BLOCKDIR"
+echo -n "Checking block_cache ($logs): "
+same && OK || error "Expected '$expected', found '$cached', '$small' and '$ahead' for $log"
+
 ALLPASS
 echo
 
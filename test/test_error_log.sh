@@ -61,6 +61,8 @@ columns=(
   [time_min]='26'
   [time_sec]='42'
   [time_epoch]="$time_epoch"
+  [time_epoch_ms]="${time_epoch}000"
+  [time_utc]="$(date -u --date "@$time_epoch" '+%F %T')"
 )
 echo -n "Checking values of columns in row $rowid: "
 for col in "${!columns[@]}"; do check_col_val  "$TABLE"   "$rowid" "$col" "${columns[$col]}"; done
@@ -127,6 +129,209 @@ echo -n "Checking values of columns in row $rowid: "
 for col in "${!columns[@]}"; do check_col_val  "$TABLE"  "$rowid" "$col" "${columns[$col]}"; done
 OK
 
+####################################
+# ROW 4
+# Testing:
+#   - httpd 2.4 time stamp with microseconds
+####################################
+declare -A columns
+rowid=4
+time_str='Thu Nov 06 10:31:29.043218 2014'
+time_epoch="$(date --date 'Thu Nov 06 10:31:29 2014' +%s)"
+columns=(
+  [time]="$time_str"
+  [log_level]='error'
+  [message]='File does not exist: /var/www/favicon.ico'
+  [remote_host]='10.15.20.201'
+  [time_day]='6'
+  [time_month]='11'
+  [time_year]='2014'
+  [time_hour]='10'
+  [time_min]='31'
+  [time_sec]='29'
+  [time_epoch]="$time_epoch"
+  [time_epoch_ms]="${time_epoch}043"
+)
+echo -n "Checking values of columns in row $rowid: "
+for col in "${!columns[@]}"; do check_col_val  "$TABLE"  "$rowid" "$col" "${columns[$col]}"; done
+OK
+
+####################################
+# time_epoch range
+# Testing:
+#   - rowid is still the line number
+####################################
+lo="$(date --date 'Nov 04 00:00:00 2014' +%s)"
+hi="$(date --date 'Nov 06 00:00:00 2014' +%s)"
+expected="2 3 "
+actual="$(echo "select rowid from $TABLE where time_epoch >= $lo and time_epoch < $hi;" | $CMD | tr '\n' ' ')"
+echo -n "Checking time_epoch range: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# rowid range
+####################################
+expected="2 3 4 "
+actual="$(echo "select rowid from $TABLE where rowid > 1 and rowid <= 4;" | $CMD | tr '\n' ' ')"
+echo -n "Checking rowid range: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# multiple files
+# Testing:
+#   - rows of every file are returned
+#   - rowid holds the file in the upper bits
+#   - vhost is the name of the log's directory
+####################################
+expected="8 1099511627777 4 "
+actual="$( ( echo "create virtual table multi using $TABLE('$TESTLOG', '$TESTDIR/$TESTLOG');"
+             echo "select count(*) from multi;"
+             echo "select min(rowid) from multi where rowid >= 1099511627776;"
+             echo "select count(*) from multi where vhost = 'test';" ) | $CMD | tr '\n' ' ')"
+echo -n "Checking multiple files: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# background reading
+# Testing:
+#   - the same rows with and without read ahead threads
+####################################
+expected="$( ( echo "create virtual table fg using $TABLE('$TESTLOG', '$TESTDIR/$TESTLOG', 'threads=0');"
+               echo "select rowid, line from fg;" ) | $CMD | md5sum )"
+actual="$( ( echo "create virtual table bg using $TABLE('$TESTLOG', '$TESTDIR/$TESTLOG', 'threads=2');"
+             echo "select rowid, line from bg;" ) | $CMD | md5sum )"
+echo -n "Checking threads: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# mapped logs
+# Testing:
+#   - the same rows whether the log is mapped or read
+####################################
+expected="$( ( echo "create virtual table rd using $TABLE('$TESTLOG', 'mmap=off');"
+               echo "select * from rd;" ) | $CMD | md5sum )"
+actual="$( ( echo "create virtual table mm using $TABLE('$TESTLOG', 'mmap=on');"
+             echo "select * from mm;" ) | $CMD | md5sum )"
+echo -n "Checking mmap: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# columnar cache
+# Testing:
+#   - the same rows from the log, the run that builds the cache and
+#     the run that reads it, rowid lookups included
+####################################
+CACHEDIR="$( mktemp -d )"
+query="select rowid, *, time_epoch_ms, time_utc from t; select rowid, line, time_epoch from t where rowid = 3;"
+expected="$( ( echo "create virtual table t using $TABLE('$TESTLOG');"
+               echo "$query" ) | $CMD | md5sum )"
+build="$( ( echo "create virtual table t using $TABLE('$TESTLOG', 'cache=$CACHEDIR');"
+            echo "$query" ) | $CMD | md5sum )"
+actual="$( ( echo "create virtual table t using $TABLE('$TESTLOG', 'cache=$CACHEDIR');"
+             echo "$query" ) | $CMD | md5sum )"
+ls "$CACHEDIR"/$TESTLOG.*.cattoy-col >/dev/null 2>&1 || actual="no cache file"
+rm -rf "$CACHEDIR"
+echo -n "Checking cache: "
+[[ "$expected" == "$build" && "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$build' and '$actual'"
+
+####################################
+# follow
+# Testing:
+#   - a query reads the whole log, the next one nothing new
+#   - a line appended is read by the next query, as the next rowid
+#   - a line still being written is left for later
+####################################
+FOLLOWDIR="$( mktemp -d )"
+head -n 2 "$TESTLOG" > "$FOLLOWDIR/log"
+follow="create virtual table f using $TABLE('$FOLLOWDIR/log', 'follow=$FOLLOWDIR/state'); select group_concat(rowid) from f;"
+actual="$( echo "$follow" | $CMD )"
+actual="$actual $( echo "$follow" | $CMD )"
+sed -n 3p "$TESTLOG" >> "$FOLLOWDIR/log"
+sed -n 4p "$TESTLOG" | tr -d '\n' >> "$FOLLOWDIR/log"
+actual="$actual $( echo "$follow" | $CMD )"
+echo >> "$FOLLOWDIR/log"
+actual="$actual $( echo "$follow" | $CMD )"
+rm -rf "$FOLLOWDIR"
+expected="1,2  3 4"
+echo -n "Checking follow: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# zone maps
+# Testing:
+#   - the first query builds a zone map next to the log
+#   - queries that can skip blocks with it find the same lines
+#   - equality under NOCASE skips none
+####################################
+ZONEDIR="$( mktemp -d )"
+cp "$TESTLOG" "$ZONEDIR/log"
+query="select group_concat(rowid) from t where log_level = 'error'; select group_concat(rowid) from t where remote_host = '10.15.20.200'; select count(*) from t where log_level = 'crit'; select group_concat(rowid) from t where log_level = 'ERROR' collate nocase;"
+expected="$( ( echo "create virtual table t using $TABLE('$ZONEDIR/log', 'index=off');"
+               echo "$query" ) | $CMD )"
+build="$( ( echo "create virtual table t using $TABLE('$ZONEDIR/log');"
+            echo "$query" ) | $CMD )"
+actual="$( ( echo "create virtual table t using $TABLE('$ZONEDIR/log');"
+             echo "$query" ) | $CMD )"
+[ -f "$ZONEDIR/log.cattoy-zone" ] || actual="no zone map"
+rm -rf "$ZONEDIR"
+echo -n "Checking zone maps: "
+[[ "$expected" == "$build" && "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$build' and '$actual'"
+
+####################################
+# lookup=on
+# Testing:
+#   - the first lookup builds an inverted index next to the log
+#   - lookups with it, = and IN, find the same lines
+#   - lines appended since are found too, and added to it
+#   - = under NOCASE is not looked up
+####################################
+POSTDIR="$( mktemp -d )"
+head -n 3 "$TESTLOG" > "$POSTDIR/log"
+query="select group_concat(rowid) from t where log_level = 'error'; select group_concat(rowid) from t where log_level = 'ERROR' collate nocase; select group_concat(rowid) from t where remote_host in ('10.15.20.200', '10.15.20.201'); select count(*) from t where log_level = 'crit';"
+lookup="create virtual table t using $TABLE('$POSTDIR/log', 'lookup=on'); $query"
+build="$( echo "$lookup" | $CMD )"
+actual="$( echo "$lookup" | $CMD )"
+[ -f "$POSTDIR/log.cattoy-post" ] || actual="no index"
+sed -n '4,$p' "$TESTLOG" >> "$POSTDIR/log"
+grown="$( echo "$lookup" | $CMD )"
+expected="$( ( echo "create virtual table t using $TABLE('$POSTDIR/log', 'index=off');"
+               echo "$query" ) | $CMD )"
+head -n 3 "$TESTLOG" > "$POSTDIR/log"
+expected_head="$( ( echo "create virtual table t using $TABLE('$POSTDIR/log', 'index=off');"
+                    echo "$query" ) | $CMD )"
+rm -rf "$POSTDIR"
+echo -n "Checking lookup: "
+[[ "$expected_head" == "$build" && "$expected_head" == "$actual" && "$expected" == "$grown" ]] && OK || error "Expected '$expected_head' and '$expected', found '$build', '$actual' and '$grown'"
+
+####################################
+# pushed down constraints
+# Testing:
+#   - comparisons, LIKE and GLOB checked on each line find the same lines
+#     as SQLite alone does, a unary + keeps a constraint from bestindex
+#   - so do remote_host_int comparisons and ip_in_cidr
+#   - comparisons under NOCASE are left to SQLite
+####################################
+actual="$( echo "select count(*), group_concat(rowid) from error_log where log_level = 'error'; select count(*), group_concat(rowid) from error_log where log_level < 'F' collate nocase and message > 'f' collate nocase; select count(*), group_concat(rowid) from error_log where message like '%FILE DOES NOT exist%'; select count(*), group_concat(rowid) from error_log where message glob '*[Ff]ile*'; select count(*), group_concat(rowid) from error_log where remote_host >= '10.15.20.201'; select count(*), group_concat(rowid) from error_log where remote_host_int < 200000000; select count(*), group_concat(rowid) from error_log where ip_in_cidr(remote_host, '10.15.0.0/16');" | $CMD )"
+expected="$( echo "select count(*), group_concat(rowid) from error_log where +log_level = 'error'; select count(*), group_concat(rowid) from error_log where +log_level < 'F' collate nocase and +message > 'f' collate nocase; select count(*), group_concat(rowid) from error_log where +message like '%FILE DOES NOT exist%'; select count(*), group_concat(rowid) from error_log where +message glob '*[Ff]ile*'; select count(*), group_concat(rowid) from error_log where +remote_host >= '10.15.20.201'; select count(*), group_concat(rowid) from error_log where +remote_host_int < 200000000; select count(*), group_concat(rowid) from error_log where ip_in_cidr(+remote_host, '10.15.0.0/16');" | $CMD )"
+echo -n "Checking pushed down constraints: "
+[[ "$expected" == "$actual" ]] && OK || error "Expected '$expected', found '$actual'"
+
+####################################
+# cattoy_stats, trace=on
+# Testing:
+#   - the table row counts the lines read and skipped, the rows returned
+#     and the columns SQLite asked for of each
+#   - the cursor is listed once closed
+#   - trace=on logs its filter and close
+####################################
+lines="$( wc -l < "$TESTLOG" )"
+matching="$( echo "select count(*) from $TABLE where +log_level = 'error';" | $CMD )"
+actual="$( echo "select count(*) from $TABLE where log_level = 'error'; select filters, lines_read, lines_skipped, rows, bytes_read > 0, columns from cattoy_stats where table_name = '$TABLE' and cursor is null; select cursor, state from cattoy_stats where table_name = '$TABLE' and cursor is not null;" | $CMD )"
+expected="$( printf '%s\n' "$matching" "1|$lines|$(( lines - matching ))|$matching|1|1:$matching" "1|closed" )"
+trace="$( echo "create virtual table t using $TABLE('$TESTLOG', 'trace=on'); select count(*) from t where log_level = 'error';" | $CMD 2>&1 >/dev/null | cut -d ' ' -f 1-5 )"
+echo -n "Checking cattoy_stats: "
+[[ "$expected" == "$actual" && "$trace" == "$( printf '%s\n' "cattoy: t cursor 1 filter" "cattoy: t cursor 1 close" )" ]] && OK || error "Expected '$expected', found '$actual' and '$trace'"
+
 ALLPASS
 echo
 